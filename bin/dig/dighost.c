@@ -2226,6 +2226,8 @@ setup_lookup(dig_lookup_t *lookup) {
 	result = dns_message_create(mctx, DNS_MESSAGE_INTENTRENDER,
 				    &lookup->sendmsg);
 	check_result(result, "dns_message_create");
+	result = dns_message_usearena(lookup->sendmsg, 0);
+	check_result(result, "dns_message_usearena");
 
 	if (lookup->new_search) {
 		debug("resetting lookup counter.");
@@ -3686,6 +3688,8 @@ recv_done(isc_task_t *task, isc_event_t *event) {
 
 	result = dns_message_create(mctx, DNS_MESSAGE_INTENTPARSE, &msg);
 	check_result(result, "dns_message_create");
+	result = dns_message_usearena(msg, 0);
+	check_result(result, "dns_message_usearena");
 
 	if (key != NULL) {
 		if (l->querysig == NULL) {
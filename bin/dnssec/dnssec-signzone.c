@@ -3788,7 +3788,7 @@ main(int argc, char *argv[]) {
 
 	if (!disable_zone_check)
 		verifyzone(gdb, gversion, gorigin, mctx,
-			   ignore_kskflag, keyset_kskonly);
+			   ignore_kskflag, keyset_kskonly, ntasks);
 
 	if (outputformat != dns_masterformat_text) {
 		dns_masterrawheader_t header;
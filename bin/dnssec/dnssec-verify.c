@@ -86,6 +86,7 @@ static dns_rdataclass_t gclass;		/* The class */
 static dns_name_t *gorigin;		/* The database origin */
 static isc_boolean_t ignore_kskflag = ISC_FALSE;
 static isc_boolean_t keyset_kskonly = ISC_FALSE;
+static unsigned int nthreads = 0;
 
 /*%
  * Load the zone file from disk
@@ -138,6 +139,7 @@ usage(void) {
 	fprintf(stderr, "\t\tzone origin (name of zonefile)\n");
 	fprintf(stderr, "\t-I format:\n");
 	fprintf(stderr, "\t\tfile format of input zonefile (text)\n");
+	fprintf(stderr, "\t-n nthreads (number of cpus present)\n");
 	fprintf(stderr, "\t-c class (IN)\n");
 	fprintf(stderr, "\t-E engine:\n");
 #if defined(PKCS11CRYPTO)
@@ -172,7 +174,7 @@ main(int argc, char *argv[]) {
 	int ch;
 
 #define CMDLINE_FLAGS \
-	"hm:o:I:c:E:v:Vxz"
+	"hm:n:o:I:c:E:v:Vxz"
 
 	/*
 	 * Process memory debugging argument first.
@@ -226,6 +228,13 @@ main(int argc, char *argv[]) {
 		case 'm':
 			break;
 
+		case 'n':
+			endp = NULL;
+			nthreads = strtol(isc_commandline_argument, &endp, 0);
+			if (*endp != '\0' || nthreads > ISC_INT32_MAX)
+				fatal("number of threads must be numeric");
+			break;
+
 		case 'o':
 			origin = isc_commandline_argument;
 			break;
@@ -280,6 +289,9 @@ main(int argc, char *argv[]) {
 
 	isc_stdtime_get(&now);
 
+	if (nthreads == 0)
+		nthreads = isc_os_ncpus();
+
 	rdclass = strtoclass(classname);
 
 	setup_logging(mctx, &log);
@@ -321,7 +333,7 @@ main(int argc, char *argv[]) {
 	check_result(result, "dns_db_newversion()");
 
 	verifyzone(gdb, gversion, gorigin, mctx,
-		   ignore_kskflag, keyset_kskonly);
+		   ignore_kskflag, keyset_kskonly, nthreads);
 
 	dns_db_closeversion(gdb, &gversion, ISC_FALSE);
 	dns_db_detach(&gdb);
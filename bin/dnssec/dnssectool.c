@@ -27,12 +27,16 @@
 
 #include <isc/base32.h>
 #include <isc/buffer.h>
+#include <isc/condition.h>
 #include <isc/dir.h>
 #include <isc/entropy.h>
 #include <isc/heap.h>
 #include <isc/list.h>
 #include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/platform.h>
 #include <isc/string.h>
+#include <isc/thread.h>
 #include <isc/time.h>
 #include <isc/util.h>
 #include <isc/print.h>
@@ -548,40 +552,297 @@ is_delegation(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 
 static isc_boolean_t
 goodsig(dns_name_t *origin, dns_rdata_t *sigrdata, dns_name_t *name,
-	dns_rdataset_t *keyrdataset, dns_rdataset_t *rdataset, isc_mem_t *mctx)
+	dst_key_t **keys, unsigned int nkeys, dns_rdataset_t *rdataset,
+	isc_mem_t *mctx)
 {
-	dns_rdata_dnskey_t key;
 	dns_rdata_rrsig_t sig;
-	dst_key_t *dstkey = NULL;
 	isc_result_t result;
+	unsigned int i;
 
 	result = dns_rdata_tostruct(sigrdata, &sig, NULL);
 	check_result(result, "dns_rdata_tostruct()");
 
+	if (!dns_name_equal(&sig.signer, origin))
+		return (ISC_FALSE);
+	for (i = 0; i < nkeys; i++) {
+		if (sig.algorithm != dst_key_alg(keys[i]) ||
+		    sig.keyid != dst_key_id(keys[i]))
+			continue;
+		result = dns_dnssec_verify(name, rdataset, keys[i], ISC_FALSE,
+					   mctx, sigrdata);
+		if (result == ISC_R_SUCCESS)
+			return(ISC_TRUE);
+	}
+	return (ISC_FALSE);
+}
+
+/*
+ * Checking the signatures is by far the most expensive part of
+ * verifyzone().  verifyset() therefore only does the cheap checks
+ * itself and queues each signed rdataset as a job; the queue is worked
+ * through by a small pool of threads whenever VERIFY_BATCH jobs have
+ * built up, and at the end of each pass over the zone.  This keeps the
+ * memory used for the queue fixed however large the zone is, and the
+ * results are still reported in the order the rdatasets were visited.
+ */
+#define VERIFY_BATCH	1024
+
+typedef struct verifyjob {
+	dns_fixedname_t		name;
+	dns_rdataset_t		rdataset;
+	dns_rdataset_t		sigrdataset;
+	unsigned char		set_algorithms[256];
+} verifyjob_t;
+
+static struct {
+	isc_mem_t		*mctx;
+	dns_name_t		*origin;
+	unsigned char		*act_algorithms;
+	dst_key_t		**keys;		/* the zone's DNSKEYs */
+	unsigned int		nkeys;
+	unsigned int		keyslots;	/* allocated for keys */
+	verifyjob_t		*jobs;		/* VERIFY_BATCH of them */
+	unsigned int		njobs;
+#ifdef ISC_PLATFORM_USETHREADS
+	isc_thread_t		*threads;
+	unsigned int		nthreads;
+	isc_mutex_t		lock;
+	isc_condition_t		work;		/* a batch was started */
+	isc_condition_t		done;		/* a batch was finished */
+
+	/* Locked by lock. */
+	unsigned int		batch;		/* jobs in the current batch */
+	unsigned int		next;		/* next job to hand out */
+	unsigned int		finished;	/* jobs finished */
+	isc_boolean_t		exiting;
+#endif
+} verifypool;
+
+static void
+verifyjob_run(verifyjob_t *job) {
+	dns_name_t *name = dns_fixedname_name(&job->name);
+	isc_result_t result;
+
+	memset(job->set_algorithms, 0, sizeof(job->set_algorithms));
+	for (result = dns_rdataset_first(&job->sigrdataset);
+	     result == ISC_R_SUCCESS;
+	     result = dns_rdataset_next(&job->sigrdataset)) {
+		dns_rdata_t rdata = DNS_RDATA_INIT;
+		dns_rdata_rrsig_t sig;
+
+		dns_rdataset_current(&job->sigrdataset, &rdata);
+		result = dns_rdata_tostruct(&rdata, &sig, NULL);
+		check_result(result, "dns_rdata_tostruct()");
+		if (job->rdataset.ttl != sig.originalttl ||
+		    job->set_algorithms[sig.algorithm] != 0 ||
+		    verifypool.act_algorithms[sig.algorithm] == 0)
+			continue;
+		if (goodsig(verifypool.origin, &rdata, name, verifypool.keys,
+			    verifypool.nkeys, &job->rdataset, verifypool.mctx))
+			job->set_algorithms[sig.algorithm] = 1;
+	}
+}
+
+#ifdef ISC_PLATFORM_USETHREADS
+static isc_threadresult_t
+#ifdef _WIN32
+WINAPI
+#endif
+verifyworker(isc_threadarg_t arg) {
+	unsigned int i;
+
+	UNUSED(arg);
+
+	LOCK(&verifypool.lock);
+	while (!verifypool.exiting) {
+		if (verifypool.next >= verifypool.batch) {
+			WAIT(&verifypool.work, &verifypool.lock);
+			continue;
+		}
+		i = verifypool.next++;
+		UNLOCK(&verifypool.lock);
+		verifyjob_run(&verifypool.jobs[i]);
+		LOCK(&verifypool.lock);
+		if (++verifypool.finished == verifypool.batch)
+			BROADCAST(&verifypool.done);
+	}
+	UNLOCK(&verifypool.lock);
+
+	return ((isc_threadresult_t)0);
+}
+#endif
+
+/*
+ * Run the queued jobs, in parallel if there are threads to help.
+ */
+static void
+verify_run(void) {
+	unsigned int i;
+
+#ifdef ISC_PLATFORM_USETHREADS
+	if (verifypool.nthreads > 0 && verifypool.njobs > 1) {
+		/*
+		 * Hand the batch to the pool, and work on it ourselves
+		 * until every job has been handed out.
+		 */
+		LOCK(&verifypool.lock);
+		verifypool.batch = verifypool.njobs;
+		verifypool.next = 0;
+		verifypool.finished = 0;
+		BROADCAST(&verifypool.work);
+		while (verifypool.next < verifypool.batch) {
+			i = verifypool.next++;
+			UNLOCK(&verifypool.lock);
+			verifyjob_run(&verifypool.jobs[i]);
+			LOCK(&verifypool.lock);
+			verifypool.finished++;
+		}
+		while (verifypool.finished < verifypool.batch)
+			WAIT(&verifypool.done, &verifypool.lock);
+		verifypool.batch = 0;
+		verifypool.next = 0;
+		UNLOCK(&verifypool.lock);
+		return;
+	}
+#endif
+
+	for (i = 0; i < verifypool.njobs; i++)
+		verifyjob_run(&verifypool.jobs[i]);
+}
+
+/*
+ * Check the signatures of the queued jobs, then report and release
+ * them.
+ */
+static void
+verify_flush(unsigned char *bad_algorithms) {
+	char namebuf[DNS_NAME_FORMATSIZE];
+	char algbuf[80];
+	char typebuf[80];
+	verifyjob_t *job;
+	unsigned int i;
+	int j;
+
+	verify_run();
+
+	for (i = 0; i < verifypool.njobs; i++) {
+		job = &verifypool.jobs[i];
+		if (memcmp(job->set_algorithms, verifypool.act_algorithms,
+			   sizeof(job->set_algorithms)) != 0)
+		{
+			dns_name_format(dns_fixedname_name(&job->name),
+					namebuf, sizeof(namebuf));
+			type_format(job->rdataset.type, typebuf,
+				    sizeof(typebuf));
+			for (j = 0; j < 256; j++)
+				if ((verifypool.act_algorithms[j] != 0) &&
+				    (job->set_algorithms[j] == 0)) {
+					dns_secalg_format(j, algbuf,
+							  sizeof(algbuf));
+					fprintf(stderr, "No correct %s "
+						"signature for %s %s\n",
+						algbuf, namebuf, typebuf);
+					bad_algorithms[j] = 1;
+				}
+		}
+		dns_rdataset_disassociate(&job->rdataset);
+		dns_rdataset_disassociate(&job->sigrdataset);
+	}
+	verifypool.njobs = 0;
+}
+
+/*
+ * Set up the verification queue: convert the zone's DNSKEYs once, and
+ * start 'nthreads' - 1 threads to help the calling thread.
+ */
+static void
+verify_start(isc_mem_t *mctx, dns_name_t *origin,
+	     dns_rdataset_t *keyrdataset, unsigned char *act_algorithms,
+	     unsigned int nthreads)
+{
+	isc_result_t result;
+
+	memset(&verifypool, 0, sizeof(verifypool));
+	verifypool.mctx = mctx;
+	verifypool.origin = origin;
+	verifypool.act_algorithms = act_algorithms;
+
+	verifypool.keyslots = dns_rdataset_count(keyrdataset);
+	verifypool.keys = isc_mem_get(mctx, verifypool.keyslots *
+					    sizeof(dst_key_t *));
+	if (verifypool.keys == NULL)
+		fatal("out of memory");
 	for (result = dns_rdataset_first(keyrdataset);
 	     result == ISC_R_SUCCESS;
 	     result = dns_rdataset_next(keyrdataset)) {
 		dns_rdata_t rdata = DNS_RDATA_INIT;
+		dst_key_t *dstkey = NULL;
+
 		dns_rdataset_current(keyrdataset, &rdata);
-		result = dns_rdata_tostruct(&rdata, &key, NULL);
-		check_result(result, "dns_rdata_tostruct()");
 		result = dns_dnssec_keyfromrdata(origin, &rdata, mctx,
 						 &dstkey);
 		if (result != ISC_R_SUCCESS)
-			return (ISC_FALSE);
-		if (sig.algorithm != key.algorithm ||
-		    sig.keyid != dst_key_id(dstkey) ||
-		    !dns_name_equal(&sig.signer, origin)) {
-			dst_key_free(&dstkey);
 			continue;
+		verifypool.keys[verifypool.nkeys++] = dstkey;
+	}
+
+	verifypool.jobs = isc_mem_get(mctx,
+				      VERIFY_BATCH * sizeof(verifyjob_t));
+	if (verifypool.jobs == NULL)
+		fatal("out of memory");
+
+#ifdef ISC_PLATFORM_USETHREADS
+	result = isc_mutex_init(&verifypool.lock);
+	check_result(result, "isc_mutex_init()");
+	result = isc_condition_init(&verifypool.work);
+	check_result(result, "isc_condition_init()");
+	result = isc_condition_init(&verifypool.done);
+	check_result(result, "isc_condition_init()");
+
+	if (nthreads > 1) {
+		verifypool.threads = isc_mem_get(mctx, (nthreads - 1) *
+						 sizeof(isc_thread_t));
+		if (verifypool.threads == NULL)
+			fatal("out of memory");
+		while (verifypool.nthreads < nthreads - 1) {
+			result = isc_thread_create(verifyworker, NULL,
+				&verifypool.threads[verifypool.nthreads]);
+			check_result(result, "isc_thread_create()");
+			verifypool.nthreads++;
 		}
-		result = dns_dnssec_verify(name, rdataset, dstkey, ISC_FALSE,
-					   mctx, sigrdata);
-		dst_key_free(&dstkey);
-		if (result == ISC_R_SUCCESS)
-			return(ISC_TRUE);
 	}
-	return (ISC_FALSE);
+#else
+	UNUSED(nthreads);
+#endif
+}
+
+static void
+verify_stop(void) {
+	unsigned int i;
+
+	INSIST(verifypool.njobs == 0);
+
+#ifdef ISC_PLATFORM_USETHREADS
+	LOCK(&verifypool.lock);
+	verifypool.exiting = ISC_TRUE;
+	BROADCAST(&verifypool.work);
+	UNLOCK(&verifypool.lock);
+	for (i = 0; i < verifypool.nthreads; i++)
+		(void)isc_thread_join(verifypool.threads[i], NULL);
+	if (verifypool.threads != NULL)
+		isc_mem_put(verifypool.mctx, verifypool.threads,
+			    verifypool.nthreads * sizeof(isc_thread_t));
+	(void)isc_condition_destroy(&verifypool.done);
+	(void)isc_condition_destroy(&verifypool.work);
+	DESTROYLOCK(&verifypool.lock);
+#endif
+
+	isc_mem_put(verifypool.mctx, verifypool.jobs,
+		    VERIFY_BATCH * sizeof(verifyjob_t));
+	for (i = 0; i < verifypool.nkeys; i++)
+		dst_key_free(&verifypool.keys[i]);
+	isc_mem_put(verifypool.mctx, verifypool.keys,
+		    verifypool.keyslots * sizeof(dst_key_t *));
 }
 
 static isc_result_t
@@ -1076,17 +1337,15 @@ verifynsec3s(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 }
 
 static void
-verifyset(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
-	  isc_mem_t *mctx, dns_rdataset_t *rdataset, dns_name_t *name,
-	  dns_dbnode_t *node, dns_rdataset_t *keyrdataset,
+verifyset(dns_db_t *db, dns_dbversion_t *ver, dns_rdataset_t *rdataset,
+	  dns_name_t *name, dns_dbnode_t *node,
 	  unsigned char *act_algorithms, unsigned char *bad_algorithms)
 {
-	unsigned char set_algorithms[256];
 	char namebuf[DNS_NAME_FORMATSIZE];
-	char algbuf[80];
 	char typebuf[80];
 	dns_rdataset_t sigrdataset;
 	dns_rdatasetiter_t *rdsiter = NULL;
+	verifyjob_t *job;
 	isc_result_t result;
 	int i;
 
@@ -1102,6 +1361,7 @@ verifyset(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 			break;
 		dns_rdataset_disassociate(&sigrdataset);
 	}
+	dns_rdatasetiter_destroy(&rdsiter);
 	if (result != ISC_R_SUCCESS) {
 		dns_name_format(name, namebuf, sizeof(namebuf));
 		type_format(rdataset->type, typebuf, sizeof(typebuf));
@@ -1109,11 +1369,9 @@ verifyset(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 		for (i = 0; i < 256; i++)
 			if (act_algorithms[i] != 0)
 				bad_algorithms[i] = 1;
-		dns_rdatasetiter_destroy(&rdsiter);
 		return;
 	}
 
-	memset(set_algorithms, 0, sizeof(set_algorithms));
 	for (result = dns_rdataset_first(&sigrdataset);
 	     result == ISC_R_SUCCESS;
 	     result = dns_rdataset_next(&sigrdataset)) {
@@ -1128,34 +1386,29 @@ verifyset(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 			type_format(rdataset->type, typebuf, sizeof(typebuf));
 			fprintf(stderr, "TTL mismatch for %s %s keytag %u\n",
 				namebuf, typebuf, sig.keyid);
-			continue;
 		}
-		if ((set_algorithms[sig.algorithm] != 0) ||
-		    (act_algorithms[sig.algorithm] == 0))
-			continue;
-		if (goodsig(origin, &rdata, name, keyrdataset, rdataset, mctx))
-			set_algorithms[sig.algorithm] = 1;
-	}
-	dns_rdatasetiter_destroy(&rdsiter);
-	if (memcmp(set_algorithms, act_algorithms, sizeof(set_algorithms))) {
-		dns_name_format(name, namebuf, sizeof(namebuf));
-		type_format(rdataset->type, typebuf, sizeof(typebuf));
-		for (i = 0; i < 256; i++)
-			if ((act_algorithms[i] != 0) &&
-			    (set_algorithms[i] == 0)) {
-				dns_secalg_format(i, algbuf, sizeof(algbuf));
-				fprintf(stderr, "No correct %s signature for "
-					"%s %s\n", algbuf, namebuf, typebuf);
-				bad_algorithms[i] = 1;
-			}
 	}
+
+	/*
+	 * Leave the signatures themselves to verify_flush().
+	 */
+	job = &verifypool.jobs[verifypool.njobs++];
+	dns_fixedname_init(&job->name);
+	dns_name_copy(name, dns_fixedname_name(&job->name), NULL);
+	dns_rdataset_init(&job->rdataset);
+	dns_rdataset_clone(rdataset, &job->rdataset);
+	dns_rdataset_init(&job->sigrdataset);
+	dns_rdataset_clone(&sigrdataset, &job->sigrdataset);
 	dns_rdataset_disassociate(&sigrdataset);
+
+	if (verifypool.njobs == VERIFY_BATCH)
+		verify_flush(bad_algorithms);
 }
 
 static isc_result_t
 verifynode(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 	   isc_mem_t *mctx, dns_name_t *name, dns_dbnode_t *node,
-	   isc_boolean_t delegation, dns_rdataset_t *keyrdataset,
+	   isc_boolean_t delegation,
 	   unsigned char *act_algorithms, unsigned char *bad_algorithms,
 	   dns_rdataset_t *nsecset, dns_rdataset_t *nsec3paramset,
 	   dns_name_t *nextname)
@@ -1183,8 +1436,7 @@ verifynode(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 		    rdataset.type != dns_rdatatype_dnskey &&
 		    (!delegation || rdataset.type == dns_rdatatype_ds ||
 		     rdataset.type == dns_rdatatype_nsec)) {
-			verifyset(db, ver, origin, mctx, &rdataset,
-				  name, node, keyrdataset,
+			verifyset(db, ver, &rdataset, name, node,
 				  act_algorithms, bad_algorithms);
 			dns_nsec_setbit(types, rdataset.type, 1);
 			if (rdataset.type > maxtype)
@@ -1452,7 +1704,8 @@ verifyemptynodes(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 void
 verifyzone(dns_db_t *db, dns_dbversion_t *ver,
 	   dns_name_t *origin, isc_mem_t *mctx,
-	   isc_boolean_t ignore_kskflag, isc_boolean_t keyset_kskonly)
+	   isc_boolean_t ignore_kskflag, isc_boolean_t keyset_kskonly,
+	   unsigned int nthreads)
 {
 	char algbuf[80];
 	dns_dbiterator_t *dbiter = NULL;
@@ -1666,6 +1919,8 @@ verifyzone(dns_db_t *db, dns_dbversion_t *ver,
 	 * present in the DNSKEY RRSET.
 	 */
 
+	verify_start(mctx, origin, &keyset, act_algorithms, nthreads);
+
 	dns_fixedname_init(&fname);
 	name = dns_fixedname_name(&fname);
 	dns_fixedname_init(&fnextname);
@@ -1731,7 +1986,7 @@ verifyzone(dns_db_t *db, dns_dbversion_t *ver,
 			fatal("iterating through the database failed: %s",
 			      isc_result_totext(result));
 		result = verifynode(db, ver, origin, mctx, name, node,
-				    isdelegation, &keyset, act_algorithms,
+				    isdelegation, act_algorithms,
 				    bad_algorithms, &nsecset, &nsec3paramset,
 				    nextname);
 		if (vresult == ISC_R_UNSET)
@@ -1751,6 +2006,7 @@ verifyzone(dns_db_t *db, dns_dbversion_t *ver,
 	}
 
 	dns_dbiterator_destroy(&dbiter);
+	verify_flush(bad_algorithms);
 
 	result = dns_db_createiterator(db, DNS_DB_NSEC3ONLY, &dbiter);
 	check_result(result, "dns_db_createiterator()");
@@ -1761,13 +2017,15 @@ verifyzone(dns_db_t *db, dns_dbversion_t *ver,
 		result = dns_dbiterator_current(dbiter, &node, name);
 		check_dns_dbiterator_current(result);
 		result = verifynode(db, ver, origin, mctx, name, node,
-				    ISC_FALSE, &keyset, act_algorithms,
+				    ISC_FALSE, act_algorithms,
 				    bad_algorithms, NULL, NULL, NULL);
 		check_result(result, "verifynode");
 		record_found(db, ver, mctx, name, node, &nsec3paramset);
 		dns_db_detachnode(db, &node);
 	}
 	dns_dbiterator_destroy(&dbiter);
+	verify_flush(bad_algorithms);
+	verify_stop();
 
 	dns_rdataset_disassociate(&keyset);
 	if (dns_rdataset_isassociated(&nsecset))
@@ -59,6 +59,7 @@
 #include <named/os.h>
 #include <named/server.h>
 #include <named/update.h>
+#include <named/viewtable.h>
 
 /***
  *** Client
@@ -97,6 +98,7 @@
 #define TCP_CLIENT(c)	(((c)->attributes & NS_CLIENTATTR_TCP) != 0)
 
 #define TCP_BUFFER_SIZE			(65535 + 2)
+#define TCP_BUFFER_FREEMAX		32
 #define SEND_BUFFER_SIZE		4096
 #define RECV_BUFFER_SIZE		4096
 
@@ -145,6 +147,15 @@ struct ns_clientmgr {
 	isc_mutex_t			reclock;
 	client_list_t			recursing;    /*%< Recursing clients */
 
+	/*
+	 * TCP response buffers, kept for reuse.  They come from a memory
+	 * context of their own so that allocating more of them shows up
+	 * in the "ReqHeapAlloc" statistic.
+	 */
+	isc_mutex_t			tcpbuflock;
+	isc_mem_t *			tcpbufmctx;
+	isc_mempool_t *			tcpbufpool;
+
 #if NMCTXS > 0
 	/*%< mctx pool for clients. */
 	unsigned int			nextmctx;
@@ -155,6 +166,33 @@ struct ns_clientmgr {
 #define MANAGER_MAGIC			ISC_MAGIC('N', 'S', 'C', 'm')
 #define VALID_MANAGER(m)		ISC_MAGIC_VALID(m, MANAGER_MAGIC)
 
+/*%
+ * A TCP connection.  The client reading requests from the connection
+ * and each client working on a request read from it hold a reference.
+ * The connection, not each of those clients, holds the "tcp-clients"
+ * quota, so the quota limits connections rather than requests.
+ *
+ * Buffers are not shared through the connection.  Each client parses
+ * its request in place from the buffer of the tcpmsg it read it with,
+ * so that buffer must live as long as the request does; responses are
+ * already built in buffers taken from the manager's tcpbufpool only
+ * while a send is in progress.
+ */
+struct ns_tcpconn {
+	/* Unlocked. */
+	unsigned int			magic;
+	isc_mem_t *			mctx;
+	isc_quota_t *			tcpquota;
+	isc_boolean_t			pipelined;    /*%< Allowed here */
+
+	/* Locked by lock. */
+	isc_mutex_t			lock;
+	unsigned int			refs;
+};
+
+#define TCPCONN_MAGIC			ISC_MAGIC('N', 'S', 'T', 'c')
+#define VALID_TCPCONN(c)		ISC_MAGIC_VALID(c, TCPCONN_MAGIC)
+
 /*!
  * Client object states.  Ordering is significant: higher-numbered
  * states are generally "more active", meaning that the client can
@@ -242,13 +280,110 @@ static void ns_client_dumpmessage(ns_client_t *client, const char *reason);
 static isc_result_t get_client(ns_clientmgr_t *manager, ns_interface_t *ifp,
 			       dns_dispatch_t *disp, isc_boolean_t tcp);
 static isc_result_t get_worker(ns_clientmgr_t *manager, ns_interface_t *ifp,
-			       isc_socket_t *sock);
+			       isc_socket_t *sock, ns_tcpconn_t *conn);
 static inline isc_boolean_t
 allowed(isc_netaddr_t *addr, dns_name_t *signer, isc_netaddr_t *ecs_addr,
 	isc_uint8_t ecs_addrlen, isc_uint8_t *ecs_scope, dns_acl_t *acl);
 static void compute_cookie(ns_client_t *client, isc_uint32_t when,
 			   isc_uint32_t nonce, isc_buffer_t *buf);
 
+static isc_result_t
+tcpconn_create(ns_clientmgr_t *manager, ns_tcpconn_t **connp) {
+	ns_tcpconn_t *conn;
+	isc_result_t result;
+
+	REQUIRE(connp != NULL && *connp == NULL);
+
+	conn = isc_mem_get(manager->mctx, sizeof(*conn));
+	if (conn == NULL)
+		return (ISC_R_NOMEMORY);
+
+	result = isc_mutex_init(&conn->lock);
+	if (result != ISC_R_SUCCESS) {
+		isc_mem_put(manager->mctx, conn, sizeof(*conn));
+		return (result);
+	}
+
+	conn->mctx = NULL;
+	isc_mem_attach(manager->mctx, &conn->mctx);
+	conn->tcpquota = NULL;
+	conn->pipelined = ISC_FALSE;
+	conn->refs = 1;
+	conn->magic = TCPCONN_MAGIC;
+
+	*connp = conn;
+	return (ISC_R_SUCCESS);
+}
+
+/*%
+ * Attach '*connp' to 'conn' for a client that is to read the next
+ * request from it, unless 'limit' clients are already attached.
+ */
+static isc_result_t
+tcpconn_attach(ns_tcpconn_t *conn, unsigned int limit, ns_tcpconn_t **connp) {
+	isc_result_t result = ISC_R_QUOTA;
+
+	REQUIRE(VALID_TCPCONN(conn));
+	REQUIRE(connp != NULL && *connp == NULL);
+
+	LOCK(&conn->lock);
+	if (conn->refs < limit) {
+		conn->refs++;
+		*connp = conn;
+		result = ISC_R_SUCCESS;
+	}
+	UNLOCK(&conn->lock);
+
+	return (result);
+}
+
+static void
+tcpconn_detach(ns_tcpconn_t **connp) {
+	ns_tcpconn_t *conn;
+	isc_boolean_t destroy;
+
+	REQUIRE(connp != NULL && VALID_TCPCONN(*connp));
+
+	conn = *connp;
+	*connp = NULL;
+
+	LOCK(&conn->lock);
+	INSIST(conn->refs > 0);
+	conn->refs--;
+	destroy = ISC_TF(conn->refs == 0);
+	UNLOCK(&conn->lock);
+
+	if (!destroy)
+		return;
+
+	if (conn->tcpquota != NULL)
+		isc_quota_detach(&conn->tcpquota);
+	DESTROYLOCK(&conn->lock);
+	conn->magic = 0;
+	isc_mem_putanddetach(&conn->mctx, conn, sizeof(*conn));
+}
+
+/*%
+ * Return the number of heap allocations made so far by the memory
+ * contexts that the client draws on.
+ */
+static inline isc_uint64_t
+client_mallocs(ns_client_t *client) {
+	return (isc_mem_mallocs(client->mctx) +
+		isc_mem_mallocs(client->manager->tcpbufmctx));
+}
+
+/*%
+ * Release the buffer of the client's TCP response, if any.
+ */
+static void
+client_freetcpbuf(ns_client_t *client) {
+	if (client->tcpbuf != NULL) {
+		isc_mempool_put(client->manager->tcpbufpool, client->tcpbuf);
+		client->tcpbuf = NULL;
+	}
+}
+
 void
 ns_client_recursing(ns_client_t *client) {
 	REQUIRE(NS_CLIENT_VALID(client));
@@ -383,6 +518,13 @@ exit_check(ns_client_t *client) {
 
 		if (NS_CLIENTSTATE_READING == client->newstate) {
 			if (!client->pipelined) {
+				/*
+				 * Pipelining may have been suspended for
+				 * the request just answered; resume it.
+				 */
+				if (client->tcpconn != NULL)
+					client->pipelined =
+						client->tcpconn->pipelined;
 				client_read(client);
 				client->newstate = NS_CLIENTSTATE_MAX;
 				return (ISC_TRUE); /* We're done. */
@@ -416,8 +558,9 @@ exit_check(ns_client_t *client) {
 			isc_socket_detach(&client->tcpsocket);
 		}
 
-		if (client->tcpquota != NULL)
-			isc_quota_detach(&client->tcpquota);
+		client_freetcpbuf(client);
+		if (client->tcpconn != NULL)
+			tcpconn_detach(&client->tcpconn);
 
 		if (client->timerset) {
 			(void)isc_timer_reset(client->timer,
@@ -571,9 +714,7 @@ exit_check(ns_client_t *client) {
 		if (client->delaytimer != NULL)
 			isc_timer_detach(&client->delaytimer);
 
-		if (client->tcpbuf != NULL)
-			isc_mem_put(client->mctx, client->tcpbuf,
-				    TCP_BUFFER_SIZE);
+		client_freetcpbuf(client);
 		if (client->opt != NULL) {
 			INSIST(dns_rdataset_isassociated(client->opt));
 			dns_rdataset_disassociate(client->opt);
@@ -723,6 +864,16 @@ ns_client_endrequest(ns_client_t *client) {
 	 * the request; that's all except the TCP flag.
 	 */
 	client->attributes &= NS_CLIENTATTR_TCP;
+
+	/*
+	 * Count requests that could not be answered using only memory
+	 * that the client (and the other clients sharing its memory
+	 * context) already had; in the steady state there should be
+	 * none.
+	 */
+	if (client_mallocs(client) != client->mallocs)
+		isc_stats_increment(ns_g_server->nsstats,
+				    dns_nsstatscounter_reqmalloc);
 }
 
 void
@@ -784,8 +935,7 @@ client_senddone(isc_task_t *task, isc_event_t *event) {
 
 	if (client->tcpbuf != NULL) {
 		INSIST(TCP_CLIENT(client));
-		isc_mem_put(client->mctx, client->tcpbuf, TCP_BUFFER_SIZE);
-		client->tcpbuf = NULL;
+		client_freetcpbuf(client);
 	}
 
 	ns_client_next(client, ISC_R_SUCCESS);
@@ -818,7 +968,7 @@ client_allocsendbuf(ns_client_t *client, isc_buffer_t *buffer,
 			result = ISC_R_NOSPACE;
 			goto done;
 		}
-		client->tcpbuf = isc_mem_get(client->mctx, TCP_BUFFER_SIZE);
+		client->tcpbuf = isc_mempool_get(client->manager->tcpbufpool);
 		if (client->tcpbuf == NULL) {
 			result = ISC_R_NOMEMORY;
 			goto done;
@@ -964,10 +1114,7 @@ ns_client_sendraw(ns_client_t *client, dns_message_t *message) {
 		return;
 
  done:
-	if (client->tcpbuf != NULL) {
-		isc_mem_put(client->mctx, client->tcpbuf, TCP_BUFFER_SIZE);
-		client->tcpbuf = NULL;
-	}
+	client_freetcpbuf(client);
 	ns_client_next(client, result);
 }
 
@@ -1163,10 +1310,7 @@ client_send(ns_client_t *client) {
 		return;
 
  done:
-	if (client->tcpbuf != NULL) {
-		isc_mem_put(client->mctx, client->tcpbuf, TCP_BUFFER_SIZE);
-		client->tcpbuf = NULL;
-	}
+	client_freetcpbuf(client);
 
 	if (cleanup_cctx)
 		dns_compress_invalidate(&cctx);
@@ -1560,6 +1704,44 @@ allowed(isc_netaddr_t *addr, dns_name_t *signer,
 	return (ISC_FALSE);
 }
 
+/*
+ * Whether the request in 'client', from 'netaddr', is for 'view'.  The
+ * message's signature is checked again with the view's keys, and the
+ * result of that is stored in '*sigresult'.
+ */
+static isc_boolean_t
+view_matches(ns_client_t *client, dns_view_t *view, isc_netaddr_t *netaddr,
+	     isc_result_t *sigresult)
+{
+	dns_name_t *tsig = NULL;
+	isc_netaddr_t *addr = NULL;
+	isc_uint8_t *scope = NULL;
+
+	if (client->message->rdclass != view->rdclass &&
+	    client->message->rdclass != dns_rdataclass_any)
+		return (ISC_FALSE);
+
+	*sigresult = dns_message_rechecksig(client->message, view);
+	if (*sigresult == ISC_R_SUCCESS) {
+		dns_tsigkey_t *tsigkey;
+
+		tsigkey = client->message->tsigkey;
+		tsig = dns_tsigkey_identity(tsigkey);
+	}
+
+	if ((client->attributes & NS_CLIENTATTR_HAVEECS) != 0) {
+		addr = &client->ecs_addr;
+		scope = &client->ecs_scope;
+	}
+
+	return (ISC_TF(allowed(netaddr, tsig, addr, client->ecs_addrlen,
+			       scope, view->matchclients) &&
+		       allowed(&client->destaddr, tsig, NULL,
+			       0, NULL, view->matchdestinations) &&
+		       !(view->matchrecursiveonly &&
+			 (client->message->flags & DNS_MESSAGEFLAG_RD) == 0)));
+}
+
 /*
  * Callback to see if a non-recursive query coming from 'srcaddr' to
  * 'destaddr', with optional key 'mykey' for class 'rdclass' would be
@@ -2008,6 +2190,23 @@ process_opt(ns_client_t *client, dns_rdataset_t *opt) {
 	return (result);
 }
 
+/*%
+ * Return ISC_TRUE if 'msg' asks for a zone transfer.
+ */
+static isc_boolean_t
+xfr_request(dns_message_t *msg) {
+	dns_name_t *name = NULL;
+	dns_rdataset_t *rdataset;
+
+	if (dns_message_firstname(msg, DNS_SECTION_QUESTION) != ISC_R_SUCCESS)
+		return (ISC_FALSE);
+	dns_message_currentname(msg, DNS_SECTION_QUESTION, &name);
+	rdataset = ISC_LIST_HEAD(name->list);
+	return (ISC_TF(rdataset != NULL &&
+		       (rdataset->type == dns_rdatatype_axfr ||
+			rdataset->type == dns_rdatatype_ixfr)));
+}
+
 /*
  * Handle an incoming request event from the socket (UDP case)
  * or tcpmsg (TCP case).
@@ -2043,6 +2242,7 @@ client_request(isc_task_t *task, isc_event_t *event) {
 				       NS_CLIENTSTATE_READY));
 
 	ns_client_requests++;
+	client->mallocs = client_mallocs(client);
 
 	if (event->ev_type == ISC_SOCKEVENT_RECVDONE) {
 		INSIST(!TCP_CLIENT(client));
@@ -2228,17 +2428,26 @@ client_request(isc_task_t *task, isc_event_t *event) {
 	}
 
 	/*
-	 * Pipeline TCP query processing.
+	 * Pipeline TCP query processing.  Zone transfers are not
+	 * pipelined so that the responses to several transfer requests
+	 * on one connection are sent one after the other, never
+	 * interleaved.
 	 */
-	if (client->message->opcode != dns_opcode_query)
+	if (client->message->opcode != dns_opcode_query ||
+	    xfr_request(client->message))
 		client->pipelined = ISC_FALSE;
 	if (TCP_CLIENT(client) && client->pipelined) {
-		result = isc_quota_reserve(&ns_g_server->tcpquota);
-		if (result == ISC_R_SUCCESS)
-			result = ns_client_replace(client);
+		/*
+		 * If the connection already has "tcp-pipelining-limit"
+		 * requests in progress, this client reads the next
+		 * request itself once it has answered this one.
+		 */
+		result = ns_client_replace(client);
 		if (result != ISC_R_SUCCESS) {
 			ns_client_log(client, NS_LOGCATEGORY_CLIENT,
-				      NS_LOGMODULE_CLIENT, ISC_LOG_WARNING,
+				      NS_LOGMODULE_CLIENT,
+				      result == ISC_R_QUOTA ?
+					ISC_LOG_DEBUG(3) : ISC_LOG_WARNING,
 				      "no more TCP clients(read): %s",
 				      isc_result_totext(result));
 			client->pipelined = ISC_FALSE;
@@ -2364,44 +2573,39 @@ client_request(isc_task_t *task, isc_event_t *event) {
 	}
 
 	/*
-	 * Find a view that matches the client's source address.
+	 * Find a view that matches the client's source address.  The
+	 * view table leaves out the views whose match-clients ACL
+	 * cannot match the address; it does not cover EDNS client
+	 * subnet options.
 	 */
-	for (view = ISC_LIST_HEAD(ns_g_server->viewlist);
-	     view != NULL;
-	     view = ISC_LIST_NEXT(view, link)) {
-		if (client->message->rdclass == view->rdclass ||
-		    client->message->rdclass == dns_rdataclass_any)
-		{
-			dns_name_t *tsig = NULL;
-			isc_netaddr_t *addr = NULL;
-			isc_uint8_t *scope = NULL;
-
-			sigresult = dns_message_rechecksig(client->message,
-							   view);
-			if (sigresult == ISC_R_SUCCESS) {
-				dns_tsigkey_t *tsigkey;
-
-				tsigkey = client->message->tsigkey;
-				tsig = dns_tsigkey_identity(tsigkey);
-			}
-
-			if ((client->attributes & NS_CLIENTATTR_HAVEECS) != 0) {
-				addr = &client->ecs_addr;
-				scope = &client->ecs_scope;
-			}
-
-			if (allowed(&netaddr, tsig, addr, client->ecs_addrlen,
-				    scope, view->matchclients) &&
-			    allowed(&client->destaddr, tsig, NULL,
-				    0, NULL, view->matchdestinations) &&
-			    !(view->matchrecursiveonly &&
-			    (client->message->flags & DNS_MESSAGEFLAG_RD) == 0))
+	if (ns_g_server->viewtable != NULL &&
+	    (client->attributes & NS_CLIENTATTR_HAVEECS) == 0)
+	{
+		dns_view_t **views;
+		unsigned int i, count;
+
+		ns_viewtable_find(ns_g_server->viewtable, &netaddr,
+				  &ns_g_server->aclenv, &views, &count);
+		view = NULL;
+		for (i = 0; i < count; i++) {
+			if (view_matches(client, views[i], &netaddr,
+					 &sigresult))
 			{
-				dns_view_attach(view, &client->view);
+				view = views[i];
 				break;
 			}
 		}
+	} else {
+		for (view = ISC_LIST_HEAD(ns_g_server->viewlist);
+		     view != NULL;
+		     view = ISC_LIST_NEXT(view, link))
+		{
+			if (view_matches(client, view, &netaddr, &sigresult))
+				break;
+		}
 	}
+	if (view != NULL)
+		dns_view_attach(view, &client->view);
 
 	if (view == NULL) {
 		char classname[DNS_RDATACLASS_FORMATSIZE];
@@ -2728,6 +2932,9 @@ client_create(ns_clientmgr_t *manager, ns_client_t **clientp) {
 				    &client->message);
 	if (result != ISC_R_SUCCESS)
 		goto cleanup_timer;
+	result = dns_message_usearena(client->message, 0);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_message;
 
 	/* XXXRTH  Hardwired constants */
 
@@ -2784,7 +2991,8 @@ client_create(ns_clientmgr_t *manager, ns_client_t **clientp) {
 	dns_name_init(&client->signername, NULL);
 	client->mortal = ISC_FALSE;
 	client->pipelined = ISC_FALSE;
-	client->tcpquota = NULL;
+	client->tcpconn = NULL;
+	client->mallocs = 0;
 	client->recursionquota = NULL;
 	client->interface = NULL;
 	client->peeraddr_valid = ISC_FALSE;
@@ -2963,6 +3171,18 @@ client_newconn(isc_task_t *task, isc_event_t *event) {
 			goto freeevent;
 		}
 
+		INSIST(client->tcpconn == NULL);
+		result = tcpconn_create(client->manager, &client->tcpconn);
+		if (result != ISC_R_SUCCESS) {
+			ns_client_log(client, NS_LOGCATEGORY_CLIENT,
+				      NS_LOGMODULE_CLIENT, ISC_LOG_WARNING,
+				      "TCP connection setup failed: %s",
+				      isc_result_totext(result));
+			client->newstate = NS_CLIENTSTATE_READY;
+			(void)exit_check(client);
+			goto freeevent;
+		}
+
 		INSIST(client->tcpmsg_valid == ISC_FALSE);
 		dns_tcpmsg_init(client->mctx, client->tcpsocket,
 				&client->tcpmsg);
@@ -2976,7 +3196,7 @@ client_newconn(isc_task_t *task, isc_event_t *event) {
 		 */
 		client->pipelined = ISC_FALSE;
 		result = isc_quota_attach(&ns_g_server->tcpquota,
-					  &client->tcpquota);
+					  &client->tcpconn->tcpquota);
 		if (result == ISC_R_SUCCESS)
 			result = ns_client_replace(client);
 		if (result != ISC_R_SUCCESS) {
@@ -2987,6 +3207,7 @@ client_newconn(isc_task_t *task, isc_event_t *event) {
 		} else if (ns_g_server->keepresporder == NULL ||
 			   !allowed(&netaddr, NULL, NULL, 0, NULL,
 				    ns_g_server->keepresporder)) {
+			client->tcpconn->pipelined = ISC_TRUE;
 			client->pipelined = ISC_TRUE;
 		}
 
@@ -3095,7 +3316,7 @@ ns_client_replace(ns_client_t *client) {
 	tcp = TCP_CLIENT(client);
 	if (tcp && client->pipelined) {
 		result = get_worker(client->manager, client->interface,
-				    client->tcpsocket);
+				    client->tcpsocket, client->tcpconn);
 	} else {
 		result = get_client(client->manager, client->interface,
 				    client->dispatch, tcp);
@@ -3134,10 +3355,14 @@ clientmgr_destroy(ns_clientmgr_t *manager) {
 	}
 #endif
 
+	isc_mempool_destroy(&manager->tcpbufpool);
+	isc_mem_detach(&manager->tcpbufmctx);
+
 	ISC_QUEUE_DESTROY(manager->inactive);
 	DESTROYLOCK(&manager->lock);
 	DESTROYLOCK(&manager->listlock);
 	DESTROYLOCK(&manager->reclock);
+	DESTROYLOCK(&manager->tcpbuflock);
 	manager->magic = 0;
 	isc_mem_put(manager->mctx, manager, sizeof(*manager));
 }
@@ -3168,6 +3393,26 @@ ns_clientmgr_create(isc_mem_t *mctx, isc_taskmgr_t *taskmgr,
 	if (result != ISC_R_SUCCESS)
 		goto cleanup_listlock;
 
+	result = isc_mutex_init(&manager->tcpbuflock);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_reclock;
+
+	manager->tcpbufmctx = NULL;
+	result = isc_mem_create(0, 0, &manager->tcpbufmctx);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_tcpbuflock;
+	isc_mem_setname(manager->tcpbufmctx, "clienttcp", NULL);
+
+	manager->tcpbufpool = NULL;
+	result = isc_mempool_create(manager->tcpbufmctx, TCP_BUFFER_SIZE,
+				    &manager->tcpbufpool);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_tcpbufmctx;
+	isc_mempool_setname(manager->tcpbufpool, "tcpbuf");
+	isc_mempool_associatelock(manager->tcpbufpool, &manager->tcpbuflock);
+	isc_mempool_setfillcount(manager->tcpbufpool, 1);
+	isc_mempool_setfreemax(manager->tcpbufpool, TCP_BUFFER_FREEMAX);
+
 	manager->mctx = mctx;
 	manager->taskmgr = taskmgr;
 	manager->timermgr = timermgr;
@@ -3188,6 +3433,15 @@ ns_clientmgr_create(isc_mem_t *mctx, isc_taskmgr_t *taskmgr,
 
 	return (ISC_R_SUCCESS);
 
+ cleanup_tcpbufmctx:
+	isc_mem_detach(&manager->tcpbufmctx);
+
+ cleanup_tcpbuflock:
+	(void) isc_mutex_destroy(&manager->tcpbuflock);
+
+ cleanup_reclock:
+	(void) isc_mutex_destroy(&manager->reclock);
+
  cleanup_listlock:
 	(void) isc_mutex_destroy(&manager->listlock);
 
@@ -3307,11 +3561,13 @@ get_client(ns_clientmgr_t *manager, ns_interface_t *ifp,
 }
 
 static isc_result_t
-get_worker(ns_clientmgr_t *manager, ns_interface_t *ifp, isc_socket_t *sock)
+get_worker(ns_clientmgr_t *manager, ns_interface_t *ifp, isc_socket_t *sock,
+	   ns_tcpconn_t *conn)
 {
 	isc_result_t result = ISC_R_SUCCESS;
 	isc_event_t *ev;
 	ns_client_t *client;
+	ns_tcpconn_t *tcpconn = NULL;
 	MTRACE("get worker");
 
 	REQUIRE(manager != NULL);
@@ -3319,6 +3575,11 @@ get_worker(ns_clientmgr_t *manager, ns_interface_t *ifp, isc_socket_t *sock)
 	if (manager->exiting)
 		return (ISC_R_SHUTTINGDOWN);
 
+	result = tcpconn_attach(conn, ns_g_server->tcppipelinelimit,
+				&tcpconn);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
 	/*
 	 * Allocate a client.  First try to get a recycled one;
 	 * if that fails, make a new one.
@@ -3335,8 +3596,10 @@ get_worker(ns_clientmgr_t *manager, ns_interface_t *ifp, isc_socket_t *sock)
 		LOCK(&manager->lock);
 		result = client_create(manager, &client);
 		UNLOCK(&manager->lock);
-		if (result != ISC_R_SUCCESS)
+		if (result != ISC_R_SUCCESS) {
+			tcpconn_detach(&tcpconn);
 			return (result);
+		}
 
 		LOCK(&manager->listlock);
 		ISC_LIST_APPEND(manager->clients, client, link);
@@ -3347,7 +3610,8 @@ get_worker(ns_clientmgr_t *manager, ns_interface_t *ifp, isc_socket_t *sock)
 	ns_interface_attach(ifp, &client->interface);
 	client->newstate = client->state = NS_CLIENTSTATE_WORKING;
 	INSIST(client->recursionquota == NULL);
-	client->tcpquota = &ns_g_server->tcpquota;
+	INSIST(client->tcpconn == NULL);
+	client->tcpconn = tcpconn;
 
 	client->dscp = ifp->dscp;
 
@@ -3377,7 +3641,7 @@ ns_clientmgr_createclients(ns_clientmgr_t *manager, unsigned int n,
 			   ns_interface_t *ifp, isc_boolean_t tcp)
 {
 	isc_result_t result = ISC_R_SUCCESS;
-	unsigned int disp;
+	unsigned int disp, i;
 
 	REQUIRE(VALID_MANAGER(manager));
 	REQUIRE(n > 0);
@@ -3385,7 +3649,11 @@ ns_clientmgr_createclients(ns_clientmgr_t *manager, unsigned int n,
 	MTRACE("createclients");
 
 	for (disp = 0; disp < n; disp++) {
-		result = get_client(manager, ifp, ifp->udpdispatch[disp], tcp);
+		/*
+		 * UDP clients are spread over the interface's dispatches.
+		 */
+		i = tcp ? disp : disp % ifp->nudpdispatch;
+		result = get_client(manager, ifp, ifp->udpdispatch[i], tcp);
 		if (result != ISC_R_SUCCESS)
 			break;
 	}
@@ -103,6 +103,7 @@ options {\n\
 	resolver-query-timeout 10;\n\
 	rrset-order { order random; };\n\
 #	serial-queries <obsolete>;\n\
+	serial-query-burst 1;\n\
 	serial-query-rate 20;\n\
 	server-id none;\n\
 	startup-notify-rate 20;\n\
@@ -110,6 +111,7 @@ options {\n\
 #	statistics-interval <obsolete>;\n\
 	tcp-clients 150;\n\
 	tcp-listen-queue 10;\n\
+	tcp-pipelining-limit 16;\n\
 #	tkey-dhkey <none>\n\
 #	tkey-gssapi-credential <none>\n\
 #	tkey-domain <none>\n\
@@ -159,8 +161,11 @@ options {\n\
 	servfail-ttl 10;\n\
 	max-ncache-ttl 10800; /* 3 hours */\n\
 	max-cache-ttl 604800; /* 1 week */\n\
+	max-stale-ttl 0;\n\
+	stale-answer-ttl 1;\n\
 	transfer-format many-answers;\n\
 	max-cache-size 0;\n\
+	max-ecs-cache-size 8M;\n\
 	check-names master fail;\n\
 	check-names slave warn;\n\
 	check-names response ignore;\n\
@@ -173,6 +178,7 @@ options {\n\
 	dnssec-enable yes;\n\
 	dnssec-validation yes; \n\
 	dnssec-accept-expired no;\n\
+	dnssec-verify-cache-size 4096;\n\
 	fetches-per-zone 0;\n\
 	fetch-quota-params 100 0.1 0.3 0.7;\n\
 	clients-per-query 10;\n\
@@ -130,13 +130,14 @@ struct ns_client {
 	void 			*shutdown_arg;
 	ns_query_t		query;
 	isc_stdtime_t		requesttime;
+	isc_uint64_t		mallocs;     /*%< At start of request */
 	isc_stdtime_t		now;
 	isc_time_t		tnow;
 	dns_name_t		signername;   /*%< [T]SIG key name */
 	dns_name_t *		signer;	      /*%< NULL if not valid sig */
 	isc_boolean_t		mortal;	      /*%< Die after handling request */
 	isc_boolean_t		pipelined;   /*%< TCP queries not in sequence */
-	isc_quota_t		*tcpquota;
+	ns_tcpconn_t		*tcpconn;    /*%< Shared TCP connection */
 	isc_quota_t		*recursionquota;
 	ns_interface_t		*interface;
 
@@ -302,7 +303,7 @@ ns_clientmgr_createclients(ns_clientmgr_t *manager, unsigned int n,
 /*%
  * Create up to 'n' clients listening on interface 'ifp'.
  * If 'tcp' is ISC_TRUE, the clients will listen for TCP connections,
- * otherwise for UDP requests.
+ * otherwise for UDP requests, spread over the UDP dispatches of 'ifp'.
  */
 
 isc_sockaddr_t *
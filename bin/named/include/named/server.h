@@ -52,6 +52,7 @@ struct ns_server {
 
 	dns_acl_t		*blackholeacl;
 	dns_acl_t		*keepresporder;
+	isc_uint32_t		tcppipelinelimit; /*%< Queries per connection */
 	char *			statsfile;	/*%< Statistics file name */
 	char *			dumpfile;	/*%< Dump file name */
 	char *			secrootsfile;	/*%< Secroots file name */
@@ -76,6 +77,7 @@ struct ns_server {
 	dns_loadmgr_t *		loadmgr;
 	dns_zonemgr_t *		zonemgr;
 	dns_viewlist_t		viewlist;
+	ns_viewtable_t *	viewtable;	/*%< Views by client address */
 	ns_interfacemgr_t *	interfacemgr;
 	dns_db_t *		in_roothints;
 	dns_tkeyctx_t *		tkeyctx;
@@ -202,7 +204,21 @@ enum {
 	dns_nsstatscounter_cookienew = 54,
 	dns_nsstatscounter_badcookie = 55,
 
-	dns_nsstatscounter_max = 56
+	dns_nsstatscounter_reqmalloc = 56,
+
+	dns_nsstatscounter_rpz_clientip_lookups = 57,
+	dns_nsstatscounter_rpz_clientip_hits = 58,
+	dns_nsstatscounter_rpz_qname_lookups = 59,
+	dns_nsstatscounter_rpz_qname_hits = 60,
+	dns_nsstatscounter_rpz_ip_lookups = 61,
+	dns_nsstatscounter_rpz_ip_hits = 62,
+	dns_nsstatscounter_rpz_nsdname_lookups = 63,
+	dns_nsstatscounter_rpz_nsdname_hits = 64,
+	dns_nsstatscounter_rpz_nsip_lookups = 65,
+	dns_nsstatscounter_rpz_nsip_hits = 66,
+	dns_nsstatscounter_rpz_nsmemo_hits = 67,
+
+	dns_nsstatscounter_max = 68
 };
 
 /*%
@@ -29,6 +29,7 @@ typedef ISC_LIST(ns_cache_t)		ns_cachelist_t;
 typedef struct ns_client		ns_client_t;
 typedef struct ns_clientmgr		ns_clientmgr_t;
 typedef struct ns_query			ns_query_t;
+typedef struct ns_tcpconn		ns_tcpconn_t;
 typedef struct ns_server 		ns_server_t;
 typedef struct ns_xmld			ns_xmld_t;
 typedef struct ns_xmldmgr		ns_xmldmgr_t;
@@ -45,6 +46,7 @@ typedef struct ns_dispatch		ns_dispatch_t;
 typedef ISC_LIST(ns_dispatch_t)		ns_dispatchlist_t;
 typedef struct ns_statschannel		ns_statschannel_t;
 typedef ISC_LIST(ns_statschannel_t)	ns_statschannellist_t;
+typedef struct ns_viewtable		ns_viewtable_t;
 
 typedef enum {
 	ns_cookiealg_aes,
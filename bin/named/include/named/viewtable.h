@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2015  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef NAMED_VIEWTABLE_H
+#define NAMED_VIEWTABLE_H 1
+
+/*! \file
+ * \brief
+ * A table that maps a client's source address to the views whose
+ * match-clients ACL could accept it.
+ *
+ * Views are selected by trying each view in turn until one accepts
+ * the query, which costs one ACL evaluation per view tried.  For
+ * views whose match-clients ACL depends on nothing but the source
+ * address, the table records in advance which addresses each such ACL
+ * accepts, so that a single prefix lookup yields the short list of
+ * views that still have to be tried, in configuration order.
+ *
+ * Views whose match-clients ACL refers to keys, "localhost",
+ * "localnets" or GeoIP data appear in every list.  The caller still
+ * checks every view in the list in full; the table only removes views
+ * that could not have accepted the query.
+ */
+
+#include <isc/types.h>
+
+#include <dns/types.h>
+
+#include <named/types.h>
+
+isc_result_t
+ns_viewtable_create(isc_mem_t *mctx, dns_viewlist_t *viewlist,
+		    ns_viewtable_t **tablep);
+/*%<
+ * Build a table for the views in 'viewlist'.  The table holds weak
+ * references to the views, and must be rebuilt whenever 'viewlist'
+ * changes.
+ *
+ * Requires:
+ *\li	'mctx' is a valid memory context.
+ *\li	tablep != NULL && *tablep == NULL
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMEMORY
+ */
+
+void
+ns_viewtable_destroy(ns_viewtable_t **tablep);
+/*%<
+ * Destroy '*tablep', releasing its references to the views.
+ */
+
+void
+ns_viewtable_find(ns_viewtable_t *table, const isc_netaddr_t *addr,
+		  const dns_aclenv_t *env, dns_view_t ***viewsp,
+		  unsigned int *countp);
+/*%<
+ * Set '*viewsp' and '*countp' to the views, in configuration order,
+ * that may accept a query from 'addr' which has no EDNS client subnet
+ * option.  'env' is used to decide whether a mapped IPv4 address is
+ * looked up as an IPv4 address, as dns_acl_match() does.
+ *
+ * The array remains valid until the table is destroyed.
+ */
+
+#endif /* NAMED_VIEWTABLE_H */
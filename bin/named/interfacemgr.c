@@ -62,6 +62,17 @@
 #define UDPBUFFERS 1000
 #endif /* TUNE_LARGE */
 
+/*%
+ * The number of clients waiting for requests on each UDP dispatch.
+ * With more than one, requests that arrive together can be received
+ * by the socket code with a single system call.
+ */
+#ifdef TUNE_LARGE
+#define UDPCLIENTS 16
+#else
+#define UDPCLIENTS 4
+#endif /* TUNE_LARGE */
+
 #define IFMGR_MAGIC			ISC_MAGIC('I', 'F', 'M', 'G')
 #define NS_INTERFACEMGR_VALID(t)	ISC_MAGIC_VALID(t, IFMGR_MAGIC)
 
@@ -459,7 +470,8 @@ ns_interface_listenudp(ns_interface_t *ifp) {
 
 	}
 
-	result = ns_clientmgr_createclients(ifp->clientmgr, ifp->nudpdispatch,
+	result = ns_clientmgr_createclients(ifp->clientmgr,
+					    ifp->nudpdispatch * UDPCLIENTS,
 					    ifp, ISC_FALSE);
 	if (result != ISC_R_SUCCESS) {
 		UNEXPECTED_ERROR(__FILE__, __LINE__,
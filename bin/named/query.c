@@ -37,11 +37,13 @@
 #include <dns/dlz.h>
 #include <dns/dns64.h>
 #include <dns/dnssec.h>
+#include <dns/ecscache.h>
 #include <dns/events.h>
 #include <dns/message.h>
 #include <dns/ncache.h>
 #include <dns/nsec3.h>
 #include <dns/order.h>
+#include <dns/rbt.h>
 #include <dns/rdata.h>
 #include <dns/rdataclass.h>
 #include <dns/rdatalist.h>
@@ -3934,10 +3936,16 @@ query_prefetch(ns_client_t *client, dns_name_t *qname,
 	ns_client_t *dummy = NULL;
 	unsigned int options;
 
-	if (client->query.prefetch != NULL ||
-	    client->view->prefetch_trigger == 0U ||
-	    rdataset->ttl > client->view->prefetch_trigger ||
-	    (rdataset->attributes & DNS_RDATASETATTR_PREFETCH) == 0)
+	/*
+	 * Stale answers are always refreshed; anything else only when
+	 * it is eligible for prefetch and close to expiry.
+	 */
+	if (client->query.prefetch != NULL)
+		return;
+	if ((rdataset->attributes & DNS_RDATASETATTR_STALE) == 0 &&
+	    (client->view->prefetch_trigger == 0U ||
+	     rdataset->ttl > client->view->prefetch_trigger ||
+	     (rdataset->attributes & DNS_RDATASETATTR_PREFETCH) == 0))
 		return;
 
 	if (client->recursionquota == NULL) {
@@ -3972,6 +3980,116 @@ query_prefetch(ns_client_t *client, dns_name_t *qname,
 	dns_rdataset_clearprefetch(rdataset);
 }
 
+/*
+ * Decide whether lookups and queries for 'name' made on behalf of
+ * 'client' use its subnet (see "ecs-zones"), and if so, set '*addr' and
+ * '*bitsp' to the subnet.  The client's own EDNS client subnet option is
+ * used if it sent one; otherwise its source address.  Either way, no
+ * more than 24 bits of an IPv4 address or 56 bits of an IPv6 address
+ * are used, as recommended by RFC 7871.
+ */
+static isc_boolean_t
+query_ecssubnet(ns_client_t *client, dns_name_t *name, isc_netaddr_t *addr,
+		unsigned int *bitsp)
+{
+	dns_view_t *view = client->view;
+	isc_netaddr_t v4;
+	unsigned int bits;
+
+	if (view->ecscache == NULL || !dns_view_isecsname(view, name))
+		return (ISC_FALSE);
+
+	if ((client->attributes & NS_CLIENTATTR_HAVEECS) != 0) {
+		*addr = client->ecs_addr;
+		bits = client->ecs_addrlen;
+	} else {
+		isc_netaddr_fromsockaddr(addr, &client->peeraddr);
+		if (addr->family == AF_INET6 &&
+		    IN6_IS_ADDR_V4MAPPED(&addr->type.in6))
+		{
+			isc_netaddr_fromv4mapped(&v4, addr);
+			*addr = v4;
+		}
+		bits = 128;
+	}
+
+	if (addr->family == AF_INET)
+		bits = ISC_MIN(bits, 24);
+	else if (addr->family == AF_INET6)
+		bits = ISC_MIN(bits, 56);
+	else
+		return (ISC_FALSE);
+
+	/*
+	 * A source prefix length of zero asks us not to reveal anything
+	 * about the client.
+	 */
+	if (bits == 0)
+		return (ISC_FALSE);
+
+	*bitsp = bits;
+	return (ISC_TRUE);
+}
+
+/*
+ * Look for an answer to the current query that is tailored to the
+ * client's subnet.  On success the rdatasets are bound to the ECS cache
+ * entries, '*nodep' is the cache node for the query name, and 'fname'
+ * is set to it, as dns_db_findext() would do.  If the cache has no node
+ * for the query name the answer is not used.
+ */
+static isc_result_t
+query_ecsfind(ns_client_t *client, dns_db_t *db, dns_rdatatype_t type,
+	      dns_dbnode_t **nodep, dns_name_t *fname,
+	      dns_rdataset_t *rdataset, dns_rdataset_t *sigrdataset)
+{
+	dns_name_t *qname = client->query.qname;
+	isc_netaddr_t addr;
+	unsigned int bits;
+	isc_result_t result, tresult;
+
+	if (type == dns_rdatatype_any || type == dns_rdatatype_rrsig ||
+	    type == dns_rdatatype_sig ||
+	    !query_ecssubnet(client, qname, &addr, &bits))
+		return (ISC_R_NOTFOUND);
+
+	result = dns_ecscache_lookup(client->view->ecscache, qname, type,
+				     &addr, bits, client->now,
+				     client->query.dboptions, rdataset,
+				     sigrdataset);
+	if (result == ISC_R_NOTFOUND && type != dns_rdatatype_cname) {
+		result = dns_ecscache_lookup(client->view->ecscache, qname,
+					     dns_rdatatype_cname, &addr, bits,
+					     client->now,
+					     client->query.dboptions,
+					     rdataset, sigrdataset);
+		if (result == ISC_R_SUCCESS)
+			result = DNS_R_CNAME;
+	}
+	if (result != ISC_R_SUCCESS && result != DNS_R_CNAME)
+		return (result);
+
+	/*
+	 * Don't create an empty cache node just to hang the answer on;
+	 * if the name has no node (ISC_R_NOTFOUND) this is a miss.
+	 */
+	tresult = dns_db_findnode(db, qname, ISC_FALSE, nodep);
+	if (tresult == ISC_R_SUCCESS) {
+		tresult = dns_name_copy(qname, fname, NULL);
+		if (tresult != ISC_R_SUCCESS)
+			dns_db_detachnode(db, nodep);
+	}
+	if (tresult != ISC_R_SUCCESS) {
+		dns_rdataset_disassociate(rdataset);
+		if (sigrdataset != NULL &&
+		    dns_rdataset_isassociated(sigrdataset))
+			dns_rdataset_disassociate(sigrdataset);
+		return (ISC_R_NOTFOUND);
+	}
+
+	return (result);
+}
+
 static isc_result_t
 query_recurse(ns_client_t *client, dns_rdatatype_t qtype, dns_name_t *qname,
 	      dns_name_t *qdomain, dns_rdataset_t *nameservers,
@@ -3980,6 +4098,8 @@ query_recurse(ns_client_t *client, dns_rdatatype_t qtype, dns_name_t *qname,
 	isc_result_t result;
 	dns_rdataset_t *rdataset, *sigrdataset;
 	isc_sockaddr_t *peeraddr;
+	isc_netaddr_t ecsaddr;
+	unsigned int ecsbits = 0;
 
 	if (!resuming)
 		inc_stats(client, dns_nsstatscounter_recursion);
@@ -4080,11 +4200,17 @@ query_recurse(ns_client_t *client, dns_rdatatype_t qtype, dns_name_t *qname,
 		peeraddr = &client->peeraddr;
 	else
 		peeraddr = NULL;
-	result = dns_resolver_createfetch3(client->view->resolver,
+	if (qtype == dns_rdatatype_any || qtype == dns_rdatatype_rrsig ||
+	    qtype == dns_rdatatype_sig ||
+	    !query_ecssubnet(client, qname, &ecsaddr, &ecsbits))
+		ecsbits = 0;
+	result = dns_resolver_createfetch4(client->view->resolver,
 					   qname, qtype, qdomain, nameservers,
 					   NULL, peeraddr, client->message->id,
 					   client->query.fetchoptions, 0, NULL,
-					   client->task, query_resume, client,
+					   ecsbits != 0 ? &ecsaddr : NULL,
+					   ecsbits, client->task,
+					   query_resume, client,
 					   rdataset, sigrdataset,
 					   &client->query.fetch);
 
@@ -4613,6 +4739,47 @@ rpz_save_p(dns_rpz_st_t *st, dns_rpz_zone_t *rpz, dns_rpz_type_t rpz_type,
 	st->m.version = version;
 }
 
+/*
+ * Count a search of the summary databases for triggers of a type,
+ * and count it as a hit if it found a policy zone to check.
+ */
+static void
+rpz_count(ns_client_t *client, dns_rpz_type_t rpz_type, isc_boolean_t hit) {
+	isc_statscounter_t lookups, hits;
+
+	switch (rpz_type) {
+	case DNS_RPZ_TYPE_CLIENT_IP:
+		lookups = dns_nsstatscounter_rpz_clientip_lookups;
+		hits = dns_nsstatscounter_rpz_clientip_hits;
+		break;
+	case DNS_RPZ_TYPE_QNAME:
+		lookups = dns_nsstatscounter_rpz_qname_lookups;
+		hits = dns_nsstatscounter_rpz_qname_hits;
+		break;
+	case DNS_RPZ_TYPE_IP:
+		lookups = dns_nsstatscounter_rpz_ip_lookups;
+		hits = dns_nsstatscounter_rpz_ip_hits;
+		break;
+	case DNS_RPZ_TYPE_NSDNAME:
+		lookups = dns_nsstatscounter_rpz_nsdname_lookups;
+		hits = dns_nsstatscounter_rpz_nsdname_hits;
+		break;
+	case DNS_RPZ_TYPE_NSIP:
+		lookups = dns_nsstatscounter_rpz_nsip_lookups;
+		hits = dns_nsstatscounter_rpz_nsip_hits;
+		break;
+	default:
+		INSIST(0);
+		return;
+	}
+
+	isc_stats_increment(ns_g_server->nsstats, lookups);
+	if (hit) {
+		isc_stats_increment(ns_g_server->nsstats, hits);
+		client->query.rpz_st->r.found++;
+	}
+}
+
 /*
  * Check this address in every eligible policy zone.
  */
@@ -4649,6 +4816,8 @@ rpz_rewrite_ip(ns_client_t *client, const isc_netaddr_t *netaddr,
 	while (zbits != 0) {
 		rpz_num = dns_rpz_find_ip(rpzs, rpz_type, zbits, netaddr,
 					  ip_name, &prefix);
+		rpz_count(client, rpz_type,
+			  ISC_TF(rpz_num != DNS_RPZ_INVALID_NUM));
 		if (rpz_num == DNS_RPZ_INVALID_NUM)
 			break;
 		zbits &= (DNS_RPZ_ZMASK(rpz_num) >> 1);
@@ -4947,6 +5116,7 @@ rpz_rewrite_name(ns_client_t *client, dns_name_t *trig_name,
 	 * are matched correctly, and not into their parent.
 	 */
 	zbits = dns_rpz_find_name(rpzs, rpz_type, zbits, trig_name);
+	rpz_count(client, rpz_type, ISC_TF(zbits != 0));
 	if (zbits == 0)
 		return (ISC_R_SUCCESS);
 
@@ -5127,6 +5297,10 @@ rpz_rewrite(ns_client_t *client, dns_rdatatype_t qtype,
 	dns_rpz_have_t have;
 	dns_rpz_popt_t popt;
 	int rpz_ver;
+	unsigned int trig_gen;
+	dns_rpz_zbits_t nsdname_zbits, nsip_zbits;
+	unsigned int found;
+	isc_boolean_t memo;
 
 	CTRACE(ISC_LOG_DEBUG(3), "rpz_rewrite");
 
@@ -5148,6 +5322,7 @@ rpz_rewrite(ns_client_t *client, dns_rdatatype_t qtype,
 	have = rpzs->have;
 	popt = rpzs->p;
 	rpz_ver = rpzs->rpz_ver;
+	trig_gen = rpzs->trig_gen;
 	RWUNLOCK(&rpzs->search_lock, isc_rwlocktype_read);
 
 	if (st == NULL) {
@@ -5173,6 +5348,7 @@ rpz_rewrite(ns_client_t *client, dns_rdatatype_t qtype,
 		st->have = have;
 		st->popt = popt;
 		st->rpz_ver = rpz_ver;
+		st->trig_gen = trig_gen;
 		client->query.rpz_st = st;
 	}
 
@@ -5339,6 +5515,9 @@ rpz_rewrite(ns_client_t *client, dns_rdatatype_t qtype,
 		goto cleanup;
 	}
 
+	nsdname_zbits = 0;
+	nsip_zbits = 0;
+	found = 0;
 	dns_fixedname_init(&nsnamef);
 	dns_name_clone(client->query.qname, dns_fixedname_name(&nsnamef));
 	while (st->r.label > st->popt.min_ns_labels) {
@@ -5352,10 +5531,35 @@ rpz_rewrite(ns_client_t *client, dns_rdatatype_t qtype,
 			dns_name_split(client->query.qname, st->r.label,
 				       NULL, nsname);
 		}
+		memo = ISC_FALSE;
 		if (st->r.ns_rdataset == NULL ||
 		    !dns_rdataset_isassociated(st->r.ns_rdataset))
 		{
 			dns_db_t *db = NULL;
+
+			/*
+			 * Skip a delegation whose name servers recently
+			 * missed all of the policy zones we would check.
+			 * Otherwise remember a miss if all of the checks
+			 * for this delegation are done without recursion.
+			 */
+			nsdname_zbits = rpz_get_zbits(client,
+						      dns_rdatatype_any,
+						      DNS_RPZ_TYPE_NSDNAME);
+			nsip_zbits = rpz_get_zbits(client, dns_rdatatype_any,
+						   DNS_RPZ_TYPE_NSIP);
+			if (dns_rpz_nsmemo_find(rpzs, st->trig_gen, nsname,
+						nsdname_zbits, nsip_zbits,
+						client->now))
+			{
+				isc_stats_increment(ns_g_server->nsstats,
+					dns_nsstatscounter_rpz_nsmemo_hits);
+				st->r.label--;
+				continue;
+			}
+			memo = ISC_TRUE;
+			found = st->r.found;
+
 			result = rpz_rrset_find(client, nsname,
 						dns_rdatatype_ns,
 						DNS_RPZ_TYPE_NSDNAME,
@@ -5458,6 +5662,10 @@ rpz_rewrite(ns_client_t *client, dns_rdatatype_t qtype,
 				       DNS_RPZ_DONE_IPv4);
 			result = dns_rdataset_next(st->r.ns_rdataset);
 		} while (result == ISC_R_SUCCESS);
+		if (memo && st->r.found == found)
+			dns_rpz_nsmemo_add(rpzs, st->trig_gen, nsname,
+					   nsdname_zbits, nsip_zbits,
+					   st->r.ns_rdataset->ttl, client->now);
 		dns_rdataset_disassociate(st->r.ns_rdataset);
 		st->r.label--;
 
@@ -6434,7 +6642,7 @@ query_find(ns_client_t *client, dns_fetchevent_t *event, dns_rdatatype_t qtype)
 	dns_zone_t *zone;
 	dns_rdata_cname_t cname;
 	dns_rdata_dname_t dname;
-	unsigned int options;
+	unsigned int options, dboptions;
 	isc_boolean_t empty_wild;
 	dns_rdataset_t *noqname;
 	dns_rpz_st_t *rpz_st;
@@ -6450,6 +6658,7 @@ query_find(ns_client_t *client, dns_fetchevent_t *event, dns_rdatatype_t qtype)
 	dns_section_t section;
 	dns_ttl_t ttl;
 	isc_boolean_t failcache;
+	unsigned int ecsscope;
 	isc_uint32_t flags;
 
 	CTRACE(ISC_LOG_DEBUG(3), "query_find");
@@ -6830,18 +7039,58 @@ query_find(ns_client_t *client, dns_fetchevent_t *event, dns_rdatatype_t qtype)
 	}
 
 	/*
-	 * Now look for an answer in the database.
-	 */
-	result = dns_db_findext(db, client->query.qname, version, type,
-				client->query.dboptions, client->now,
-				&node, fname, &cm, &ci, rdataset, sigrdataset);
+	 * Now look for an answer in the database.  If the view keeps
+	 * expired cache data, a recursive client is answered from it
+	 * straight away and query_prefetch() refreshes it in the
+	 * background.
+	 */
+	dboptions = client->query.dboptions;
+	if (!is_zone && RECURSIONOK(client) && client->view->maxstalettl > 0)
+		dboptions |= DNS_DBFIND_STALEOK;
+	result = ISC_R_NOTFOUND;
+	if (!is_zone && db == client->view->cachedb)
+		result = query_ecsfind(client, db, type, &node, fname,
+				       rdataset, sigrdataset);
+	if (result != ISC_R_SUCCESS && result != DNS_R_CNAME)
+		result = dns_db_findext(db, client->query.qname, version,
+					type, dboptions, client->now,
+					&node, fname, &cm, &ci, rdataset,
+					sigrdataset);
 
 	if (db == client->view->cachedb)
 		dns_cache_updatestats(client->view->cache, result);
 
+	if (dns_rdataset_isassociated(rdataset) &&
+	    (rdataset->attributes & DNS_RDATASETATTR_STALE) != 0)
+	{
+		char namebuf[DNS_NAME_FORMATSIZE];
+		char typebuf[DNS_RDATATYPE_FORMATSIZE];
+
+		dns_name_format(client->query.qname, namebuf, sizeof(namebuf));
+		dns_rdatatype_format(type, typebuf, sizeof(typebuf));
+		ns_client_log(client, NS_LOGCATEGORY_CLIENT,
+			      NS_LOGMODULE_QUERY, ISC_LOG_DEBUG(1),
+			      "serving stale answer for %s/%s",
+			      namebuf, typebuf);
+		rdataset->ttl = client->view->staleanswerttl;
+		if (sigrdataset != NULL &&
+		    dns_rdataset_isassociated(sigrdataset))
+			sigrdataset->ttl = client->view->staleanswerttl;
+	}
+
  resume:
 	CTRACE(ISC_LOG_DEBUG(3), "query_find: resume");
 
+	/*
+	 * Tell the client when the answer only applies to part of the
+	 * subnet it sent.
+	 */
+	if ((client->attributes & NS_CLIENTATTR_HAVEECS) != 0 &&
+	    rdataset != NULL && dns_rdataset_isassociated(rdataset) &&
+	    dns_ecscache_getscope(rdataset, &ecsscope) &&
+	    ecsscope > client->ecs_scope)
+		client->ecs_scope = ecsscope;
+
 	/*
 	 * Rate limit these responses to this client.
 	 * Do not delay counting and handling obvious referrals,
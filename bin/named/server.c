@@ -67,6 +67,7 @@
 #include <dns/dispatch.h>
 #include <dns/dlz.h>
 #include <dns/dns64.h>
+#include <dns/ecscache.h>
 #include <dns/forward.h>
 #include <dns/journal.h>
 #include <dns/keytable.h>
@@ -77,6 +78,7 @@
 #include <dns/nta.h>
 #include <dns/order.h>
 #include <dns/peer.h>
+#include <dns/popularity.h>
 #include <dns/portlist.h>
 #include <dns/private.h>
 #include <dns/rbt.h>
@@ -88,6 +90,8 @@
 #include <dns/rootns.h>
 #include <dns/rriterator.h>
 #include <dns/secalg.h>
+#include <dns/sigcache.h>
+#include <dns/signpool.h>
 #include <dns/soa.h>
 #include <dns/stats.h>
 #include <dns/tkey.h>
@@ -114,6 +118,7 @@
 #include <named/statschannel.h>
 #include <named/tkeyconf.h>
 #include <named/tsigconf.h>
+#include <named/viewtable.h>
 #include <named/zoneconf.h>
 #ifdef HAVE_LIBSCF
 #include <named/ns_smf_globals.h>
@@ -2052,7 +2057,6 @@ configure_rrl(dns_view_t *view, const cfg_obj_t *config, const cfg_obj_t *map) {
 		CHECK_RRL(i >= 1, "invalid 'qps-scale %d'%s", i, "");
 	}
 	rrl->qps_scale = i;
-	rrl->qps = 1.0;
 
 	i = 24;
 	obj = NULL;
@@ -2849,6 +2853,20 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 	if (view->maxncachettl > 7 * 24 * 3600)
 		view->maxncachettl = 7 * 24 * 3600;
 
+	obj = NULL;
+	result = ns_config_get(maps, "max-stale-ttl", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	view->maxstalettl = cfg_obj_asuint32(obj);
+	if (view->maxstalettl > 7 * 24 * 3600)
+		view->maxstalettl = 7 * 24 * 3600;
+
+	obj = NULL;
+	result = ns_config_get(maps, "stale-answer-ttl", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	view->staleanswerttl = cfg_obj_asuint32(obj);
+	if (view->staleanswerttl == 0)
+		view->staleanswerttl = 1;
+
 	/*
 	 * Configure the view's cache.
 	 *
@@ -2980,6 +2998,7 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 
 	dns_cache_setcleaninginterval(cache, cleaning_interval);
 	dns_cache_setcachesize(cache, max_cache_size);
+	dns_cache_setservestalettl(cache, view->maxstalettl);
 
 	dns_cache_detach(&cache);
 
@@ -3169,6 +3188,77 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 		maxbits = 4096;
 	view->maxbits = maxbits;
 
+	/*
+	 * Remember successful signature verifications.
+	 */
+	obj = NULL;
+	result = ns_config_get(maps, "dnssec-verify-cache-size", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	if (view->enablevalidation && cfg_obj_asuint32(obj) > 0)
+		CHECK(dns_sigcache_create(mctx, cfg_obj_asuint32(obj),
+					  &view->sigcache));
+
+	/*
+	 * Send the client's subnet with queries for names in "ecs-zones",
+	 * and cache the tailored answers apart from the cache database.
+	 * The ECS cache of the previous instance of the view is kept if
+	 * its cache is.
+	 */
+	CHECK(configure_view_nametable(vconfig, config, "ecs-zones", NULL,
+				       mctx, &view->ecszones));
+	if (view->ecszones != NULL) {
+		size_t max_ecs_cache_size;
+
+		obj = NULL;
+		result = ns_config_get(maps, "max-ecs-cache-size", &obj);
+		INSIST(result == ISC_R_SUCCESS);
+		if (cfg_obj_isstring(obj)) {
+			str = cfg_obj_asstring(obj);
+			INSIST(strcasecmp(str, "unlimited") == 0);
+			max_ecs_cache_size = 0;
+		} else {
+			isc_resourcevalue_t value;
+			value = cfg_obj_asuint64(obj);
+			if (value > SIZE_MAX) {
+				cfg_obj_log(obj, ns_g_lctx,
+					    ISC_LOG_WARNING,
+					    "'max-ecs-cache-size "
+					    "%" ISC_PRINT_QUADFORMAT "u' "
+					    "is too large for this "
+					    "system; reducing to %lu",
+					    value, (unsigned long)SIZE_MAX);
+				value = SIZE_MAX;
+			}
+			max_ecs_cache_size = (size_t) value;
+		}
+
+		result = dns_viewlist_find(&ns_g_server->viewlist,
+					   view->name, view->rdclass, &pview);
+		if (result != ISC_R_NOTFOUND && result != ISC_R_SUCCESS)
+			goto cleanup;
+		if (pview != NULL) {
+			if (pview->ecscache != NULL &&
+			    pview->cache == view->cache)
+				dns_ecscache_attach(pview->ecscache,
+						    &view->ecscache);
+			dns_view_detach(&pview);
+		}
+		if (view->ecscache != NULL)
+			dns_ecscache_setmaxsize(view->ecscache,
+						max_ecs_cache_size);
+		else
+			CHECK(dns_ecscache_create(mctx, max_ecs_cache_size,
+						  &view->ecscache));
+	}
+
+	/*
+	 * Run DNSSEC signature verifications on their own tasks rather
+	 * than on the resolver's.
+	 */
+	if (view->enablevalidation)
+		CHECK(dns_view_createverifytasks(view, ns_g_taskmgr,
+						 ns_g_cpus));
+
 	/*
 	 * Set supported DNSSEC algorithms.
 	 */
@@ -3643,6 +3733,47 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 			view->prefetch_eligible = view->prefetch_trigger + 6;
 	}
 
+	obj = NULL;
+	result = ns_config_get(maps, "prefetch-popular", &obj);
+	if (result == ISC_R_SUCCESS) {
+		const cfg_obj_t *count, *rate;
+		dns_popularity_t *pop = NULL;
+		isc_uint32_t popcount, poprate = 20;
+
+		count = cfg_tuple_get(obj, "count");
+		popcount = cfg_obj_asuint32(count);
+		if (popcount > 1000) {
+			cfg_obj_log(count, ns_g_lctx, ISC_LOG_WARNING,
+				    "prefetch-popular %u is too large, "
+				    "using 1000", popcount);
+			popcount = 1000;
+		}
+		rate = cfg_tuple_get(obj, "rate");
+		if (cfg_obj_isuint32(rate))
+			poprate = cfg_obj_asuint32(rate);
+		if (popcount > 0 && poprate > 0 &&
+		    dns_cache_getpopularity(view->cache) == NULL)
+		{
+			CHECK(dns_popularity_create(mctx, popcount, &pop));
+			result = dns_cache_setpopularity(view->cache, pop);
+			dns_popularity_detach(&pop);
+			if (result != ISC_R_SUCCESS && result != ISC_R_EXISTS)
+				goto cleanup;
+		}
+		pop = dns_cache_getpopularity(view->cache);
+		if (pop != NULL && popcount > dns_popularity_hotsize(pop)) {
+			cfg_obj_log(count, ns_g_lctx, ISC_LOG_WARNING,
+				    "prefetch-popular %u is larger than the "
+				    "%u records tracked by the existing "
+				    "cache, using %u", popcount,
+				    dns_popularity_hotsize(pop),
+				    dns_popularity_hotsize(pop));
+			popcount = dns_popularity_hotsize(pop);
+		}
+		CHECK(dns_resolver_setpopularprefetch(view->resolver, pop,
+						      popcount, poprate));
+	}
+
 	obj = NULL;
 	result = ns_config_get(maps, "dnssec-enable", &obj);
 	INSIST(result == ISC_R_SUCCESS);
@@ -5565,6 +5696,7 @@ load_configuration(const char *filename, ns_server_t *server,
 	dns_view_t *view_next;
 	dns_viewlist_t tmpviewlist;
 	dns_viewlist_t viewlist, builtin_viewlist;
+	ns_viewtable_t *viewtable = NULL, *tmpviewtable;
 	in_port_t listen_port, udpport_low, udpport_high;
 	int i;
 	int num_zones = 0;
@@ -5806,6 +5938,11 @@ load_configuration(const char *filename, ns_server_t *server,
 				 ns_g_aclconfctx, ns_g_mctx,
 				 &server->keepresporder));
 
+	obj = NULL;
+	result = ns_config_get(maps, "tcp-pipelining-limit", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	server->tcppipelinelimit = cfg_obj_asuint32(obj);
+
 	obj = NULL;
 	result = ns_config_get(maps, "match-mapped-addresses", &obj);
 	INSIST(result == ISC_R_SUCCESS);
@@ -5916,6 +6053,12 @@ load_configuration(const char *filename, ns_server_t *server,
 	INSIST(result == ISC_R_SUCCESS);
 	dns_zonemgr_setserialqueryrate(server->zonemgr, cfg_obj_asuint32(obj));
 
+	obj = NULL;
+	result = ns_config_get(maps, "serial-query-burst", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	dns_zonemgr_setserialqueryburst(server->zonemgr,
+					cfg_obj_asuint32(obj));
+
 	/*
 	 * Determine which port to use for listening for incoming connections.
 	 */
@@ -6223,11 +6366,19 @@ load_configuration(const char *filename, ns_server_t *server,
 	/* Now combine the two viewlists into one */
 	ISC_LIST_APPENDLIST(viewlist, builtin_viewlist, link);
 
+	/* Index the new views by the client addresses they match. */
+	CHECKM(ns_viewtable_create(ns_g_mctx, &viewlist, &viewtable),
+	       "building view table");
+
 	/* Swap our new view list with the production one. */
 	tmpviewlist = server->viewlist;
 	server->viewlist = viewlist;
 	viewlist = tmpviewlist;
 
+	tmpviewtable = server->viewtable;
+	server->viewtable = viewtable;
+	viewtable = tmpviewtable;
+
 	/* Make the view list available to each of the views */
 	view = ISC_LIST_HEAD(server->viewlist);
 	while (view != NULL) {
@@ -6587,6 +6738,9 @@ load_configuration(const char *filename, ns_server_t *server,
 
 	ISC_LIST_APPENDLIST(viewlist, builtin_viewlist, link);
 
+	if (viewtable != NULL)
+		ns_viewtable_destroy(&viewtable);
+
 	/*
 	 * This cleans up either the old production view list
 	 * or our temporary list depending on whether they
@@ -6871,6 +7025,9 @@ shutdown_server(isc_task_t *task, isc_event_t *event) {
 
 	(void) ns_server_saventa(server);
 
+	if (server->viewtable != NULL)
+		ns_viewtable_destroy(&server->viewtable);
+
 	for (view = ISC_LIST_HEAD(server->viewlist);
 	     view != NULL;
 	     view = view_next) {
@@ -6926,6 +7083,7 @@ shutdown_server(isc_task_t *task, isc_event_t *event) {
 void
 ns_server_create(isc_mem_t *mctx, ns_server_t **serverp) {
 	isc_result_t result;
+	dns_signpool_t *signpool;
 	ns_server_t *server = isc_mem_get(mctx, sizeof(*server));
 
 	if (server == NULL)
@@ -6955,9 +7113,11 @@ ns_server_create(isc_mem_t *mctx, ns_server_t **serverp) {
 	server->zonemgr = NULL;
 	server->interfacemgr = NULL;
 	ISC_LIST_INIT(server->viewlist);
+	server->viewtable = NULL;
 	server->in_roothints = NULL;
 	server->blackholeacl = NULL;
 	server->keepresporder = NULL;
+	server->tcppipelinelimit = 16;
 
 	/* Must be first. */
 	CHECKFATAL(dst_lib_init2(ns_g_mctx, ns_g_entropy,
@@ -7012,6 +7172,16 @@ ns_server_create(isc_mem_t *mctx, ns_server_t **serverp) {
 	CHECKFATAL(dns_zonemgr_setsize(server->zonemgr, 1000),
 		   "dns_zonemgr_setsize");
 
+	/*
+	 * The task signing an update works on its own batch, so one
+	 * thread fewer than the number of CPUs keeps them all busy.
+	 */
+	signpool = NULL;
+	CHECKFATAL(dns_signpool_create(ns_g_mctx, ns_g_cpus - 1, &signpool),
+		   "dns_signpool_create");
+	dns_zonemgr_setsignpool(server->zonemgr, signpool);
+	dns_signpool_detach(&signpool);
+
 	server->statsfile = isc_mem_strdup(server->mctx, "named.stats");
 	CHECKFATAL(server->statsfile == NULL ? ISC_R_NOMEMORY : ISC_R_SUCCESS,
 		   "isc_mem_strdup");
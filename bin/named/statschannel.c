@@ -255,6 +255,41 @@ init_desc(void) {
 		"resulted in a successful remote lookup",
 		"QryNXRedirRLookup");
 	SET_NSSTATDESC(badcookie, "sent badcookie response", "QryBADCOOKIE");
+	SET_NSSTATDESC(reqmalloc, "requests that needed more heap memory",
+		       "ReqHeapAlloc");
+	SET_NSSTATDESC(rpz_clientip_lookups,
+		       "response policy client IP trigger searches",
+		       "RPZClientIPLookups");
+	SET_NSSTATDESC(rpz_clientip_hits,
+		       "response policy client IP trigger search hits",
+		       "RPZClientIPHits");
+	SET_NSSTATDESC(rpz_qname_lookups,
+		       "response policy QNAME trigger searches",
+		       "RPZQNAMELookups");
+	SET_NSSTATDESC(rpz_qname_hits,
+		       "response policy QNAME trigger search hits",
+		       "RPZQNAMEHits");
+	SET_NSSTATDESC(rpz_ip_lookups,
+		       "response policy IP trigger searches",
+		       "RPZIPLookups");
+	SET_NSSTATDESC(rpz_ip_hits,
+		       "response policy IP trigger search hits",
+		       "RPZIPHits");
+	SET_NSSTATDESC(rpz_nsdname_lookups,
+		       "response policy NSDNAME trigger searches",
+		       "RPZNSDNAMELookups");
+	SET_NSSTATDESC(rpz_nsdname_hits,
+		       "response policy NSDNAME trigger search hits",
+		       "RPZNSDNAMEHits");
+	SET_NSSTATDESC(rpz_nsip_lookups,
+		       "response policy NSIP trigger searches",
+		       "RPZNSIPLookups");
+	SET_NSSTATDESC(rpz_nsip_hits,
+		       "response policy NSIP trigger search hits",
+		       "RPZNSIPHits");
+	SET_NSSTATDESC(rpz_nsmemo_hits,
+		       "response policy NS checks skipped after a recent miss",
+		       "RPZNSMemoHits");
 	INSIST(i == dns_nsstatscounter_max);
 
 	/* Initialize resolver statistics */
@@ -3119,7 +3119,6 @@ update_action(isc_task_t *task, isc_event_t *event) {
 	 */
 	if (! ISC_LIST_EMPTY(diff.tuples)) {
 		char *journalfile;
-		dns_journal_t *journal;
 		isc_boolean_t has_dnskey;
 
 		/*
@@ -3194,19 +3193,14 @@ update_action(isc_task_t *task, isc_event_t *event) {
 			update_log(client, zone, LOGLEVEL_DEBUG,
 				   "writing journal %s", journalfile);
 
-			journal = NULL;
-			result = dns_journal_open(mctx, journalfile,
-						  DNS_JOURNAL_CREATE, &journal);
+			/*
+			 * The journal is committed to stable storage
+			 * together with those of other updates to this
+			 * zone; the response waits for that below.
+			 */
+			result = dns_zone_journalwrite(zone, &diff);
 			if (result != ISC_R_SUCCESS)
-				FAILS(result, "journal open failed");
-
-			result = dns_journal_write_transaction(journal, &diff);
-			if (result != ISC_R_SUCCESS) {
-				dns_journal_destroy(&journal);
 				FAILS(result, "journal write failed");
-			}
-
-			dns_journal_destroy(&journal);
 		}
 
 		/*
@@ -3332,7 +3326,10 @@ update_action(isc_task_t *task, isc_event_t *event) {
 		INSIST(uev->zone == zone); /* we use this later */
 	uev->ev_type = DNS_EVENT_UPDATEDONE;
 	uev->ev_action = updatedone_action;
-	isc_task_send(client->task, &event);
+	if (zone != NULL)
+		dns_zone_journalwait(zone, client->task, &event);
+	else
+		isc_task_send(client->task, &event);
 
 	INSIST(ver == NULL);
 	INSIST(event == NULL);
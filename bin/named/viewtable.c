@@ -0,0 +1,458 @@
+/*
+ * Copyright (C) 2015  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <stdlib.h>
+
+#include <isc/magic.h>
+#include <isc/mem.h>
+#include <isc/netaddr.h>
+#include <isc/radix.h>
+#include <isc/string.h>
+#include <isc/util.h>
+
+#include <dns/acl.h>
+#include <dns/iptable.h>
+#include <dns/view.h>
+
+#include <named/viewtable.h>
+
+#define VIEWTABLE_MAGIC			ISC_MAGIC('V', 'w', 'T', 'b')
+#define VALID_VIEWTABLE(t)		ISC_MAGIC_VALID(t, VIEWTABLE_MAGIC)
+
+/*%
+ * A list of candidate views, in configuration order.
+ */
+typedef struct viewset viewset_t;
+
+struct viewset {
+	dns_view_t		**views;
+	unsigned int		count;
+	ISC_LINK(viewset_t)	link;
+};
+
+/*%
+ * A prefix found in one of the match-clients ACLs.
+ */
+typedef struct vprefix {
+	unsigned char		addr[16];
+	unsigned int		family;
+	unsigned int		bitlen;
+} vprefix_t;
+
+struct ns_viewtable {
+	unsigned int		magic;
+	isc_mem_t		*mctx;
+	dns_view_t		**views;	/* weak references */
+	unsigned int		nviews;
+	isc_radix_tree_t	*radix;		/* NULL if no view qualifies */
+	viewset_t		*all;		/* every view */
+	viewset_t		*other;		/* addresses not in 'radix' */
+	ISC_LIST(viewset_t)	sets;
+};
+
+/*
+ * Whether a query can only be accepted by 'view' if its source address
+ * is accepted by a match-clients ACL that depends on nothing else.
+ */
+static isc_boolean_t
+addressonly(dns_view_t *view) {
+	return (ISC_TF(view->matchclients != NULL &&
+		       dns_acl_isaddressonly(view->matchclients)));
+}
+
+static void
+prefix_tonetaddr(const vprefix_t *p, isc_netaddr_t *na) {
+	memset(na, 0, sizeof(*na));
+	na->family = p->family;
+	if (p->family == AF_INET6)
+		memmove(&na->type.in6, p->addr, 16);
+	else
+		memmove(&na->type.in, p->addr, 4);
+}
+
+static isc_result_t
+addprefix(isc_mem_t *mctx, vprefix_t **prefixesp, unsigned int *countp,
+	  unsigned int *allocp, isc_prefix_t *prefix, unsigned int family)
+{
+	vprefix_t *p;
+
+	if (*countp == *allocp) {
+		unsigned int alloc = (*allocp == 0) ? 16 : *allocp * 2;
+
+		p = isc_mem_get(mctx, alloc * sizeof(vprefix_t));
+		if (p == NULL)
+			return (ISC_R_NOMEMORY);
+		if (*prefixesp != NULL) {
+			memmove(p, *prefixesp, *countp * sizeof(vprefix_t));
+			isc_mem_put(mctx, *prefixesp,
+				    *allocp * sizeof(vprefix_t));
+		}
+		*prefixesp = p;
+		*allocp = alloc;
+	}
+
+	p = &(*prefixesp)[(*countp)++];
+	memset(p->addr, 0, sizeof(p->addr));
+	memmove(p->addr, isc_prefix_touchar(prefix),
+		(prefix->family == AF_INET6) ? 16 : 4);
+	p->family = family;
+	p->bitlen = prefix->bitlen;
+	return (ISC_R_SUCCESS);
+}
+
+/*
+ * Add the prefixes of 'acl' and of the ACLs nested in it to
+ * '*prefixesp'.
+ */
+static isc_result_t
+collect(isc_mem_t *mctx, dns_acl_t *acl, vprefix_t **prefixesp,
+	unsigned int *countp, unsigned int *allocp)
+{
+	isc_radix_node_t *node;
+	isc_result_t result;
+	unsigned int i;
+
+	RADIX_WALK(acl->iptable->radix->head, node) {
+		if (node->node_num[0] != -1) {
+			result = addprefix(mctx, prefixesp, countp, allocp,
+					   node->prefix, AF_INET);
+			if (result != ISC_R_SUCCESS)
+				return (result);
+		}
+		if (node->node_num[1] != -1) {
+			result = addprefix(mctx, prefixesp, countp, allocp,
+					   node->prefix, AF_INET6);
+			if (result != ISC_R_SUCCESS)
+				return (result);
+		}
+	} RADIX_WALK_END;
+
+	for (i = 0; i < acl->length; i++) {
+		result = collect(mctx, acl->elements[i].nestedacl,
+				 prefixesp, countp, allocp);
+		if (result != ISC_R_SUCCESS)
+			return (result);
+	}
+	return (ISC_R_SUCCESS);
+}
+
+static int
+compare_bitlen(const void *a, const void *b) {
+	const vprefix_t *pa = a, *pb = b;
+
+	/* Longest first. */
+	if (pa->bitlen > pb->bitlen)
+		return (-1);
+	if (pa->bitlen < pb->bitlen)
+		return (1);
+	return (0);
+}
+
+/*
+ * Make a view set holding the views of 'table' that may accept a query
+ * from an address beginning with the first 'bitlen' bits of 'addr',
+ * given that the address matches no longer prefix in the table; with
+ * 'addr' NULL, the views that may accept a query from an address that
+ * matches no prefix in the table at all.  Views not marked in 'pure'
+ * are always included; with 'pure' NULL, every view is.
+ */
+static isc_result_t
+makeset(ns_viewtable_t *table, const isc_boolean_t *pure,
+	const isc_netaddr_t *addr, unsigned int bitlen, dns_view_t **scratch,
+	viewset_t **setp)
+{
+	viewset_t *set;
+	unsigned int i, count = 0;
+	int match;
+
+	for (i = 0; i < table->nviews; i++) {
+		if (pure != NULL && pure[i]) {
+			if (addr == NULL)
+				continue;
+			(void)dns_acl_matchprefix(addr, bitlen,
+						  table->views[i]->matchclients,
+						  &match);
+			if (match <= 0)
+				continue;
+		}
+		scratch[count++] = table->views[i];
+	}
+
+	set = isc_mem_get(table->mctx, sizeof(*set));
+	if (set == NULL)
+		return (ISC_R_NOMEMORY);
+	set->views = NULL;
+	set->count = count;
+	ISC_LINK_INIT(set, link);
+	if (count > 0) {
+		set->views = isc_mem_get(table->mctx,
+					 count * sizeof(dns_view_t *));
+		if (set->views == NULL) {
+			isc_mem_put(table->mctx, set, sizeof(*set));
+			return (ISC_R_NOMEMORY);
+		}
+		memmove(set->views, scratch, count * sizeof(dns_view_t *));
+	}
+	ISC_LIST_APPEND(table->sets, set, link);
+
+	*setp = set;
+	return (ISC_R_SUCCESS);
+}
+
+/*
+ * Build the prefix table for the views marked in 'pure'.
+ */
+static isc_result_t
+build(ns_viewtable_t *table, const isc_boolean_t *pure, dns_view_t **scratch)
+{
+	vprefix_t *prefixes = NULL;
+	unsigned int i, count = 0, alloc = 0;
+	isc_radix_node_t *node;
+	isc_netaddr_t na;
+	isc_prefix_t pfx;
+	isc_result_t result = ISC_R_SUCCESS;
+	int off;
+
+	for (i = 0; i < table->nviews; i++) {
+		if (!pure[i])
+			continue;
+		result = collect(table->mctx, table->views[i]->matchclients,
+				 &prefixes, &count, &alloc);
+		if (result != ISC_R_SUCCESS)
+			goto cleanup;
+	}
+
+	result = isc_radix_create(table->mctx, &table->radix, RADIX_MAXBITS);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
+
+	/*
+	 * isc_radix_search() prefers the matching node that was added
+	 * first, so adding the longest prefixes first makes it find the
+	 * longest match.
+	 */
+	if (count > 1)
+		qsort(prefixes, count, sizeof(vprefix_t), compare_bitlen);
+	for (i = 0; i < count; i++) {
+		node = NULL;
+		prefix_tonetaddr(&prefixes[i], &na);
+		NETADDR_TO_PREFIX_T(&na, pfx, prefixes[i].bitlen, ISC_FALSE);
+		result = isc_radix_insert(table->radix, &node, NULL, &pfx);
+		isc_refcount_destroy(&pfx.refcount);
+		if (result != ISC_R_SUCCESS)
+			goto cleanup;
+	}
+
+	/*
+	 * Every address whose longest match in the table is a given
+	 * prefix lies inside exactly the same ACL prefixes, so each
+	 * ACL treats all of them alike.
+	 */
+	RADIX_WALK(table->radix->head, node) {
+		for (off = 0; off < 2; off++) {
+			vprefix_t p;
+
+			if (node->node_num[off] == -1)
+				continue;
+			memset(p.addr, 0, sizeof(p.addr));
+			memmove(p.addr, isc_prefix_touchar(node->prefix),
+				(node->prefix->family == AF_INET6) ? 16 : 4);
+			p.family = (off == 0) ? AF_INET : AF_INET6;
+			prefix_tonetaddr(&p, &na);
+			result = makeset(table, pure, &na,
+					 node->prefix->bitlen, scratch,
+					 (viewset_t **)&node->data[off]);
+			if (result != ISC_R_SUCCESS)
+				goto cleanup;
+		}
+	} RADIX_WALK_END;
+
+ cleanup:
+	if (prefixes != NULL)
+		isc_mem_put(table->mctx, prefixes, alloc * sizeof(vprefix_t));
+	return (result);
+}
+
+static void
+freesets(ns_viewtable_t *table) {
+	viewset_t *set;
+
+	while ((set = ISC_LIST_HEAD(table->sets)) != NULL) {
+		ISC_LIST_UNLINK(table->sets, set, link);
+		if (set->views != NULL)
+			isc_mem_put(table->mctx, set->views,
+				    set->count * sizeof(dns_view_t *));
+		isc_mem_put(table->mctx, set, sizeof(*set));
+	}
+}
+
+isc_result_t
+ns_viewtable_create(isc_mem_t *mctx, dns_viewlist_t *viewlist,
+		    ns_viewtable_t **tablep)
+{
+	ns_viewtable_t *table;
+	dns_view_t *view, **scratch = NULL;
+	isc_boolean_t *pure = NULL, anypure = ISC_FALSE;
+	isc_result_t result;
+	unsigned int i, n = 0;
+
+	REQUIRE(mctx != NULL);
+	REQUIRE(viewlist != NULL);
+	REQUIRE(tablep != NULL && *tablep == NULL);
+
+	for (view = ISC_LIST_HEAD(*viewlist);
+	     view != NULL;
+	     view = ISC_LIST_NEXT(view, link))
+		n++;
+
+	table = isc_mem_get(mctx, sizeof(*table));
+	if (table == NULL)
+		return (ISC_R_NOMEMORY);
+	table->mctx = NULL;
+	isc_mem_attach(mctx, &table->mctx);
+	table->views = NULL;
+	table->nviews = 0;
+	table->radix = NULL;
+	table->all = NULL;
+	table->other = NULL;
+	ISC_LIST_INIT(table->sets);
+	table->magic = VIEWTABLE_MAGIC;
+
+	if (n > 0) {
+		table->views = isc_mem_get(mctx, n * sizeof(dns_view_t *));
+		if (table->views == NULL) {
+			result = ISC_R_NOMEMORY;
+			goto cleanup;
+		}
+	}
+	for (view = ISC_LIST_HEAD(*viewlist);
+	     view != NULL;
+	     view = ISC_LIST_NEXT(view, link))
+	{
+		i = table->nviews++;
+		table->views[i] = NULL;
+		dns_view_weakattach(view, &table->views[i]);
+	}
+
+	if (n > 0) {
+		pure = isc_mem_get(mctx, n * sizeof(isc_boolean_t));
+		scratch = isc_mem_get(mctx, n * sizeof(dns_view_t *));
+		if (pure == NULL || scratch == NULL) {
+			result = ISC_R_NOMEMORY;
+			goto cleanup;
+		}
+	}
+	for (i = 0; i < n; i++) {
+		pure[i] = addressonly(table->views[i]);
+		if (pure[i])
+			anypure = ISC_TRUE;
+	}
+
+	result = makeset(table, NULL, NULL, 0, scratch, &table->all);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
+
+	if (anypure) {
+		result = makeset(table, pure, NULL, 0, scratch,
+				 &table->other);
+		if (result != ISC_R_SUCCESS)
+			goto cleanup;
+		result = build(table, pure, scratch);
+		if (result != ISC_R_SUCCESS)
+			goto cleanup;
+	}
+
+	*tablep = table;
+	result = ISC_R_SUCCESS;
+	table = NULL;
+
+ cleanup:
+	if (pure != NULL)
+		isc_mem_put(mctx, pure, n * sizeof(isc_boolean_t));
+	if (scratch != NULL)
+		isc_mem_put(mctx, scratch, n * sizeof(dns_view_t *));
+	if (table != NULL)
+		ns_viewtable_destroy(&table);
+	return (result);
+}
+
+void
+ns_viewtable_destroy(ns_viewtable_t **tablep) {
+	ns_viewtable_t *table;
+	unsigned int i;
+
+	REQUIRE(tablep != NULL);
+	table = *tablep;
+	*tablep = NULL;
+	REQUIRE(VALID_VIEWTABLE(table));
+
+	table->magic = 0;
+	if (table->radix != NULL)
+		isc_radix_destroy(table->radix, NULL);
+	freesets(table);
+	for (i = 0; i < table->nviews; i++)
+		dns_view_weakdetach(&table->views[i]);
+	if (table->views != NULL)
+		isc_mem_put(table->mctx, table->views,
+			    table->nviews * sizeof(dns_view_t *));
+	isc_mem_putanddetach(&table->mctx, table, sizeof(*table));
+}
+
+void
+ns_viewtable_find(ns_viewtable_t *table, const isc_netaddr_t *addr,
+		  const dns_aclenv_t *env, dns_view_t ***viewsp,
+		  unsigned int *countp)
+{
+	const viewset_t *set;
+	isc_netaddr_t v4addr;
+	isc_radix_node_t *node = NULL;
+	isc_prefix_t pfx;
+	isc_result_t result;
+
+	REQUIRE(VALID_VIEWTABLE(table));
+	REQUIRE(addr != NULL);
+	REQUIRE(viewsp != NULL && countp != NULL);
+
+	if (env != NULL && env->match_mapped &&
+	    addr->family == AF_INET6 &&
+	    IN6_IS_ADDR_V4MAPPED(&addr->type.in6))
+	{
+		isc_netaddr_fromv4mapped(&v4addr, addr);
+		addr = &v4addr;
+	}
+
+	if (table->radix == NULL ||
+	    (addr->family != AF_INET && addr->family != AF_INET6))
+		set = table->all;
+	else {
+		NETADDR_TO_PREFIX_T(addr, pfx,
+				    (addr->family == AF_INET6) ? 128 : 32,
+				    ISC_FALSE);
+		result = isc_radix_search(table->radix, &node, &pfx);
+		if (result == ISC_R_SUCCESS && node != NULL)
+			set = node->data[ISC_RADIX_OFF(&pfx)];
+		else
+			set = table->other;
+		isc_refcount_destroy(&pfx.refcount);
+	}
+
+	*viewsp = set->views;
+	*countp = set->count;
+}
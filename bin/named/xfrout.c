@@ -1289,11 +1289,10 @@ sendstream(xfrout_ctx_t *xfr) {
 		CHECK(dns_message_reply(msg, ISC_TRUE));
 	} else {
 		/*
-		 * TCP. Build a response dns_message_t, temporarily storing
-		 * the raw, uncompressed owner names and RR data contiguously
-		 * in xfr->buf.  We know that if the uncompressed data fits
-		 * in xfr->buf, the compressed data will surely fit in a TCP
-		 * message.
+		 * TCP. Build a response dns_message_t holding just the
+		 * question, if any, and start rendering it into xfr->txbuf.
+		 * The RRs are then rendered one at a time straight from the
+		 * database, without being copied into the message first.
 		 */
 
 		CHECK(dns_message_create(xfr->mctx,
@@ -1325,12 +1324,8 @@ sendstream(xfrout_ctx_t *xfr) {
 			xfr->client->attributes &= ~NS_CLIENTATTR_HAVEEXPIRE;
 		}
 
-		/*
-		 * Account for reserved space.
-		 */
 		if (xfr->tsigkey != NULL)
 			INSIST(msg->reserved != 0U);
-		isc_buffer_add(&xfr->buf, msg->reserved);
 
 		/*
 		 * Include a question section in the first message only.
@@ -1341,12 +1336,6 @@ sendstream(xfrout_ctx_t *xfr) {
 			dns_name_t *qname = NULL;
 			isc_region_t r;
 
-			/*
-			 * Reserve space for the 12-byte message header
-			 * and 4 bytes of question.
-			 */
-			isc_buffer_add(&xfr->buf, 12 + 4);
-
 			qrdataset = NULL;
 			result = dns_message_gettemprdataset(msg, &qrdataset);
 			if (result != ISC_R_SUCCESS)
@@ -1369,13 +1358,14 @@ sendstream(xfrout_ctx_t *xfr) {
 			ISC_LIST_APPEND(qname->list, qrdataset, link);
 
 			dns_message_addname(msg, qname, DNS_SECTION_QUESTION);
-		} else {
-			/*
-			 * Reserve space for the 12-byte message header
-			 */
-			isc_buffer_add(&xfr->buf, 12);
+		} else
 			msg->tcp_continuation = 1;
-		}
+
+		CHECK(dns_compress_init(&cctx, -1, xfr->mctx));
+		dns_compress_setsensitive(&cctx, ISC_TRUE);
+		cleanup_cctx = ISC_TRUE;
+		CHECK(dns_message_renderbegin(msg, &cctx, &xfr->txbuf));
+		CHECK(dns_message_rendersection(msg, DNS_SECTION_QUESTION, 0));
 	}
 
 	/*
@@ -1398,6 +1388,32 @@ sendstream(xfrout_ctx_t *xfr) {
 		xfr->stream->methods->current(xfr->stream,
 					      &name, &ttl, &rdata);
 		size = name->length + 10 + rdata->length;
+
+		if (tcpmsg != NULL) {
+			/*
+			 * If the RR does not fit, and there are other RRs
+			 * in the message, send them now and leave this RR
+			 * to the next message.  If this RR overflows an
+			 * empty message all by itself, fail.
+			 */
+			result = dns_message_renderrr(msg, DNS_SECTION_ANSWER,
+						      name, ttl, rdata);
+			if (result == ISC_R_NOSPACE && n_rrs != 0)
+				break;
+			if (result == ISC_R_NOSPACE) {
+				xfrout_log(xfr, ISC_LOG_WARNING,
+					   "RR too large for zone transfer "
+					   "(%d bytes)", size);
+				/* XXX DNS_R_RRTOOLARGE? */
+				goto failure;
+			}
+			CHECK(result);
+
+			if (isc_log_wouldlog(ns_g_lctx, XFROUT_RR_LOGLEVEL))
+				log_rr(name, rdata, ttl); /* XXX */
+			goto next;
+		}
+
 		isc_buffer_availableregion(&xfr->buf, &r);
 		if (size >= r.length) {
 			/*
@@ -1473,6 +1489,7 @@ sendstream(xfrout_ctx_t *xfr) {
 		dns_message_addname(msg, msgname, DNS_SECTION_ANSWER);
 		msgname = NULL;
 
+	 next:
 		result = xfr->stream->methods->next(xfr->stream);
 		if (result == ISC_R_NOMORE) {
 			xfr->end_of_stream = ISC_TRUE;
@@ -1485,12 +1502,6 @@ sendstream(xfrout_ctx_t *xfr) {
 	}
 
 	if ((xfr->client->attributes & NS_CLIENTATTR_TCP) != 0) {
-		CHECK(dns_compress_init(&cctx, -1, xfr->mctx));
-		dns_compress_setsensitive(&cctx, ISC_TRUE);
-		cleanup_cctx = ISC_TRUE;
-		CHECK(dns_message_renderbegin(msg, &cctx, &xfr->txbuf));
-		CHECK(dns_message_rendersection(msg, DNS_SECTION_QUESTION, 0));
-		CHECK(dns_message_rendersection(msg, DNS_SECTION_ANSWER, 0));
 		CHECK(dns_message_renderend(msg));
 		dns_compress_invalidate(&cctx);
 		cleanup_cctx = ISC_FALSE;
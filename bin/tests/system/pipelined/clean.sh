@@ -17,4 +17,5 @@
 rm -f */named.memstats
 rm -f */named.run
 rm -f raw* output*
+rm -f rndc.out.*
 rm -f ns*/named.lock
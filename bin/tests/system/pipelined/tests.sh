@@ -17,6 +17,8 @@
 SYSTEMTESTTOP=..
 . $SYSTEMTESTTOP/conf.sh
 
+RNDCCMD="$RNDC -p 9953 -c ../common/rndc.conf"
+
 status=0
 
 echo "I:check pipelined TCP queries"
@@ -37,5 +39,26 @@ diff refb outputb || ret=1
 if [ $ret != 0 ]; then echo "I:failed"; fi
 status=`expr $status + $ret`
 
+# ns4 allows a single TCP client, so the pipelined queries above were
+# only answered out of order because they shared its quota slot.
+echo "I:check pipelined TCP queries take one tcp-clients slot"
+ret=0
+$RNDCCMD -s 10.53.0.4 flush
+./pipequeries < input > rawc || ret=1
+awk '{ print $1 " " $5 }' < rawc > outputc
+sort < outputc > outputc-sorted
+diff ref outputc-sorted || { ret=1 ; echo "I: diff sorted failed"; }
+diff ref outputc > /dev/null && { ret=1 ; echo "I: diff out of order failed"; }
+# The slot is released once every client on the connection is done.
+for i in 1 2 3 4 5 6 7 8 9 10
+do
+	$RNDCCMD -s 10.53.0.4 status > rndc.out.status 2>&1
+	grep "^tcp clients: 0/1$" rndc.out.status > /dev/null && break
+	sleep 1
+done
+grep "^tcp clients: 0/1$" rndc.out.status > /dev/null || ret=1
+if [ $ret != 0 ]; then echo "I:failed"; fi
+status=`expr $status + $ret`
+
 echo "I:exit status: $status"
 exit $status
@@ -235,6 +235,8 @@ recvresponse(isc_task_t *task, isc_event_t *event) {
 	response = NULL;
 	result = dns_message_create(mctx, DNS_MESSAGE_INTENTPARSE, &response);
 	CHECK("dns_message_create", result);
+	result = dns_message_usearena(response, 0);
+	CHECK("dns_message_usearena", result);
 
 	parseflags |= DNS_MESSAGEPARSE_PRESERVEORDER;
 	if (besteffort) {
@@ -531,6 +533,8 @@ sendquery(struct query *query, isc_task_t *task)
 	message = NULL;
 	result = dns_message_create(mctx, DNS_MESSAGE_INTENTRENDER, &message);
 	CHECK("dns_message_create", result);
+	result = dns_message_usearena(message, 0);
+	CHECK("dns_message_usearena", result);
 
 	message->opcode = dns_opcode_query;
 	if (query->recurse)
@@ -27,6 +27,30 @@
 #include <dns/acl.h>
 #include <dns/iptable.h>
 
+/*%
+ * The compiled form of an ACL's radix tree: the tree's nodes, copied
+ * in depth first order into one array, with children referred to by
+ * index.
+ */
+#define TRIE_NONE		0xffffffffU
+#define TRIE_NOPREFIX		0xffff
+
+typedef struct trienode {
+	unsigned char		addr[16];	/*%< Prefix, if any */
+	int			node_num[4];	/*%< As in isc_radix_node_t */
+	isc_uint32_t		child[2];	/*%< Or TRIE_NONE */
+	isc_uint16_t		bit;		/*%< As in isc_radix_node_t */
+	isc_uint16_t		plen;		/*%< Or TRIE_NOPREFIX (glue) */
+	isc_uint8_t		pos;		/*%< Positive node_num[] bits */
+} trienode_t;
+
+struct dns_acltrie {
+	trienode_t		*nodes;
+	unsigned int		count;
+	unsigned int		alloc;
+	int			added;		/*%< Radix counters when built */
+	int			active;
+};
 
 /*
  * Create a new ACL, including an IP table and an array with room
@@ -66,6 +90,7 @@ dns_acl_create(isc_mem_t *mctx, int n, dns_acl_t **target) {
 	}
 
 	acl->elements = NULL;
+	acl->trie = NULL;
 	acl->alloc = 0;
 	acl->length = 0;
 	acl->has_negatives = ISC_FALSE;
@@ -196,6 +221,117 @@ dns_acl_match(const isc_netaddr_t *reqaddr,
 			       match, matchelt));
 }
 
+/*
+ * Compare the first 'mask' bits of 'addr' and 'dest'.
+ */
+static inline isc_boolean_t
+comp_with_mask(const unsigned char *addr, const unsigned char *dest,
+	       unsigned int mask)
+{
+	unsigned int n = mask / 8;
+	unsigned char m;
+
+	if (memcmp(addr, dest, n) != 0)
+		return (ISC_FALSE);
+	if ((mask % 8) == 0)
+		return (ISC_TRUE);
+	m = (0xff << (8 - (mask % 8))) & 0xff;
+	return (ISC_TF((addr[n] & m) == (dest[n] & m)));
+}
+
+static inline isc_boolean_t
+trie_current(const dns_acl_t *acl) {
+	const isc_radix_tree_t *radix = acl->iptable->radix;
+
+	return (ISC_TF(acl->trie != NULL &&
+		       acl->trie->added == radix->num_added_node &&
+		       acl->trie->active == radix->num_active_node));
+}
+
+/*
+ * Find the best match for the first 'bitlen' bits of 'addr' in 'trie',
+ * exactly as isc_radix_search() would in the tree it was built from.
+ */
+static isc_boolean_t
+trie_search(const dns_acltrie_t *trie, const unsigned char *addr,
+	    unsigned int bitlen, int off, int *nump, isc_boolean_t *posp,
+	    unsigned int *bitp)
+{
+	const trienode_t *node, *best = NULL;
+	isc_uint32_t i = 0;
+
+	if (trie->count == 0)
+		return (ISC_FALSE);
+
+	for (;;) {
+		node = &trie->nodes[i];
+		if (node->bit > bitlen)
+			break;
+		if (node->plen != TRIE_NOPREFIX &&
+		    node->node_num[off] != -1 &&
+		    (best == NULL ||
+		     best->node_num[off] > node->node_num[off]) &&
+		    comp_with_mask(node->addr, addr, node->plen))
+			best = node;
+		if (node->bit == bitlen)
+			break;
+		i = node->child[(addr[node->bit >> 3] >>
+				 (7 - (node->bit & 0x07))) & 1];
+		if (i == TRIE_NONE)
+			break;
+	}
+
+	if (best == NULL)
+		return (ISC_FALSE);
+	*nump = best->node_num[off];
+	*posp = ISC_TF((best->pos & (1 << off)) != 0);
+	*bitp = best->bit;
+	return (ISC_TRUE);
+}
+
+/*
+ * Search the IP table of 'acl' for the first 'bitlen' bits of 'addr',
+ * using the compiled copy if it is up to date.
+ */
+static isc_boolean_t
+iptable_search(const dns_acl_t *acl, const isc_netaddr_t *addr,
+	       unsigned int bitlen, isc_boolean_t ecs, int *nump,
+	       isc_boolean_t *posp, unsigned int *bitp)
+{
+	isc_prefix_t pfx;
+	isc_radix_node_t *node = NULL;
+	isc_result_t result;
+	isc_boolean_t found = ISC_FALSE;
+	int off;
+
+	if (trie_current(acl)) {
+		const unsigned char *bytes;
+
+		if (addr->family == AF_INET6)
+			bytes = (const unsigned char *)&addr->type.in6;
+		else if (addr->family == AF_INET)
+			bytes = (const unsigned char *)&addr->type.in;
+		else
+			return (ISC_FALSE);
+		off = (addr->family == AF_INET6 ? 1 : 0) + (ecs ? 2 : 0);
+		return (trie_search(acl->trie, bytes, bitlen, off,
+				    nump, posp, bitp));
+	}
+
+	NETADDR_TO_PREFIX_T(addr, pfx, bitlen, ecs);
+	result = isc_radix_search(acl->iptable->radix, &node, &pfx);
+	if (result == ISC_R_SUCCESS && node != NULL) {
+		off = ISC_RADIX_OFF(&pfx);
+		*nump = node->node_num[off];
+		*posp = *(isc_boolean_t *) node->data[off];
+		*bitp = node->bit;
+		found = ISC_TRUE;
+	}
+	isc_refcount_destroy(&pfx.refcount);
+
+	return (found);
+}
+
 isc_result_t
 dns_acl_match2(const isc_netaddr_t *reqaddr,
 	       const dns_name_t *reqsigner,
@@ -207,13 +343,11 @@ dns_acl_match2(const isc_netaddr_t *reqaddr,
 	       int *match,
 	       const dns_aclelement_t **matchelt)
 {
-	isc_uint16_t bitlen;
-	isc_prefix_t pfx;
-	isc_radix_node_t *node = NULL;
 	const isc_netaddr_t *addr = reqaddr;
 	isc_netaddr_t v4addr;
-	isc_result_t result;
-	int match_num = -1;
+	isc_boolean_t pos;
+	unsigned int bit;
+	int match_num = -1, num;
 	unsigned int i;
 
 	REQUIRE(reqaddr != NULL);
@@ -228,34 +362,22 @@ dns_acl_match2(const isc_netaddr_t *reqaddr,
 		addr = &v4addr;
 	}
 
-	/* Always match with host addresses. */
-	bitlen = (addr->family == AF_INET6) ? 128 : 32;
-	NETADDR_TO_PREFIX_T(addr, pfx, bitlen, ISC_FALSE);
-
 	/* Assume no match. */
 	*match = 0;
 
-	/* Search radix. */
-	result = isc_radix_search(acl->iptable->radix, &node, &pfx);
-
-	/* Found a match. */
-	if (result == ISC_R_SUCCESS && node != NULL) {
-		int off = ISC_RADIX_OFF(&pfx);
-		match_num = node->node_num[off];
-		if (*(isc_boolean_t *) node->data[off])
-			*match = match_num;
-		else
-			*match = -match_num;
+	/* Search radix, always with host addresses. */
+	if (iptable_search(acl, addr, (addr->family == AF_INET6) ? 128 : 32,
+			   ISC_FALSE, &num, &pos, &bit))
+	{
+		match_num = num;
+		*match = pos ? match_num : -match_num;
 	}
 
-	isc_refcount_destroy(&pfx.refcount);
-
 	/*
 	 * If ecs is not NULL, we search the radix tree again to
 	 * see if we find a better match on an ECS node
 	 */
 	if (ecs != NULL) {
-		node = NULL;
 		addr = ecs;
 
 		if (env != NULL && env->match_mapped &&
@@ -266,25 +388,15 @@ dns_acl_match2(const isc_netaddr_t *reqaddr,
 			addr = &v4addr;
 		}
 
-		NETADDR_TO_PREFIX_T(addr, pfx, ecslen, ISC_TRUE);
-
-		result = isc_radix_search(acl->iptable->radix, &node, &pfx);
-		if (result == ISC_R_SUCCESS && node != NULL) {
-			int off = ISC_RADIX_OFF(&pfx);
-			if (match_num == -1 ||
-			    node->node_num[off] < match_num)
-			{
-				match_num = node->node_num[off];
-				if (scope != NULL)
-					*scope = node->bit;
-				if (*(isc_boolean_t *) node->data[off])
-					*match = match_num;
-				else
-					*match = -match_num;
-			}
+		if (iptable_search(acl, addr, ecslen, ISC_TRUE,
+				   &num, &pos, &bit) &&
+		    (match_num == -1 || num < match_num))
+		{
+			match_num = num;
+			if (scope != NULL)
+				*scope = bit;
+			*match = pos ? match_num : -match_num;
 		}
-
-		isc_refcount_destroy(&pfx.refcount);
 	}
 
 	/* Now search non-radix elements for a match with a lower node_num. */
@@ -312,6 +424,168 @@ dns_acl_match2(const isc_netaddr_t *reqaddr,
 	return (ISC_R_SUCCESS);
 }
 
+isc_boolean_t
+dns_acl_isaddressonly(const dns_acl_t *acl) {
+	unsigned int i;
+
+	REQUIRE(DNS_ACL_VALID(acl));
+
+	for (i = 0; i < acl->length; i++) {
+		dns_aclelement_t *e = &acl->elements[i];
+
+		if (e->type != dns_aclelementtype_nestedacl ||
+		    !dns_acl_isaddressonly(e->nestedacl))
+			return (ISC_FALSE);
+	}
+	return (ISC_TRUE);
+}
+
+/*
+ * Like dns_acl_match2(), but for every address that starts with the
+ * first 'bitlen' bits of 'addr' and that matches no longer prefix in
+ * 'acl'.  The caller guarantees that 'acl' is address only.
+ */
+isc_result_t
+dns_acl_matchprefix(const isc_netaddr_t *addr, unsigned int bitlen,
+		    const dns_acl_t *acl, int *match)
+{
+	isc_boolean_t pos;
+	unsigned int bit;
+	int match_num = -1, num, inner;
+	unsigned int i;
+
+	REQUIRE(addr != NULL);
+	REQUIRE(DNS_ACL_VALID(acl));
+	REQUIRE(match != NULL);
+
+	*match = 0;
+
+	if (iptable_search(acl, addr, bitlen, ISC_FALSE, &num, &pos, &bit)) {
+		match_num = num;
+		*match = pos ? match_num : -match_num;
+	}
+
+	for (i = 0; i < acl->length; i++) {
+		dns_aclelement_t *e = &acl->elements[i];
+
+		if (match_num != -1 && match_num < e->node_num)
+			break;
+
+		INSIST(e->type == dns_aclelementtype_nestedacl);
+		(void)dns_acl_matchprefix(addr, bitlen, e->nestedacl, &inner);
+		if (inner > 0) {
+			if (match_num == -1 || e->node_num < match_num)
+				*match = e->negative ? -e->node_num
+						     : e->node_num;
+			break;
+		}
+	}
+
+	return (ISC_R_SUCCESS);
+}
+
+static unsigned int
+trie_countnodes(isc_radix_node_t *node) {
+	if (node == NULL)
+		return (0);
+	return (1 + trie_countnodes(node->l) + trie_countnodes(node->r));
+}
+
+/*
+ * Copy 'node' and its children into 'trie', which has room for them;
+ * return the index of the copy of 'node'.
+ */
+static isc_uint32_t
+trie_fill(dns_acltrie_t *trie, isc_radix_node_t *node) {
+	trienode_t *tn;
+	isc_uint32_t i;
+	int off;
+
+	i = trie->count++;
+	tn = &trie->nodes[i];
+	memset(tn, 0, sizeof(*tn));
+	tn->bit = node->bit;
+	if (node->prefix != NULL) {
+		tn->plen = node->prefix->bitlen;
+		memmove(tn->addr, isc_prefix_touchar(node->prefix),
+			(node->prefix->family == AF_INET6) ? 16 : 4);
+	} else
+		tn->plen = TRIE_NOPREFIX;
+	for (off = 0; off < 4; off++) {
+		tn->node_num[off] = node->node_num[off];
+		if (node->node_num[off] != -1 &&
+		    *(isc_boolean_t *) node->data[off])
+			tn->pos |= 1 << off;
+	}
+
+	tn->child[0] = tn->child[1] = TRIE_NONE;
+	if (node->l != NULL)
+		tn->child[0] = trie_fill(trie, node->l);
+	if (node->r != NULL)
+		tn->child[1] = trie_fill(trie, node->r);
+	return (i);
+}
+
+static void
+trie_free(isc_mem_t *mctx, dns_acltrie_t **triep) {
+	dns_acltrie_t *trie = *triep;
+
+	*triep = NULL;
+	if (trie->nodes != NULL)
+		isc_mem_put(mctx, trie->nodes,
+			    trie->alloc * sizeof(trienode_t));
+	isc_mem_put(mctx, trie, sizeof(*trie));
+}
+
+isc_result_t
+dns_acl_compile(dns_acl_t *acl) {
+	isc_radix_tree_t *radix;
+	dns_acltrie_t *trie;
+	isc_result_t result;
+	unsigned int i, n;
+
+	REQUIRE(DNS_ACL_VALID(acl));
+
+	for (i = 0; i < acl->length; i++) {
+		dns_aclelement_t *e = &acl->elements[i];
+		if (e->type == dns_aclelementtype_nestedacl) {
+			result = dns_acl_compile(e->nestedacl);
+			if (result != ISC_R_SUCCESS)
+				return (result);
+		}
+	}
+
+	if (trie_current(acl))
+		return (ISC_R_SUCCESS);
+
+	radix = acl->iptable->radix;
+	trie = isc_mem_get(acl->mctx, sizeof(*trie));
+	if (trie == NULL)
+		return (ISC_R_NOMEMORY);
+	trie->nodes = NULL;
+	trie->count = 0;
+	trie->alloc = 0;
+	trie->added = radix->num_added_node;
+	trie->active = radix->num_active_node;
+
+	n = trie_countnodes(radix->head);
+	if (n > 0) {
+		trie->nodes = isc_mem_get(acl->mctx, n * sizeof(trienode_t));
+		if (trie->nodes == NULL) {
+			isc_mem_put(acl->mctx, trie, sizeof(*trie));
+			return (ISC_R_NOMEMORY);
+		}
+		trie->alloc = n;
+		(void)trie_fill(trie, radix->head);
+		INSIST(trie->count == n);
+	}
+
+	if (acl->trie != NULL)
+		trie_free(acl->mctx, &acl->trie);
+	acl->trie = trie;
+	return (ISC_R_SUCCESS);
+}
+
 /*
  * Merge the contents of one ACL into another.  Call dns_iptable_merge()
  * for the IP tables, then concatenate the element arrays.
@@ -552,6 +826,8 @@ destroy(dns_acl_t *dacl) {
 			    dacl->alloc * sizeof(dns_aclelement_t));
 	if (dacl->name != NULL)
 		isc_mem_free(dacl->mctx, dacl->name);
+	if (dacl->trie != NULL)
+		trie_free(dacl->mctx, &dacl->trie);
 	if (dacl->iptable != NULL)
 		dns_iptable_detach(&dacl->iptable);
 	isc_refcount_destroy(&dacl->refcount);
@@ -28,6 +28,7 @@
 
 #include <limits.h>
 
+#include <isc/atomic.h>
 #include <isc/mutexblock.h>
 #include <isc/netaddr.h>
 #include <isc/print.h>
@@ -2111,8 +2112,12 @@ find_entry_and_lock(dns_adb_t *adb, isc_sockaddr_t *addr, int *bucketp,
 		if (entry != NULL &&
 		    (entry->expires == 0 || entry->expires > now) &&
 		    isc_sockaddr_equal(addr, &entry->sockaddr)) {
-			ISC_LIST_UNLINK(adb->entries[bucket], entry, plink);
-			ISC_LIST_PREPEND(adb->entries[bucket], entry, plink);
+			if (entry != ISC_LIST_HEAD(adb->entries[bucket])) {
+				ISC_LIST_UNLINK(adb->entries[bucket], entry,
+						plink);
+				ISC_LIST_PREPEND(adb->entries[bucket], entry,
+						 plink);
+			}
 			return (entry);
 		}
 	}
@@ -2197,9 +2202,13 @@ copy_namehook_lists(dns_adb_t *adb, dns_adbfind_t *find, dns_name_t *qname,
 		namehook = ISC_LIST_HEAD(name->v4);
 		while (namehook != NULL) {
 			entry = namehook->entry;
-			bucket = entry->lock_bucket;
-			INSIST(bucket != DNS_ADB_INVALIDBUCKET);
-			LOCK(&adb->entrylocks[bucket]);
+			INSIST(entry->lock_bucket != DNS_ADB_INVALIDBUCKET);
+			if (bucket != entry->lock_bucket) {
+				if (bucket != DNS_ADB_INVALIDBUCKET)
+					UNLOCK(&adb->entrylocks[bucket]);
+				bucket = entry->lock_bucket;
+				LOCK(&adb->entrylocks[bucket]);
+			}
 
 			if (entry->quota != 0 &&
 			    entry->active >= entry->quota)
@@ -2227,8 +2236,6 @@ copy_namehook_lists(dns_adb_t *adb, dns_adbfind_t *find, dns_name_t *qname,
 			ISC_LIST_APPEND(find->list, addrinfo, publink);
 			addrinfo = NULL;
 		nextv4:
-			UNLOCK(&adb->entrylocks[bucket]);
-			bucket = DNS_ADB_INVALIDBUCKET;
 			namehook = ISC_LIST_NEXT(namehook, plink);
 		}
 	}
@@ -2237,9 +2244,13 @@ copy_namehook_lists(dns_adb_t *adb, dns_adbfind_t *find, dns_name_t *qname,
 		namehook = ISC_LIST_HEAD(name->v6);
 		while (namehook != NULL) {
 			entry = namehook->entry;
-			bucket = entry->lock_bucket;
-			INSIST(bucket != DNS_ADB_INVALIDBUCKET);
-			LOCK(&adb->entrylocks[bucket]);
+			INSIST(entry->lock_bucket != DNS_ADB_INVALIDBUCKET);
+			if (bucket != entry->lock_bucket) {
+				if (bucket != DNS_ADB_INVALIDBUCKET)
+					UNLOCK(&adb->entrylocks[bucket]);
+				bucket = entry->lock_bucket;
+				LOCK(&adb->entrylocks[bucket]);
+			}
 
 			if (entry->quota != 0 &&
 			    entry->active >= entry->quota)
@@ -2267,8 +2278,6 @@ copy_namehook_lists(dns_adb_t *adb, dns_adbfind_t *find, dns_name_t *qname,
 			ISC_LIST_APPEND(find->list, addrinfo, publink);
 			addrinfo = NULL;
 		nextv6:
-			UNLOCK(&adb->entrylocks[bucket]);
-			bucket = DNS_ADB_INVALIDBUCKET;
 			namehook = ISC_LIST_NEXT(namehook, plink);
 		}
 	}
@@ -3065,7 +3074,7 @@ dns_adb_createfind2(dns_adb_t *adb, isc_task_t *task, isc_taskaction_t action,
 			adbname->flags |= NAME_GLUE_OK;
 		if (FIND_STARTATZONE(find))
 			adbname->flags |= NAME_STARTATZONE;
-	} else {
+	} else if (adbname != ISC_LIST_HEAD(adb->names[bucket])) {
 		/* Move this name forward in the LRU list */
 		ISC_LIST_UNLINK(adb->names[bucket], adbname, plink);
 		ISC_LIST_PREPEND(adb->names[bucket], adbname, plink);
@@ -4137,12 +4146,30 @@ dns_adb_adjustsrtt(dns_adb_t *adb, dns_adbaddrinfo_t *addr,
 	REQUIRE(DNS_ADBADDRINFO_VALID(addr));
 	REQUIRE(factor <= 10);
 
+#ifdef ISC_PLATFORM_HAVECMPXCHG
+	/*
+	 * Once the entry has an expiry time set only 'srtt' changes, and
+	 * adjustsrtt() updates that atomically, so the (frequent) RTT
+	 * samples from the resolver need not take the bucket lock.
+	 * 'expires' is never cleared once set, and 'addr' holds a
+	 * reference to the entry, so reading it here without the lock
+	 * at worst sends us down the locked path below; 'expires' itself
+	 * is only ever written with the lock held.
+	 */
+	if (factor != DNS_ADB_RTTADJAGE && addr->entry->expires != 0) {
+		adjustsrtt(addr, rtt, factor, 0);
+		return;
+	}
+#endif
+
 	bucket = addr->entry->lock_bucket;
 	LOCK(&adb->entrylocks[bucket]);
 
 	if (addr->entry->expires == 0 || factor == DNS_ADB_RTTADJAGE)
 		isc_stdtime_get(&now);
 	adjustsrtt(addr, rtt, factor, now);
+	if (addr->entry->expires == 0)
+		addr->entry->expires = now + ADB_ENTRY_WINDOW;
 
 	UNLOCK(&adb->entrylocks[bucket]);
 }
@@ -4158,6 +4185,8 @@ dns_adb_agesrtt(dns_adb_t *adb, dns_adbaddrinfo_t *addr, isc_stdtime_t now) {
 	LOCK(&adb->entrylocks[bucket]);
 
 	adjustsrtt(addr, 0, DNS_ADB_RTTADJAGE, now);
+	if (addr->entry->expires == 0)
+		addr->entry->expires = now + ADB_ENTRY_WINDOW;
 
 	UNLOCK(&adb->entrylocks[bucket]);
 }
@@ -4167,25 +4196,42 @@ adjustsrtt(dns_adbaddrinfo_t *addr, unsigned int rtt, unsigned int factor,
 	   isc_stdtime_t now)
 {
 	isc_uint64_t new_srtt;
+	unsigned int old_srtt;
+	isc_boolean_t age;
 
+	/*
+	 * Ageing is only done with the bucket lock held, which also
+	 * protects 'lastage'.
+	 */
+	age = ISC_TF(factor == DNS_ADB_RTTADJAGE &&
+		     addr->entry->lastage != now);
+
+#ifdef ISC_PLATFORM_HAVECMPXCHG
+ again:
+#endif
+	old_srtt = addr->entry->srtt;
 	if (factor == DNS_ADB_RTTADJAGE) {
-		if (addr->entry->lastage != now) {
-			new_srtt = addr->entry->srtt;
+		new_srtt = old_srtt;
+		if (age) {
 			new_srtt <<= 9;
-			new_srtt -= addr->entry->srtt;
+			new_srtt -= old_srtt;
 			new_srtt >>= 9;
-			addr->entry->lastage = now;
-		} else
-			new_srtt = addr->entry->srtt;
+		}
 	} else
-		new_srtt = ((isc_uint64_t)addr->entry->srtt / 10 * factor)
+		new_srtt = ((isc_uint64_t)old_srtt / 10 * factor)
 			+ ((isc_uint64_t)rtt / 10 * (10 - factor));
 
+#ifdef ISC_PLATFORM_HAVECMPXCHG
+	if ((unsigned int)isc_atomic_cmpxchg((isc_int32_t *)&addr->entry->srtt,
+					     (isc_int32_t)old_srtt,
+					     (isc_int32_t)new_srtt) != old_srtt)
+		goto again;
+#else
 	addr->entry->srtt = (unsigned int) new_srtt;
+#endif
 	addr->srtt = (unsigned int) new_srtt;
-
-	if (addr->entry->expires == 0)
-		addr->entry->expires = now + ADB_ENTRY_WINDOW;
+	if (age)
+		addr->entry->lastage = now;
 }
 
 void
@@ -4464,16 +4510,16 @@ dns_adb_setudpsize(dns_adb_t *adb, dns_adbaddrinfo_t *addr, unsigned int size) {
 
 unsigned int
 dns_adb_getudpsize(dns_adb_t *adb, dns_adbaddrinfo_t *addr) {
-	int bucket;
 	unsigned int size;
 
 	REQUIRE(DNS_ADB_VALID(adb));
 	REQUIRE(DNS_ADBADDRINFO_VALID(addr));
 
-	bucket = addr->entry->lock_bucket;
-	LOCK(&adb->entrylocks[bucket]);
+	/*
+	 * A single aligned load; a concurrent update is seen either
+	 * before or after, which is all the caller can rely on anyway.
+	 */
 	size = addr->entry->udpsize;
-	UNLOCK(&adb->entrylocks[bucket]);
 
 	return (size);
 }
@@ -39,6 +39,7 @@
 #include <dns/lib.h>
 #include <dns/log.h>
 #include <dns/masterdump.h>
+#include <dns/popularity.h>
 #include <dns/rdata.h>
 #include <dns/rdataset.h>
 #include <dns/rdatasetiter.h>
@@ -62,6 +63,11 @@
  * See also DNS_CACHE_MINSIZE
  */
 #define DNS_CACHE_CLEANERINCREMENT	1000U	/*%< Number of nodes. */
+/*!
+ * Expired data kept to be served stale may use up to a quarter of the
+ * cache size, so that it cannot crowd out live data.
+ */
+#define STALESIZE(size)		((size) >> 2)
 
 /***
  ***	Types
@@ -143,6 +149,8 @@ struct dns_cache {
 	char			**db_argv;
 	size_t			size;
 	isc_stats_t		*stats;
+	dns_popularity_t	*popularity;
+	dns_ttl_t		serve_stale_ttl;
 
 	/* Locked by 'filelock'. */
 	char			*filename;
@@ -243,6 +251,8 @@ dns_cache_create3(isc_mem_t *cmctx, isc_mem_t *hmctx, isc_taskmgr_t *taskmgr,
 	cache->live_tasks = 0;
 	cache->rdclass = rdclass;
 
+	cache->popularity = NULL;
+	cache->serve_stale_ttl = 0;
 	cache->stats = NULL;
 	result = isc_stats_create(cmctx, &cache->stats,
 				  dns_cachestatscounter_max);
@@ -411,6 +421,9 @@ cache_free(dns_cache_t *cache) {
 	if (cache->stats != NULL)
 		isc_stats_detach(&cache->stats);
 
+	if (cache->popularity != NULL)
+		dns_popularity_detach(&cache->popularity);
+
 	DESTROYLOCK(&cache->lock);
 	DESTROYLOCK(&cache->filelock);
 
@@ -1058,6 +1071,7 @@ dns_cache_setcachesize(dns_cache_t *cache, size_t size) {
 
 	LOCK(&cache->lock);
 	cache->size = size;
+	(void)dns_db_setservestalesize(cache->db, STALESIZE(size));
 	UNLOCK(&cache->lock);
 
 	hiwater = size - (size >> 3);	/* Approximately 7/8ths. */
@@ -1169,6 +1183,11 @@ dns_cache_flush(dns_cache_t *cache) {
 	olddb = cache->db;
 	cache->db = db;
 	dns_db_setcachestats(cache->db, cache->stats);
+	if (cache->popularity != NULL)
+		(void)dns_db_setpopularity(cache->db, cache->popularity);
+	if (cache->serve_stale_ttl != 0)
+		(void)dns_db_setservestalettl(cache->db, cache->serve_stale_ttl);
+	(void)dns_db_setservestalesize(cache->db, STALESIZE(cache->size));
 	UNLOCK(&cache->cleaner.lock);
 	UNLOCK(&cache->lock);
 
@@ -1314,6 +1333,61 @@ dns_cache_getstats(dns_cache_t *cache) {
 	return (cache->stats);
 }
 
+isc_result_t
+dns_cache_setpopularity(dns_cache_t *cache, dns_popularity_t *pop) {
+	isc_result_t result;
+
+	REQUIRE(VALID_CACHE(cache));
+	REQUIRE(pop != NULL);
+
+	LOCK(&cache->lock);
+	if (cache->popularity != NULL) {
+		result = (cache->popularity == pop) ? ISC_R_SUCCESS
+						    : ISC_R_EXISTS;
+		goto unlock;
+	}
+	result = dns_db_setpopularity(cache->db, pop);
+	if (result == ISC_R_SUCCESS)
+		dns_popularity_attach(pop, &cache->popularity);
+ unlock:
+	UNLOCK(&cache->lock);
+	return (result);
+}
+
+dns_popularity_t *
+dns_cache_getpopularity(dns_cache_t *cache) {
+	dns_popularity_t *pop;
+
+	REQUIRE(VALID_CACHE(cache));
+
+	LOCK(&cache->lock);
+	pop = cache->popularity;
+	UNLOCK(&cache->lock);
+	return (pop);
+}
+
+void
+dns_cache_setservestalettl(dns_cache_t *cache, dns_ttl_t ttl) {
+	REQUIRE(VALID_CACHE(cache));
+
+	LOCK(&cache->lock);
+	cache->serve_stale_ttl = ttl;
+	(void)dns_db_setservestalettl(cache->db, ttl);
+	UNLOCK(&cache->lock);
+}
+
+dns_ttl_t
+dns_cache_getservestalettl(dns_cache_t *cache) {
+	dns_ttl_t ttl;
+
+	REQUIRE(VALID_CACHE(cache));
+
+	LOCK(&cache->lock);
+	ttl = cache->serve_stale_ttl;
+	UNLOCK(&cache->lock);
+	return (ttl);
+}
+
 void
 dns_cache_updatestats(dns_cache_t *cache, isc_result_t result) {
 	REQUIRE(VALID_CACHE(cache));
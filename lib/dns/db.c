@@ -981,6 +981,36 @@ dns_db_setcachestats(dns_db_t *db, isc_stats_t *stats) {
 	return (ISC_R_NOTIMPLEMENTED);
 }
 
+isc_result_t
+dns_db_setpopularity(dns_db_t *db, dns_popularity_t *pop) {
+	REQUIRE(DNS_DB_VALID(db));
+
+	if (db->methods->setpopularity != NULL)
+		return ((db->methods->setpopularity)(db, pop));
+
+	return (ISC_R_NOTIMPLEMENTED);
+}
+
+isc_result_t
+dns_db_setservestalettl(dns_db_t *db, dns_ttl_t ttl) {
+	REQUIRE(DNS_DB_VALID(db));
+
+	if (db->methods->setservestalettl != NULL)
+		return ((db->methods->setservestalettl)(db, ttl));
+
+	return (ISC_R_NOTIMPLEMENTED);
+}
+
+isc_result_t
+dns_db_setservestalesize(dns_db_t *db, size_t size) {
+	REQUIRE(DNS_DB_VALID(db));
+
+	if (db->methods->setservestalesize != NULL)
+		return ((db->methods->setservestalesize)(db, size));
+
+	return (ISC_R_NOTIMPLEMENTED);
+}
+
 isc_result_t
 dns_db_getnsec3parameters(dns_db_t *db, dns_dbversion_t *version,
 			  dns_hash_t *hash, isc_uint8_t *flags,
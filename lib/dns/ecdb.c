@@ -589,7 +589,10 @@ static dns_dbmethods_t ecdb_methods = {
 	NULL,			/* findnodeext */
 	NULL,			/* findext */
 	NULL,			/* setcachestats */
-	NULL			/* hashsize */
+	NULL,			/* hashsize */
+	NULL,			/* setpopularity */
+	NULL,			/* setservestalettl */
+	NULL			/* setservestalesize */
 };
 
 static isc_result_t
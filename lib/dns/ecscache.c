@@ -0,0 +1,672 @@
+/*
+ * Copyright (C) 2015  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <isc/magic.h>
+#include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/refcount.h>
+#include <isc/serial.h>
+#include <isc/string.h>
+#include <isc/util.h>
+
+#include <dns/db.h>
+#include <dns/ecscache.h>
+#include <dns/name.h>
+#include <dns/rdata.h>
+#include <dns/rdatalist.h>
+#include <dns/rdataset.h>
+#include <dns/result.h>
+
+#include "rdatalist_p.h"
+
+#define ECSCACHE_MAGIC			ISC_MAGIC('E', 'C', 'S', 'C')
+#define VALID_ECSCACHE(c)		ISC_MAGIC_VALID(c, ECSCACHE_MAGIC)
+
+#define ECSENTRY_MAGIC			ISC_MAGIC('E', 'C', 'S', 'E')
+#define VALID_ECSENTRY(e)		ISC_MAGIC_VALID(e, ECSENTRY_MAGIC)
+
+#define ECSCACHE_INITIALBUCKETS		64
+#define ECSCACHE_MAXBUCKETS		(1U << 20)
+
+/*%
+ * Index into the per-scope entry counts for each address family.
+ */
+#define FAMILY_INDEX(f)			((f) == AF_INET ? 0 : 1)
+#define FAMILY_MAXBITS(f)		((f) == AF_INET ? 32U : 128U)
+
+typedef struct ecsentry ecsentry_t;
+typedef ISC_LIST(ecsentry_t) ecsentrylist_t;
+
+/*%
+ * An entry is a single allocation holding the entry itself, the
+ * rdata structures, the owner name and the rdata.  The cache holds a
+ * reference to each entry it links, and each rdataset bound to the
+ * entry holds another one.
+ */
+struct ecsentry {
+	unsigned int		magic;
+	isc_refcount_t		references;
+	isc_mem_t		*mctx;
+	size_t			size;
+	unsigned int		hashval;
+	isc_boolean_t		linked;
+	ISC_LINK(ecsentry_t)	hlink;
+	ISC_LINK(ecsentry_t)	lru;
+	dns_name_t		name;
+	dns_rdatalist_t		rdatalist;
+	isc_stdtime_t		expire;
+	dns_trust_t		trust;
+	int			family;
+	unsigned int		scope;
+	unsigned char		prefix[16];
+};
+
+struct dns_ecscache {
+	/* Unlocked. */
+	unsigned int		magic;
+	isc_mem_t		*mctx;
+	isc_refcount_t		references;
+	isc_mutex_t		lock;
+
+	/* Locked by lock. */
+	size_t			maxsize;
+	size_t			size;
+	unsigned int		count;
+	unsigned int		nbuckets;	/* power of 2 */
+	ecsentrylist_t		*buckets;
+	ecsentrylist_t		lru;
+	unsigned int		scopes[2][129];
+};
+
+static void		rdataset_disassociate(dns_rdataset_t *rdataset);
+static void		rdataset_clone(dns_rdataset_t *source,
+				       dns_rdataset_t *target);
+
+static dns_rdatasetmethods_t methods = {
+	rdataset_disassociate,
+	isc__rdatalist_first,
+	isc__rdatalist_next,
+	isc__rdatalist_current,
+	rdataset_clone,
+	isc__rdatalist_count,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL
+};
+
+static void
+entry_detach(ecsentry_t **entryp) {
+	ecsentry_t *entry = *entryp;
+	unsigned int refs;
+
+	*entryp = NULL;
+	REQUIRE(VALID_ECSENTRY(entry));
+
+	isc_refcount_decrement(&entry->references, &refs);
+	if (refs > 0)
+		return;
+
+	INSIST(!entry->linked);
+	entry->magic = 0;
+	isc_refcount_destroy(&entry->references);
+	isc_mem_putanddetach(&entry->mctx, entry, entry->size);
+}
+
+static void
+rdataset_disassociate(dns_rdataset_t *rdataset) {
+	ecsentry_t *entry = rdataset->private5;
+
+	entry_detach(&entry);
+}
+
+static void
+rdataset_clone(dns_rdataset_t *source, dns_rdataset_t *target) {
+	ecsentry_t *entry = source->private5;
+
+	REQUIRE(VALID_ECSENTRY(entry));
+
+	isc_refcount_increment(&entry->references, NULL);
+	isc__rdatalist_clone(source, target);
+}
+
+static void
+bindrdataset(ecsentry_t *entry, isc_stdtime_t now, dns_rdataset_t *rdataset)
+{
+	isc_refcount_increment(&entry->references, NULL);
+
+	rdataset->methods = &methods;
+	rdataset->rdclass = entry->rdatalist.rdclass;
+	rdataset->type = entry->rdatalist.type;
+	rdataset->covers = entry->rdatalist.covers;
+	rdataset->ttl = isc_serial_gt(entry->expire, now) ?
+			entry->expire - now : 0;
+	rdataset->trust = entry->trust;
+	rdataset->private1 = &entry->rdatalist;
+	rdataset->private2 = NULL;
+	rdataset->private3 = NULL;
+	rdataset->privateuint4 = 0;
+	rdataset->private5 = entry;
+}
+
+/*
+ * Copy the first 'bits' bits of 'addr' to 'prefix', clearing the rest.
+ */
+static void
+maskaddr(const isc_netaddr_t *addr, unsigned int bits,
+	 unsigned char prefix[16])
+{
+	const unsigned char *p;
+	unsigned int bytes;
+
+	if (addr->family == AF_INET)
+		p = (const unsigned char *)&addr->type.in;
+	else
+		p = (const unsigned char *)&addr->type.in6;
+
+	memset(prefix, 0, 16);
+	bytes = bits / 8;
+	memmove(prefix, p, bytes);
+	if ((bits % 8) != 0)
+		prefix[bytes] = p[bytes] & (0xff << (8 - (bits % 8)));
+}
+
+static unsigned int
+hashkey(dns_name_t *name, dns_rdatatype_t type, dns_rdatatype_t covers,
+	int family, unsigned int scope, const unsigned char prefix[16])
+{
+	unsigned int h, i;
+
+	h = dns_name_hash(name, ISC_FALSE);
+	h ^= (type << 16) | covers;
+	h = h * 31 + (family == AF_INET ? 0 : 0x80) + scope;
+	for (i = 0; i < (scope + 7) / 8; i++)
+		h = h * 31 + prefix[i];
+
+	return (h);
+}
+
+/*
+ * Unlink 'entry' from 'cache' and release the cache's reference to it.
+ * The entry is freed once no rdataset is bound to it either.
+ */
+static void
+unlink_entry(dns_ecscache_t *cache, ecsentry_t *entry) {
+	unsigned int bucket = entry->hashval & (cache->nbuckets - 1);
+
+	INSIST(entry->linked);
+
+	ISC_LIST_UNLINK(cache->buckets[bucket], entry, hlink);
+	ISC_LIST_UNLINK(cache->lru, entry, lru);
+	entry->linked = ISC_FALSE;
+	cache->size -= entry->size;
+	cache->count--;
+	cache->scopes[FAMILY_INDEX(entry->family)][entry->scope]--;
+	entry_detach(&entry);
+}
+
+static void
+trim(dns_ecscache_t *cache) {
+	ecsentry_t *entry;
+
+	if (cache->maxsize == 0)
+		return;
+
+	while (cache->size > cache->maxsize) {
+		entry = ISC_LIST_TAIL(cache->lru);
+		INSIST(entry != NULL);
+		unlink_entry(cache, entry);
+	}
+}
+
+/*
+ * Double the number of hash buckets when the chains get long.  Failure
+ * to allocate the new table is not an error; the chains just stay long.
+ */
+static void
+grow(dns_ecscache_t *cache) {
+	ecsentrylist_t *buckets;
+	ecsentry_t *entry;
+	unsigned int i, n;
+
+	if (cache->count <= cache->nbuckets * 2 ||
+	    cache->nbuckets >= ECSCACHE_MAXBUCKETS)
+		return;
+
+	n = cache->nbuckets * 2;
+	buckets = isc_mem_get(cache->mctx, n * sizeof(*buckets));
+	if (buckets == NULL)
+		return;
+	for (i = 0; i < n; i++)
+		ISC_LIST_INIT(buckets[i]);
+
+	for (i = 0; i < cache->nbuckets; i++) {
+		while ((entry = ISC_LIST_HEAD(cache->buckets[i])) != NULL) {
+			ISC_LIST_UNLINK(cache->buckets[i], entry, hlink);
+			ISC_LIST_APPEND(buckets[entry->hashval & (n - 1)],
+					entry, hlink);
+		}
+	}
+
+	isc_mem_put(cache->mctx, cache->buckets,
+		    cache->nbuckets * sizeof(*cache->buckets));
+	cache->buckets = buckets;
+	cache->nbuckets = n;
+}
+
+static ecsentry_t *
+find(dns_ecscache_t *cache, unsigned int hashval, dns_name_t *name,
+     dns_rdatatype_t type, dns_rdatatype_t covers, int family,
+     unsigned int scope, const unsigned char prefix[16])
+{
+	ecsentry_t *entry;
+	unsigned int bucket = hashval & (cache->nbuckets - 1);
+
+	for (entry = ISC_LIST_HEAD(cache->buckets[bucket]);
+	     entry != NULL;
+	     entry = ISC_LIST_NEXT(entry, hlink))
+	{
+		if (entry->hashval == hashval &&
+		    entry->rdatalist.type == type &&
+		    entry->rdatalist.covers == covers &&
+		    entry->family == family && entry->scope == scope &&
+		    memcmp(entry->prefix, prefix, 16) == 0 &&
+		    dns_name_equal(&entry->name, name))
+			return (entry);
+	}
+
+	return (NULL);
+}
+
+isc_result_t
+dns_ecscache_create(isc_mem_t *mctx, size_t maxsize,
+		    dns_ecscache_t **cachep)
+{
+	dns_ecscache_t *cache;
+	isc_result_t result;
+	unsigned int i;
+
+	REQUIRE(mctx != NULL);
+	REQUIRE(cachep != NULL && *cachep == NULL);
+
+	cache = isc_mem_get(mctx, sizeof(*cache));
+	if (cache == NULL)
+		return (ISC_R_NOMEMORY);
+
+	cache->nbuckets = ECSCACHE_INITIALBUCKETS;
+	cache->buckets = isc_mem_get(mctx, cache->nbuckets *
+				     sizeof(*cache->buckets));
+	if (cache->buckets == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto cleanup_cache;
+	}
+	for (i = 0; i < cache->nbuckets; i++)
+		ISC_LIST_INIT(cache->buckets[i]);
+
+	result = isc_mutex_init(&cache->lock);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_buckets;
+
+	result = isc_refcount_init(&cache->references, 1);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_lock;
+
+	cache->maxsize = maxsize;
+	cache->size = 0;
+	cache->count = 0;
+	ISC_LIST_INIT(cache->lru);
+	memset(cache->scopes, 0, sizeof(cache->scopes));
+	cache->mctx = NULL;
+	isc_mem_attach(mctx, &cache->mctx);
+	cache->magic = ECSCACHE_MAGIC;
+
+	*cachep = cache;
+	return (ISC_R_SUCCESS);
+
+ cleanup_lock:
+	DESTROYLOCK(&cache->lock);
+ cleanup_buckets:
+	isc_mem_put(mctx, cache->buckets,
+		    cache->nbuckets * sizeof(*cache->buckets));
+ cleanup_cache:
+	isc_mem_put(mctx, cache, sizeof(*cache));
+	return (result);
+}
+
+void
+dns_ecscache_attach(dns_ecscache_t *source, dns_ecscache_t **targetp) {
+	REQUIRE(VALID_ECSCACHE(source));
+	REQUIRE(targetp != NULL && *targetp == NULL);
+
+	isc_refcount_increment(&source->references, NULL);
+	*targetp = source;
+}
+
+void
+dns_ecscache_detach(dns_ecscache_t **cachep) {
+	dns_ecscache_t *cache;
+	unsigned int refs;
+
+	REQUIRE(cachep != NULL);
+	cache = *cachep;
+	*cachep = NULL;
+	REQUIRE(VALID_ECSCACHE(cache));
+
+	isc_refcount_decrement(&cache->references, &refs);
+	if (refs > 0)
+		return;
+
+	dns_ecscache_flush(cache);
+	cache->magic = 0;
+	isc_refcount_destroy(&cache->references);
+	DESTROYLOCK(&cache->lock);
+	isc_mem_put(cache->mctx, cache->buckets,
+		    cache->nbuckets * sizeof(*cache->buckets));
+	isc_mem_putanddetach(&cache->mctx, cache, sizeof(*cache));
+}
+
+void
+dns_ecscache_setmaxsize(dns_ecscache_t *cache, size_t maxsize) {
+	REQUIRE(VALID_ECSCACHE(cache));
+
+	LOCK(&cache->lock);
+	cache->maxsize = maxsize;
+	trim(cache);
+	UNLOCK(&cache->lock);
+}
+
+size_t
+dns_ecscache_size(dns_ecscache_t *cache) {
+	size_t size;
+
+	REQUIRE(VALID_ECSCACHE(cache));
+
+	LOCK(&cache->lock);
+	size = cache->size;
+	UNLOCK(&cache->lock);
+
+	return (size);
+}
+
+isc_result_t
+dns_ecscache_add(dns_ecscache_t *cache, dns_name_t *name,
+		 dns_rdataset_t *rdataset, const isc_netaddr_t *addr,
+		 unsigned int scope, isc_stdtime_t now,
+		 dns_rdataset_t *addedrdataset)
+{
+	ecsentry_t *entry, *old;
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	dns_rdata_t *rdatas;
+	unsigned char *data;
+	unsigned int count, datalen, i;
+	isc_region_t r;
+	size_t size;
+	isc_result_t result;
+
+	REQUIRE(VALID_ECSCACHE(cache));
+	REQUIRE(dns_rdataset_isassociated(rdataset));
+	REQUIRE(addr != NULL);
+	REQUIRE(addr->family == AF_INET || addr->family == AF_INET6);
+	REQUIRE(scope > 0 && scope <= FAMILY_MAXBITS(addr->family));
+	REQUIRE(addedrdataset == NULL ||
+		!dns_rdataset_isassociated(addedrdataset));
+
+	count = 0;
+	datalen = 0;
+	for (result = dns_rdataset_first(rdataset);
+	     result == ISC_R_SUCCESS;
+	     result = dns_rdataset_next(rdataset))
+	{
+		dns_rdata_reset(&rdata);
+		dns_rdataset_current(rdataset, &rdata);
+		count++;
+		datalen += rdata.length;
+	}
+	if (result != ISC_R_NOMORE)
+		return (result);
+
+	size = sizeof(*entry) + count * sizeof(dns_rdata_t) +
+	       name->length + datalen;
+	entry = isc_mem_get(cache->mctx, size);
+	if (entry == NULL)
+		return (ISC_R_NOMEMORY);
+
+	rdatas = (dns_rdata_t *)(entry + 1);
+	data = (unsigned char *)(rdatas + count);
+
+	dns_name_init(&entry->name, NULL);
+	dns_name_toregion(name, &r);
+	memmove(data, r.base, r.length);
+	r.base = data;
+	dns_name_fromregion(&entry->name, &r);
+	data += r.length;
+
+	dns_rdatalist_init(&entry->rdatalist);
+	entry->rdatalist.rdclass = rdataset->rdclass;
+	entry->rdatalist.type = rdataset->type;
+	entry->rdatalist.covers = rdataset->covers;
+	entry->rdatalist.ttl = rdataset->ttl;
+	i = 0;
+	for (result = dns_rdataset_first(rdataset);
+	     result == ISC_R_SUCCESS;
+	     result = dns_rdataset_next(rdataset))
+	{
+		dns_rdata_reset(&rdata);
+		dns_rdataset_current(rdataset, &rdata);
+		dns_rdata_toregion(&rdata, &r);
+		memmove(data, r.base, r.length);
+		r.base = data;
+		data += r.length;
+		dns_rdata_init(&rdatas[i]);
+		dns_rdata_fromregion(&rdatas[i], rdata.rdclass, rdata.type,
+				     &r);
+		ISC_LIST_APPEND(entry->rdatalist.rdata, &rdatas[i], link);
+		i++;
+	}
+	INSIST(i == count);
+
+	entry->mctx = NULL;
+	isc_mem_attach(cache->mctx, &entry->mctx);
+	entry->size = size;
+	entry->linked = ISC_FALSE;
+	ISC_LINK_INIT(entry, hlink);
+	ISC_LINK_INIT(entry, lru);
+	entry->expire = now + rdataset->ttl;
+	entry->trust = rdataset->trust;
+	entry->family = addr->family;
+	entry->scope = scope;
+	maskaddr(addr, scope, entry->prefix);
+	entry->hashval = hashkey(&entry->name, rdataset->type,
+				 rdataset->covers, entry->family, scope,
+				 entry->prefix);
+	result = isc_refcount_init(&entry->references, 1);
+	if (result != ISC_R_SUCCESS) {
+		isc_mem_putanddetach(&entry->mctx, entry, size);
+		return (result);
+	}
+	entry->magic = ECSENTRY_MAGIC;
+
+	LOCK(&cache->lock);
+
+	old = find(cache, entry->hashval, &entry->name, rdataset->type,
+		   rdataset->covers, entry->family, scope, entry->prefix);
+	if (old != NULL && isc_serial_gt(old->expire, now) &&
+	    old->trust > entry->trust)
+	{
+		/*
+		 * Keep the better data we already have.
+		 */
+		ISC_LIST_UNLINK(cache->lru, old, lru);
+		ISC_LIST_PREPEND(cache->lru, old, lru);
+		if (addedrdataset != NULL)
+			bindrdataset(old, now, addedrdataset);
+		UNLOCK(&cache->lock);
+		entry_detach(&entry);
+		return (DNS_R_UNCHANGED);
+	}
+	if (old != NULL)
+		unlink_entry(cache, old);
+
+	ISC_LIST_PREPEND(cache->buckets[entry->hashval &
+					(cache->nbuckets - 1)],
+			 entry, hlink);
+	ISC_LIST_PREPEND(cache->lru, entry, lru);
+	entry->linked = ISC_TRUE;
+	cache->size += entry->size;
+	cache->count++;
+	cache->scopes[FAMILY_INDEX(entry->family)][scope]++;
+	if (addedrdataset != NULL)
+		bindrdataset(entry, now, addedrdataset);
+	trim(cache);
+	grow(cache);
+
+	UNLOCK(&cache->lock);
+
+	return (ISC_R_SUCCESS);
+}
+
+isc_result_t
+dns_ecscache_lookup(dns_ecscache_t *cache, dns_name_t *name,
+		    dns_rdatatype_t type, const isc_netaddr_t *addr,
+		    unsigned int sourcelen, isc_stdtime_t now,
+		    unsigned int options, dns_rdataset_t *rdataset,
+		    dns_rdataset_t *sigrdataset)
+{
+	ecsentry_t *entry = NULL, *sig;
+	unsigned char prefix[16];
+	unsigned int *scopes;
+	unsigned int scope, hashval;
+	isc_result_t result = ISC_R_NOTFOUND;
+
+	REQUIRE(VALID_ECSCACHE(cache));
+	REQUIRE(addr != NULL);
+	REQUIRE(addr->family == AF_INET || addr->family == AF_INET6);
+	REQUIRE(DNS_RDATASET_VALID(rdataset));
+	REQUIRE(!dns_rdataset_isassociated(rdataset));
+	REQUIRE(sigrdataset == NULL ||
+		!dns_rdataset_isassociated(sigrdataset));
+
+	if (sourcelen > FAMILY_MAXBITS(addr->family))
+		sourcelen = FAMILY_MAXBITS(addr->family);
+
+	LOCK(&cache->lock);
+
+	scopes = cache->scopes[FAMILY_INDEX(addr->family)];
+	for (scope = sourcelen; scope > 0; scope--) {
+		if (scopes[scope] == 0)
+			continue;
+		maskaddr(addr, scope, prefix);
+		hashval = hashkey(name, type, 0, addr->family, scope, prefix);
+		entry = find(cache, hashval, name, type, 0, addr->family,
+			     scope, prefix);
+		if (entry == NULL)
+			continue;
+		if (!isc_serial_gt(entry->expire, now)) {
+			unlink_entry(cache, entry);
+			entry = NULL;
+			continue;
+		}
+		if (DNS_TRUST_PENDING(entry->trust) &&
+		    (options & DNS_DBFIND_PENDINGOK) == 0)
+		{
+			entry = NULL;
+			continue;
+		}
+		break;
+	}
+
+	if (entry != NULL) {
+		ISC_LIST_UNLINK(cache->lru, entry, lru);
+		ISC_LIST_PREPEND(cache->lru, entry, lru);
+		bindrdataset(entry, now, rdataset);
+
+		if (sigrdataset != NULL) {
+			hashval = hashkey(name, dns_rdatatype_rrsig, type,
+					  addr->family, scope, prefix);
+			sig = find(cache, hashval, name, dns_rdatatype_rrsig,
+				   type, addr->family, scope, prefix);
+			if (sig != NULL && isc_serial_gt(sig->expire, now))
+				bindrdataset(sig, now, sigrdataset);
+		}
+		result = ISC_R_SUCCESS;
+	}
+
+	UNLOCK(&cache->lock);
+
+	return (result);
+}
+
+isc_boolean_t
+dns_ecscache_getscope(dns_rdataset_t *rdataset, unsigned int *scopep) {
+	ecsentry_t *entry;
+
+	REQUIRE(DNS_RDATASET_VALID(rdataset));
+	REQUIRE(scopep != NULL);
+
+	if (rdataset->methods != &methods)
+		return (ISC_FALSE);
+
+	entry = rdataset->private5;
+	INSIST(VALID_ECSENTRY(entry));
+	*scopep = entry->scope;
+	return (ISC_TRUE);
+}
+
+void
+dns_ecscache_flush(dns_ecscache_t *cache) {
+	ecsentry_t *entry;
+
+	REQUIRE(VALID_ECSCACHE(cache));
+
+	LOCK(&cache->lock);
+	while ((entry = ISC_LIST_HEAD(cache->lru)) != NULL)
+		unlink_entry(cache, entry);
+	UNLOCK(&cache->lock);
+}
+
+void
+dns_ecscache_flushnode(dns_ecscache_t *cache, dns_name_t *name,
+		       isc_boolean_t tree)
+{
+	ecsentry_t *entry, *next;
+	isc_boolean_t match;
+
+	REQUIRE(VALID_ECSCACHE(cache));
+
+	LOCK(&cache->lock);
+	for (entry = ISC_LIST_HEAD(cache->lru); entry != NULL; entry = next) {
+		next = ISC_LIST_NEXT(entry, lru);
+		if (tree)
+			match = dns_name_issubdomain(&entry->name, name);
+		else
+			match = dns_name_equal(&entry->name, name);
+		if (match)
+			unlink_entry(cache, entry);
+	}
+	UNLOCK(&cache->lock);
+}
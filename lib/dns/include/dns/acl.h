@@ -66,6 +66,7 @@ typedef enum {
 } dns_aclelementtype_t;
 
 typedef struct dns_aclipprefix dns_aclipprefix_t;
+typedef struct dns_acltrie dns_acltrie_t;
 
 struct dns_aclipprefix {
 	isc_netaddr_t address; /* IP4/IP6 */
@@ -89,6 +90,7 @@ struct dns_acl {
 	isc_refcount_t		refcount;
 	dns_iptable_t		*iptable;
 #define node_count		iptable->radix->num_added_node
+	dns_acltrie_t		*trie;		/*%< Compiled iptable */
 	dns_aclelement_t	*elements;
 	isc_boolean_t 		has_negatives;
 	unsigned int 		alloc;		/*%< Elements allocated */
@@ -183,6 +185,53 @@ dns_acl_detach(dns_acl_t **aclp);
  *\li	'*aclp' is not linked on final detach.
  */
 
+isc_result_t
+dns_acl_compile(dns_acl_t *acl);
+/*%<
+ * Build a flattened copy of the IP table of 'acl', and of the ACLs
+ * nested in it, for dns_acl_match2() to search instead of the radix
+ * tree.  The copy is held in a single array, so that a search touches
+ * little memory, and matching needs no isc_prefix_t.
+ *
+ * Nothing needs to be done when 'acl' changes afterwards: a copy that
+ * is out of date is ignored until dns_acl_compile() is called again.
+ *
+ * Requires:
+ *\li	'acl' is a valid ACL which is not yet being used for matching.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMEMORY
+ */
+
+isc_boolean_t
+dns_acl_isaddressonly(const dns_acl_t *acl);
+/*%<
+ * Return #ISC_TRUE iff whether an address matches 'acl' depends on
+ * nothing but the address itself: that is, 'acl' and the ACLs nested
+ * in it have no key names, "localhost", "localnets" or GeoIP
+ * elements.
+ */
+
+isc_result_t
+dns_acl_matchprefix(const isc_netaddr_t *addr, unsigned int bitlen,
+		    const dns_acl_t *acl, int *match);
+/*%<
+ * Determine how 'acl' matches the addresses that begin with the first
+ * 'bitlen' bits of 'addr' and that do not match any prefix in 'acl'
+ * longer than 'bitlen'.  All such addresses match 'acl' in the same
+ * way; '*match' is set as dns_acl_match() would set it for any of them
+ * in a query without a TSIG signature or EDNS client subnet option.
+ *
+ * Requires:
+ *\li	'addr' is an IPv4 or IPv6 address.
+ *\li	'acl' is a valid ACL for which dns_acl_isaddressonly() is true.
+ *\li	'match' is not NULL.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ */
+
 isc_boolean_t
 dns_acl_isinsecure(const dns_acl_t *a);
 /*%<
@@ -326,6 +326,46 @@ dns_cache_updatestats(dns_cache_t *cache, isc_result_t result);
  * Update cache statistics based on result code in 'result'
  */
 
+isc_result_t
+dns_cache_setpopularity(dns_cache_t *cache, dns_popularity_t *pop);
+/*%<
+ * Count successful lookups in 'cache' in the popularity counter 'pop'.
+ * The counter is kept across dns_cache_flush() and can only be set
+ * once for the lifetime of the cache.
+ *
+ * Requires:
+ *\li	'cache' to be a valid cache.
+ *\li	'pop' to be a valid popularity counter.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_EXISTS if a different counter has already been set.
+ *\li	#ISC_R_NOTIMPLEMENTED if the cache database does not support it.
+ */
+
+dns_popularity_t *
+dns_cache_getpopularity(dns_cache_t *cache);
+/*%<
+ * Return the popularity counter set for 'cache', or NULL.
+ */
+
+void
+dns_cache_setservestalettl(dns_cache_t *cache, dns_ttl_t ttl);
+/*%<
+ * Keep expired records in 'cache' for up to 'ttl' seconds so that they
+ * can be served stale; zero disables this.  The setting is kept across
+ * dns_cache_flush().
+ *
+ * Requires:
+ *\li	'cache' to be a valid cache.
+ */
+
+dns_ttl_t
+dns_cache_getservestalettl(dns_cache_t *cache);
+/*%<
+ * Return the serve-stale window of 'cache'.
+ */
+
 #ifdef HAVE_LIBXML2
 int
 dns_cache_renderxml(dns_cache_t *cache, xmlTextWriterPtr writer);
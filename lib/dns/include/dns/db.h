@@ -195,6 +195,9 @@ typedef struct dns_dbmethods {
 				   dns_rdataset_t *sigrdataset);
 	isc_result_t	(*setcachestats)(dns_db_t *db, isc_stats_t *stats);
 	unsigned int	(*hashsize)(dns_db_t *db);
+	isc_result_t	(*setpopularity)(dns_db_t *db, dns_popularity_t *pop);
+	isc_result_t	(*setservestalettl)(dns_db_t *db, dns_ttl_t ttl);
+	isc_result_t	(*setservestalesize)(dns_db_t *db, size_t size);
 } dns_dbmethods_t;
 
 typedef isc_result_t
@@ -243,6 +246,8 @@ struct dns_db {
 #define DNS_DBFIND_FORCENSEC3		0x0080
 #define DNS_DBFIND_ADDITIONALOK		0x0100
 #define DNS_DBFIND_NOZONECUT		0x0200
+#define DNS_DBFIND_STALEOK		0x0400
+#define DNS_DBFIND_NOPOPULARITY		0x0800
 /*@}*/
 
 /*@{*/
@@ -795,6 +800,17 @@ dns_db_findext(dns_db_t *db, dns_name_t *name, dns_dbversion_t *version,
  *	and working up to the zone origin.  This option is only meaningful
  *	when querying redirect zones.
  *
+ * \li	If the #DNS_DBFIND_STALEOK option is set, expired data that is
+ *	still within the database's serve-stale window (see
+ *	dns_db_setservestalettl()) may be returned.  Such rdatasets have
+ *	a TTL of zero and #DNS_RDATASETATTR_STALE set.  This option is
+ *	only meaningful for cache databases.
+ *
+ * \li	If the #DNS_DBFIND_NOPOPULARITY option is set, a successful lookup
+ *	is not counted by the database's popularity counters (see
+ *	dns_db_setpopularity()).  This is for lookups made on behalf of
+ *	the cache itself rather than a client.
+ *
  * \li	If the #DNS_DBFIND_FORCENSEC option is set, the database is assumed to
  *	have NSEC records, and these will be returned when appropriate.  This
  *	is only necessary when querying a database that was not secure
@@ -1611,6 +1627,57 @@ dns_db_setcachestats(dns_db_t *db, isc_stats_t *stats);
  *	dns_rdatasetstats_create(); otherwise NULL.
  */
 
+isc_result_t
+dns_db_setpopularity(dns_db_t *db, dns_popularity_t *pop);
+/*%<
+ * Count successful lookups in 'db' in the popularity counter 'pop'.
+ * This option may not exist depending on the DB implementation.
+ *
+ * Requires:
+ *
+ * \li	'db' is a valid database (cache only).
+ *
+ * Returns:
+ * \li	#ISC_R_SUCCESS
+ * \li	#ISC_R_EXISTS if a different counter has already been set.
+ * \li	#ISC_R_NOTIMPLEMENTED if the database does not support it.
+ */
+
+isc_result_t
+dns_db_setservestalettl(dns_db_t *db, dns_ttl_t ttl);
+/*%<
+ * Keep expired data in 'db' for up to 'ttl' seconds past its expiry so
+ * that it can be returned by dns_db_find() with #DNS_DBFIND_STALEOK.
+ * A 'ttl' of zero disables the retention.  Retained data is the first
+ * to be purged when the database is over its memory limit, and its size
+ * is limited by dns_db_setservestalesize().
+ *
+ * Requires:
+ *
+ * \li	'db' is a valid database (cache only).
+ *
+ * Returns:
+ * \li	#ISC_R_SUCCESS
+ * \li	#ISC_R_NOTIMPLEMENTED if the database does not support it.
+ */
+
+isc_result_t
+dns_db_setservestalesize(dns_db_t *db, size_t size);
+/*%<
+ * Limit the memory used by data which 'db' only keeps so that it can be
+ * served stale (see dns_db_setservestalettl()) to about 'size' bytes.
+ * When the limit is reached, the oldest such data is purged first.
+ * A 'size' of zero means no limit other than the database's own.
+ *
+ * Requires:
+ *
+ * \li	'db' is a valid database (cache only).
+ *
+ * Returns:
+ * \li	#ISC_R_SUCCESS
+ * \li	#ISC_R_NOTIMPLEMENTED if the database does not support it.
+ */
+
 void
 dns_db_rpz_attach(dns_db_t *db, dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num);
 /*%<
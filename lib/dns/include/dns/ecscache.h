@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2015  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DNS_ECSCACHE_H
+#define DNS_ECSCACHE_H 1
+
+/*****
+ ***** Module Info
+ *****/
+
+/*! \file dns/ecscache.h
+ * \brief
+ * Defines dns_ecscache_t, a cache of answers that an authoritative
+ * server tailored to a client subnet (RFC 7871).
+ *
+ * Notes:
+ *\li	An answer that carries an EDNS client subnet option with a
+ *	non-zero scope prefix length is only valid for clients within
+ *	that prefix, so it cannot be stored in the ordinary cache
+ *	database.  Such rdatasets are kept here instead, keyed by owner
+ *	name, type, address family, scope prefix length and the client
+ *	address truncated to the scope.
+ *
+ *\li	A lookup for a client address tries the scope prefix lengths
+ *	that are in use, longest first, so the most specific answer that
+ *	covers the client is found.  Scopes longer than the source
+ *	prefix length known for the client are never used.
+ *
+ *\li	The cache has its own memory limit, independent of the cache
+ *	database; when it is exceeded the least recently used entries are
+ *	discarded.  Expired entries are removed when they are found.
+ *
+ *\li	Rdatasets returned by dns_ecscache_lookup() and
+ *	dns_ecscache_add() hold a reference to the cache entry, and stay
+ *	valid after the entry has been replaced, evicted or flushed.
+ *
+ * MP:
+ *\li	All functions may be called concurrently.
+ */
+
+/***
+ ***	Imports
+ ***/
+
+#include <isc/lang.h>
+#include <isc/netaddr.h>
+#include <isc/stdtime.h>
+
+#include <dns/types.h>
+
+ISC_LANG_BEGINDECLS
+
+/***
+ ***	Functions
+ ***/
+
+isc_result_t
+dns_ecscache_create(isc_mem_t *mctx, size_t maxsize,
+		    dns_ecscache_t **cachep);
+/*%<
+ * Create an empty cache which may use up to 'maxsize' bytes of memory
+ * for its entries.  A 'maxsize' of zero means no limit.
+ *
+ * Requires:
+ *\li	'mctx' is a valid memory context.
+ *\li	cachep != NULL && *cachep == NULL
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMEMORY
+ */
+
+void
+dns_ecscache_attach(dns_ecscache_t *source, dns_ecscache_t **targetp);
+/*%<
+ * Attach '*targetp' to 'source'.
+ */
+
+void
+dns_ecscache_detach(dns_ecscache_t **cachep);
+/*%<
+ * Detach '*cachep', destroying the cache when the last reference goes
+ * away.
+ */
+
+void
+dns_ecscache_setmaxsize(dns_ecscache_t *cache, size_t maxsize);
+/*%<
+ * Change the memory limit of 'cache' to 'maxsize' bytes, discarding
+ * entries as needed.  A 'maxsize' of zero means no limit.
+ */
+
+size_t
+dns_ecscache_size(dns_ecscache_t *cache);
+/*%<
+ * Return the number of bytes used by the entries in 'cache'.
+ */
+
+isc_result_t
+dns_ecscache_add(dns_ecscache_t *cache, dns_name_t *name,
+		 dns_rdataset_t *rdataset, const isc_netaddr_t *addr,
+		 unsigned int scope, isc_stdtime_t now,
+		 dns_rdataset_t *addedrdataset);
+/*%<
+ * Store a copy of 'rdataset', owned by 'name', as the answer for
+ * clients whose address begins with the first 'scope' bits of 'addr'.
+ * The entry expires 'rdataset->ttl' seconds after 'now'.
+ *
+ * An unexpired entry with the same key and a higher trust level is
+ * kept in preference to 'rdataset'.
+ *
+ * If 'addedrdataset' is not NULL, it is bound to the entry that is in
+ * the cache after the call.
+ *
+ * Requires:
+ *\li	'cache' is a valid cache.
+ *\li	'rdataset' is a valid, associated rdataset.
+ *\li	'addr' is an IPv4 or IPv6 address.
+ *\li	0 < scope <= 32 for IPv4, 0 < scope <= 128 for IPv6.
+ *\li	'addedrdataset' is NULL, or a valid, disassociated rdataset.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#DNS_R_UNCHANGED	an existing entry was kept
+ *\li	#ISC_R_NOMEMORY
+ */
+
+isc_result_t
+dns_ecscache_lookup(dns_ecscache_t *cache, dns_name_t *name,
+		    dns_rdatatype_t type, const isc_netaddr_t *addr,
+		    unsigned int sourcelen, isc_stdtime_t now,
+		    unsigned int options, dns_rdataset_t *rdataset,
+		    dns_rdataset_t *sigrdataset);
+/*%<
+ * Find the most specific unexpired rdataset of type 'type' owned by
+ * 'name' which was stored for a prefix that contains the first
+ * 'sourcelen' bits of 'addr', and bind it to 'rdataset'.  If
+ * 'sigrdataset' is not NULL, the RRSIGs stored for the same prefix are
+ * bound to it, if there are any.
+ *
+ * Entries which are pending validation are ignored unless
+ * #DNS_DBFIND_PENDINGOK is set in 'options'.
+ *
+ * Requires:
+ *\li	'cache' is a valid cache.
+ *\li	'addr' is an IPv4 or IPv6 address.
+ *\li	'rdataset' is a valid, disassociated rdataset.
+ *\li	'sigrdataset' is NULL, or a valid, disassociated rdataset.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOTFOUND
+ */
+
+isc_boolean_t
+dns_ecscache_getscope(dns_rdataset_t *rdataset, unsigned int *scopep);
+/*%<
+ * If 'rdataset' is bound to an entry in an ECS cache, set '*scopep'
+ * to the scope prefix length of the entry and return #ISC_TRUE.
+ * Otherwise return #ISC_FALSE.
+ */
+
+void
+dns_ecscache_flush(dns_ecscache_t *cache);
+/*%<
+ * Discard every entry in 'cache'.
+ */
+
+void
+dns_ecscache_flushnode(dns_ecscache_t *cache, dns_name_t *name,
+		       isc_boolean_t tree);
+/*%<
+ * Discard every entry in 'cache' owned by 'name', or if 'tree' is
+ * true, by 'name' or any name below it.
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* DNS_ECSCACHE_H */
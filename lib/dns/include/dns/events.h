@@ -80,6 +80,9 @@
 #define DNS_EVENT_KEYDONE			(ISC_EVENTCLASS_DNS + 50)
 #define DNS_EVENT_SETNSEC3PARAM			(ISC_EVENTCLASS_DNS + 51)
 #define DNS_EVENT_SETSERIAL			(ISC_EVENTCLASS_DNS + 52)
+#define DNS_EVENT_VALIDATORVERIFY		(ISC_EVENTCLASS_DNS + 53)
+#define DNS_EVENT_ZONEJOURNALSYNC		(ISC_EVENTCLASS_DNS + 54)
+#define DNS_EVENT_ZONEJOURNALDUMP		(ISC_EVENTCLASS_DNS + 55)
 
 #define DNS_EVENT_FIRSTEVENT			(ISC_EVENTCLASS_DNS + 0)
 #define DNS_EVENT_LASTEVENT			(ISC_EVENTCLASS_DNS + 65535)
@@ -49,6 +49,7 @@
 #define DNS_JOURNAL_READ	0x00000000	/* ISC_FALSE */
 #define DNS_JOURNAL_CREATE	0x00000001	/* ISC_TRUE */
 #define DNS_JOURNAL_WRITE	0x00000002
+#define DNS_JOURNAL_GROUPCOMMIT	0x00000004
 
 /***
  *** Types
@@ -108,6 +109,12 @@ dns_journal_open(isc_mem_t *mctx, const char *filename, unsigned int mode,
  * the journal if it does not exist.
  * DNS_JOURNAL_WRITE open the journal for reading and writing.
  * DNS_JOURNAL_READ open the journal for reading only.
+ *
+ * DNS_JOURNAL_GROUPCOMMIT may be added to DNS_JOURNAL_CREATE or
+ * DNS_JOURNAL_WRITE to defer committing transactions to stable storage
+ * until dns_journal_sync() is called, so that several transactions
+ * can share one sync.  Until then, the journal header on disk does not
+ * include them and other openers of the journal will not see them.
  */
 
 void
@@ -157,6 +164,23 @@ dns_journal_commit(dns_journal_t *j);
  *      sequence.
  */
 
+isc_result_t
+dns_journal_sync(dns_journal_t *j);
+/*%<
+ * Commit the transactions written to journal file 'j' since it was
+ * opened with DNS_JOURNAL_GROUPCOMMIT, or since the last call to
+ * dns_journal_sync(), to stable storage and update the journal header
+ * and index on disk to include them.  This is also done by
+ * dns_journal_destroy(), ignoring any errors.
+ *
+ * Requires:
+ *\li	'j' is a valid journal.
+ *
+ * Returns:
+ *\li	ISC_R_SUCCESS, also when there was nothing to commit.
+ *\li	ISC_R_UNEXPECTED if writing or syncing the file failed.
+ */
+
 isc_result_t
 dns_journal_write_transaction(dns_journal_t *j, dns_diff_t *diff);
 /*%
@@ -189,6 +189,7 @@ typedef int dns_messagetextflag_t;
 #endif
 
 typedef struct dns_msgblock dns_msgblock_t;
+typedef struct dns_msgchunk dns_msgchunk_t;
 
 struct dns_message {
 	/* public from here down */
@@ -243,6 +244,13 @@ struct dns_message {
 	ISC_LIST(dns_rdata_t)		freerdata;
 	ISC_LIST(dns_rdatalist_t)	freerdatalist;
 
+	ISC_LIST(dns_msgchunk_t)	arena;
+	size_t				arenasize;
+	ISC_LIST(dns_name_t)		freenames;
+	ISC_LIST(dns_rdataset_t)	freerdatasets;
+	unsigned int			arenanames;
+	unsigned int			arenardatasets;
+
 	dns_rcode_t			tsigstatus;
 	dns_rcode_t			querytsigstatus;
 	dns_name_t		       *tsigname; /* Owner name of TSIG, if any */
@@ -300,6 +308,31 @@ dns_message_create(isc_mem_t *mctx, unsigned int intent, dns_message_t **msgp);
  *\li	#ISC_R_SUCCESS		-- success
  */
 
+isc_result_t
+dns_message_usearena(dns_message_t *msg, size_t size);
+/*%<
+ * Make 'msg' carve the names, rdatasets, rdatas, rdatalists, offsets
+ * and scratch buffers it needs while parsing or rendering out of a
+ * private arena instead of getting each of them from its memory
+ * context.  The arena starts as a single chunk of about 'size' bytes
+ * (a default size is used if 'size' is zero) and is given back all at
+ * once by dns_message_reset(); when a message overflows it, the chunk
+ * is grown so that the next message of that size fits.
+ *
+ * This is intended for messages which are reset and reused for many
+ * queries or responses, such as those of a client or a resolver fetch.
+ *
+ * Requires:
+ *\li	'msg' be valid, and not yet used for parsing or rendering since
+ *	it was created or last reset.
+ *
+ *\li	'msg' not already be using an arena.
+ *
+ * Returns:
+ *\li	#ISC_R_NOMEMORY		-- out of memory
+ *\li	#ISC_R_SUCCESS		-- success
+ */
+
 void
 dns_message_reset(dns_message_t *msg, unsigned int intent);
 /*%<
@@ -580,6 +613,32 @@ dns_message_rendersection(dns_message_t *msg, dns_section_t section,
  *				   are records remaining for this section.
  */
 
+isc_result_t
+dns_message_renderrr(dns_message_t *msg, dns_section_t section,
+		     dns_name_t *owner, dns_ttl_t ttl, dns_rdata_t *rdata);
+/*%<
+ * Render a single record straight into the render buffer, without
+ * adding it to the message's names and rdatasets.  This lets a caller
+ * stream records from a database, as outgoing zone transfers do,
+ * without building temporary names and rdata lists for them.
+ *
+ * Records rendered this way are counted in the header but are otherwise
+ * invisible to the message; in particular they are not seen by
+ * dns_message_renderreset().
+ *
+ * Requires:
+ *\li	'msg' be valid.
+ *
+ *\li	'section' be a valid section other than the question section.
+ *
+ *\li	dns_message_renderbegin() was called.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS		-- the record was written.
+ *\li	#ISC_R_NOSPACE		-- Not enough room in the buffer; nothing
+ *				   was written.
+ */
+
 void
 dns_message_renderheader(dns_message_t *msg, isc_buffer_t *target);
 /*%<
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2015  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DNS_POPULARITY_H
+#define DNS_POPULARITY_H 1
+
+/*****
+ ***** Module Info
+ *****/
+
+/*! \file dns/popularity.h
+ * \brief
+ * Defines dns_popularity_t, an approximate per-name/type hit counter.
+ *
+ * Notes:
+ *\li	Hits are counted in a count-min sketch, so the memory used is
+ *	fixed at creation time regardless of the number of distinct
+ *	names seen.  Estimates never undercount; they may overcount
+ *	when names collide in every row of the sketch.
+ *
+ *\li	The most popular name/type tuples are additionally kept in a
+ *	small "hot list" so that they can be enumerated, e.g. by the
+ *	resolver when refreshing popular cache entries before they
+ *	expire.
+ *
+ *\li	Counters are halved by dns_popularity_decay() so that old
+ *	popularity fades away.
+ *
+ * MP:
+ *\li	dns_popularity_record() may be called concurrently from any
+ *	number of threads.  Counter updates are lock-free where atomic
+ *	operations are available; lost updates are tolerated as the
+ *	counts are approximate by design.
+ */
+
+/***
+ ***	Imports
+ ***/
+
+#include <isc/lang.h>
+
+#include <dns/fixedname.h>
+#include <dns/types.h>
+
+ISC_LANG_BEGINDECLS
+
+/***
+ ***	Types
+ ***/
+
+typedef struct dns_popentry {
+	dns_fixedname_t		fname;
+	dns_rdatatype_t		type;
+	isc_uint32_t		count;
+} dns_popentry_t;
+
+/***
+ ***	Functions
+ ***/
+
+isc_result_t
+dns_popularity_create(isc_mem_t *mctx, unsigned int hotsize,
+		      dns_popularity_t **popp);
+/*%<
+ * Create a popularity counter able to track up to 'hotsize' of the
+ * most popular name/type tuples.  The sketch width is derived from
+ * 'hotsize'.
+ *
+ * Requires:
+ *\li	'mctx' is a valid memory context.
+ *\li	'hotsize' > 0
+ *\li	popp != NULL && *popp == NULL
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMEMORY
+ */
+
+void
+dns_popularity_attach(dns_popularity_t *source, dns_popularity_t **targetp);
+/*%<
+ * Attach '*targetp' to 'source'.
+ */
+
+void
+dns_popularity_detach(dns_popularity_t **popp);
+/*%<
+ * Detach '*popp', destroying the object when the last reference
+ * goes away.
+ */
+
+isc_uint32_t
+dns_popularity_record(dns_popularity_t *pop, dns_name_t *name,
+		      dns_rdatatype_t type);
+/*%<
+ * Record a hit for 'name'/'type' and return the updated estimate.
+ *
+ * Requires:
+ *\li	'pop' is valid.
+ *\li	'name' is a valid absolute name.
+ */
+
+isc_uint32_t
+dns_popularity_estimate(dns_popularity_t *pop, dns_name_t *name,
+			dns_rdatatype_t type);
+/*%<
+ * Return the current estimate for 'name'/'type' without recording a hit.
+ */
+
+void
+dns_popularity_decay(dns_popularity_t *pop);
+/*%<
+ * Halve every counter in the sketch and in the hot list.  Hot list
+ * entries whose count drops to zero are removed.
+ */
+
+unsigned int
+dns_popularity_gethot(dns_popularity_t *pop, dns_popentry_t *entries,
+		      unsigned int nentries);
+/*%<
+ * Copy up to 'nentries' of the most popular tuples into 'entries',
+ * most popular first, and return the number copied.  Each returned
+ * entry's 'fname' has been initialized by this function.
+ *
+ * Requires:
+ *\li	'entries' points to an array of at least 'nentries' elements.
+ */
+
+unsigned int
+dns_popularity_hotsize(dns_popularity_t *pop);
+/*%<
+ * Return the maximum number of tuples kept in the hot list.
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* DNS_POPULARITY_H */
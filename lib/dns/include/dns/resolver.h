@@ -297,6 +297,19 @@ dns_resolver_createfetch3(dns_resolver_t *res, dns_name_t *name,
 			  dns_rdataset_t *rdataset,
 			  dns_rdataset_t *sigrdataset,
 			  dns_fetch_t **fetchp);
+isc_result_t
+dns_resolver_createfetch4(dns_resolver_t *res, dns_name_t *name,
+			  dns_rdatatype_t type,
+			  dns_name_t *domain, dns_rdataset_t *nameservers,
+			  dns_forwarders_t *forwarders,
+			  isc_sockaddr_t *client, isc_uint16_t id,
+			  unsigned int options, unsigned int depth,
+			  isc_counter_t *qc, const isc_netaddr_t *ecsaddr,
+			  unsigned int ecsbits, isc_task_t *task,
+			  isc_taskaction_t action, void *arg,
+			  dns_rdataset_t *rdataset,
+			  dns_rdataset_t *sigrdataset,
+			  dns_fetch_t **fetchp);
 /*%<
  * Recurse to answer a question.
  *
@@ -323,6 +336,13 @@ dns_resolver_createfetch3(dns_resolver_t *res, dns_name_t *name,
  *	must remain stable until after 'action' has been called or
  *	dns_resolver_cancelfetch() is called.
  *
+ *\li	If 'ecsbits' is not zero, queries carry an EDNS client subnet
+ *	option for the first 'ecsbits' bits of 'ecsaddr', and a fetch is
+ *	only shared with fetches for the same client subnet.  Answer data
+ *	that the server scopes to part of the client subnet is added to
+ *	the view's ECS cache (see dns/ecscache.h) rather than to the
+ *	cache database, and is what the rdatasets are bound to.
+ *
  * Requires:
  *
  *\li	'res' is a valid resolver that has been frozen.
@@ -340,6 +360,10 @@ dns_resolver_createfetch3(dns_resolver_t *res, dns_name_t *name,
  *
  *\li	'client' is a valid sockaddr or NULL.
  *
+ *\li	'ecsbits' is zero, or 'ecsaddr' is an IPv4 address and
+ *	'ecsbits' <= 32, or 'ecsaddr' is an IPv6 address and
+ *	'ecsbits' <= 128.
+ *
  *\li	'options' contains valid options.
  *
  *\li	'rdataset' is a valid, disassociated rdataset.
@@ -568,6 +592,24 @@ dns_resolver_setclientsperquery(dns_resolver_t *resolver,
 void
 dns_resolver_setfetchesperzone(dns_resolver_t *resolver, isc_uint32_t clients);
 
+isc_result_t
+dns_resolver_setpopularprefetch(dns_resolver_t *resolver,
+				dns_popularity_t *pop, unsigned int count,
+				unsigned int rate);
+/*%<
+ * Periodically refresh the 'count' most popular entries tracked by
+ * 'pop' that are about to expire from the cache, starting at most
+ * 'rate' refresh fetches per second.  Passing a NULL 'pop', or zero
+ * 'count' or 'rate', disables the refresh.
+ *
+ * Requires:
+ *\li	'resolver' is valid and not frozen.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMEMORY
+ */
+
 void
 dns_resolver_getclientsperquery(dns_resolver_t *resolver, isc_uint32_t *cur,
 				isc_uint32_t *min, isc_uint32_t *max);
@@ -23,6 +23,7 @@
 #include <isc/lang.h>
 #include <isc/refcount.h>
 #include <isc/rwlock.h>
+#include <isc/stdtime.h>
 
 #include <dns/fixedname.h>
 #include <dns/rdata.h>
@@ -180,6 +181,13 @@ struct dns_rpz_popt {
 	dns_rpz_num_t	    num_zones;
 };
 
+/*
+ * Bloom filter over the triggers in the summary databases, and cache of
+ * delegations whose name servers hit no NSDNAME or NSIP triggers.
+ */
+typedef struct dns_rpz_filter dns_rpz_filter_t;
+typedef struct dns_rpz_nsmemo dns_rpz_nsmemo_t;
+
 /*
  * Response policy zones known to a view.
  */
@@ -234,6 +242,15 @@ struct dns_rpz_zones {
 
 	dns_rpz_cidr_node_t	*cidr;
 	dns_rbt_t		*rbt;
+
+	/*
+	 * The filter lets most searches of the summary databases that
+	 * would fail stop early.  trig_gen changes whenever the summary
+	 * databases change, and invalidates the entries in nsmemo.
+	 */
+	dns_rpz_filter_t	*filter;
+	dns_rpz_nsmemo_t	*nsmemo;
+	unsigned int		trig_gen;
 };
 
 
@@ -276,6 +293,7 @@ typedef struct {
 		dns_rdatatype_t		r_type;
 		isc_result_t		r_result;
 		dns_rdataset_t		*r_rdataset;
+		unsigned int		found;	/* summary database hits */
 	} r;
 
 	/*
@@ -294,14 +312,16 @@ typedef struct {
 	} q;
 
 	/*
-	 * A copy of the 'have' and 'p' structures and the RPZ
-	 * policy version as of the beginning of RPZ processing,
+	 * A copy of the 'have' and 'p' structures, the RPZ
+	 * policy version and the trigger generation
+	 * as of the beginning of RPZ processing,
 	 * used to avoid problems when policy is updated while
 	 * RPZ recursion is ongoing.
 	 */
 	dns_rpz_have_t		have;
 	dns_rpz_popt_t		popt;
 	int			rpz_ver;
+	unsigned int		trig_gen;
 
 	/*
 	 * p_name: current policy owner name
@@ -374,6 +394,16 @@ dns_rpz_zbits_t
 dns_rpz_find_name(dns_rpz_zones_t *rpzs, dns_rpz_type_t rpz_type,
 		  dns_rpz_zbits_t zbits, dns_name_t *trig_name);
 
+isc_boolean_t
+dns_rpz_nsmemo_find(dns_rpz_zones_t *rpzs, unsigned int trig_gen,
+		    dns_name_t *nsname, dns_rpz_zbits_t nsdname_zbits,
+		    dns_rpz_zbits_t nsip_zbits, isc_stdtime_t now);
+
+void
+dns_rpz_nsmemo_add(dns_rpz_zones_t *rpzs, unsigned int trig_gen,
+		   dns_name_t *nsname, dns_rpz_zbits_t nsdname_zbits,
+		   dns_rpz_zbits_t nsip_zbits, dns_ttl_t ttl, isc_stdtime_t now);
+
 ISC_LANG_ENDDECLS
 
 #endif /* DNS_RPZ_H */
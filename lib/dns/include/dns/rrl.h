@@ -200,32 +200,26 @@ struct dns_rrl_rate {
 };
 
 /*
- * Per-view query rate limit parameters and a pointer to database.
+ * One shard of the rate-limit database.  A response is charged to the
+ * shard of the thread that sends it, so threads do not contend even
+ * when all responses go to one client address block.  A client can
+ * have entries in several shards, each allowing its share of the rates,
+ * so the limits are approximate.
  */
 typedef struct dns_rrl dns_rrl_t;
-struct dns_rrl {
+typedef struct dns_rrl_shard dns_rrl_shard_t;
+struct dns_rrl_shard {
 	isc_mutex_t	lock;
-	isc_mem_t	*mctx;
-
-	isc_boolean_t	log_only;
-	dns_rrl_rate_t	responses_per_second;
-	dns_rrl_rate_t	referrals_per_second;
-	dns_rrl_rate_t	nodata_per_second;
-	dns_rrl_rate_t	nxdomains_per_second;
-	dns_rrl_rate_t	errors_per_second;
-	dns_rrl_rate_t	all_per_second;
-	dns_rrl_rate_t	slip;
-	int		window;
-	double		qps_scale;
-	int		max_entries;
-
-	dns_acl_t	*exempt;
+	dns_rrl_t	*rrl;
 
 	int		num_entries;
 
 	int		qps_responses;
 	isc_stdtime_t	qps_time;
-	double		qps;
+	unsigned int	qps;
+
+	int		scaled[DNS_RRL_RTYPE_TCP];
+	int		slip_scaled;
 
 	unsigned int	probes;
 	unsigned int	searches;
@@ -241,11 +235,6 @@ struct dns_rrl {
 # define DNS_RRL_TS_BASES   (1<<DNS_RRL_TS_GEN_BITS)
 	isc_stdtime_t	ts_bases[DNS_RRL_TS_BASES];
 
-	int		ipv4_prefixlen;
-	isc_uint32_t	ipv4_mask;
-	int		ipv6_prefixlen;
-	isc_uint32_t	ipv6_mask[4];
-
 	isc_stdtime_t	log_stops_time;
 	dns_rrl_entry_t	*last_logged;
 	int		num_logged;
@@ -255,6 +244,39 @@ struct dns_rrl {
 	dns_rrl_qname_buf_t *qnames[DNS_RRL_QNAMES];
 };
 
+/*
+ * Per-view query rate limit parameters and a pointer to database.
+ * The rates, the limits on the number of entries and the queries/second
+ * estimate used for qps-scale are spread over the shards, and so are
+ * approximate.
+ */
+#define DNS_RRL_SHARD_BITS  4
+#define DNS_RRL_SHARDS	    (1<<DNS_RRL_SHARD_BITS)
+struct dns_rrl {
+	isc_mem_t	*mctx;
+
+	isc_boolean_t	log_only;
+	dns_rrl_rate_t	responses_per_second;
+	dns_rrl_rate_t	referrals_per_second;
+	dns_rrl_rate_t	nodata_per_second;
+	dns_rrl_rate_t	nxdomains_per_second;
+	dns_rrl_rate_t	errors_per_second;
+	dns_rrl_rate_t	all_per_second;
+	dns_rrl_rate_t	slip;
+	int		window;
+	double		qps_scale;
+	int		max_entries;
+
+	dns_acl_t	*exempt;
+
+	int		ipv4_prefixlen;
+	isc_uint32_t	ipv4_mask;
+	int		ipv6_prefixlen;
+	isc_uint32_t	ipv6_mask[4];
+
+	dns_rrl_shard_t	shards[DNS_RRL_SHARDS];
+};
+
 typedef enum {
 	DNS_RRL_RESULT_OK,
 	DNS_RRL_RESULT_DROP,
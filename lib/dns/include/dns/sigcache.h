@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2015  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DNS_SIGCACHE_H
+#define DNS_SIGCACHE_H 1
+
+/*****
+ ***** Module Info
+ *****/
+
+/*! \file dns/sigcache.h
+ * \brief
+ * Defines dns_sigcache_t, a bounded memo of successful RRSIG
+ * verifications.
+ *
+ * Notes:
+ *\li	Each verification is identified by a SHA-256 digest over the
+ *	owner name, the rdataset, the signing key and the RRSIG (see
+ *	dns_sigcache_key()), so a hit means that exactly the same
+ *	verification has succeeded before and the public key operation
+ *	can be skipped.
+ *
+ *\li	Entries are remembered until the signature expires.  The caller
+ *	is still responsible for checking the signature's validity
+ *	period against the current time before trusting a hit.
+ *
+ *\li	The memo is a fixed size, direct mapped table; a new entry
+ *	simply replaces whatever was in its slot.
+ *
+ * MP:
+ *\li	All functions may be called concurrently.
+ */
+
+/***
+ ***	Imports
+ ***/
+
+#include <isc/lang.h>
+#include <isc/sha2.h>
+#include <isc/stdtime.h>
+
+#include <dns/types.h>
+
+#include <dst/dst.h>
+
+ISC_LANG_BEGINDECLS
+
+#define DNS_SIGCACHE_KEYLENGTH	ISC_SHA256_DIGESTLENGTH
+
+/***
+ ***	Functions
+ ***/
+
+isc_result_t
+dns_sigcache_create(isc_mem_t *mctx, unsigned int size,
+		    dns_sigcache_t **cachep);
+/*%<
+ * Create a verification memo with room for about 'size' entries
+ * (rounded up to a power of two).
+ *
+ * Requires:
+ *\li	'mctx' is a valid memory context.
+ *\li	'size' > 0
+ *\li	cachep != NULL && *cachep == NULL
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMEMORY
+ */
+
+void
+dns_sigcache_attach(dns_sigcache_t *source, dns_sigcache_t **targetp);
+/*%<
+ * Attach '*targetp' to 'source'.
+ */
+
+void
+dns_sigcache_detach(dns_sigcache_t **cachep);
+/*%<
+ * Detach '*cachep', destroying the memo when the last reference goes
+ * away.
+ */
+
+isc_result_t
+dns_sigcache_key(dns_name_t *name, dns_rdataset_t *rdataset, dst_key_t *key,
+		 dns_rdata_t *sigrdata, unsigned int maxbits,
+		 unsigned char digest[DNS_SIGCACHE_KEYLENGTH]);
+/*%<
+ * Compute the memo key for verifying 'rdataset' at 'name' with 'key'
+ * and the RRSIG 'sigrdata', as done by dns_dnssec_verify3() with
+ * 'maxbits'.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	Any error from converting 'key' to wire format.
+ */
+
+isc_boolean_t
+dns_sigcache_lookup(dns_sigcache_t *cache,
+		    const unsigned char digest[DNS_SIGCACHE_KEYLENGTH],
+		    isc_stdtime_t now);
+/*%<
+ * Return ISC_TRUE if the verification identified by 'digest' has
+ * succeeded before and the signature had not expired by 'now'.
+ */
+
+void
+dns_sigcache_add(dns_sigcache_t *cache,
+		 const unsigned char digest[DNS_SIGCACHE_KEYLENGTH],
+		 isc_stdtime_t expire);
+/*%<
+ * Remember that the verification identified by 'digest' succeeded
+ * with a signature that expires at 'expire'.
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* DNS_SIGCACHE_H */
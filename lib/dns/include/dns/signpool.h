@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2015  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DNS_SIGNPOOL_H
+#define DNS_SIGNPOOL_H 1
+
+/*****
+ ***** Module Info
+ *****/
+
+/*! \file dns/signpool.h
+ * \brief
+ * Defines dns_signpool_t, a pool of threads that compute RRSIGs in
+ * parallel.
+ *
+ * Notes:
+ *\li	A caller hands dns_signpool_sign() a batch of independent
+ *	signing jobs and blocks until all of them are done.  The
+ *	calling thread works through the batch alongside the pool's
+ *	threads, so a batch always completes even when every pool
+ *	thread is busy with batches from other callers.
+ *
+ *\li	The pool's threads are not task manager worker threads, so
+ *	blocking a task while its batch is signed cannot starve the
+ *	task manager.
+ *
+ * MP:
+ *\li	dns_signpool_sign() may be called concurrently.
+ */
+
+/***
+ ***	Imports
+ ***/
+
+#include <isc/lang.h>
+#include <isc/stdtime.h>
+
+#include <dns/fixedname.h>
+#include <dns/rdata.h>
+#include <dns/rdataset.h>
+#include <dns/types.h>
+
+#include <dst/dst.h>
+
+ISC_LANG_BEGINDECLS
+
+/*%
+ * A request to sign 'rdataset' at 'name' with 'key', as done by
+ * dns_dnssec_sign().  The caller fills in the first group of fields;
+ * dns_signpool_sign() fills in 'result' and, on success, 'rdata',
+ * which refers to 'data'.
+ */
+typedef struct dns_signjob {
+	dns_fixedname_t		name;
+	dns_rdataset_t		rdataset;
+	dst_key_t		*key;
+	isc_stdtime_t		inception;
+	isc_stdtime_t		expire;
+
+	isc_result_t		result;
+	dns_rdata_t		rdata;
+	unsigned char		data[1024];
+} dns_signjob_t;
+
+/***
+ ***	Functions
+ ***/
+
+isc_result_t
+dns_signpool_create(isc_mem_t *mctx, unsigned int nthreads,
+		    dns_signpool_t **poolp);
+/*%<
+ * Create a signing pool with 'nthreads' threads.  With no threads,
+ * or in a build without threads, dns_signpool_sign() signs the whole
+ * batch itself.
+ *
+ * Requires:
+ *\li	'mctx' is a valid memory context.
+ *\li	poolp != NULL && *poolp == NULL
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMEMORY
+ *\li	#ISC_R_UNEXPECTED
+ */
+
+void
+dns_signpool_attach(dns_signpool_t *source, dns_signpool_t **targetp);
+/*%<
+ * Attach '*targetp' to 'source'.
+ */
+
+void
+dns_signpool_detach(dns_signpool_t **poolp);
+/*%<
+ * Detach '*poolp'.  When the last reference goes away the pool's
+ * threads are stopped and the pool is destroyed.
+ */
+
+void
+dns_signpool_sign(dns_signpool_t *pool, dns_signjob_t **jobs,
+		  unsigned int njobs);
+/*%<
+ * Perform the 'njobs' signing jobs in 'jobs', in parallel, and return
+ * when all of them are done.
+ *
+ * Requires:
+ *\li	'pool' is a valid signing pool.
+ *\li	The jobs are independent: in particular no two of them share
+ *	an rdataset, and none of the data being signed changes until
+ *	dns_signpool_sign() returns.
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* DNS_SIGNPOOL_H */
@@ -133,6 +133,7 @@ struct dns_validator {
 	dns_validatorevent_t *		event;
 	dns_fetch_t *			fetch;
 	dns_validator_t *		subvalidator;
+	isc_event_t *			verifyevent;
 	dns_validator_t *		parent;
 	dns_keytable_t *		keytable;
 	dns_keynode_t *			keynode;
@@ -68,6 +68,7 @@
 #include <isc/refcount.h>
 #include <isc/rwlock.h>
 #include <isc/stdtime.h>
+#include <isc/taskpool.h>
 
 #include <dns/acl.h>
 #include <dns/clientinfo.h>
@@ -156,6 +157,8 @@ struct dns_view {
 	char				*nta_file;
 	dns_ttl_t			prefetch_trigger;
 	dns_ttl_t			prefetch_eligible;
+	dns_ttl_t			maxstalettl;
+	dns_ttl_t			staleanswerttl;
 	in_port_t			dstport;
 	dns_aclenv_t			aclenv;
 	dns_rdatatype_t			preferred_glue;
@@ -169,6 +172,10 @@ struct dns_view {
 	isc_uint16_t			maxudp;
 	isc_uint16_t			nocookieudp;
 	unsigned int			maxbits;
+	dns_sigcache_t *		sigcache;
+	dns_ecscache_t *		ecscache;
+	dns_rbt_t *			ecszones;
+	isc_taskpool_t *		verifytasks;
 	dns_aaaa_t			v4_aaaa;
 	dns_aaaa_t			v6_aaaa;
 	dns_acl_t *			aaaa_acl;
@@ -381,6 +388,30 @@ dns_view_createresolver(dns_view_t *view,
  *\li	Any error that dns_resolver_create() can return.
  */
 
+isc_result_t
+dns_view_createverifytasks(dns_view_t *view, isc_taskmgr_t *taskmgr,
+			   unsigned int ntasks);
+/*%<
+ * Create 'ntasks' tasks on which the view's validators run their
+ * signature verifications, so that the public key operations don't
+ * hold up the resolver tasks.  Without them verification is done
+ * inline.
+ *
+ * Requires:
+ *
+ *\li	'view' is a valid, unfrozen view.
+ *
+ *\li	'view' does not have verification tasks already.
+ *
+ *\li	'ntasks' > 0
+ *
+ * Returns:
+ *
+ *\li   	#ISC_R_SUCCESS
+ *
+ *\li	Any error that isc_taskpool_create() can return.
+ */
+
 void
 dns_view_setcache(dns_view_t *view, dns_cache_t *cache);
 void
@@ -1281,6 +1312,18 @@ dns_view_loadnta(dns_view_t *view);
  *\li	'view' to be valid.
  */
 
+isc_boolean_t
+dns_view_isecsname(dns_view_t *view, dns_name_t *name);
+/*%<
+ * Return ISC_TRUE if 'name' is at or below one of the domains listed
+ * in the view's "ecs-zones", i.e. if the client's subnet may be sent
+ * with queries for 'name', or to the servers of zone 'name'.
+ *
+ * Requires:
+ *\li	'view' to be valid.
+ *\li	'name' to be a valid absolute name.
+ */
+
 ISC_LANG_ENDDECLS
 
 #endif /* DNS_VIEW_H */
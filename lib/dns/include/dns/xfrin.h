@@ -114,6 +114,47 @@ dns_xfrin_attach(dns_xfrin_ctx_t *source, dns_xfrin_ctx_t **target);
  * Caller to maintain external locking if required.
  */
 
+isc_result_t
+dns_xfrinpool_create(isc_mem_t *mctx, dns_xfrinpool_t **poolp);
+/*%<
+ * Create an empty connection cache.
+ *
+ * When a transfer started with a zone whose zone manager has a
+ * connection cache finishes successfully, its connection is kept in
+ * the cache for a few seconds.  A later transfer from the same master
+ * and source address sends its request over that connection.  If the
+ * master has closed the connection in the meantime, the transfer is
+ * retried over a new one.
+ *
+ * Requires:
+ *\li	'mctx' is a valid memory context.
+ *\li	poolp != NULL && *poolp == NULL
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMEMORY
+ *\li	#ISC_R_UNEXPECTED
+ */
+
+void
+dns_xfrinpool_attach(dns_xfrinpool_t *source, dns_xfrinpool_t **targetp);
+/*%<
+ * Attach '*targetp' to 'source'.
+ */
+
+void
+dns_xfrinpool_detach(dns_xfrinpool_t **poolp);
+/*%<
+ * Detach '*poolp', closing all cached connections and destroying the
+ * cache when the last reference goes away.
+ */
+
+void
+dns_xfrinpool_shutdown(dns_xfrinpool_t *pool);
+/*%<
+ * Close all cached connections and stop caching new ones.
+ */
+
 ISC_LANG_ENDDECLS
 
 #endif /* DNS_XFRIN_H */
@@ -32,6 +32,7 @@
 #include <isc/lang.h>
 #include <isc/rwlock.h>
 
+#include <dns/diff.h>
 #include <dns/master.h>
 #include <dns/masterdump.h>
 #include <dns/rdatastruct.h>
@@ -1312,6 +1313,52 @@ dns_zone_getjournal(dns_zone_t *zone);
  *\li	'zone' to be valid initialised zone.
  */
 
+isc_result_t
+dns_zone_journalwrite(dns_zone_t *zone, dns_diff_t *diff);
+/*%<
+ * Write 'diff' to the zone's journal, if it has one, as a single
+ * transaction.
+ *
+ * The transaction is committed to stable storage together with any
+ * others written before the zone's task has processed the events
+ * queued for it (group commit).  Use dns_zone_journalwait() to learn
+ * when that has happened.  Pending transactions are also committed
+ * before the zone sends NOTIFY messages.
+ *
+ * Requires:
+ *\li	'zone' to be a valid zone.
+ *\li	The caller is running on the zone's task.
+ *\li	'diff' is a complete transaction, as for
+ *	dns_journal_write_transaction().
+ *
+ * Returns:
+ *\li	ISC_R_SUCCESS
+ *\li	Any error from dns_journal_open() or
+ *	dns_journal_write_transaction().
+ */
+
+void
+dns_zone_journalwait(dns_zone_t *zone, isc_task_t *task,
+		     isc_event_t **eventp);
+/*%<
+ * Send '*eventp' to 'task' once all transactions written with
+ * dns_zone_journalwrite() are on stable storage, or at once if there
+ * are none.  Events are sent in the order they were passed in.
+ *
+ * The transactions are already committed to the zone database, so
+ * the event is sent even if they cannot be committed to stable
+ * storage.  In that case the journal is removed and the zone is
+ * dumped instead.
+ *
+ * Requires:
+ *\li	'zone' to be a valid zone.
+ *\li	The caller is running on the zone's task.
+ *\li	'eventp' != NULL && '*eventp' != NULL.
+ *
+ * Ensures:
+ *\li	'*eventp' == NULL.
+ */
+
 dns_zonetype_t
 dns_zone_gettype(dns_zone_t *zone);
 /*%<
@@ -1785,6 +1832,19 @@ dns_zonemgr_setserialqueryrate(dns_zonemgr_t *zmgr, unsigned int value);
  *\li	'zmgr' to be a valid zone manager
  */
 
+void
+dns_zonemgr_setserialqueryburst(dns_zonemgr_t *zmgr, unsigned int value);
+/*%<
+ *	Set the number of SOA queries to the same master that may be
+ *	sent together, as one of the queries allowed per second by
+ *	dns_zonemgr_setserialqueryrate().  Zones waiting to refresh
+ *	are queued per master, and each burst sends the queries of up
+ *	to 'value' of them.  A value of zero is treated as one.
+ *
+ * Requires:
+ *\li	'zmgr' to be a valid zone manager
+ */
+
 unsigned int
 dns_zonemgr_getnotifyrate(dns_zonemgr_t *zmgr);
 /*%<
@@ -1812,6 +1872,50 @@ dns_zonemgr_getserialqueryrate(dns_zonemgr_t *zmgr);
  *\li	'zmgr' to be a valid zone manager.
  */
 
+unsigned int
+dns_zonemgr_getserialqueryburst(dns_zonemgr_t *zmgr);
+/*%<
+ *	Return the number of SOA queries to the same master sent in
+ *	one burst.
+ *
+ * Requires:
+ *\li	'zmgr' to be a valid zone manager.
+ */
+
+void
+dns_zonemgr_setsignpool(dns_zonemgr_t *zmgr, dns_signpool_t *pool);
+/*%<
+ *	Set the pool of threads used to compute the signatures for
+ *	dynamic updates to the managed zones.  This may only be done
+ *	once.
+ *
+ * Requires:
+ *\li	'zmgr' to be a valid zone manager.
+ *\li	'pool' to be a valid signing pool.
+ */
+
+void
+dns_zone_getsignpool(dns_zone_t *zone, dns_signpool_t **poolp);
+/*%<
+ *	Attach '*poolp' to the signing pool of the zone's manager, if
+ *	the zone is managed and the manager has one.
+ *
+ * Requires:
+ *\li	'zone' to be a valid zone.
+ *\li	'poolp' != NULL && '*poolp' == NULL.
+ */
+
+void
+dns_zone_getxfrinpool(dns_zone_t *zone, dns_xfrinpool_t **poolp);
+/*%<
+ *	Attach '*poolp' to the cache of connections to masters of the
+ *	zone's manager, if the zone is managed.
+ *
+ * Requires:
+ *\li	'zone' to be a valid zone.
+ *\li	'poolp' != NULL && '*poolp' == NULL.
+ */
+
 unsigned int
 dns_zonemgr_getcount(dns_zonemgr_t *zmgr, int state);
 /*%<
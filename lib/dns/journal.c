@@ -23,6 +23,10 @@
 #include <unistd.h>
 #include <errno.h>
 
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
 #include <isc/file.h>
 #include <isc/mem.h>
 #include <isc/print.h>
@@ -49,9 +53,9 @@
  *
  *   \li A fixed-size header of type journal_rawheader_t.
  *
- *   \li The index.  This is an unordered array of index entries
+ *   \li The index.  This is an array of index entries
  *     of type journal_rawpos_t giving the locations
- *     of some arbitrary subset of the journal's addressable
+ *     of some subset of the journal's addressable
  *     transactions.  The index entries are used as hints to
  *     speed up the process of locating a transaction with a given
  *     serial number.  Unused index entries have an "offset"
@@ -59,6 +63,15 @@
  *     journal files, but does not change during the lifetime
  *     of a file.  The size can be zero.
  *
+ *     Entries are written in file order, one per transaction,
+ *     so that a transaction can be found by binary search.
+ *     Files written by older versions may have their entries
+ *     in any order; they are sorted when the index is read.
+ *     When the index of a journal opened for writing is full,
+ *     the journal is copied to a new file with an index twice
+ *     the size (up to JOURNAL_INDEX_MAX entries); beyond that,
+ *     every other entry is dropped to make room.
+ *
  *   \li The journal data.  This  consists of one or more transactions.
  *     Each transaction begins with a transaction header of type
  *     journal_rawxhdr_t.  The transaction header is followed by a
@@ -114,7 +127,17 @@ static isc_boolean_t bind8_compat = ISC_TRUE; /* XXX config */
 
 #define JOURNAL_SERIALSET	0x01U
 
+/*%
+ * Number of index entries in a newly created journal, and the most
+ * the index is allowed to grow to.
+ */
+#define JOURNAL_INDEX_INITIAL	56
+#define JOURNAL_INDEX_MAX	(1024 * 1024)
+
 static isc_result_t index_to_disk(dns_journal_t *);
+static isc_result_t journal_header_to_disk(dns_journal_t *);
+static void journal_unmap(dns_journal_t *);
+static isc_result_t journal_grow(isc_mem_t *, const char *);
 
 static inline isc_uint32_t
 decode_uint32(unsigned char *p) {
@@ -318,6 +341,11 @@ struct dns_journal {
 	journal_header_t 	header;		/*%< In-core journal header */
 	unsigned char		*rawindex;	/*%< In-core buffer for journal index in on-disk format */
 	journal_pos_t		*index;		/*%< In-core journal index */
+	unsigned int		nindex;		/*%< Entries in use in index */
+	isc_boolean_t		groupcommit;	/*%< Defer syncs to
+						     dns_journal_sync() */
+	isc_boolean_t		unsynced;	/*%< Committed transactions
+						     not yet on disk */
 
 	/*% Current transaction state (when writing). */
 	struct {
@@ -332,6 +360,9 @@ struct dns_journal {
 		journal_pos_t epos;		/*%< and after last transaction */
 		/* The rest is iterator state. */
 		isc_uint32_t current_serial;	/*%< Current SOA serial */
+		unsigned char *map;		/*%< Journal mapped up to epos */
+		size_t maplen;			/*%< Length of the mapping */
+		isc_buffer_t mapsource;		/*%< RR data in the mapping */
 		isc_buffer_t source;		/*%< Data from disk */
 		isc_buffer_t target;		/*%< Data from _fromwire check */
 		dns_decompress_t dctx;		/*%< Dummy decompression ctx */
@@ -347,6 +378,9 @@ struct dns_journal {
 #define DNS_JOURNAL_MAGIC	ISC_MAGIC('J', 'O', 'U', 'R')
 #define DNS_JOURNAL_VALID(t)	ISC_MAGIC_VALID(t, DNS_JOURNAL_MAGIC)
 
+#define INDEX_FULL(j) \
+	((j)->index != NULL && (j)->nindex == (j)->header.index_size)
+
 static void
 journal_pos_decode(journal_rawpos_t *raw, journal_pos_t *cooked) {
 	cooked->serial = decode_uint32(raw->serial);
@@ -408,6 +442,24 @@ static isc_result_t
 journal_read(dns_journal_t *j, void *mem, size_t nbytes) {
 	isc_result_t result;
 
+	/*
+	 * While iterating over a mapped journal, reads within the
+	 * mapping don't move the file position, so resynchronize it
+	 * before reading from the file.
+	 */
+	if (j->it.map != NULL) {
+		if (j->offset >= 0 &&
+		    (size_t)j->offset + nbytes <= j->it.maplen)
+		{
+			memmove(mem, j->it.map + j->offset, nbytes);
+			j->offset += (isc_offset_t)nbytes;
+			return (ISC_R_SUCCESS);
+		}
+		result = journal_seek(j, j->offset);
+		if (result != ISC_R_SUCCESS)
+			return (result);
+	}
+
 	result = isc_stdio_read(mem, 1, nbytes, j->fp, NULL);
 	if (result != ISC_R_SUCCESS) {
 		if (result == ISC_R_EOF)
@@ -500,13 +552,29 @@ journal_read_rrhdr(dns_journal_t *j, journal_rrhdr_t *rrhdr) {
 	return (ISC_R_SUCCESS);
 }
 
+/*
+ * Sort index entries into file order.
+ */
+static int
+index_order(const void *av, const void *bv) {
+	const journal_pos_t *a = av;
+	const journal_pos_t *b = bv;
+
+	if (a->offset < b->offset)
+		return (-1);
+	if (a->offset > b->offset)
+		return (1);
+	return (0);
+}
+
 static isc_result_t
-journal_file_create(isc_mem_t *mctx, const char *filename) {
+journal_file_create(isc_mem_t *mctx, const char *filename,
+		    unsigned int index_size)
+{
 	FILE *fp = NULL;
 	isc_result_t result;
 	journal_header_t header;
 	journal_rawheader_t rawheader;
-	int index_size = 56; /* XXX configurable */
 	int size;
 	void *mem; /* Memory for temporary index image. */
 
@@ -581,6 +649,11 @@ journal_open(isc_mem_t *mctx, const char *filename, isc_boolean_t writable,
 	j->filename = isc_mem_strdup(mctx, filename);
 	j->index = NULL;
 	j->rawindex = NULL;
+	j->nindex = 0;
+	j->groupcommit = ISC_FALSE;
+	j->unsynced = ISC_FALSE;
+	j->it.map = NULL;
+	j->it.maplen = 0;
 
 	if (j->filename == NULL)
 		FAIL(ISC_R_NOMEMORY);
@@ -592,7 +665,8 @@ journal_open(isc_mem_t *mctx, const char *filename, isc_boolean_t writable,
 			isc_log_write(JOURNAL_COMMON_LOGARGS, ISC_LOG_DEBUG(1),
 				      "journal file %s does not exist, "
 				      "creating it", j->filename);
-			CHECK(journal_file_create(mctx, filename));
+			CHECK(journal_file_create(mctx, filename,
+						  JOURNAL_INDEX_INITIAL));
 			/*
 			 * Retry.
 			 */
@@ -629,12 +703,15 @@ journal_open(isc_mem_t *mctx, const char *filename, isc_boolean_t writable,
 
 	/*
 	 * If there is an index, read the raw index into a dynamically
-	 * allocated buffer and then convert it into a cooked index.
+	 * allocated buffer and then convert it into a cooked index,
+	 * keeping only the entries for addressable transactions and
+	 * putting them in file order.
 	 */
 	if (j->header.index_size != 0) {
 		unsigned int i;
 		unsigned int rawbytes;
 		unsigned char *p;
+		journal_pos_t pos;
 
 		rawbytes = j->header.index_size * sizeof(journal_rawpos_t);
 		j->rawindex = isc_mem_get(mctx, rawbytes);
@@ -650,12 +727,21 @@ journal_open(isc_mem_t *mctx, const char *filename, isc_boolean_t writable,
 
 		p = j->rawindex;
 		for (i = 0; i < j->header.index_size; i++) {
-			j->index[i].serial = decode_uint32(p);
+			pos.serial = decode_uint32(p);
 			p += 4;
-			j->index[i].offset = decode_uint32(p);
+			pos.offset = decode_uint32(p);
 			p += 4;
+			if (POS_VALID(pos) &&
+			    pos.offset >= j->header.begin.offset &&
+			    pos.offset < j->header.end.offset)
+				j->index[j->nindex++] = pos;
 		}
 		INSIST(p == j->rawindex + rawbytes);
+
+		qsort(j->index, j->nindex, sizeof(journal_pos_t),
+		      index_order);
+		for (i = j->nindex; i < j->header.index_size; i++)
+			POS_INVALIDATE(j->index[i]);
 	}
 	j->offset = -1; /* Invalid, must seek explicitly. */
 
@@ -708,6 +794,24 @@ dns_journal_open(isc_mem_t *mctx, const char *filename, unsigned int mode,
 	writable = ISC_TF(mode & (DNS_JOURNAL_WRITE|DNS_JOURNAL_CREATE));
 
 	result = journal_open(mctx, filename, writable, create, journalp);
+	if (result == ISC_R_SUCCESS && writable && INDEX_FULL(*journalp) &&
+	    (*journalp)->header.index_size < JOURNAL_INDEX_MAX)
+	{
+		isc_result_t tresult;
+
+		/*
+		 * Give the index room for the transactions about to be
+		 * added.  If that fails, carry on with the old one.
+		 */
+		dns_journal_destroy(journalp);
+		tresult = journal_grow(mctx, filename);
+		if (tresult != ISC_R_SUCCESS)
+			isc_log_write(JOURNAL_COMMON_LOGARGS, ISC_LOG_WARNING,
+				      "%s: failed to grow journal index: %s",
+				      filename, isc_result_totext(tresult));
+		result = journal_open(mctx, filename, writable, create,
+				      journalp);
+	}
 	if (result == ISC_R_NOTFOUND) {
 		namelen = strlen(filename);
 		if (namelen > 4U && strcmp(filename + namelen - 4, ".jnl") == 0)
@@ -720,6 +824,9 @@ dns_journal_open(isc_mem_t *mctx, const char *filename, unsigned int mode,
 		result = journal_open(mctx, backup, writable, writable,
 				      journalp);
 	}
+	if (result == ISC_R_SUCCESS && writable &&
+	    (mode & DNS_JOURNAL_GROUPCOMMIT) != 0)
+		(*journalp)->groupcommit = ISC_TRUE;
 	return (result);
 }
 
@@ -851,76 +958,108 @@ journal_next(dns_journal_t *j, journal_pos_t *pos) {
  *
  * "Better" means having a serial number closer to 'serial'
  * but not greater than 'serial'.
+ *
+ * The entries in use are in file order, and serial numbers only
+ * increase through the addressable part of the journal, so the
+ * best entry can be found by binary search.
  */
 static void
 index_find(dns_journal_t *j, isc_uint32_t serial, journal_pos_t *best_guess) {
-	unsigned int i;
-	if (j->index == NULL)
+	unsigned int lo, hi, mid;
+
+	if (j->index == NULL || j->nindex == 0)
 		return;
-	for (i = 0; i < j->header.index_size; i++) {
-		if (POS_VALID(j->index[i]) &&
-		    DNS_SERIAL_GE(serial, j->index[i].serial) &&
-		    DNS_SERIAL_GT(j->index[i].serial, best_guess->serial))
-			*best_guess = j->index[i];
+
+	/*
+	 * Find the first entry whose serial number is greater than
+	 * 'serial'; the one before it is the candidate.
+	 */
+	lo = 0;
+	hi = j->nindex;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (DNS_SERIAL_GE(serial, j->index[mid].serial))
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
+	if (lo == 0)
+		return;
+	lo--;
+
+	/*
+	 * Transactions that don't change the serial number (see
+	 * 'bind8_compat') share it with their successor; use the
+	 * earliest.
+	 */
+	while (lo > 0 && j->index[lo - 1].serial == j->index[lo].serial)
+		lo--;
+
+	if (DNS_SERIAL_GT(j->index[lo].serial, best_guess->serial))
+		*best_guess = j->index[lo];
 }
 
 /*
- * Add a new index entry.  If there is no room, make room by removing
- * the odd-numbered entries and compacting the others into the first
+ * Add a new index entry, which must follow all the existing ones in
+ * the file.  If there is no room, make room by removing the
+ * odd-numbered entries and compacting the others into the first
  * half of the index.  This decimates old index entries exponentially
  * over time, so that the index always contains a much larger fraction
  * of recent serial numbers than of old ones.  This is deliberate -
  * most index searches are for outgoing IXFR, and IXFR tends to request
- * recent versions more often than old ones.
+ * recent versions more often than old ones.  It only happens once the
+ * index has reached JOURNAL_INDEX_MAX entries, or while a journal is
+ * held open across more transactions than its index can hold.
  */
 static void
 index_add(dns_journal_t *j, journal_pos_t *pos) {
-	unsigned int i;
+	unsigned int i, k;
+
 	if (j->index == NULL)
 		return;
-	/*
-	 * Search for a vacant position.
-	 */
-	for (i = 0; i < j->header.index_size; i++) {
-		if (! POS_VALID(j->index[i]))
-			break;
-	}
-	if (i == j->header.index_size) {
-		unsigned int k = 0;
+
+	if (j->nindex == j->header.index_size) {
 		/*
-		 * Found no vacant position.  Make some room.
+		 * No vacant position.  Make some room.
 		 */
-		for (i = 0; i < j->header.index_size; i += 2) {
+		for (i = 0, k = 0; i < j->nindex; i += 2)
 			j->index[k++] = j->index[i];
-		}
-		i = k; /* 'i' identifies the first vacant position. */
+		j->nindex = k;
 		while (k < j->header.index_size) {
 			POS_INVALIDATE(j->index[k]);
 			k++;
 		}
 	}
-	INSIST(i < j->header.index_size);
-	INSIST(! POS_VALID(j->index[i]));
+	INSIST(j->nindex < j->header.index_size);
+	INSIST(j->nindex == 0 ||
+	       j->index[j->nindex - 1].offset < pos->offset);
 
 	/*
 	 * Store the new index entry.
 	 */
-	j->index[i] = *pos;
+	j->index[j->nindex++] = *pos;
 }
 
 /*
  * Invalidate any existing index entries that could become
- * ambiguous when a new transaction with number 'serial' is added.
+ * ambiguous when a new transaction with number 'serial' is added,
+ * and those for transactions that are no longer addressable.
  */
 static void
 index_invalidate(dns_journal_t *j, isc_uint32_t serial) {
-	unsigned int i;
+	unsigned int i, k;
+
 	if (j->index == NULL)
 		return;
-	for (i = 0; i < j->header.index_size; i++) {
-		if (! DNS_SERIAL_GT(serial, j->index[i].serial))
-			POS_INVALIDATE(j->index[i]);
+	for (i = 0, k = 0; i < j->nindex; i++) {
+		if (DNS_SERIAL_GT(serial, j->index[i].serial) &&
+		    j->index[i].offset >= j->header.begin.offset)
+			j->index[k++] = j->index[i];
+	}
+	j->nindex = k;
+	while (k < j->header.index_size) {
+		POS_INVALIDATE(j->index[k]);
+		k++;
 	}
 }
 
@@ -1170,9 +1309,12 @@ dns_journal_commit(dns_journal_t *j) {
 #endif
 
 	/*
-	 * Commit the transaction data to stable storage.
+	 * Commit the transaction data to stable storage.  For group
+	 * commit, this is left to dns_journal_sync(), together with
+	 * writing out the header and index.
 	 */
-	CHECK(journal_fsync(j));
+	if (!j->groupcommit)
+		CHECK(journal_fsync(j));
 
 	if (j->state == JOURNAL_STATE_TRANSACTION) {
 		isc_offset_t offset;
@@ -1187,30 +1329,23 @@ dns_journal_commit(dns_journal_t *j) {
 	}
 
 	/*
-	 * Update the journal header.
+	 * Update the journal header and the index.
 	 */
 	if (JOURNAL_EMPTY(&j->header))
 		j->header.begin = j->x.pos[0];
 	j->header.end = j->x.pos[1];
-	journal_header_encode(&j->header, &rawheader);
-	CHECK(journal_seek(j, 0));
-	CHECK(journal_write(j, &rawheader, sizeof(rawheader)));
-
-	/*
-	 * Update the index.
-	 */
 	index_add(j, &j->x.pos[0]);
 
-	/*
-	 * Convert the index into on-disk format and write
-	 * it to disk.
-	 */
-	CHECK(index_to_disk(j));
-
-	/*
-	 * Commit the header to stable storage.
-	 */
-	CHECK(journal_fsync(j));
+	if (j->groupcommit) {
+		j->unsynced = ISC_TRUE;
+	} else {
+		/*
+		 * Write the header and index to disk and commit them
+		 * to stable storage.
+		 */
+		CHECK(journal_header_to_disk(j));
+		CHECK(journal_fsync(j));
+	}
 
 	/*
 	 * We no longer have a transaction open.
@@ -1223,6 +1358,28 @@ dns_journal_commit(dns_journal_t *j) {
 	return (result);
 }
 
+isc_result_t
+dns_journal_sync(dns_journal_t *j) {
+	isc_result_t result;
+
+	REQUIRE(DNS_JOURNAL_VALID(j));
+
+	if (!j->unsynced)
+		return (ISC_R_SUCCESS);
+
+	/*
+	 * The header must never refer to transaction data that
+	 * isn't on stable storage yet, so sync the data first.
+	 */
+	CHECK(journal_fsync(j));
+	CHECK(journal_header_to_disk(j));
+	CHECK(journal_fsync(j));
+	j->unsynced = ISC_FALSE;
+
+ failure:
+	return (result);
+}
+
 isc_result_t
 dns_journal_write_transaction(dns_journal_t *j, dns_diff_t *diff) {
 	isc_result_t result;
@@ -1240,7 +1397,11 @@ dns_journal_destroy(dns_journal_t **journalp) {
 	dns_journal_t *j = *journalp;
 	REQUIRE(DNS_JOURNAL_VALID(j));
 
+	if (j->unsynced)
+		(void)dns_journal_sync(j);
+
 	j->it.result = ISC_R_FAILURE;
+	journal_unmap(j);
 	dns_name_invalidate(&j->it.name);
 	dns_decompress_invalidate(&j->it.dctx);
 	if (j->rawindex != NULL)
@@ -1634,10 +1795,61 @@ dns_journal_iter_init(dns_journal_t *j,
 }
 
 
+/*
+ * Map the journal up to the end of the transactions being iterated
+ * over, so that read_one_rr() can parse RRs in place rather than
+ * copying each one out of the file first.  Concurrent outgoing
+ * transfers of the same journal then share the mapped pages instead
+ * of each reading them into its own buffers.
+ *
+ * Only journals opened for reading are mapped; the part of the file
+ * up to 'epos' is never rewritten once committed.  If the journal
+ * can't be mapped, the file is read as before.
+ */
+static void
+journal_map(dns_journal_t *j) {
+#ifdef HAVE_MMAP
+	void *base;
+	int flags;
+
+	if (j->state != JOURNAL_STATE_READ)
+		return;
+	if (j->it.map != NULL && j->it.maplen >= (size_t)j->it.epos.offset)
+		return;
+	journal_unmap(j);
+	if (j->it.epos.offset == 0)
+		return;
+
+	flags = MAP_PRIVATE;
+#ifdef MAP_FILE
+	flags |= MAP_FILE;
+#endif
+	base = isc_file_mmap(NULL, (size_t)j->it.epos.offset, PROT_READ,
+			     flags, fileno(j->fp), 0);
+	if (base == NULL || base == MAP_FAILED)
+		return;
+	j->it.map = base;
+	j->it.maplen = (size_t)j->it.epos.offset;
+#else
+	UNUSED(j);
+#endif
+}
+
+static void
+journal_unmap(dns_journal_t *j) {
+	if (j->it.map != NULL) {
+		(void)isc_file_munmap(j->it.map, j->it.maplen);
+		j->it.map = NULL;
+		j->it.maplen = 0;
+	}
+}
+
 isc_result_t
 dns_journal_first_rr(dns_journal_t *j) {
 	isc_result_t result;
 
+	journal_map(j);
+
 	/*
 	 * Seek to the beginning of the first transaction we are
 	 * interested in.
@@ -1664,6 +1876,7 @@ read_one_rr(dns_journal_t *j) {
 	isc_uint32_t ttl;
 	journal_xhdr_t xhdr;
 	journal_rrhdr_t rrhdr;
+	isc_buffer_t *source;
 
 	INSIST(j->offset <= j->it.epos.offset);
 	if (j->offset == j->it.epos.offset)
@@ -1709,9 +1922,23 @@ read_one_rr(dns_journal_t *j) {
 		FAIL(ISC_R_UNEXPECTED);
 	}
 
-	CHECK(size_buffer(j->mctx, &j->it.source, rrhdr.size));
-	CHECK(journal_read(j, j->it.source.base, rrhdr.size));
-	isc_buffer_add(&j->it.source, rrhdr.size);
+	/*
+	 * If the RR is within the mapped part of the journal, parse
+	 * it where it is; otherwise read it into our own buffer.
+	 */
+	if (j->it.map != NULL &&
+	    (size_t)j->offset + rrhdr.size <= j->it.maplen)
+	{
+		source = &j->it.mapsource;
+		isc_buffer_init(source, j->it.map + j->offset, rrhdr.size);
+		isc_buffer_add(source, rrhdr.size);
+		j->offset += rrhdr.size;
+	} else {
+		source = &j->it.source;
+		CHECK(size_buffer(j->mctx, source, rrhdr.size));
+		CHECK(journal_read(j, source->base, rrhdr.size));
+		isc_buffer_add(source, rrhdr.size);
+	}
 
 	/*
 	 * The target buffer is made the same size
@@ -1726,31 +1953,30 @@ read_one_rr(dns_journal_t *j) {
 	 * ends yet, so we make the entire "remaining"
 	 * part of the buffer "active".
 	 */
-	isc_buffer_setactive(&j->it.source,
-			     j->it.source.used - j->it.source.current);
-	CHECK(dns_name_fromwire(&j->it.name, &j->it.source,
+	isc_buffer_setactive(source, source->used - source->current);
+	CHECK(dns_name_fromwire(&j->it.name, source,
 				&j->it.dctx, 0, &j->it.target));
 
 	/*
 	 * Check that the RR header is there, and parse it.
 	 */
-	if (isc_buffer_remaininglength(&j->it.source) < 10)
+	if (isc_buffer_remaininglength(source) < 10)
 		FAIL(DNS_R_FORMERR);
 
-	rdtype = isc_buffer_getuint16(&j->it.source);
-	rdclass = isc_buffer_getuint16(&j->it.source);
-	ttl = isc_buffer_getuint32(&j->it.source);
-	rdlen = isc_buffer_getuint16(&j->it.source);
+	rdtype = isc_buffer_getuint16(source);
+	rdclass = isc_buffer_getuint16(source);
+	ttl = isc_buffer_getuint32(source);
+	rdlen = isc_buffer_getuint16(source);
 
 	/*
 	 * Parse the rdata.
 	 */
-	if (isc_buffer_remaininglength(&j->it.source) != rdlen)
+	if (isc_buffer_remaininglength(source) != rdlen)
 		FAIL(DNS_R_FORMERR);
-	isc_buffer_setactive(&j->it.source, rdlen);
+	isc_buffer_setactive(source, rdlen);
 	dns_rdata_reset(&j->it.rdata);
 	CHECK(dns_rdata_fromwire(&j->it.rdata, rdclass,
-				 rdtype, &j->it.source, &j->it.dctx,
+				 rdtype, source, &j->it.dctx,
 				 0, &j->it.target));
 	j->it.ttl = ttl;
 
@@ -1789,31 +2015,22 @@ dns_journal_current_rr(dns_journal_t *j, dns_name_t **name, isc_uint32_t *ttl,
  */
 
 /*
- * Construct a diff containing all the RRs at the current name of the
- * database iterator 'dbit' in database 'db', version 'ver'.
- * Set '*name' to the current name, and append the diff to 'diff'.
+ * Construct a diff containing all the RRs at 'node', whose name is
+ * 'name', in database 'db', version 'ver', and append it to 'diff'.
  * All new tuples will have the operation 'op'.
- *
- * Requires: 'name' must have buffer large enough to hold the name.
- * Typically, a dns_fixedname_t would be used.
  */
 static isc_result_t
 get_name_diff(dns_db_t *db, dns_dbversion_t *ver, isc_stdtime_t now,
-	      dns_dbiterator_t *dbit, dns_name_t *name, dns_diffop_t op,
+	      dns_dbnode_t *node, dns_name_t *name, dns_diffop_t op,
 	      dns_diff_t *diff)
 {
 	isc_result_t result;
-	dns_dbnode_t *node = NULL;
 	dns_rdatasetiter_t *rdsiter = NULL;
 	dns_difftuple_t *tuple = NULL;
 
-	result = dns_dbiterator_current(dbit, &node, name);
-	if (result != ISC_R_SUCCESS)
-		return (result);
-
 	result = dns_db_allrdatasets(db, node, ver, now, &rdsiter);
 	if (result != ISC_R_SUCCESS)
-		goto cleanup_node;
+		return (result);
 
 	for (result = dns_rdatasetiter_first(rdsiter);
 	     result == ISC_R_SUCCESS;
@@ -1851,12 +2068,91 @@ get_name_diff(dns_db_t *db, dns_dbversion_t *ver, isc_stdtime_t now,
  cleanup_iterator:
 	dns_rdatasetiter_destroy(&rdsiter);
 
- cleanup_node:
-	dns_db_detachnode(db, &node);
-
 	return (result);
 }
 
+/*
+ * Return ISC_TRUE if the rdatasets 'a' and 'b' have the same TTL and
+ * return the same rdatas in the same order.
+ */
+static isc_boolean_t
+rdataset_equal(dns_rdataset_t *a, dns_rdataset_t *b) {
+	isc_result_t resulta, resultb;
+
+	if (a->ttl != b->ttl ||
+	    dns_rdataset_count(a) != dns_rdataset_count(b))
+		return (ISC_FALSE);
+
+	for (resulta = dns_rdataset_first(a), resultb = dns_rdataset_first(b);
+	     resulta == ISC_R_SUCCESS && resultb == ISC_R_SUCCESS;
+	     resulta = dns_rdataset_next(a), resultb = dns_rdataset_next(b))
+	{
+		dns_rdata_t rdataa = DNS_RDATA_INIT;
+		dns_rdata_t rdatab = DNS_RDATA_INIT;
+
+		dns_rdataset_current(a, &rdataa);
+		dns_rdataset_current(b, &rdatab);
+		if (dns_rdata_compare(&rdataa, &rdatab) != 0)
+			return (ISC_FALSE);
+	}
+	return (ISC_TF(resulta == ISC_R_NOMORE && resultb == ISC_R_NOMORE));
+}
+
+/*
+ * Return ISC_TRUE if the nodes 'node[0]' and 'node[1]' hold exactly the
+ * same RRsets, so that the name contributes nothing to the difference.
+ * This is checked by comparing the rdatasets in place, which is far
+ * cheaper than building and sorting tuples for every RR at the name.
+ * As the rdatas have to come out in the same order, ISC_FALSE does not
+ * necessarily mean that the nodes differ, only that get_name_diff()
+ * and dns_diff_subtract() have to work it out.
+ */
+static isc_boolean_t
+node_equal(dns_db_t *db[2], dns_dbversion_t *ver[2], dns_dbnode_t *node[2]) {
+	dns_rdatasetiter_t *rdsiter = NULL;
+	dns_rdataset_t rdataset[2];
+	unsigned int count[2] = { 0, 0 };
+	isc_boolean_t equal = ISC_TRUE;
+	isc_result_t result;
+	int i;
+
+	dns_rdataset_init(&rdataset[0]);
+	dns_rdataset_init(&rdataset[1]);
+
+	for (i = 0; i < 2 && equal; i++) {
+		result = dns_db_allrdatasets(db[i], node[i], ver[i], 0,
+					     &rdsiter);
+		if (result != ISC_R_SUCCESS)
+			return (ISC_FALSE);
+		for (result = dns_rdatasetiter_first(rdsiter);
+		     result == ISC_R_SUCCESS;
+		     result = dns_rdatasetiter_next(rdsiter))
+		{
+			count[i]++;
+			if (i == 1)
+				continue;
+			dns_rdatasetiter_current(rdsiter, &rdataset[0]);
+			result = dns_db_findrdataset(db[1], node[1], ver[1],
+						     rdataset[0].type,
+						     rdataset[0].covers, 0,
+						     &rdataset[1], NULL);
+			if (result != ISC_R_SUCCESS ||
+			    !rdataset_equal(&rdataset[0], &rdataset[1]))
+				equal = ISC_FALSE;
+			if (dns_rdataset_isassociated(&rdataset[1]))
+				dns_rdataset_disassociate(&rdataset[1]);
+			dns_rdataset_disassociate(&rdataset[0]);
+			if (!equal)
+				break;
+		}
+		if (result != ISC_R_NOMORE)
+			equal = ISC_FALSE;
+		dns_rdatasetiter_destroy(&rdsiter);
+	}
+
+	return (ISC_TF(equal && count[0] == count[1]));
+}
+
 /*
  * Comparison function for use by dns_diff_subtract when sorting
  * the diffs to be subtracted.  The sort keys are the rdata type
@@ -1939,7 +2235,7 @@ diff_namespace(dns_db_t *dba, dns_dbversion_t *dbvera,
 	dns_db_t *db[2];
 	dns_dbversion_t *ver[2];
 	dns_dbiterator_t *dbit[2] = { NULL, NULL };
-	isc_boolean_t have[2] = { ISC_FALSE, ISC_FALSE };
+	dns_dbnode_t *node[2] = { NULL, NULL };
 	dns_fixedname_t fixname[2];
 	isc_result_t result, itresult[2];
 	dns_diff_t diff[2];
@@ -1964,58 +2260,62 @@ diff_namespace(dns_db_t *dba, dns_dbversion_t *dbvera,
 	itresult[0] = dns_dbiterator_first(dbit[0]);
 	itresult[1] = dns_dbiterator_first(dbit[1]);
 
+	/*
+	 * Walk both databases in step.  Tuples are only built for names
+	 * that are in one database but not the other, and for names
+	 * whose contents differ, so that the cost of an unchanged name
+	 * is a comparison of its rdatasets in place.
+	 */
 	for (;;) {
 		for (i = 0; i < 2; i++) {
-			if (! have[i] && itresult[i] == ISC_R_SUCCESS) {
-				CHECK(get_name_diff(db[i], ver[i], 0, dbit[i],
-					    dns_fixedname_name(&fixname[i]),
-					    i == 0 ?
-					    DNS_DIFFOP_ADD :
-					    DNS_DIFFOP_DEL,
-					    &diff[i]));
-				itresult[i] = dns_dbiterator_next(dbit[i]);
-				have[i] = ISC_TRUE;
-			}
+			if (node[i] == NULL && itresult[i] == ISC_R_SUCCESS)
+				CHECK(dns_dbiterator_current(dbit[i], &node[i],
+					    dns_fixedname_name(&fixname[i])));
 		}
 
-		if (! have[0] && ! have[1]) {
-			INSIST(ISC_LIST_EMPTY(diff[0].tuples));
-			INSIST(ISC_LIST_EMPTY(diff[1].tuples));
+		if (node[0] == NULL && node[1] == NULL)
 			break;
-		}
 
-		for (i = 0; i < 2; i++) {
-			if (! have[!i]) {
-				ISC_LIST_APPENDLIST(resultdiff->tuples,
-						    diff[i].tuples, link);
-				INSIST(ISC_LIST_EMPTY(diff[i].tuples));
-				have[i] = ISC_FALSE;
-				goto next;
+		if (node[0] == NULL)
+			t = 1;
+		else if (node[1] == NULL)
+			t = -1;
+		else
+			t = dns_name_compare(dns_fixedname_name(&fixname[0]),
+					     dns_fixedname_name(&fixname[1]));
+
+		if (t == 0) {
+			if (!node_equal(db, ver, node)) {
+				for (i = 0; i < 2; i++)
+					CHECK(get_name_diff(db[i], ver[i], 0,
+					      node[i],
+					      dns_fixedname_name(&fixname[i]),
+					      i == 0 ? DNS_DIFFOP_ADD :
+						       DNS_DIFFOP_DEL,
+					      &diff[i]));
+				CHECK(dns_diff_subtract(diff, resultdiff));
+				INSIST(ISC_LIST_EMPTY(diff[0].tuples));
+				INSIST(ISC_LIST_EMPTY(diff[1].tuples));
+			}
+			for (i = 0; i < 2; i++) {
+				dns_db_detachnode(db[i], &node[i]);
+				itresult[i] = dns_dbiterator_next(dbit[i]);
 			}
-		}
-
-		t = dns_name_compare(dns_fixedname_name(&fixname[0]),
-				     dns_fixedname_name(&fixname[1]));
-		if (t < 0) {
-			ISC_LIST_APPENDLIST(resultdiff->tuples,
-					    diff[0].tuples, link);
-			INSIST(ISC_LIST_EMPTY(diff[0].tuples));
-			have[0] = ISC_FALSE;
-			continue;
-		}
-		if (t > 0) {
-			ISC_LIST_APPENDLIST(resultdiff->tuples,
-					    diff[1].tuples, link);
-			INSIST(ISC_LIST_EMPTY(diff[1].tuples));
-			have[1] = ISC_FALSE;
 			continue;
 		}
-		INSIST(t == 0);
-		CHECK(dns_diff_subtract(diff, resultdiff));
-		INSIST(ISC_LIST_EMPTY(diff[0].tuples));
-		INSIST(ISC_LIST_EMPTY(diff[1].tuples));
-		have[0] = have[1] = ISC_FALSE;
-	next: ;
+
+		/*
+		 * The name is only in one of the databases.
+		 */
+		i = (t < 0) ? 0 : 1;
+		CHECK(get_name_diff(db[i], ver[i], 0, node[i],
+				    dns_fixedname_name(&fixname[i]),
+				    i == 0 ? DNS_DIFFOP_ADD : DNS_DIFFOP_DEL,
+				    &diff[i]));
+		ISC_LIST_APPENDLIST(resultdiff->tuples, diff[i].tuples, link);
+		INSIST(ISC_LIST_EMPTY(diff[i].tuples));
+		dns_db_detachnode(db[i], &node[i]);
+		itresult[i] = dns_dbiterator_next(dbit[i]);
 	}
 	if (itresult[0] != ISC_R_NOMORE)
 		FAIL(itresult[0]);
@@ -2026,6 +2326,9 @@ diff_namespace(dns_db_t *dba, dns_dbversion_t *dbvera,
 	INSIST(ISC_LIST_EMPTY(diff[1].tuples));
 
  failure:
+	for (i = 0; i < 2; i++)
+		if (node[i] != NULL)
+			dns_db_detachnode(db[i], &node[i]);
 	dns_dbiterator_destroy(&dbit[1]);
 
  cleanup_iterator:
@@ -2087,6 +2390,196 @@ dns_db_diffx(dns_diff_t *diff, dns_db_t *dba, dns_dbversion_t *dbvera,
 	return (result);
 }
 
+/*
+ * Construct the name of one of the files used alongside the journal
+ * 'filename' by replacing its ".jnl" suffix with 'suffix'.
+ */
+static isc_result_t
+journal_altname(const char *filename, const char *suffix, char *buf,
+		size_t buflen)
+{
+	size_t namelen;
+
+	namelen = strlen(filename);
+	if (namelen > 4U && strcmp(filename + namelen - 4, ".jnl") == 0)
+		namelen -= 4;
+
+	return (isc_string_printf(buf, buflen, "%.*s%s",
+				  (int)namelen, filename, suffix));
+}
+
+/*
+ * Copy the transactions of 'j' from 'pos' to the end into the newly
+ * created, empty journal 'new', then write 'new's header and a fresh
+ * index for them.
+ */
+static isc_result_t
+journal_copy(isc_mem_t *mctx, dns_journal_t *j, journal_pos_t *pos,
+	     dns_journal_t *new)
+{
+	journal_pos_t current_pos;
+	journal_rawheader_t rawheader;
+	unsigned int copy_length;
+	unsigned int indexend;
+	unsigned int i;
+	char *buf = NULL;
+	unsigned int size = 0;
+	isc_result_t result;
+
+	indexend = sizeof(journal_rawheader_t) +
+		   new->header.index_size * sizeof(journal_rawpos_t);
+	copy_length = j->header.end.offset - pos->offset;
+	if (copy_length == 0)
+		return (ISC_R_SUCCESS);
+
+	/*
+	 * Copy pos to end into the new journal.
+	 */
+	size = 64*1024;
+	if (copy_length < size)
+		size = copy_length;
+	buf = isc_mem_get(mctx, size);
+	if (buf == NULL)
+		return (ISC_R_NOMEMORY);
+
+	CHECK(journal_seek(j, pos->offset));
+	CHECK(journal_seek(new, indexend));
+	for (i = 0; i < copy_length; i += size) {
+		unsigned int len = (copy_length - i) > size ? size :
+						 (copy_length - i);
+		CHECK(journal_read(j, buf, len));
+		CHECK(journal_write(new, buf, len));
+	}
+
+	CHECK(journal_fsync(new));
+
+	/*
+	 * Compute new header.
+	 */
+	new->header.begin.serial = pos->serial;
+	new->header.begin.offset = indexend;
+	new->header.end.serial = j->header.end.serial;
+	new->header.end.offset = indexend + copy_length;
+	new->header.sourceserial = j->header.sourceserial;
+	new->header.serialset = j->header.serialset;
+
+	/*
+	 * Update the journal header.
+	 */
+	journal_header_encode(&new->header, &rawheader);
+	CHECK(journal_seek(new, 0));
+	CHECK(journal_write(new, &rawheader, sizeof(rawheader)));
+	CHECK(journal_fsync(new));
+
+	/*
+	 * Build new index.
+	 */
+	current_pos = new->header.begin;
+	while (current_pos.serial != new->header.end.serial) {
+		index_add(new, &current_pos);
+		CHECK(journal_next(new, &current_pos));
+	}
+
+	/*
+	 * Write index.
+	 */
+	CHECK(index_to_disk(new));
+	CHECK(journal_fsync(new));
+
+ failure:
+	isc_mem_put(mctx, buf, size);
+	return (result);
+}
+
+/*
+ * Replace the journal 'filename' with 'newname'.
+ *
+ * With a UFS file system this should just succeed and be atomic.
+ * Any IXFR outs will just continue and the old journal will be
+ * removed on final close.
+ *
+ * With MSDOS / NTFS we need to do a two stage rename, triggered
+ * by EEXIST.  (If any IXFR's are running in other threads, however,
+ * this will fail, and the journal will not be replaced.  But
+ * if so, hopefully they'll be finished by the next time we
+ * try.)
+ */
+static isc_result_t
+journal_replace(const char *newname, const char *filename,
+		const char *backup, isc_boolean_t is_backup)
+{
+	isc_result_t result;
+
+	if (rename(newname, filename) == -1) {
+		if (errno == EEXIST && !is_backup) {
+			result = isc_file_remove(backup);
+			if (result != ISC_R_SUCCESS &&
+			    result != ISC_R_FILENOTFOUND)
+				return (result);
+			if (rename(filename, backup) == -1)
+				return (ISC_R_FAILURE);
+			if (rename(newname, filename) == -1)
+				return (ISC_R_FAILURE);
+			(void)isc_file_remove(backup);
+		} else
+			return (ISC_R_FAILURE);
+	}
+	return (ISC_R_SUCCESS);
+}
+
+/*
+ * Rewrite the journal 'filename' with an index twice the size, so
+ * that it can keep one entry per transaction.
+ */
+static isc_result_t
+journal_grow(isc_mem_t *mctx, const char *filename) {
+	dns_journal_t *j = NULL;
+	dns_journal_t *new = NULL;
+	unsigned int index_size;
+	char newname[1024];
+	char backup[1024];
+	isc_result_t result;
+
+	CHECK(journal_altname(filename, ".jnw", newname, sizeof(newname)));
+	CHECK(journal_altname(filename, ".jbk", backup, sizeof(backup)));
+
+	CHECK(journal_open(mctx, filename, ISC_FALSE, ISC_FALSE, &j));
+
+	index_size = j->header.index_size * 2;
+	if (index_size > JOURNAL_INDEX_MAX)
+		index_size = JOURNAL_INDEX_MAX;
+	if (index_size <= j->header.index_size) {
+		result = ISC_R_SUCCESS;
+		goto failure;
+	}
+
+	isc_log_write(JOURNAL_DEBUG_LOGARGS(1),
+		      "%s: growing journal index to %u entries",
+		      filename, index_size);
+
+	CHECK(journal_file_create(mctx, newname, index_size));
+	CHECK(journal_open(mctx, newname, ISC_TRUE, ISC_FALSE, &new));
+	if (!JOURNAL_EMPTY(&j->header))
+		CHECK(journal_copy(mctx, j, &j->header.begin, new));
+
+	/*
+	 * Close both journals before trying to rename files (this is
+	 * necessary on WIN32).
+	 */
+	dns_journal_destroy(&j);
+	dns_journal_destroy(&new);
+
+	CHECK(journal_replace(newname, filename, backup, ISC_FALSE));
+
+ failure:
+	(void)isc_file_remove(newname);
+	if (j != NULL)
+		dns_journal_destroy(&j);
+	if (new != NULL)
+		dns_journal_destroy(&new);
+	return (result);
+}
+
 isc_result_t
 dns_journal_compact(isc_mem_t *mctx, char *filename, isc_uint32_t serial,
 		    isc_uint32_t target_size)
@@ -2096,11 +2589,6 @@ dns_journal_compact(isc_mem_t *mctx, char *filename, isc_uint32_t serial,
 	journal_pos_t current_pos;
 	dns_journal_t *j = NULL;
 	dns_journal_t *new = NULL;
-	journal_rawheader_t rawheader;
-	unsigned int copy_length;
-	size_t namelen;
-	char *buf = NULL;
-	unsigned int size = 0;
 	isc_result_t result;
 	unsigned int indexend;
 	char newname[1024];
@@ -2109,17 +2597,11 @@ dns_journal_compact(isc_mem_t *mctx, char *filename, isc_uint32_t serial,
 
 	REQUIRE(filename != NULL);
 
-	namelen = strlen(filename);
-	if (namelen > 4U && strcmp(filename + namelen - 4, ".jnl") == 0)
-		namelen -= 4;
-
-	result = isc_string_printf(newname, sizeof(newname), "%.*s.jnw",
-				   (int)namelen, filename);
+	result = journal_altname(filename, ".jnw", newname, sizeof(newname));
 	if (result != ISC_R_SUCCESS)
 		return (result);
 
-	result = isc_string_printf(backup, sizeof(backup), "%.*s.jbk",
-				   (int)namelen, filename);
+	result = journal_altname(filename, ".jbk", backup, sizeof(backup));
 	if (result != ISC_R_SUCCESS)
 		return (result);
 
@@ -2158,7 +2640,11 @@ dns_journal_compact(isc_mem_t *mctx, char *filename, isc_uint32_t serial,
 		return (ISC_R_SUCCESS);
 	}
 
-	CHECK(journal_open(mctx, newname, ISC_TRUE, ISC_TRUE, &new));
+	/*
+	 * The new journal keeps the index size the old one has grown to.
+	 */
+	CHECK(journal_file_create(mctx, newname, j->header.index_size));
+	CHECK(journal_open(mctx, newname, ISC_TRUE, ISC_FALSE, &new));
 
 	/*
 	 * Remove overhead so space test below can succeed.
@@ -2170,9 +2656,8 @@ dns_journal_compact(isc_mem_t *mctx, char *filename, isc_uint32_t serial,
 	 * Find if we can create enough free space.
 	 */
 	best_guess = j->header.begin;
-	for (i = 0; i < j->header.index_size; i++) {
-		if (POS_VALID(j->index[i]) &&
-		    DNS_SERIAL_GE(serial, j->index[i].serial) &&
+	for (i = 0; i < j->nindex; i++) {
+		if (DNS_SERIAL_GE(serial, j->index[i].serial) &&
 		    ((isc_uint32_t)(j->header.end.offset - j->index[i].offset)
 		     >= target_size / 2) &&
 		    j->index[i].offset > best_guess.offset)
@@ -2203,68 +2688,7 @@ dns_journal_compact(isc_mem_t *mctx, char *filename, isc_uint32_t serial,
 	 * we did not reach 'serial'.  If not we will just copy
 	 * all uncommitted deltas regardless of the size.
 	 */
-	copy_length = j->header.end.offset - best_guess.offset;
-
-	if (copy_length != 0) {
-		/*
-		 * Copy best_guess to end into space just freed.
-		 */
-		size = 64*1024;
-		if (copy_length < size)
-			size = copy_length;
-		buf = isc_mem_get(mctx, size);
-		if (buf == NULL) {
-			result = ISC_R_NOMEMORY;
-			goto failure;
-		}
-
-		CHECK(journal_seek(j, best_guess.offset));
-		CHECK(journal_seek(new, indexend));
-		for (i = 0; i < copy_length; i += size) {
-			unsigned int len = (copy_length - i) > size ? size :
-							 (copy_length - i);
-			CHECK(journal_read(j, buf, len));
-			CHECK(journal_write(new, buf, len));
-		}
-
-		CHECK(journal_fsync(new));
-
-		/*
-		 * Compute new header.
-		 */
-		new->header.begin.serial = best_guess.serial;
-		new->header.begin.offset = indexend;
-		new->header.end.serial = j->header.end.serial;
-		new->header.end.offset = indexend + copy_length;
-		new->header.sourceserial = j->header.sourceserial;
-		new->header.serialset = j->header.serialset;
-
-		/*
-		 * Update the journal header.
-		 */
-		journal_header_encode(&new->header, &rawheader);
-		CHECK(journal_seek(new, 0));
-		CHECK(journal_write(new, &rawheader, sizeof(rawheader)));
-		CHECK(journal_fsync(new));
-
-		/*
-		 * Build new index.
-		 */
-		current_pos = new->header.begin;
-		while (current_pos.serial != new->header.end.serial) {
-			index_add(new, &current_pos);
-			CHECK(journal_next(new, &current_pos));
-		}
-
-		/*
-		 * Write index.
-		 */
-		CHECK(index_to_disk(new));
-		CHECK(journal_fsync(new));
-
-		indexend = new->header.end.offset;
-		POST(indexend);
-	}
+	CHECK(journal_copy(mctx, j, &best_guess, new));
 
 	/*
 	 * Close both journals before trying to rename files (this is
@@ -2273,41 +2697,12 @@ dns_journal_compact(isc_mem_t *mctx, char *filename, isc_uint32_t serial,
 	dns_journal_destroy(&j);
 	dns_journal_destroy(&new);
 
-	/*
-	 * With a UFS file system this should just succeed and be atomic.
-	 * Any IXFR outs will just continue and the old journal will be
-	 * removed on final close.
-	 *
-	 * With MSDOS / NTFS we need to do a two stage rename, triggered
-	 * by EEXIST.  (If any IXFR's are running in other threads, however,
-	 * this will fail, and the journal will not be compacted.  But
-	 * if so, hopefully they'll be finished by the next time we
-	 * compact.)
-	 */
-	if (rename(newname, filename) == -1) {
-		if (errno == EEXIST && !is_backup) {
-			result = isc_file_remove(backup);
-			if (result != ISC_R_SUCCESS &&
-			    result != ISC_R_FILENOTFOUND)
-				goto failure;
-			if (rename(filename, backup) == -1)
-				goto maperrno;
-			if (rename(newname, filename) == -1)
-				goto maperrno;
-			(void)isc_file_remove(backup);
-		} else {
- maperrno:
-			result = ISC_R_FAILURE;
-			goto failure;
-		}
-	}
+	CHECK(journal_replace(newname, filename, backup, is_backup));
 
 	result = ISC_R_SUCCESS;
 
  failure:
 	(void)isc_file_remove(newname);
-	if (buf != NULL)
-		isc_mem_put(mctx, buf, size);
 	if (j != NULL)
 		dns_journal_destroy(&j);
 	if (new != NULL)
@@ -2315,6 +2710,22 @@ dns_journal_compact(isc_mem_t *mctx, char *filename, isc_uint32_t serial,
 	return (result);
 }
 
+/*
+ * Write the in-core header and index to the journal file.
+ */
+static isc_result_t
+journal_header_to_disk(dns_journal_t *j) {
+	journal_rawheader_t rawheader;
+	isc_result_t result;
+
+	journal_header_encode(&j->header, &rawheader);
+	CHECK(journal_seek(j, 0));
+	CHECK(journal_write(j, &rawheader, sizeof(rawheader)));
+	CHECK(index_to_disk(j));
+ failure:
+	return (result);
+}
+
 static isc_result_t
 index_to_disk(dns_journal_t *j) {
 	isc_result_t result = ISC_R_SUCCESS;
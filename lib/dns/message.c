@@ -108,6 +108,16 @@ hexdump(const char *msg, const char *msg2, void *base, size_t len) {
 #define RDATALIST_COUNT		  8
 #define RDATASET_COUNT		 RDATALIST_COUNT
 
+/*%
+ * Default, minimum and maximum sizes of the first chunk of a message
+ * arena, and the alignment of the items carved out of it.
+ */
+#define ARENA_DEFSIZE		4096
+#define ARENA_MINSIZE		1024
+#define ARENA_MAXSIZE		65536
+#define ARENA_ALIGN(x)		(((x) + 7) & ~((size_t)7))
+#define ARENA_HDRSIZE		ARENA_ALIGN(sizeof(dns_msgchunk_t))
+
 /*%
  * Text representation of the different items, for message_totext
  * functions.
@@ -178,7 +188,7 @@ struct dns_msgblock {
 }; /* dynamically sized */
 
 static inline dns_msgblock_t *
-msgblock_allocate(isc_mem_t *, unsigned int, unsigned int);
+msgblock_allocate(dns_message_t *, unsigned int, unsigned int);
 
 #define msgblock_get(block, type) \
 	((type *)msgblock_internalget(block, sizeof(type)))
@@ -192,6 +202,19 @@ msgblock_reset(dns_msgblock_t *);
 static inline void
 msgblock_free(isc_mem_t *, dns_msgblock_t *, unsigned int);
 
+/*%
+ * A chunk of a message arena.  Items are carved out of the chunk
+ * starting ARENA_HDRSIZE bytes past its beginning.
+ */
+struct dns_msgchunk {
+	size_t				size;
+	size_t				used;
+	ISC_LINK(dns_msgchunk_t)	link;
+};
+
+static void *
+arena_get(dns_message_t *, size_t);
+
 static void
 logfmtpacket(dns_message_t *message, const char *description,
 	     isc_sockaddr_t *address, isc_logcategory_t *category,
@@ -203,7 +226,7 @@ logfmtpacket(dns_message_t *message, const char *description,
  * is free, return NULL.
  */
 static inline dns_msgblock_t *
-msgblock_allocate(isc_mem_t *mctx, unsigned int sizeof_type,
+msgblock_allocate(dns_message_t *msg, unsigned int sizeof_type,
 		  unsigned int count)
 {
 	dns_msgblock_t *block;
@@ -211,7 +234,10 @@ msgblock_allocate(isc_mem_t *mctx, unsigned int sizeof_type,
 
 	length = sizeof(dns_msgblock_t) + (sizeof_type * count);
 
-	block = isc_mem_get(mctx, length);
+	if (msg->arenasize != 0)
+		block = arena_get(msg, length);
+	else
+		block = isc_mem_get(msg->mctx, length);
 	if (block == NULL)
 		return (NULL);
 
@@ -261,6 +287,155 @@ msgblock_free(isc_mem_t *mctx, dns_msgblock_t *block, unsigned int sizeof_type)
 	isc_mem_put(mctx, block, length);
 }
 
+static dns_msgchunk_t *
+arena_newchunk(dns_message_t *msg, size_t size) {
+	dns_msgchunk_t *chunk;
+
+	chunk = isc_mem_get(msg->mctx, ARENA_HDRSIZE + size);
+	if (chunk == NULL)
+		return (NULL);
+
+	chunk->size = size;
+	chunk->used = 0;
+	ISC_LINK_INIT(chunk, link);
+
+	return (chunk);
+}
+
+static inline void
+arena_freechunk(dns_message_t *msg, dns_msgchunk_t *chunk) {
+	isc_mem_put(msg->mctx, chunk, ARENA_HDRSIZE + chunk->size);
+}
+
+/*
+ * Carve 'size' bytes out of the message arena.  When the current chunk
+ * is full another one is added, which stays until the next msgreset().
+ */
+static void *
+arena_get(dns_message_t *msg, size_t size) {
+	dns_msgchunk_t *chunk;
+	void *ptr;
+
+	size = ARENA_ALIGN(size);
+
+	chunk = ISC_LIST_TAIL(msg->arena);
+	INSIST(chunk != NULL);
+	if (chunk->size - chunk->used < size) {
+		chunk = arena_newchunk(msg, ISC_MAX(msg->arenasize, size));
+		if (chunk == NULL)
+			return (NULL);
+		ISC_LIST_APPEND(msg->arena, chunk, link);
+	}
+
+	ptr = (unsigned char *)chunk + ARENA_HDRSIZE + chunk->used;
+	chunk->used += size;
+
+	return (ptr);
+}
+
+/*
+ * Give everything carved out of the arena back at once, keeping the
+ * first chunk unless 'everything' is set.  If the last message needed
+ * more than one chunk, the first chunk is replaced by one big enough to
+ * hold all of it (up to ARENA_MAXSIZE), so that the next message of
+ * that size fits without extra allocations.
+ */
+static void
+arena_reset(dns_message_t *msg, isc_boolean_t everything) {
+	dns_msgchunk_t *chunk, *next_chunk, *first;
+	size_t total = 0;
+
+	first = ISC_LIST_HEAD(msg->arena);
+	INSIST(first != NULL);
+
+	chunk = first;
+	while (chunk != NULL) {
+		next_chunk = ISC_LIST_NEXT(chunk, link);
+		total += chunk->used;
+		if (everything || chunk != first) {
+			ISC_LIST_UNLINK(msg->arena, chunk, link);
+			arena_freechunk(msg, chunk);
+		}
+		chunk = next_chunk;
+	}
+	if (everything)
+		return;
+
+	first->used = 0;
+	total = ISC_MIN(ARENA_ALIGN(total), ARENA_MAXSIZE);
+	if (total > first->size) {
+		chunk = arena_newchunk(msg, total);
+		if (chunk != NULL) {
+			ISC_LIST_UNLINK(msg->arena, first, link);
+			arena_freechunk(msg, first);
+			ISC_LIST_APPEND(msg->arena, chunk, link);
+			msg->arenasize = total;
+		}
+	}
+}
+
+static inline dns_name_t *
+newname(dns_message_t *msg) {
+	dns_name_t *name;
+
+	if (msg->arenasize == 0)
+		return (isc_mempool_get(msg->namepool));
+
+	name = ISC_LIST_HEAD(msg->freenames);
+	if (name != NULL)
+		ISC_LIST_UNLINK(msg->freenames, name, link);
+	else
+		name = arena_get(msg, sizeof(dns_name_t));
+	if (name != NULL)
+		msg->arenanames++;
+
+	return (name);
+}
+
+static inline void
+releasename(dns_message_t *msg, dns_name_t *name) {
+	if (msg->arenasize == 0) {
+		isc_mempool_put(msg->namepool, name);
+		return;
+	}
+
+	INSIST(msg->arenanames > 0);
+	msg->arenanames--;
+	ISC_LINK_INIT(name, link);
+	ISC_LIST_PREPEND(msg->freenames, name, link);
+}
+
+static inline dns_rdataset_t *
+newrdataset(dns_message_t *msg) {
+	dns_rdataset_t *rdataset;
+
+	if (msg->arenasize == 0)
+		return (isc_mempool_get(msg->rdspool));
+
+	rdataset = ISC_LIST_HEAD(msg->freerdatasets);
+	if (rdataset != NULL)
+		ISC_LIST_UNLINK(msg->freerdatasets, rdataset, link);
+	else
+		rdataset = arena_get(msg, sizeof(dns_rdataset_t));
+	if (rdataset != NULL)
+		msg->arenardatasets++;
+
+	return (rdataset);
+}
+
+static inline void
+releaserdataset(dns_message_t *msg, dns_rdataset_t *rdataset) {
+	if (msg->arenasize == 0) {
+		isc_mempool_put(msg->rdspool, rdataset);
+		return;
+	}
+
+	INSIST(msg->arenardatasets > 0);
+	msg->arenardatasets--;
+	ISC_LINK_INIT(rdataset, link);
+	ISC_LIST_PREPEND(msg->freerdatasets, rdataset, link);
+}
+
 /*
  * Allocate a new dynamic buffer, and attach it to this message as the
  * "current" buffer.  (which is always the last on the list, for our
@@ -271,6 +446,15 @@ newbuffer(dns_message_t *msg, unsigned int size) {
 	isc_result_t result;
 	isc_buffer_t *dynbuf;
 
+	if (msg->arenasize != 0) {
+		dynbuf = arena_get(msg, sizeof(isc_buffer_t) + size);
+		if (dynbuf == NULL)
+			return (ISC_R_NOMEMORY);
+		isc_buffer_init(dynbuf, dynbuf + 1, size);
+		ISC_LIST_APPEND(msg->scratchpad, dynbuf, link);
+		return (ISC_R_SUCCESS);
+	}
+
 	dynbuf = NULL;
 	result = isc_buffer_allocate(msg->mctx, &dynbuf, size);
 	if (result != ISC_R_SUCCESS)
@@ -309,7 +493,7 @@ newrdata(dns_message_t *msg) {
 	msgblock = ISC_LIST_TAIL(msg->rdatas);
 	rdata = msgblock_get(msgblock, dns_rdata_t);
 	if (rdata == NULL) {
-		msgblock = msgblock_allocate(msg->mctx, sizeof(dns_rdata_t),
+		msgblock = msgblock_allocate(msg, sizeof(dns_rdata_t),
 					     RDATA_COUNT);
 		if (msgblock == NULL)
 			return (NULL);
@@ -342,7 +526,7 @@ newrdatalist(dns_message_t *msg) {
 	msgblock = ISC_LIST_TAIL(msg->rdatalists);
 	rdatalist = msgblock_get(msgblock, dns_rdatalist_t);
 	if (rdatalist == NULL) {
-		msgblock = msgblock_allocate(msg->mctx,
+		msgblock = msgblock_allocate(msg,
 					     sizeof(dns_rdatalist_t),
 					     RDATALIST_COUNT);
 		if (msgblock == NULL)
@@ -367,7 +551,7 @@ newoffsets(dns_message_t *msg) {
 	msgblock = ISC_LIST_TAIL(msg->offsets);
 	offsets = msgblock_get(msgblock, dns_offsets_t);
 	if (offsets == NULL) {
-		msgblock = msgblock_allocate(msg->mctx,
+		msgblock = msgblock_allocate(msg,
 					     sizeof(dns_offsets_t),
 					     OFFSET_COUNT);
 		if (msgblock == NULL)
@@ -471,12 +655,12 @@ msgresetnames(dns_message_t *msg, unsigned int first_section) {
 
 				INSIST(dns_rdataset_isassociated(rds));
 				dns_rdataset_disassociate(rds);
-				isc_mempool_put(msg->rdspool, rds);
+				releaserdataset(msg, rds);
 				rds = next_rds;
 			}
 			if (dns_name_dynamic(name))
 				dns_name_free(name, msg->mctx);
-			isc_mempool_put(msg->namepool, name);
+			releasename(msg, name);
 			name = next_name;
 		}
 	}
@@ -492,7 +676,7 @@ msgresetopt(dns_message_t *msg)
 		}
 		INSIST(dns_rdataset_isassociated(msg->opt));
 		dns_rdataset_disassociate(msg->opt);
-		isc_mempool_put(msg->rdspool, msg->opt);
+		releaserdataset(msg, msg->opt);
 		msg->opt = NULL;
 		msg->cc_ok = 0;
 		msg->cc_bad = 0;
@@ -513,30 +697,30 @@ msgresetsigs(dns_message_t *msg, isc_boolean_t replying) {
 			msg->querytsig = msg->tsig;
 		} else {
 			dns_rdataset_disassociate(msg->tsig);
-			isc_mempool_put(msg->rdspool, msg->tsig);
+			releaserdataset(msg, msg->tsig);
 			if (msg->querytsig != NULL) {
 				dns_rdataset_disassociate(msg->querytsig);
-				isc_mempool_put(msg->rdspool, msg->querytsig);
+				releaserdataset(msg, msg->querytsig);
 			}
 		}
 		if (dns_name_dynamic(msg->tsigname))
 			dns_name_free(msg->tsigname, msg->mctx);
-		isc_mempool_put(msg->namepool, msg->tsigname);
+		releasename(msg, msg->tsigname);
 		msg->tsig = NULL;
 		msg->tsigname = NULL;
 	} else if (msg->querytsig != NULL && !replying) {
 		dns_rdataset_disassociate(msg->querytsig);
-		isc_mempool_put(msg->rdspool, msg->querytsig);
+		releaserdataset(msg, msg->querytsig);
 		msg->querytsig = NULL;
 	}
 	if (msg->sig0 != NULL) {
 		INSIST(dns_rdataset_isassociated(msg->sig0));
 		dns_rdataset_disassociate(msg->sig0);
-		isc_mempool_put(msg->rdspool, msg->sig0);
+		releaserdataset(msg, msg->sig0);
 		if (msg->sig0name != NULL) {
 			if (dns_name_dynamic(msg->sig0name))
 				dns_name_free(msg->sig0name, msg->mctx);
-			isc_mempool_put(msg->namepool, msg->sig0name);
+			releasename(msg, msg->sig0name);
 		}
 		msg->sig0 = NULL;
 		msg->sig0name = NULL;
@@ -578,57 +762,77 @@ msgreset(dns_message_t *msg, isc_boolean_t everything) {
 		rdatalist = ISC_LIST_HEAD(msg->freerdatalist);
 	}
 
-	dynbuf = ISC_LIST_HEAD(msg->scratchpad);
-	INSIST(dynbuf != NULL);
-	if (!everything) {
-		isc_buffer_clear(dynbuf);
-		dynbuf = ISC_LIST_NEXT(dynbuf, link);
-	}
-	while (dynbuf != NULL) {
-		next_dynbuf = ISC_LIST_NEXT(dynbuf, link);
-		ISC_LIST_UNLINK(msg->scratchpad, dynbuf, link);
-		isc_buffer_free(&dynbuf);
-		dynbuf = next_dynbuf;
-	}
+	if (msg->arenasize != 0) {
+		/*
+		 * The scratchpad buffers, the message blocks and the free
+		 * names and rdatasets all live in the arena.
+		 */
+		ISC_LIST_INIT(msg->scratchpad);
+		ISC_LIST_INIT(msg->rdatas);
+		ISC_LIST_INIT(msg->rdatalists);
+		ISC_LIST_INIT(msg->offsets);
+		ISC_LIST_INIT(msg->freenames);
+		ISC_LIST_INIT(msg->freerdatasets);
+		arena_reset(msg, everything);
+		if (!everything)
+			RUNTIME_CHECK(newbuffer(msg, SCRATCHPAD_SIZE) ==
+				      ISC_R_SUCCESS);
+	} else {
+		dynbuf = ISC_LIST_HEAD(msg->scratchpad);
+		INSIST(dynbuf != NULL);
+		if (!everything) {
+			isc_buffer_clear(dynbuf);
+			dynbuf = ISC_LIST_NEXT(dynbuf, link);
+		}
+		while (dynbuf != NULL) {
+			next_dynbuf = ISC_LIST_NEXT(dynbuf, link);
+			ISC_LIST_UNLINK(msg->scratchpad, dynbuf, link);
+			isc_buffer_free(&dynbuf);
+			dynbuf = next_dynbuf;
+		}
 
-	msgblock = ISC_LIST_HEAD(msg->rdatas);
-	if (!everything && msgblock != NULL) {
-		msgblock_reset(msgblock);
-		msgblock = ISC_LIST_NEXT(msgblock, link);
-	}
-	while (msgblock != NULL) {
-		next_msgblock = ISC_LIST_NEXT(msgblock, link);
-		ISC_LIST_UNLINK(msg->rdatas, msgblock, link);
-		msgblock_free(msg->mctx, msgblock, sizeof(dns_rdata_t));
-		msgblock = next_msgblock;
-	}
+		msgblock = ISC_LIST_HEAD(msg->rdatas);
+		if (!everything && msgblock != NULL) {
+			msgblock_reset(msgblock);
+			msgblock = ISC_LIST_NEXT(msgblock, link);
+		}
+		while (msgblock != NULL) {
+			next_msgblock = ISC_LIST_NEXT(msgblock, link);
+			ISC_LIST_UNLINK(msg->rdatas, msgblock, link);
+			msgblock_free(msg->mctx, msgblock,
+				      sizeof(dns_rdata_t));
+			msgblock = next_msgblock;
+		}
 
-	/*
-	 * rdatalists could be empty.
-	 */
+		/*
+		 * rdatalists could be empty.
+		 */
 
-	msgblock = ISC_LIST_HEAD(msg->rdatalists);
-	if (!everything && msgblock != NULL) {
-		msgblock_reset(msgblock);
-		msgblock = ISC_LIST_NEXT(msgblock, link);
-	}
-	while (msgblock != NULL) {
-		next_msgblock = ISC_LIST_NEXT(msgblock, link);
-		ISC_LIST_UNLINK(msg->rdatalists, msgblock, link);
-		msgblock_free(msg->mctx, msgblock, sizeof(dns_rdatalist_t));
-		msgblock = next_msgblock;
-	}
+		msgblock = ISC_LIST_HEAD(msg->rdatalists);
+		if (!everything && msgblock != NULL) {
+			msgblock_reset(msgblock);
+			msgblock = ISC_LIST_NEXT(msgblock, link);
+		}
+		while (msgblock != NULL) {
+			next_msgblock = ISC_LIST_NEXT(msgblock, link);
+			ISC_LIST_UNLINK(msg->rdatalists, msgblock, link);
+			msgblock_free(msg->mctx, msgblock,
+				      sizeof(dns_rdatalist_t));
+			msgblock = next_msgblock;
+		}
 
-	msgblock = ISC_LIST_HEAD(msg->offsets);
-	if (!everything && msgblock != NULL) {
-		msgblock_reset(msgblock);
-		msgblock = ISC_LIST_NEXT(msgblock, link);
-	}
-	while (msgblock != NULL) {
-		next_msgblock = ISC_LIST_NEXT(msgblock, link);
-		ISC_LIST_UNLINK(msg->offsets, msgblock, link);
-		msgblock_free(msg->mctx, msgblock, sizeof(dns_offsets_t));
-		msgblock = next_msgblock;
+		msgblock = ISC_LIST_HEAD(msg->offsets);
+		if (!everything && msgblock != NULL) {
+			msgblock_reset(msgblock);
+			msgblock = ISC_LIST_NEXT(msgblock, link);
+		}
+		while (msgblock != NULL) {
+			next_msgblock = ISC_LIST_NEXT(msgblock, link);
+			ISC_LIST_UNLINK(msg->offsets, msgblock, link);
+			msgblock_free(msg->mctx, msgblock,
+				      sizeof(dns_offsets_t));
+			msgblock = next_msgblock;
+		}
 	}
 
 	if (msg->tsigkey != NULL) {
@@ -674,6 +878,8 @@ msgreset(dns_message_t *msg, isc_boolean_t everything) {
 
 	ENSURE(isc_mempool_getallocated(msg->namepool) == 0);
 	ENSURE(isc_mempool_getallocated(msg->rdspool) == 0);
+	ENSURE(msg->arenanames == 0);
+	ENSURE(msg->arenardatasets == 0);
 }
 
 static unsigned int
@@ -757,6 +963,12 @@ dns_message_create(isc_mem_t *mctx, unsigned int intent, dns_message_t **msgp)
 	ISC_LIST_INIT(m->offsets);
 	ISC_LIST_INIT(m->freerdata);
 	ISC_LIST_INIT(m->freerdatalist);
+	ISC_LIST_INIT(m->arena);
+	m->arenasize = 0;
+	ISC_LIST_INIT(m->freenames);
+	ISC_LIST_INIT(m->freerdatasets);
+	m->arenanames = 0;
+	m->arenardatasets = 0;
 
 	/*
 	 * Ok, it is safe to allocate (and then "goto cleanup" if failure)
@@ -805,6 +1017,41 @@ dns_message_create(isc_mem_t *mctx, unsigned int intent, dns_message_t **msgp)
 	return (ISC_R_NOMEMORY);
 }
 
+isc_result_t
+dns_message_usearena(dns_message_t *msg, size_t size) {
+	dns_msgchunk_t *chunk;
+	isc_result_t result;
+
+	REQUIRE(DNS_MESSAGE_VALID(msg));
+	REQUIRE(msg->arenasize == 0);
+	REQUIRE(msg->state == DNS_SECTION_ANY);
+
+	if (size == 0)
+		size = ARENA_DEFSIZE;
+	else if (size < ARENA_MINSIZE)
+		size = ARENA_MINSIZE;
+	else if (size > ARENA_MAXSIZE)
+		size = ARENA_MAXSIZE;
+	size = ARENA_ALIGN(size);
+
+	chunk = arena_newchunk(msg, size);
+	if (chunk == NULL)
+		return (ISC_R_NOMEMORY);
+
+	/*
+	 * Free the scratchpad and message blocks allocated by
+	 * dns_message_create(); from now on they come from the arena.
+	 */
+	msgreset(msg, ISC_TRUE);
+
+	ISC_LIST_APPEND(msg->arena, chunk, link);
+	msg->arenasize = size;
+	result = newbuffer(msg, SCRATCHPAD_SIZE);
+	INSIST(result == ISC_R_SUCCESS);
+
+	return (ISC_R_SUCCESS);
+}
+
 void
 dns_message_reset(dns_message_t *msg, unsigned int intent) {
 	REQUIRE(DNS_MESSAGE_VALID(msg));
@@ -1032,7 +1279,7 @@ getquestions(isc_buffer_t *source, dns_message_t *msg, dns_decompress_t *dctx,
 	rdatalist = NULL;
 
 	for (count = 0; count < msg->counts[DNS_SECTION_QUESTION]; count++) {
-		name = isc_mempool_get(msg->namepool);
+		name = newname(msg);
 		if (name == NULL)
 			return (ISC_R_NOMEMORY);
 		free_name = ISC_TRUE;
@@ -1077,7 +1324,7 @@ getquestions(isc_buffer_t *source, dns_message_t *msg, dns_decompress_t *dctx,
 			ISC_LIST_APPEND(*section, name, link);
 			free_name = ISC_FALSE;
 		} else {
-			isc_mempool_put(msg->namepool, name);
+			releasename(msg, name);
 			name = name2;
 			name2 = NULL;
 			free_name = ISC_FALSE;
@@ -1119,7 +1366,7 @@ getquestions(isc_buffer_t *source, dns_message_t *msg, dns_decompress_t *dctx,
 			result = ISC_R_NOMEMORY;
 			goto cleanup;
 		}
-		rdataset =  isc_mempool_get(msg->rdspool);
+		rdataset =  newrdataset(msg);
 		if (rdataset == NULL) {
 			result = ISC_R_NOMEMORY;
 			goto cleanup;
@@ -1150,14 +1397,14 @@ getquestions(isc_buffer_t *source, dns_message_t *msg, dns_decompress_t *dctx,
  cleanup:
 	if (rdataset != NULL) {
 		INSIST(!dns_rdataset_isassociated(rdataset));
-		isc_mempool_put(msg->rdspool, rdataset);
+		releaserdataset(msg, rdataset);
 	}
 #if 0
 	if (rdatalist != NULL)
 		isc_mempool_put(msg->rdlpool, rdatalist);
 #endif
 	if (free_name)
-		isc_mempool_put(msg->namepool, name);
+		releasename(msg, name);
 
 	return (result);
 }
@@ -1207,7 +1454,7 @@ getsection(isc_buffer_t *source, dns_message_t *msg, dns_decompress_t *dctx,
 		skip_type_search = ISC_FALSE;
 		free_rdataset = ISC_FALSE;
 
-		name = isc_mempool_get(msg->namepool);
+		name = newname(msg);
 		if (name == NULL)
 			return (ISC_R_NOMEMORY);
 		free_name = ISC_TRUE;
@@ -1422,7 +1669,7 @@ getsection(isc_buffer_t *source, dns_message_t *msg, dns_decompress_t *dctx,
 			 * If it is a new name, append to the section.
 			 */
 			if (result == ISC_R_SUCCESS) {
-				isc_mempool_put(msg->namepool, name);
+				releasename(msg, name);
 				name = name2;
 			} else {
 				ISC_LIST_APPEND(*section, name, link);
@@ -1474,7 +1721,7 @@ getsection(isc_buffer_t *source, dns_message_t *msg, dns_decompress_t *dctx,
 		}
 
 		if (result == ISC_R_NOTFOUND) {
-			rdataset = isc_mempool_get(msg->rdspool);
+			rdataset = newrdataset(msg);
 			if (rdataset == NULL) {
 				result = ISC_R_NOMEMORY;
 				goto cleanup;
@@ -1540,7 +1787,7 @@ getsection(isc_buffer_t *source, dns_message_t *msg, dns_decompress_t *dctx,
 				((msg->opt->ttl & DNS_MESSAGE_EDNSRCODE_MASK)
 				 >> 20);
 			msg->rcode |= ercode;
-			isc_mempool_put(msg->namepool, name);
+			releasename(msg, name);
 			free_name = ISC_FALSE;
 		}
 
@@ -1567,9 +1814,9 @@ getsection(isc_buffer_t *source, dns_message_t *msg, dns_decompress_t *dctx,
 
 		if (seen_problem) {
 			if (free_name)
-				isc_mempool_put(msg->namepool, name);
+				releasename(msg, name);
 			if (free_rdataset)
-				isc_mempool_put(msg->rdspool, rdataset);
+				releaserdataset(msg, rdataset);
 			free_name = free_rdataset = ISC_FALSE;
 		}
 		INSIST(free_name == ISC_FALSE);
@@ -1582,9 +1829,9 @@ getsection(isc_buffer_t *source, dns_message_t *msg, dns_decompress_t *dctx,
 
  cleanup:
 	if (free_name)
-		isc_mempool_put(msg->namepool, name);
+		releasename(msg, name);
 	if (free_rdataset)
-		isc_mempool_put(msg->rdspool, rdataset);
+		releaserdataset(msg, rdataset);
 
 	return (result);
 }
@@ -1691,12 +1938,16 @@ dns_message_parse(dns_message_t *msg, isc_buffer_t *source,
 		isc_buffer_usedregion(&origsource, &msg->saved);
 	else {
 		msg->saved.length = isc_buffer_usedlength(&origsource);
-		msg->saved.base = isc_mem_get(msg->mctx, msg->saved.length);
+		if (msg->arenasize != 0)
+			msg->saved.base = arena_get(msg, msg->saved.length);
+		else
+			msg->saved.base = isc_mem_get(msg->mctx,
+						      msg->saved.length);
 		if (msg->saved.base == NULL)
 			return (ISC_R_NOMEMORY);
 		memmove(msg->saved.base, isc_buffer_base(&origsource),
 			msg->saved.length);
-		msg->free_saved = 1;
+		msg->free_saved = (msg->arenasize == 0) ? 1 : 0;
 	}
 
 	if (ret == ISC_R_UNEXPECTEDEND && ignore_tc)
@@ -2101,6 +2352,63 @@ dns_message_rendersection(dns_message_t *msg, dns_section_t sectionid,
 	return (ISC_R_SUCCESS);
 }
 
+isc_result_t
+dns_message_renderrr(dns_message_t *msg, dns_section_t sectionid,
+		     dns_name_t *owner, dns_ttl_t ttl, dns_rdata_t *rdata)
+{
+	isc_buffer_t st; /* for rollbacks */
+	isc_buffer_t rdlen;
+	isc_region_t r;
+	isc_result_t result;
+
+	REQUIRE(DNS_MESSAGE_VALID(msg));
+	REQUIRE(msg->buffer != NULL);
+	REQUIRE(VALID_NAMED_SECTION(sectionid));
+	REQUIRE(sectionid != DNS_SECTION_QUESTION);
+	REQUIRE(rdata != NULL);
+
+	/*
+	 * Shrink the space in the buffer by the reserved amount.  The
+	 * saved state includes the original length.
+	 */
+	st = *(msg->buffer);
+	msg->buffer->length -= msg->reserved;
+
+	dns_compress_setmethods(msg->cctx, DNS_COMPRESS_GLOBAL14);
+	result = dns_name_towire(owner, msg->cctx, msg->buffer);
+	if (result != ISC_R_SUCCESS)
+		goto rollback;
+
+	isc_buffer_availableregion(msg->buffer, &r);
+	if (r.length < 10) {
+		result = ISC_R_NOSPACE;
+		goto rollback;
+	}
+	isc_buffer_putuint16(msg->buffer, rdata->type);
+	isc_buffer_putuint16(msg->buffer, rdata->rdclass);
+	isc_buffer_putuint32(msg->buffer, ttl);
+	rdlen = *(msg->buffer);
+	isc_buffer_add(msg->buffer, 2);
+
+	result = dns_rdata_towire(rdata, msg->cctx, msg->buffer);
+	if (result != ISC_R_SUCCESS)
+		goto rollback;
+	INSIST(msg->buffer->used - rdlen.used - 2 < 65536);
+	isc_buffer_putuint16(&rdlen,
+			     (isc_uint16_t)(msg->buffer->used -
+					    rdlen.used - 2));
+
+	msg->buffer->length += msg->reserved;
+	msg->counts[sectionid]++;
+	return (ISC_R_SUCCESS);
+
+ rollback:
+	INSIST(st.used < 65536);
+	dns_compress_rollback(msg->cctx, (isc_uint16_t)st.used);
+	*(msg->buffer) = st;
+	return (result);
+}
+
 void
 dns_message_renderheader(dns_message_t *msg, isc_buffer_t *target) {
 	isc_uint16_t tmp;
@@ -2428,7 +2736,7 @@ dns_message_gettempname(dns_message_t *msg, dns_name_t **item) {
 	REQUIRE(DNS_MESSAGE_VALID(msg));
 	REQUIRE(item != NULL && *item == NULL);
 
-	*item = isc_mempool_get(msg->namepool);
+	*item = newname(msg);
 	if (*item == NULL)
 		return (ISC_R_NOMEMORY);
 	dns_name_init(*item, NULL);
@@ -2465,7 +2773,7 @@ dns_message_gettemprdataset(dns_message_t *msg, dns_rdataset_t **item) {
 	REQUIRE(DNS_MESSAGE_VALID(msg));
 	REQUIRE(item != NULL && *item == NULL);
 
-	*item = isc_mempool_get(msg->rdspool);
+	*item = newrdataset(msg);
 	if (*item == NULL)
 		return (ISC_R_NOMEMORY);
 
@@ -2493,7 +2801,7 @@ dns_message_puttempname(dns_message_t *msg, dns_name_t **item) {
 
 	if (dns_name_dynamic(*item))
 		dns_name_free(*item, msg->mctx);
-	isc_mempool_put(msg->namepool, *item);
+	releasename(msg, *item);
 	*item = NULL;
 }
 
@@ -2512,7 +2820,7 @@ dns_message_puttemprdataset(dns_message_t *msg, dns_rdataset_t **item) {
 	REQUIRE(item != NULL && *item != NULL);
 
 	REQUIRE(!dns_rdataset_isassociated(*item));
-	isc_mempool_put(msg->rdspool, *item);
+	releaserdataset(msg, *item);
 	*item = NULL;
 }
 
@@ -0,0 +1,450 @@
+/*
+ * Copyright (C) 2015  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <stdlib.h>
+
+#include <isc/atomic.h>
+#include <isc/magic.h>
+#include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/platform.h>
+#include <isc/random.h>
+#include <isc/refcount.h>
+#include <isc/region.h>
+#include <isc/string.h>
+#include <isc/util.h>
+
+#include <dns/fixedname.h>
+#include <dns/name.h>
+#include <dns/popularity.h>
+
+#define POPULARITY_MAGIC		ISC_MAGIC('P', 'o', 'p', 'l')
+#define VALID_POPULARITY(p)		ISC_MAGIC_VALID(p, POPULARITY_MAGIC)
+
+/*%
+ * Number of independent rows in the sketch.  Four rows keep the
+ * probability of an overestimate low while bounding the per-hit cost
+ * to four counter updates.
+ */
+#define POP_DEPTH		4
+
+/*%
+ * Counters per row, per hot list slot, and the bounds on the row width.
+ */
+#define POP_WIDTHFACTOR		64
+#define POP_MINWIDTH		1024
+#define POP_MAXWIDTH		(1 << 20)
+
+/*%
+ * Only every POP_SAMPLE'th hit on a tuple is considered for the hot
+ * list, so that the hot list lock is not taken on every lookup.
+ */
+#define POP_SAMPLE		16
+
+/*%
+ * Hot list entries keep the (downcased) owner name in wire format so
+ * that they can be moved around with memcpy() when sorting.
+ */
+typedef struct hotentry {
+	isc_uint32_t		count;
+	dns_rdatatype_t		type;
+	unsigned int		length;
+	unsigned char		ndata[DNS_NAME_MAXWIRE];
+} hotentry_t;
+
+struct dns_popularity {
+	/* Unlocked. */
+	unsigned int		magic;
+	isc_mem_t		*mctx;
+	isc_refcount_t		references;
+	unsigned int		width;		/* power of 2 */
+	isc_uint32_t		seeds[POP_DEPTH];
+	isc_int32_t		*counters;	/* POP_DEPTH * width */
+
+	/* Locked by lock. */
+	isc_mutex_t		lock;
+	unsigned int		hotsize;
+	unsigned int		hotcount;
+	isc_uint32_t		hotmin;
+	hotentry_t		*hot;
+};
+
+static isc_uint32_t
+name_hash(dns_name_t *name, dns_rdatatype_t type) {
+	isc_uint32_t h = 2166136261U;
+	unsigned int i;
+	unsigned char c;
+
+	/* FNV-1a over the case-folded owner name and the type. */
+	for (i = 0; i < name->length; i++) {
+		c = name->ndata[i];
+		if (c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+		h ^= c;
+		h *= 16777619U;
+	}
+	h ^= type & 0xff;
+	h *= 16777619U;
+	h ^= type >> 8;
+	h *= 16777619U;
+	return (h);
+}
+
+static inline isc_uint32_t
+row_index(dns_popularity_t *pop, isc_uint32_t h, unsigned int row) {
+	h ^= pop->seeds[row];
+	h ^= h >> 16;
+	h *= 0x85ebca6bU;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35U;
+	h ^= h >> 16;
+	return (row * pop->width + (h & (pop->width - 1)));
+}
+
+static inline isc_uint32_t
+counter_increment(isc_int32_t *counter) {
+#ifdef ISC_PLATFORM_HAVEXADD
+	return ((isc_uint32_t)isc_atomic_xadd(counter, 1) + 1);
+#else
+	/* Racy, but the counts are approximate anyway. */
+	return ((isc_uint32_t)++(*counter));
+#endif
+}
+
+isc_result_t
+dns_popularity_create(isc_mem_t *mctx, unsigned int hotsize,
+		      dns_popularity_t **popp)
+{
+	dns_popularity_t *pop;
+	isc_result_t result;
+	unsigned int i;
+	size_t size;
+
+	REQUIRE(mctx != NULL);
+	REQUIRE(hotsize > 0);
+	REQUIRE(popp != NULL && *popp == NULL);
+
+	pop = isc_mem_get(mctx, sizeof(*pop));
+	if (pop == NULL)
+		return (ISC_R_NOMEMORY);
+
+	pop->width = POP_MINWIDTH;
+	while (pop->width < POP_MAXWIDTH &&
+	       pop->width < hotsize * POP_WIDTHFACTOR)
+		pop->width <<= 1;
+
+	size = POP_DEPTH * pop->width * sizeof(isc_int32_t);
+	pop->counters = isc_mem_get(mctx, size);
+	if (pop->counters == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto cleanup_pop;
+	}
+	memset(pop->counters, 0, size);
+
+	pop->hot = isc_mem_get(mctx, hotsize * sizeof(hotentry_t));
+	if (pop->hot == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto cleanup_counters;
+	}
+	memset(pop->hot, 0, hotsize * sizeof(hotentry_t));
+
+	result = isc_mutex_init(&pop->lock);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_hot;
+
+	result = isc_refcount_init(&pop->references, 1);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_lock;
+
+	for (i = 0; i < POP_DEPTH; i++)
+		isc_random_get(&pop->seeds[i]);
+
+	pop->hotsize = hotsize;
+	pop->hotcount = 0;
+	pop->hotmin = 0;
+	pop->mctx = NULL;
+	isc_mem_attach(mctx, &pop->mctx);
+	pop->magic = POPULARITY_MAGIC;
+
+	*popp = pop;
+	return (ISC_R_SUCCESS);
+
+ cleanup_lock:
+	DESTROYLOCK(&pop->lock);
+ cleanup_hot:
+	isc_mem_put(mctx, pop->hot, hotsize * sizeof(hotentry_t));
+ cleanup_counters:
+	isc_mem_put(mctx, pop->counters, size);
+ cleanup_pop:
+	isc_mem_put(mctx, pop, sizeof(*pop));
+	return (result);
+}
+
+void
+dns_popularity_attach(dns_popularity_t *source, dns_popularity_t **targetp) {
+	REQUIRE(VALID_POPULARITY(source));
+	REQUIRE(targetp != NULL && *targetp == NULL);
+
+	isc_refcount_increment(&source->references, NULL);
+	*targetp = source;
+}
+
+void
+dns_popularity_detach(dns_popularity_t **popp) {
+	dns_popularity_t *pop;
+	unsigned int refs;
+
+	REQUIRE(popp != NULL);
+	pop = *popp;
+	*popp = NULL;
+	REQUIRE(VALID_POPULARITY(pop));
+
+	isc_refcount_decrement(&pop->references, &refs);
+	if (refs > 0)
+		return;
+
+	pop->magic = 0;
+	isc_refcount_destroy(&pop->references);
+	DESTROYLOCK(&pop->lock);
+	isc_mem_put(pop->mctx, pop->hot, pop->hotsize * sizeof(hotentry_t));
+	isc_mem_put(pop->mctx, pop->counters,
+		    POP_DEPTH * pop->width * sizeof(isc_int32_t));
+	isc_mem_putanddetach(&pop->mctx, pop, sizeof(*pop));
+}
+
+/*
+ * Find the hot list slot to be used for 'name'/'type': either the
+ * slot already holding it, a free slot, or the least popular slot.
+ * 'name' must be downcased.  Caller must hold pop->lock.
+ */
+static hotentry_t *
+hot_slot(dns_popularity_t *pop, dns_name_t *name, dns_rdatatype_t type,
+	 isc_boolean_t *existing)
+{
+	hotentry_t *entry, *min = NULL;
+	unsigned int i;
+
+	for (i = 0; i < pop->hotcount; i++) {
+		entry = &pop->hot[i];
+		if (entry->type == type && entry->length == name->length &&
+		    memcmp(entry->ndata, name->ndata, name->length) == 0)
+		{
+			*existing = ISC_TRUE;
+			return (entry);
+		}
+		if (min == NULL || entry->count < min->count)
+			min = entry;
+	}
+	*existing = ISC_FALSE;
+	if (pop->hotcount < pop->hotsize) {
+		entry = &pop->hot[pop->hotcount++];
+		entry->count = 0;
+		return (entry);
+	}
+	return (min);
+}
+
+/*
+ * Recompute the smallest count in a full hot list from scratch.
+ * Caller must hold pop->lock.
+ */
+static void
+hot_setmin(dns_popularity_t *pop) {
+	unsigned int i;
+
+	if (pop->hotcount < pop->hotsize) {
+		pop->hotmin = 0;
+		return;
+	}
+	pop->hotmin = pop->hot[0].count;
+	for (i = 1; i < pop->hotcount; i++)
+		if (pop->hot[i].count < pop->hotmin)
+			pop->hotmin = pop->hot[i].count;
+}
+
+/*
+ * Keep 'hotmin' up to date after a hot list entry's count changed
+ * from 'old' to 'new', rescanning the list only when the entry was
+ * the minimum or the list has just filled up.
+ * Caller must hold pop->lock.
+ */
+static void
+hot_newmin(dns_popularity_t *pop, isc_uint32_t old, isc_uint32_t new) {
+	if (pop->hotcount < pop->hotsize)
+		pop->hotmin = 0;
+	else if (pop->hotmin == 0 || old == pop->hotmin)
+		hot_setmin(pop);
+	else if (new < pop->hotmin)
+		pop->hotmin = new;
+}
+
+static void
+hot_update(dns_popularity_t *pop, dns_name_t *name, dns_rdatatype_t type,
+	   isc_uint32_t estimate)
+{
+	dns_fixedname_t fixed;
+	dns_name_t *lname;
+	hotentry_t *entry;
+	isc_boolean_t existing;
+	isc_uint32_t old;
+
+	dns_fixedname_init(&fixed);
+	lname = dns_fixedname_name(&fixed);
+	if (dns_name_downcase(name, lname, NULL) != ISC_R_SUCCESS)
+		return;
+
+	LOCK(&pop->lock);
+	entry = hot_slot(pop, lname, type, &existing);
+	old = entry->count;
+	if (existing || old < estimate) {
+		if (!existing) {
+			memmove(entry->ndata, lname->ndata, lname->length);
+			entry->length = lname->length;
+			entry->type = type;
+		}
+		entry->count = estimate;
+		if (old != estimate)
+			hot_newmin(pop, old, estimate);
+	}
+	UNLOCK(&pop->lock);
+}
+
+isc_uint32_t
+dns_popularity_record(dns_popularity_t *pop, dns_name_t *name,
+		      dns_rdatatype_t type)
+{
+	isc_uint32_t h, v, estimate = 0;
+	unsigned int row;
+
+	REQUIRE(VALID_POPULARITY(pop));
+	REQUIRE(dns_name_isabsolute(name));
+
+	h = name_hash(name, type);
+	for (row = 0; row < POP_DEPTH; row++) {
+		v = counter_increment(&pop->counters[row_index(pop, h, row)]);
+		if (row == 0 || v < estimate)
+			estimate = v;
+	}
+
+	/*
+	 * 'hotmin' is read without the lock; a stale value only
+	 * delays or causes a redundant hot list update.
+	 */
+	if (estimate > pop->hotmin && (estimate % POP_SAMPLE) == 0)
+		hot_update(pop, name, type, estimate);
+
+	return (estimate);
+}
+
+isc_uint32_t
+dns_popularity_estimate(dns_popularity_t *pop, dns_name_t *name,
+			dns_rdatatype_t type)
+{
+	isc_uint32_t h, v, estimate = 0;
+	unsigned int row;
+
+	REQUIRE(VALID_POPULARITY(pop));
+	REQUIRE(dns_name_isabsolute(name));
+
+	h = name_hash(name, type);
+	for (row = 0; row < POP_DEPTH; row++) {
+		v = (isc_uint32_t)pop->counters[row_index(pop, h, row)];
+		if (row == 0 || v < estimate)
+			estimate = v;
+	}
+	return (estimate);
+}
+
+void
+dns_popularity_decay(dns_popularity_t *pop) {
+	unsigned int i, n;
+
+	REQUIRE(VALID_POPULARITY(pop));
+
+	/*
+	 * Concurrent increments racing with the halving may be lost
+	 * or survive undivided; either outcome is acceptable.
+	 */
+	for (i = 0; i < POP_DEPTH * pop->width; i++)
+		pop->counters[i] >>= 1;
+
+	LOCK(&pop->lock);
+	for (i = 0, n = 0; i < pop->hotcount; i++) {
+		pop->hot[i].count >>= 1;
+		if (pop->hot[i].count == 0)
+			continue;
+		if (n != i)
+			pop->hot[n] = pop->hot[i];
+		n++;
+	}
+	pop->hotcount = n;
+	hot_setmin(pop);
+	UNLOCK(&pop->lock);
+}
+
+static int
+popentry_compare(const void *a, const void *b) {
+	const hotentry_t *ea = a, *eb = b;
+
+	if (ea->count > eb->count)
+		return (-1);
+	if (ea->count < eb->count)
+		return (1);
+	return (0);
+}
+
+unsigned int
+dns_popularity_gethot(dns_popularity_t *pop, dns_popentry_t *entries,
+		      unsigned int nentries)
+{
+	dns_name_t name;
+	isc_region_t r;
+	unsigned int i;
+
+	REQUIRE(VALID_POPULARITY(pop));
+	REQUIRE(entries != NULL || nentries == 0);
+
+	LOCK(&pop->lock);
+	qsort(pop->hot, pop->hotcount, sizeof(hotentry_t), popentry_compare);
+	if (nentries > pop->hotcount)
+		nentries = pop->hotcount;
+	for (i = 0; i < nentries; i++) {
+		dns_name_init(&name, NULL);
+		r.base = pop->hot[i].ndata;
+		r.length = pop->hot[i].length;
+		dns_name_fromregion(&name, &r);
+		dns_fixedname_init(&entries[i].fname);
+		RUNTIME_CHECK(dns_name_copy(&name,
+					    dns_fixedname_name(&entries[i].fname),
+					    NULL) == ISC_R_SUCCESS);
+		entries[i].type = pop->hot[i].type;
+		entries[i].count = pop->hot[i].count;
+	}
+	UNLOCK(&pop->lock);
+
+	return (nentries);
+}
+
+unsigned int
+dns_popularity_hotsize(dns_popularity_t *pop) {
+	REQUIRE(VALID_POPULARITY(pop));
+
+	return (pop->hotsize);
+}
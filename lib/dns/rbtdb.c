@@ -61,6 +61,7 @@
 #include <dns/masterdump.h>
 #include <dns/nsec.h>
 #include <dns/nsec3.h>
+#include <dns/popularity.h>
 #include <dns/rbt.h>
 #include <dns/rpz.h>
 #include <dns/rdata.h>
@@ -264,6 +265,9 @@ typedef isc_uint64_t                    rbtdb_serial_t;
 #define set_ttl set_ttl64
 #define setcachestats setcachestats64
 #define setownercase setownercase64
+#define setpopularity setpopularity64
+#define setservestalesize setservestalesize64
+#define setservestalettl setservestalettl64
 #define setsigningtime setsigningtime64
 #define settask settask64
 #define setup_delegation setup_delegation64
@@ -393,6 +397,16 @@ typedef isc_mutex_t nodelock_t;
  */
 #define RBTDB_VIRTUAL 300
 
+/*
+ * Whether expired rdatasets are retained in the cache so that they can
+ * be served stale (DNS_DBFIND_STALEOK), and whether 'header' is within
+ * that retention window.
+ */
+#define KEEPSTALE(rbtdb) ((rbtdb)->serve_stale_ttl > 0)
+#define STALE_WINDOW(rbtdb, header, now) \
+	(KEEPSTALE(rbtdb) && !STALE(header) && \
+	 (header)->rdh_ttl + (rbtdb)->serve_stale_ttl >= (now))
+
 struct noqname {
 	dns_name_t 	name;
 	void *     	neg;
@@ -478,6 +492,7 @@ typedef ISC_LIST(dns_rbtnode_t)         rbtnodelist_t;
 #define RDATASET_ATTR_NEGATIVE          0x0100
 #define RDATASET_ATTR_PREFETCH          0x0200
 #define RDATASET_ATTR_CASESET           0x0400
+#define RDATASET_ATTR_KEPTSTALE         0x0800
 
 typedef struct acache_cbarg {
 	dns_rdatasetadditional_t        type;
@@ -524,6 +539,8 @@ struct acachectl {
 	(((header)->attributes & RDATASET_ATTR_PREFETCH) != 0)
 #define CASESET(header) \
 	(((header)->attributes & RDATASET_ATTR_CASESET) != 0)
+#define KEPTSTALE(header) \
+	(((header)->attributes & RDATASET_ATTR_KEPTSTALE) != 0)
 
 #define DEFAULT_NODE_LOCK_COUNT         7       /*%< Should be prime. */
 
@@ -553,6 +570,13 @@ typedef struct {
 	isc_refcount_t                  references;
 	/* Locked by lock. */
 	isc_boolean_t                   exiting;
+	/*%
+	 * Expired rdatasets kept to be served stale, oldest first, and
+	 * their total size (cache DB only).  These are neither on the
+	 * TTL heap nor on the LRU list.
+	 */
+	rdatasetheaderlist_t            stale;
+	size_t                          stale_size;
 } rbtdb_nodelock_t;
 
 typedef struct rbtdb_changed {
@@ -623,6 +647,9 @@ struct dns_rbtdb {
 	dns_rbtnode_t *                 origin_node;
 	dns_stats_t *			rrsetstats; /* cache DB only */
 	isc_stats_t *			cachestats; /* cache DB only */
+	dns_popularity_t *		popularity; /* cache DB only */
+	dns_ttl_t			serve_stale_ttl; /* cache DB only */
+	size_t				serve_stale_size; /* cache DB only */
 	/* Locked by lock. */
 	unsigned int                    active;
 	isc_refcount_t                  references;
@@ -754,6 +781,9 @@ static void expire_header(dns_rbtdb_t *rbtdb, rdatasetheader_t *header,
 			  isc_boolean_t tree_locked, expire_t reason);
 static void overmem_purge(dns_rbtdb_t *rbtdb, unsigned int locknum_start,
 			  isc_stdtime_t now, isc_boolean_t tree_locked);
+static void keep_stale(dns_rbtdb_t *rbtdb, unsigned int locknum,
+		       isc_stdtime_t now, isc_boolean_t tree_locked);
+static void stale_release(dns_rbtdb_t *rbtdb, rdatasetheader_t *header);
 static isc_result_t resign_insert(dns_rbtdb_t *rbtdb, int idx,
 				  rdatasetheader_t *newheader);
 static void resign_delete(dns_rbtdb_t *rbtdb, rbtdb_version_t *version,
@@ -1246,6 +1276,7 @@ free_rbtdb(dns_rbtdb_t *rbtdb, isc_boolean_t log, isc_event_t *event) {
 	if (dns_name_dynamic(&rbtdb->common.origin))
 		dns_name_free(&rbtdb->common.origin, rbtdb->common.mctx);
 	for (i = 0; i < rbtdb->node_lock_count; i++) {
+		INSIST(ISC_LIST_EMPTY(rbtdb->node_locks[i].stale));
 		isc_refcount_destroy(&rbtdb->node_locks[i].references);
 		NODE_DESTROYLOCK(&rbtdb->node_locks[i].lock);
 	}
@@ -1283,6 +1314,8 @@ free_rbtdb(dns_rbtdb_t *rbtdb, isc_boolean_t log, isc_event_t *event) {
 		dns_stats_detach(&rbtdb->rrsetstats);
 	if (rbtdb->cachestats != NULL)
 		isc_stats_detach(&rbtdb->cachestats);
+	if (rbtdb->popularity != NULL)
+		dns_popularity_detach(&rbtdb->popularity);
 
 	if (rbtdb->load_rpzs != NULL) {
 		/*
@@ -1630,7 +1663,9 @@ free_rdataset(dns_rbtdb_t *rbtdb, isc_mem_t *mctx, rdatasetheader_t *rdataset) {
 	}
 
 	idx = rdataset->node->locknum;
-	if (ISC_LINK_LINKED(rdataset, link)) {
+	if (KEPTSTALE(rdataset))
+		stale_release(rbtdb, rdataset);
+	else if (ISC_LINK_LINKED(rdataset, link)) {
 		INSIST(IS_CACHE(rbtdb));
 		ISC_LIST_UNLINK(rbtdb->rdatasets[idx], rdataset, link);
 	}
@@ -1700,6 +1735,9 @@ mark_stale_header(dns_rbtdb_t *rbtdb, rdatasetheader_t *header) {
 	if ((header->attributes & RDATASET_ATTR_STALE) != 0)
 		return;
 
+	if (KEPTSTALE(header))
+		stale_release(rbtdb, header);
+
 	header->attributes |= RDATASET_ATTR_STALE;
 	header->node->dirty = 1;
 
@@ -3178,7 +3216,14 @@ bind_rdataset(dns_rbtdb_t *rbtdb, dns_rbtnode_t *node,
 	rdataset->rdclass = rbtdb->common.rdclass;
 	rdataset->type = RBTDB_RDATATYPE_BASE(header->type);
 	rdataset->covers = RBTDB_RDATATYPE_EXT(header->type);
-	rdataset->ttl = header->rdh_ttl - now;
+	if (header->rdh_ttl < now) {
+		/*
+		 * Served from the serve-stale window.
+		 */
+		rdataset->ttl = 0;
+		rdataset->attributes |= DNS_RDATASETATTR_STALE;
+	} else
+		rdataset->ttl = header->rdh_ttl - now;
 	rdataset->trust = header->trust;
 	if (NEGATIVE(header))
 		rdataset->attributes |= DNS_RDATASETATTR_NEGATIVE;
@@ -4552,6 +4597,18 @@ check_stale_rdataset(dns_rbtnode_t *node, rdatasetheader_t *header,
 #endif
 
 	if (header->rdh_ttl < search->now) {
+		/*
+		 * Expired data within the serve-stale window is kept.
+		 * It is only usable for positive answers, and only if
+		 * the caller asked for it.
+		 */
+		if (STALE_WINDOW(search->rbtdb, header, search->now)) {
+			*header_prev = header;
+			return (ISC_TF(NEGATIVE(header) ||
+				       (search->options &
+					DNS_DBFIND_STALEOK) == 0));
+		}
+
 		/*
 		 * This rdataset is stale.  If no one else is using the
 		 * node, we can clean it up right now, otherwise we mark
@@ -5234,6 +5291,9 @@ cache_find(dns_db_t *db, dns_name_t *name, dns_dbversion_t *version,
 	dns_rbtnodechain_reset(&search.chain);
 
 	update_cachestats(search.rbtdb, result);
+	if (result == ISC_R_SUCCESS && search.rbtdb->popularity != NULL &&
+	    (options & DNS_DBFIND_NOPOPULARITY) == 0)
+		dns_popularity_record(search.rbtdb->popularity, name, type);
 	return (result);
 }
 
@@ -5502,7 +5562,8 @@ expirenode(dns_db_t *db, dns_dbnode_t *node, isc_stdtime_t now) {
 		  isc_rwlocktype_write);
 
 	for (header = rbtnode->data; header != NULL; header = header->next)
-		if (header->rdh_ttl <= now - RBTDB_VIRTUAL) {
+		if (header->rdh_ttl <= now - RBTDB_VIRTUAL &&
+		    (force_expire || !STALE_WINDOW(rbtdb, header, now))) {
 			/*
 			 * We don't check if refcurrent(rbtnode) == 0 and try
 			 * to free like we do in cache_find(), because
@@ -5758,6 +5819,7 @@ cache_findrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 		header_next = header->next;
 		if (header->rdh_ttl < now) {
 			if ((header->rdh_ttl < now - RBTDB_VIRTUAL) &&
+			    !STALE_WINDOW(rbtdb, header, now) &&
 			    (locktype == isc_rwlocktype_write ||
 			     NODE_TRYUPGRADE(lock) == ISC_R_SUCCESS)) {
 				/*
@@ -6693,8 +6755,11 @@ addrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 		if (tree_locked)
 			cleanup_dead_nodes(rbtdb, rbtnode->locknum);
 
+		keep_stale(rbtdb, rbtnode->locknum, now, tree_locked);
+
 		header = isc_heap_element(rbtdb->heaps[rbtnode->locknum], 1);
-		if (header && header->rdh_ttl < now - RBTDB_VIRTUAL)
+		if (header && header->rdh_ttl < now - RBTDB_VIRTUAL &&
+		    !STALE_WINDOW(rbtdb, header, now))
 			expire_header(rbtdb, header, tree_locked,
 				      expire_ttl);
 
@@ -7974,6 +8039,55 @@ setcachestats(dns_db_t *db, isc_stats_t *stats) {
 	return (ISC_R_SUCCESS);
 }
 
+static isc_result_t
+setpopularity(dns_db_t *db, dns_popularity_t *pop) {
+	dns_rbtdb_t *rbtdb = (dns_rbtdb_t *)db;
+
+	REQUIRE(VALID_RBTDB(rbtdb));
+	REQUIRE(IS_CACHE(rbtdb)); /* current restriction */
+	REQUIRE(pop != NULL);
+
+	/*
+	 * cache_find() reads 'popularity' without locking, so it can
+	 * only be set once for the lifetime of the database.
+	 */
+	if (rbtdb->popularity != NULL)
+		return (rbtdb->popularity == pop ? ISC_R_SUCCESS : ISC_R_EXISTS);
+	dns_popularity_attach(pop, &rbtdb->popularity);
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+setservestalettl(dns_db_t *db, dns_ttl_t ttl) {
+	dns_rbtdb_t *rbtdb = (dns_rbtdb_t *)db;
+
+	REQUIRE(VALID_RBTDB(rbtdb));
+	REQUIRE(IS_CACHE(rbtdb)); /* current restriction */
+
+	/*
+	 * Read without locking; a search racing with a change simply
+	 * sees the old or the new window.
+	 */
+	rbtdb->serve_stale_ttl = ttl;
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+setservestalesize(dns_db_t *db, size_t size) {
+	dns_rbtdb_t *rbtdb = (dns_rbtdb_t *)db;
+
+	REQUIRE(VALID_RBTDB(rbtdb));
+	REQUIRE(IS_CACHE(rbtdb)); /* current restriction */
+
+	/*
+	 * Read without locking, as for the serve-stale window; each
+	 * bucket is held to its share of the limit as it is next
+	 * written to.
+	 */
+	rbtdb->serve_stale_size = size;
+	return (ISC_R_SUCCESS);
+}
+
 static dns_stats_t *
 getrrsetstats(dns_db_t *db) {
 	dns_rbtdb_t *rbtdb = (dns_rbtdb_t *)db;
@@ -8027,7 +8141,10 @@ static dns_dbmethods_t zone_methods = {
 	NULL,
 	NULL,
 	NULL,
-	hashsize
+	hashsize,
+	NULL,
+	NULL,
+	NULL
 };
 
 static dns_dbmethods_t cache_methods = {
@@ -8073,7 +8190,10 @@ static dns_dbmethods_t cache_methods = {
 	NULL,
 	NULL,
 	setcachestats,
-	hashsize
+	hashsize,
+	setpopularity,
+	setservestalettl,
+	setservestalesize
 };
 
 isc_result_t
@@ -8152,6 +8272,9 @@ dns_rbtdb_create
 	}
 
 	rbtdb->cachestats = NULL;
+	rbtdb->popularity = NULL;
+	rbtdb->serve_stale_ttl = 0;
+	rbtdb->serve_stale_size = 0;
 	rbtdb->rrsetstats = NULL;
 	if (IS_CACHE(rbtdb)) {
 		result = dns_rdatasetstats_create(mctx, &rbtdb->rrsetstats);
@@ -8217,6 +8340,8 @@ dns_rbtdb_create
 			goto cleanup_deadnodes;
 		}
 		rbtdb->node_locks[i].exiting = ISC_FALSE;
+		ISC_LIST_INIT(rbtdb->node_locks[i].stale);
+		rbtdb->node_locks[i].stale_size = 0;
 	}
 
 	/*
@@ -9843,6 +9968,12 @@ update_header(dns_rbtdb_t *rbtdb, rdatasetheader_t *header,
 {
 	INSIST(IS_CACHE(rbtdb));
 
+	/*
+	 * Data kept to be served stale ages out in expiry order.
+	 */
+	if (KEPTSTALE(header))
+		return;
+
 	/* To be checked: can we really assume this? XXXMLG */
 	INSIST(ISC_LINK_LINKED(header, link));
 
@@ -9851,6 +9982,78 @@ update_header(dns_rbtdb_t *rbtdb, rdatasetheader_t *header,
 	ISC_LIST_PREPEND(rbtdb->rdatasets[header->node->locknum], header, link);
 }
 
+static inline unsigned int
+header_size(rdatasetheader_t *header) {
+	if (NONEXISTENT(header))
+		return (sizeof(*header));
+	return (dns_rdataslab_size((unsigned char *)header,
+				   sizeof(*header)));
+}
+
+/*%
+ * Remove 'header' from the stale list of its bucket.
+ *
+ * Caller must hold the node (write) lock.
+ */
+static void
+stale_release(dns_rbtdb_t *rbtdb, rdatasetheader_t *header) {
+	rbtdb_nodelock_t *nodelock;
+
+	INSIST(KEPTSTALE(header));
+
+	nodelock = &rbtdb->node_locks[header->node->locknum];
+	ISC_LIST_UNLINK(nodelock->stale, header, link);
+	INSIST(nodelock->stale_size >= header_size(header));
+	nodelock->stale_size -= header_size(header);
+	header->attributes &= ~RDATASET_ATTR_KEPTSTALE;
+}
+
+/*%
+ * Move the rdatasets of bucket 'locknum' which have expired, but are
+ * within the serve-stale window, off the TTL heap and the LRU list and
+ * onto the bucket's stale list.  As they leave the heap in expiry
+ * order, the stale list stays sorted oldest first.  Then expire kept
+ * rdatasets that have left the window, and the oldest ones while the
+ * bucket is over its share of the serve-stale size limit.
+ *
+ * Caller must hold the node (write) lock.
+ */
+static void
+keep_stale(dns_rbtdb_t *rbtdb, unsigned int locknum, isc_stdtime_t now,
+	   isc_boolean_t tree_locked)
+{
+	rbtdb_nodelock_t *nodelock = &rbtdb->node_locks[locknum];
+	rdatasetheader_t *header;
+	size_t limit;
+
+	while ((header = isc_heap_element(rbtdb->heaps[locknum], 1)) != NULL &&
+	       header->rdh_ttl < now && STALE_WINDOW(rbtdb, header, now))
+	{
+		isc_heap_delete(rbtdb->heaps[locknum], header->heap_index);
+		header->heap_index = 0;
+		if (ISC_LINK_LINKED(header, link))
+			ISC_LIST_UNLINK(rbtdb->rdatasets[locknum],
+					header, link);
+		header->attributes |= RDATASET_ATTR_KEPTSTALE;
+		ISC_LIST_APPEND(nodelock->stale, header, link);
+		nodelock->stale_size += header_size(header);
+	}
+
+	limit = rbtdb->serve_stale_size / rbtdb->node_lock_count;
+	if (limit == 0 && rbtdb->serve_stale_size != 0)
+		limit = 1;
+	while ((header = ISC_LIST_HEAD(nodelock->stale)) != NULL) {
+		if (!STALE_WINDOW(rbtdb, header, now))
+			expire_header(rbtdb, header, tree_locked,
+				      expire_ttl);
+		else if (limit != 0 && nodelock->stale_size > limit)
+			expire_header(rbtdb, header, tree_locked,
+				      expire_lru);
+		else
+			break;
+	}
+}
+
 /*%
  * Purge some expired and/or stale (i.e. unused for some period) cache entries
  * under an overmem condition.  To recover from this condition quickly, up to
@@ -9860,28 +10063,51 @@ update_header(dns_rbtdb_t *rbtdb, rdatasetheader_t *header,
  * entries of the same name of different RR types while adding RRsets from a
  * single response (consider the case where we're adding A and AAAA glue records
  * of the same NS name).
+ *
+ * Expired entries, including those kept to be served stale, are purged from
+ * all buckets before any live entry is taken from an LRU list.
  */
 static void
 overmem_purge(dns_rbtdb_t *rbtdb, unsigned int locknum_start,
 	      isc_stdtime_t now, isc_boolean_t tree_locked)
 {
 	rdatasetheader_t *header, *header_prev;
+	rbtdb_nodelock_t *nodelock;
 	unsigned int locknum;
 	int purgecount = 2;
 
 	for (locknum = (locknum_start + 1) % rbtdb->node_lock_count;
 	     locknum != locknum_start && purgecount > 0;
 	     locknum = (locknum + 1) % rbtdb->node_lock_count) {
-		NODE_LOCK(&rbtdb->node_locks[locknum].lock,
-			  isc_rwlocktype_write);
+		nodelock = &rbtdb->node_locks[locknum];
+		NODE_LOCK(&nodelock->lock, isc_rwlocktype_write);
+
+		keep_stale(rbtdb, locknum, now, tree_locked);
+		while (purgecount > 0 &&
+		       (header = ISC_LIST_HEAD(nodelock->stale)) != NULL)
+		{
+			expire_header(rbtdb, header, tree_locked,
+				      expire_lru);
+			purgecount--;
+		}
 
 		header = isc_heap_element(rbtdb->heaps[locknum], 1);
-		if (header && header->rdh_ttl < now - RBTDB_VIRTUAL) {
+		if (purgecount > 0 && header &&
+		    header->rdh_ttl < now - RBTDB_VIRTUAL) {
 			expire_header(rbtdb, header, tree_locked,
 				      expire_ttl);
 			purgecount--;
 		}
 
+		NODE_UNLOCK(&nodelock->lock, isc_rwlocktype_write);
+	}
+
+	for (locknum = (locknum_start + 1) % rbtdb->node_lock_count;
+	     locknum != locknum_start && purgecount > 0;
+	     locknum = (locknum + 1) % rbtdb->node_lock_count) {
+		NODE_LOCK(&rbtdb->node_locks[locknum].lock,
+			  isc_rwlocktype_write);
+
 		for (header = ISC_LIST_TAIL(rbtdb->rdatasets[locknum]);
 		     header != NULL && purgecount > 0;
 		     header = header_prev) {
@@ -45,6 +45,7 @@
 #include <dns/db.h>
 #include <dns/dispatch.h>
 #include <dns/ds.h>
+#include <dns/ecscache.h>
 #include <dns/edns.h>
 #include <dns/events.h>
 #include <dns/forward.h>
@@ -56,6 +57,7 @@
 #include <dns/nsec3.h>
 #include <dns/opcode.h>
 #include <dns/peer.h>
+#include <dns/popularity.h>
 #include <dns/rbt.h>
 #include <dns/rcode.h>
 #include <dns/rdata.h>
@@ -170,6 +172,21 @@
 #define DEFAULT_MAX_QUERIES 75
 #endif
 
+/*
+ * Popular name refresh: how often (in seconds) the hot list is scanned,
+ * how close to expiry (in seconds) an entry must be to be refreshed, and
+ * after how many scans the popularity counts are halved.
+ */
+#ifndef POPULAR_INTERVAL
+#define POPULAR_INTERVAL	1
+#endif
+#ifndef POPULAR_WINDOW
+#define POPULAR_WINDOW		10
+#endif
+#ifndef POPULAR_DECAY
+#define POPULAR_DECAY		300
+#endif
+
 /* Number of hash buckets for zone counters */
 #ifndef RES_DOMAIN_BUCKETS
 #define RES_DOMAIN_BUCKETS	523
@@ -231,6 +248,7 @@ struct tried {
 #define VALID_QUERY(query)		ISC_MAGIC_VALID(query, QUERY_MAGIC)
 
 #define RESQUERY_ATTR_CANCELED          0x02
+#define RESQUERY_ATTR_ECS               0x04
 
 #define RESQUERY_CONNECTING(q)          ((q)->connects > 0)
 #define RESQUERY_CANCELED(q)            (((q)->attributes & \
@@ -368,6 +386,14 @@ struct fetchctx {
 	dns_adbaddrinfo_t 		*addrinfo;
 	isc_sockaddr_t			*client;
 	unsigned int			depth;
+
+	/*%
+	 * EDNS client subnet to send (none if 'ecsbits' is zero), and
+	 * the scope prefix length returned in the current response.
+	 */
+	isc_netaddr_t			ecsaddr;
+	unsigned int			ecsbits;
+	unsigned int			ecsscope;
 };
 
 #define FCTX_MAGIC			ISC_MAGIC('F', '!', '!', '!')
@@ -487,6 +513,7 @@ struct dns_resolver {
 	unsigned int			spillatmax;
 	unsigned int			spillatmin;
 	isc_timer_t *			spillattimer;
+	isc_timer_t *			poptimer;
 	isc_boolean_t			zero_no_soa_ttl;
 	unsigned int			query_timeout;
 	unsigned int			maxdepth;
@@ -504,6 +531,12 @@ struct dns_resolver {
 
 	dns_badcache_t  * 		badcache;	 /* Bad cache. */
 
+	dns_popularity_t *		popularity;
+	dns_popentry_t *		popentries;
+	unsigned int			popcount;	/* prefetch-popular */
+	unsigned int			poprate;
+	unsigned int			popscans;
+
 	/* Locked by primelock. */
 	dns_fetch_t *			primefetch;
 	/* Locked by nlock. */
@@ -2072,6 +2105,56 @@ wouldvalidate(fetchctx_t *fctx) {
 	return (secure_domain);
 }
 
+/*
+ * Set 'target' to the first 'bits' bits of 'source', followed by zeros.
+ */
+static void
+maskaddr(const isc_netaddr_t *source, unsigned int bits,
+	 isc_netaddr_t *target)
+{
+	unsigned char *p;
+	unsigned int i, len;
+
+	*target = *source;
+	if (target->family == AF_INET) {
+		p = (unsigned char *)&target->type.in;
+		len = 4;
+	} else {
+		p = (unsigned char *)&target->type.in6;
+		len = 16;
+	}
+	for (i = bits / 8; i < len; i++) {
+		if (i == bits / 8 && (bits % 8) != 0)
+			p[i] &= 0xff << (8 - (bits % 8));
+		else
+			p[i] = 0;
+	}
+}
+
+/*
+ * Render the EDNS client subnet option for 'fctx' into 'buf', which
+ * must hold at least 20 bytes, and return its length.
+ */
+static isc_uint16_t
+ecsoption(fetchctx_t *fctx, unsigned char *buf) {
+	const unsigned char *addr;
+	unsigned int len = (fctx->ecsbits + 7) / 8;
+
+	if (fctx->ecsaddr.family == AF_INET) {
+		addr = (const unsigned char *)&fctx->ecsaddr.type.in;
+		buf[1] = 1;
+	} else {
+		addr = (const unsigned char *)&fctx->ecsaddr.type.in6;
+		buf[1] = 2;
+	}
+	buf[0] = 0;
+	buf[2] = fctx->ecsbits;
+	buf[3] = 0;
+	memmove(buf + 4, addr, len);
+
+	return ((isc_uint16_t)(4 + len));
+}
+
 static isc_result_t
 resquery_send(resquery_t *query) {
 	fetchctx_t *fctx;
@@ -2095,6 +2178,7 @@ resquery_send(resquery_t *query) {
 	isc_boolean_t connecting = ISC_FALSE;
 	dns_ednsopt_t ednsopts[DNS_EDNSOPTIONS];
 	unsigned ednsopt = 0;
+	unsigned char ecs[20];
 	isc_uint16_t hint = 0, udpsize = 0;	/* No EDNS */
 
 	fctx = query->fctx;
@@ -2365,6 +2449,22 @@ resquery_send(resquery_t *query) {
 				}
 				ednsopt++;
 			}
+			/*
+			 * The client's subnet only goes to the servers
+			 * of the "ecs-zones" domains, not to the root,
+			 * TLD or forwarding servers used to reach them.
+			 */
+			if (fctx->ecsbits != 0 &&
+			    dns_view_isecsname(res->view, &fctx->domain))
+			{
+				INSIST(ednsopt < DNS_EDNSOPTIONS);
+				query->attributes |= RESQUERY_ATTR_ECS;
+				ednsopts[ednsopt].code = DNS_OPT_CLIENT_SUBNET;
+				ednsopts[ednsopt].length =
+					ecsoption(fctx, ecs);
+				ednsopts[ednsopt].value = ecs;
+				ednsopt++;
+			}
 			query->ednsversion = version;
 			result = fctx_addopt(fctx->qmessage, version,
 					     udpsize, ednsopts, ednsopt);
@@ -4117,7 +4217,8 @@ static isc_result_t
 fctx_create(dns_resolver_t *res, dns_name_t *name, dns_rdatatype_t type,
 	    dns_name_t *domain, dns_rdataset_t *nameservers,
 	    unsigned int options, unsigned int bucketnum, unsigned int depth,
-	    isc_counter_t *qc, fetchctx_t **fctxp)
+	    isc_counter_t *qc, const isc_netaddr_t *ecsaddr,
+	    unsigned int ecsbits, fetchctx_t **fctxp)
 {
 	fetchctx_t *fctx;
 	isc_result_t result;
@@ -4186,6 +4287,14 @@ fctx_create(dns_resolver_t *res, dns_name_t *name, dns_rdatatype_t type,
 	fctx->want_shutdown = ISC_FALSE;
 	fctx->cloned = ISC_FALSE;
 	fctx->depth = depth;
+	if (ecsaddr != NULL && ecsbits != 0) {
+		maskaddr(ecsaddr, ecsbits, &fctx->ecsaddr);
+		fctx->ecsbits = ecsbits;
+	} else {
+		memset(&fctx->ecsaddr, 0, sizeof(fctx->ecsaddr));
+		fctx->ecsbits = 0;
+	}
+	fctx->ecsscope = 0;
 	ISC_LIST_INIT(fctx->queries);
 	ISC_LIST_INIT(fctx->finds);
 	ISC_LIST_INIT(fctx->altfinds);
@@ -4322,6 +4431,10 @@ fctx_create(dns_resolver_t *res, dns_name_t *name, dns_rdatatype_t type,
 	if (result != ISC_R_SUCCESS)
 		goto cleanup_fcount;
 
+	result = dns_message_usearena(fctx->qmessage, 0);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_qmessage;
+
 	fctx->rmessage = NULL;
 	result = dns_message_create(mctx, DNS_MESSAGE_INTENTPARSE,
 				    &fctx->rmessage);
@@ -4329,6 +4442,10 @@ fctx_create(dns_resolver_t *res, dns_name_t *name, dns_rdatatype_t type,
 	if (result != ISC_R_SUCCESS)
 		goto cleanup_qmessage;
 
+	result = dns_message_usearena(fctx->rmessage, 0);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_rmessage;
+
 	/*
 	 * Compute an expiration time for the entire fetch.
 	 */
@@ -4609,6 +4726,30 @@ clone_results(fetchctx_t *fctx) {
 #define CHASE(r)        (((r)->attributes & DNS_RDATASETATTR_CHASE) != 0)
 #define CHECKNAMES(r)   (((r)->attributes & DNS_RDATASETATTR_CHECKNAMES) != 0)
 
+/*
+ * Add 'rdataset', owned by 'name', to the cache.  Answer data from a
+ * response whose EDNS client subnet option has a non-zero scope is only
+ * valid for clients within that scope, so it is added to the view's
+ * ECS cache instead of at 'node'.
+ */
+static isc_result_t
+addrdataset(fetchctx_t *fctx, dns_dbnode_t *node, dns_name_t *name,
+	    isc_stdtime_t now, dns_rdataset_t *rdataset, unsigned int options,
+	    dns_rdataset_t *addedrdataset)
+{
+	dns_ecscache_t *ecscache = fctx->res->view->ecscache;
+
+	if (fctx->ecsscope != 0 && ecscache != NULL &&
+	    (ANSWER(rdataset) || ANSWERSIG(rdataset)) &&
+	    !NEGATIVE(rdataset) && rdataset->type != dns_rdatatype_dname &&
+	    rdataset->covers != dns_rdatatype_dname)
+		return (dns_ecscache_add(ecscache, name, rdataset,
+					 &fctx->ecsaddr, fctx->ecsscope, now,
+					 addedrdataset));
+
+	return (dns_db_addrdataset(fctx->cache, node, NULL, now, rdataset,
+				   options, addedrdataset));
+}
 
 /*
  * Destroy '*fctx' if it is ready to be destroyed (i.e., if it has
@@ -4805,17 +4946,15 @@ validated(isc_task_t *task, isc_event_t *event) {
 							 vevent->name,
 							 ISC_TRUE, &node);
 			if (result == ISC_R_SUCCESS) {
-				(void)dns_db_addrdataset(fctx->cache, node,
-							 NULL, now,
-							 vevent->rdataset, 0,
-							 NULL);
+				(void)addrdataset(fctx, node, vevent->name,
+						  now, vevent->rdataset, 0,
+						  NULL);
 			}
 			if (result == ISC_R_SUCCESS &&
 			    vevent->sigrdataset != NULL)
-				(void)dns_db_addrdataset(fctx->cache, node,
-							 NULL, now,
-							 vevent->sigrdataset,
-							 0, NULL);
+				(void)addrdataset(fctx, node, vevent->name,
+						  now, vevent->sigrdataset,
+						  0, NULL);
 			if (result == ISC_R_SUCCESS)
 				dns_db_detachnode(fctx->cache, &node);
 		}
@@ -4929,8 +5068,8 @@ validated(isc_task_t *task, isc_event_t *event) {
 	options = 0;
 	if ((fctx->options & DNS_FETCHOPT_PREFETCH) != 0)
 		options = DNS_DBADD_PREFETCH;
-	result = dns_db_addrdataset(fctx->cache, node, NULL, now,
-				    vevent->rdataset, options, ardataset);
+	result = addrdataset(fctx, node, vevent->name, now,
+			     vevent->rdataset, options, ardataset);
 	if (result != ISC_R_SUCCESS &&
 	    result != DNS_R_UNCHANGED)
 		goto noanswer_response;
@@ -4940,9 +5079,8 @@ validated(isc_task_t *task, isc_event_t *event) {
 		else
 			eresult = DNS_R_NCACHENXRRSET;
 	} else if (vevent->sigrdataset != NULL) {
-		result = dns_db_addrdataset(fctx->cache, node, NULL, now,
-					    vevent->sigrdataset, 0,
-					    asigrdataset);
+		result = addrdataset(fctx, node, vevent->name, now,
+				     vevent->sigrdataset, 0, asigrdataset);
 		if (result != ISC_R_SUCCESS &&
 		    result != DNS_R_UNCHANGED)
 			goto noanswer_response;
@@ -5447,10 +5585,9 @@ cache_name(fetchctx_t *fctx, dns_name_t *name, dns_adbaddrinfo_t *addrinfo,
 				if ((fctx->options & DNS_FETCHOPT_PREFETCH) != 0)
 						options = DNS_DBADD_PREFETCH;
 				addedrdataset = ardataset;
-				result = dns_db_addrdataset(fctx->cache, node,
-							    NULL, now, rdataset,
-							    options,
-							    addedrdataset);
+				result = addrdataset(fctx, node, name, now,
+						     rdataset, options,
+						     addedrdataset);
 				if (result == DNS_R_UNCHANGED) {
 					result = ISC_R_SUCCESS;
 					if (!need_validation &&
@@ -5482,11 +5619,10 @@ cache_name(fetchctx_t *fctx, dns_name_t *name, dns_adbaddrinfo_t *addrinfo,
 					break;
 				if (sigrdataset != NULL) {
 					addedrdataset = asigrdataset;
-					result = dns_db_addrdataset(fctx->cache,
-								node, NULL, now,
-								sigrdataset,
-								options,
-								addedrdataset);
+					result = addrdataset(fctx, node, name,
+							     now, sigrdataset,
+							     options,
+							     addedrdataset);
 					if (result == DNS_R_UNCHANGED)
 						result = ISC_R_SUCCESS;
 					if (result != ISC_R_SUCCESS)
@@ -5595,11 +5731,9 @@ cache_name(fetchctx_t *fctx, dns_name_t *name, dns_adbaddrinfo_t *addrinfo,
 			/*
 			 * Now we can add the rdataset.
 			 */
-			result = dns_db_addrdataset(fctx->cache,
-						    node, NULL, now,
-						    rdataset,
-						    options,
-						    addedrdataset);
+			result = addrdataset(fctx, node, name, now,
+					     rdataset, options,
+					     addedrdataset);
 
 			if (result == DNS_R_UNCHANGED) {
 				if (ANSWER(rdataset) &&
@@ -7484,6 +7618,51 @@ betterreferral(fetchctx_t *fctx) {
 	return (ISC_FALSE);
 }
 
+/*
+ * Record the scope of an EDNS client subnet option in a response.  The
+ * option is ignored unless the query carried one and the response
+ * echoes the family, source prefix length and address that were sent.  A scope longer than the source prefix
+ * is treated as the source prefix length (RFC 7871, section 7.3.1).
+ */
+static void
+process_ecs(resquery_t *query, isc_buffer_t *optbuf, isc_uint16_t optlen) {
+	fetchctx_t *fctx = query->fctx;
+	isc_uint16_t family;
+	unsigned int source, scope, len;
+	isc_netaddr_t addr;
+	unsigned char *p;
+
+	if ((query->attributes & RESQUERY_ATTR_ECS) == 0 || optlen < 4) {
+		isc_buffer_forward(optbuf, optlen);
+		return;
+	}
+
+	family = isc_buffer_getuint16(optbuf);
+	source = isc_buffer_getuint8(optbuf);
+	scope = isc_buffer_getuint8(optbuf);
+	optlen -= 4;
+
+	len = (source + 7) / 8;
+	if (source != fctx->ecsbits || optlen != len ||
+	    family != (fctx->ecsaddr.family == AF_INET ? 1 : 2))
+	{
+		isc_buffer_forward(optbuf, optlen);
+		return;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.family = fctx->ecsaddr.family;
+	p = (addr.family == AF_INET) ? (unsigned char *)&addr.type.in
+				     : (unsigned char *)&addr.type.in6;
+	memmove(p, isc_buffer_current(optbuf), len);
+	isc_buffer_forward(optbuf, len);
+
+	if (!isc_netaddr_eqprefix(&addr, &fctx->ecsaddr, source))
+		return;
+
+	fctx->ecsscope = ISC_MIN(scope, source);
+}
+
 static void
 process_opt(resquery_t *query, dns_rdataset_t *opt) {
 	dns_rdata_t rdata;
@@ -7533,6 +7712,9 @@ process_opt(resquery_t *query, dns_rdataset_t *opt) {
 				inc_stats(query->fctx->res,
 					  dns_resstatscounter_cookiein);
 				break;
+			case DNS_OPT_CLIENT_SUBNET:
+				process_ecs(query, &optbuf, optlen);
+				break;
 			default:
 				isc_buffer_forward(&optbuf, optlen);
 				break;
@@ -7752,6 +7934,7 @@ resquery_response(isc_task_t *task, isc_event_t *event) {
 	/*
 	 * Process receive opt record.
 	 */
+	fctx->ecsscope = 0;
 	opt = dns_message_getopt(message);
 	if (opt != NULL)
 		process_opt(query, opt);
@@ -8541,6 +8724,12 @@ destroy(dns_resolver_t *res) {
 	isc_rwlock_destroy(&res->mbslock);
 #endif
 	isc_timer_detach(&res->spillattimer);
+	isc_timer_detach(&res->poptimer);
+	if (res->popularity != NULL)
+		dns_popularity_detach(&res->popularity);
+	if (res->popentries != NULL)
+		isc_mem_put(res->mctx, res->popentries,
+			    res->popcount * sizeof(dns_popentry_t));
 	res->magic = 0;
 	isc_mem_put(res->mctx, res, sizeof(*res));
 }
@@ -8612,6 +8801,167 @@ spillattimer_countdown(isc_task_t *task, isc_event_t *event) {
 	isc_event_free(&event);
 }
 
+static void
+popular_done(isc_task_t *task, isc_event_t *event) {
+	dns_resolver_t *res;
+	dns_fetchevent_t *fevent;
+	dns_fetch_t *fetch;
+
+	REQUIRE(event->ev_type == DNS_EVENT_FETCHDONE);
+	fevent = (dns_fetchevent_t *)event;
+	res = event->ev_arg;
+	REQUIRE(VALID_RESOLVER(res));
+
+	UNUSED(task);
+
+	fetch = fevent->fetch;
+	if (fevent->node != NULL)
+		dns_db_detachnode(fevent->db, &fevent->node);
+	if (fevent->db != NULL)
+		dns_db_detach(&fevent->db);
+	if (dns_rdataset_isassociated(fevent->rdataset))
+		dns_rdataset_disassociate(fevent->rdataset);
+	INSIST(fevent->sigrdataset == NULL);
+
+	isc_mem_put(res->mctx, fevent->rdataset, sizeof(*fevent->rdataset));
+
+	isc_event_free(&event);
+	dns_resolver_destroyfetch(&fetch);
+}
+
+/*%
+ * Return ISC_TRUE if 'name'/'type' is about to expire from the cache
+ * or has already gone.  Negative answers are left alone.  The lookup
+ * is not counted as a hit, so that refreshing an entry does not keep
+ * it popular.
+ */
+static isc_boolean_t
+popular_expiring(dns_db_t *db, dns_name_t *name, dns_rdatatype_t type,
+		 isc_stdtime_t now)
+{
+	dns_fixedname_t fixed;
+	dns_rdataset_t rdataset;
+	isc_boolean_t expiring = ISC_FALSE;
+	isc_result_t result;
+
+	dns_fixedname_init(&fixed);
+	dns_rdataset_init(&rdataset);
+	result = dns_db_find(db, name, NULL, type, DNS_DBFIND_NOPOPULARITY,
+			     now, NULL, dns_fixedname_name(&fixed), &rdataset,
+			     NULL);
+	switch (result) {
+	case ISC_R_SUCCESS:
+		expiring = ISC_TF(rdataset.ttl <= POPULAR_WINDOW);
+		break;
+	case ISC_R_NOTFOUND:
+	case DNS_R_DELEGATION:
+		expiring = ISC_TRUE;
+		break;
+	default:
+		break;
+	}
+	if (dns_rdataset_isassociated(&rdataset))
+		dns_rdataset_disassociate(&rdataset);
+	return (expiring);
+}
+
+/*%
+ * Timer action: refresh the most popular cache entries that are close
+ * to expiry, starting at most 'poprate' fetches per interval.
+ */
+static void
+popular_refresh(isc_task_t *task, isc_event_t *event) {
+	dns_resolver_t *res = event->ev_arg;
+	dns_popularity_t *pop = NULL;
+	dns_db_t *db = NULL;
+	dns_name_t *name;
+	dns_rdatatype_t type;
+	dns_rdataset_t *rdataset;
+	dns_fetch_t *fetch;
+	isc_boolean_t decay = ISC_FALSE;
+	isc_result_t result;
+	isc_stdtime_t now;
+	unsigned int i, n, count, budget;
+
+	REQUIRE(VALID_RESOLVER(res));
+
+	isc_event_free(&event);
+
+	LOCK(&res->lock);
+	if (res->exiting || !res->frozen || res->popularity == NULL ||
+	    res->view->cache == NULL)
+	{
+		UNLOCK(&res->lock);
+		return;
+	}
+	/*
+	 * Hold a reference so that the resolver cannot go away
+	 * underneath us while the fetches are being started.
+	 */
+	res->references++;
+	dns_popularity_attach(res->popularity, &pop);
+	count = res->popcount;
+	budget = res->poprate;
+	if (++res->popscans >= POPULAR_DECAY) {
+		res->popscans = 0;
+		decay = ISC_TRUE;
+	}
+	UNLOCK(&res->lock);
+
+	if (decay)
+		dns_popularity_decay(pop);
+
+	/*
+	 * 'popentries' is only used by this timer's task.
+	 */
+	n = (budget > 0) ? dns_popularity_gethot(pop, res->popentries, count)
+			 : 0;
+	if (n > 0) {
+		dns_cache_attachdb(res->view->cache, &db);
+		isc_stdtime_get(&now);
+	}
+	for (i = 0; i < n && budget > 0; i++) {
+		name = dns_fixedname_name(&res->popentries[i].fname);
+		type = res->popentries[i].type;
+		if (!popular_expiring(db, name, type, now))
+			continue;
+
+		rdataset = isc_mem_get(res->mctx, sizeof(*rdataset));
+		if (rdataset == NULL)
+			break;
+		dns_rdataset_init(rdataset);
+		fetch = NULL;
+		result = dns_resolver_createfetch(res, name, type,
+						  NULL, NULL, NULL,
+						  DNS_FETCHOPT_PREFETCH,
+						  task, popular_done, res,
+						  rdataset, NULL, &fetch);
+		if (result != ISC_R_SUCCESS) {
+			isc_mem_put(res->mctx, rdataset, sizeof(*rdataset));
+			break;
+		}
+		budget--;
+		if (isc_log_wouldlog(dns_lctx, ISC_LOG_DEBUG(3))) {
+			char namebuf[DNS_NAME_FORMATSIZE];
+			char typebuf[DNS_RDATATYPE_FORMATSIZE];
+
+			dns_name_format(name, namebuf, sizeof(namebuf));
+			dns_rdatatype_format(type, typebuf, sizeof(typebuf));
+			isc_log_write(dns_lctx, DNS_LOGCATEGORY_RESOLVER,
+				      DNS_LOGMODULE_RESOLVER,
+				      ISC_LOG_DEBUG(3),
+				      "refreshing popular %s/%s (%u hits)",
+				      namebuf, typebuf,
+				      res->popentries[i].count);
+		}
+	}
+
+	if (db != NULL)
+		dns_db_detach(&db);
+	dns_popularity_detach(&pop);
+	dns_resolver_detach(&res);
+}
+
 isc_result_t
 dns_resolver_create(dns_view_t *view,
 		    isc_taskmgr_t *taskmgr,
@@ -8666,6 +9016,12 @@ dns_resolver_create(dns_view_t *view,
 	res->spillatmin = res->spillat = 10;
 	res->spillatmax = 100;
 	res->spillattimer = NULL;
+	res->poptimer = NULL;
+	res->popularity = NULL;
+	res->popentries = NULL;
+	res->popcount = 0;
+	res->poprate = 0;
+	res->popscans = 0;
 	res->zspill = 0;
 	res->zero_no_soa_ttl = ISC_FALSE;
 	res->query_timeout = DEFAULT_QUERY_TIMEOUT;
@@ -8785,6 +9141,13 @@ dns_resolver_create(dns_view_t *view,
 	result = isc_timer_create(timermgr, isc_timertype_inactive, NULL, NULL,
 				  task, spillattimer_countdown, res,
 				  &res->spillattimer);
+	if (result == ISC_R_SUCCESS) {
+		result = isc_timer_create(timermgr, isc_timertype_inactive,
+					  NULL, NULL, task, popular_refresh,
+					  res, &res->poptimer);
+		if (result != ISC_R_SUCCESS)
+			isc_timer_detach(&res->spillattimer);
+	}
 	isc_task_detach(&task);
 	if (result != ISC_R_SUCCESS)
 		goto cleanup_primelock;
@@ -8814,6 +9177,7 @@ dns_resolver_create(dns_view_t *view,
 #endif
 #if USE_ALGLOCK || USE_MBSLOCK
  cleanup_spillattimer:
+	isc_timer_detach(&res->poptimer);
 	isc_timer_detach(&res->spillattimer);
 #endif
 
@@ -9064,6 +9428,10 @@ dns_resolver_shutdown(dns_resolver_t *res) {
 					 isc_timertype_inactive, NULL,
 					 NULL, ISC_TRUE);
 		RUNTIME_CHECK(result == ISC_R_SUCCESS);
+		result = isc_timer_reset(res->poptimer,
+					 isc_timertype_inactive, NULL,
+					 NULL, ISC_TRUE);
+		RUNTIME_CHECK(result == ISC_R_SUCCESS);
 	}
 
 	UNLOCK(&res->lock);
@@ -9099,7 +9467,8 @@ dns_resolver_detach(dns_resolver_t **resp) {
 
 static inline isc_boolean_t
 fctx_match(fetchctx_t *fctx, dns_name_t *name, dns_rdatatype_t type,
-	   unsigned int options)
+	   unsigned int options, const isc_netaddr_t *ecsaddr,
+	   unsigned int ecsbits)
 {
 	/*
 	 * Don't match fetch contexts that are shutting down.
@@ -9110,6 +9479,13 @@ fctx_match(fetchctx_t *fctx, dns_name_t *name, dns_rdatatype_t type,
 
 	if (fctx->type != type || fctx->options != options)
 		return (ISC_FALSE);
+	/*
+	 * Fetches for different client subnets may get different answers.
+	 */
+	if (fctx->ecsbits != ecsbits ||
+	    (ecsbits != 0 &&
+	     !isc_netaddr_eqprefix(&fctx->ecsaddr, ecsaddr, ecsbits)))
+		return (ISC_FALSE);
 	return (dns_name_equal(&fctx->name, name));
 }
 
@@ -9181,6 +9557,27 @@ dns_resolver_createfetch3(dns_resolver_t *res, dns_name_t *name,
 			  dns_rdataset_t *rdataset,
 			  dns_rdataset_t *sigrdataset,
 			  dns_fetch_t **fetchp)
+{
+	return (dns_resolver_createfetch4(res, name, type, domain,
+					  nameservers, forwarders, client, id,
+					  options, depth, qc, NULL, 0, task,
+					  action, arg, rdataset, sigrdataset,
+					  fetchp));
+}
+
+isc_result_t
+dns_resolver_createfetch4(dns_resolver_t *res, dns_name_t *name,
+			  dns_rdatatype_t type,
+			  dns_name_t *domain, dns_rdataset_t *nameservers,
+			  dns_forwarders_t *forwarders,
+			  isc_sockaddr_t *client, dns_messageid_t id,
+			  unsigned int options, unsigned int depth,
+			  isc_counter_t *qc, const isc_netaddr_t *ecsaddr,
+			  unsigned int ecsbits, isc_task_t *task,
+			  isc_taskaction_t action, void *arg,
+			  dns_rdataset_t *rdataset,
+			  dns_rdataset_t *sigrdataset,
+			  dns_fetch_t **fetchp)
 {
 	dns_fetch_t *fetch;
 	fetchctx_t *fctx = NULL;
@@ -9204,6 +9601,10 @@ dns_resolver_createfetch3(dns_resolver_t *res, dns_name_t *name,
 	} else
 		REQUIRE(nameservers == NULL);
 	REQUIRE(forwarders == NULL);
+	REQUIRE(ecsbits == 0 ||
+		(ecsaddr != NULL &&
+		 ((ecsaddr->family == AF_INET && ecsbits <= 32) ||
+		  (ecsaddr->family == AF_INET6 && ecsbits <= 128))));
 	REQUIRE(!dns_rdataset_isassociated(rdataset));
 	REQUIRE(sigrdataset == NULL ||
 		!dns_rdataset_isassociated(sigrdataset));
@@ -9237,7 +9638,8 @@ dns_resolver_createfetch3(dns_resolver_t *res, dns_name_t *name,
 		for (fctx = ISC_LIST_HEAD(res->buckets[bucketnum].fctxs);
 		     fctx != NULL;
 		     fctx = ISC_LIST_NEXT(fctx, link)) {
-			if (fctx_match(fctx, name, type, options))
+			if (fctx_match(fctx, name, type, options,
+				       ecsaddr, ecsbits))
 				break;
 		}
 	}
@@ -9270,7 +9672,8 @@ dns_resolver_createfetch3(dns_resolver_t *res, dns_name_t *name,
 
 	if (fctx == NULL) {
 		result = fctx_create(res, name, type, domain, nameservers,
-				     options, bucketnum, depth, qc, &fctx);
+				     options, bucketnum, depth, qc,
+				     ecsaddr, ecsbits, &fctx);
 		if (result != ISC_R_SUCCESS)
 			goto unlock;
 		new_fctx = ISC_TRUE;
@@ -9949,6 +10352,55 @@ dns_resolver_setfetchesperzone(dns_resolver_t *resolver, isc_uint32_t clients)
 	UNLOCK(&resolver->lock);
 }
 
+isc_result_t
+dns_resolver_setpopularprefetch(dns_resolver_t *resolver,
+				dns_popularity_t *pop, unsigned int count,
+				unsigned int rate)
+{
+	isc_result_t result;
+	isc_interval_t interval;
+	isc_timertype_t type;
+	dns_popentry_t *entries = NULL, *oldentries;
+	unsigned int oldcount;
+
+	REQUIRE(VALID_RESOLVER(resolver));
+	REQUIRE(!resolver->frozen);
+
+	if (pop == NULL || count == 0 || rate == 0) {
+		pop = NULL;
+		count = 0;
+	} else {
+		if (count > dns_popularity_hotsize(pop))
+			count = dns_popularity_hotsize(pop);
+		entries = isc_mem_get(resolver->mctx,
+				      count * sizeof(dns_popentry_t));
+		if (entries == NULL)
+			return (ISC_R_NOMEMORY);
+	}
+
+	LOCK(&resolver->lock);
+	if (resolver->popularity != NULL)
+		dns_popularity_detach(&resolver->popularity);
+	if (pop != NULL)
+		dns_popularity_attach(pop, &resolver->popularity);
+	oldentries = resolver->popentries;
+	oldcount = resolver->popcount;
+	resolver->popentries = entries;
+	resolver->popcount = count;
+	resolver->poprate = rate;
+
+	type = (pop != NULL) ? isc_timertype_ticker : isc_timertype_inactive;
+	isc_interval_set(&interval, POPULAR_INTERVAL, 0);
+	result = isc_timer_reset(resolver->poptimer, type, NULL,
+				 (pop != NULL) ? &interval : NULL, ISC_TRUE);
+	UNLOCK(&resolver->lock);
+
+	if (oldentries != NULL)
+		isc_mem_put(resolver->mctx, oldentries,
+			    oldcount * sizeof(dns_popentry_t));
+	return (result);
+}
+
 
 isc_boolean_t
 dns_resolver_getzeronosoattl(dns_resolver_t *resolver) {
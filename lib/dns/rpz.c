@@ -20,6 +20,7 @@
 
 #include <isc/buffer.h>
 #include <isc/mem.h>
+#include <isc/mutexblock.h>
 #include <isc/net.h>
 #include <isc/netaddr.h>
 #include <isc/print.h>
@@ -548,6 +549,503 @@ fix_qname_skip_recurse(dns_rpz_zones_t *rpzs) {
 	rpzs->have.qname_skip_recurse = mask;
 }
 
+/*
+ * The filter is a Bloom filter over the keys of the summary databases,
+ * each tagged with the kind of trigger.  A search that can match none
+ * of the keys in the filter need not look in the summary databases.
+ * Bits are only set, so deleted triggers leave false positives until
+ * dns_rpz_ready() replaces the filter.  Bitmaps of the label counts and
+ * prefix lengths in use limit the keys that must be tried for a name
+ * or an address.
+ */
+typedef enum {
+	FILTER_QNAME = 0,
+	FILTER_QNAME_WILD,
+	FILTER_NS,
+	FILTER_NS_WILD,
+	FILTER_CLIENT_IP,
+	FILTER_IP,
+	FILTER_NSIP,
+	FILTER_KINDS
+} filter_kind_t;
+
+#define FILTER_HASHES		4
+#define FILTER_BITS_PER_KEY	12
+#define FILTER_MIN_KEYS		4096
+/*
+ * Do not try more IP address prefix lengths than this.
+ */
+#define FILTER_MAX_LENS		24
+#define FILTER_LEN_WORDS	((DNS_RPZ_CIDR_KEY_BITS + 32) / 32)
+
+#define FILTER_HAS_LEN(f, k, n) \
+	(((f)->lens[k][(n) / 32] & (1U << ((n) % 32))) != 0)
+
+struct dns_rpz_filter {
+	isc_uint32_t		mask;		/* number of bits - 1 */
+	unsigned int		capacity;	/* keys the filter is sized for */
+	unsigned int		keys;		/* keys added */
+	unsigned int		stale;		/* keys deleted */
+	unsigned int		nlens[FILTER_KINDS];
+	isc_uint32_t		lens[FILTER_KINDS][FILTER_LEN_WORDS];
+	isc_uint32_t		*words;
+};
+
+/*
+ * FNV-1a with a final mix, ignoring case for names.
+ */
+static isc_uint64_t
+filter_hash(filter_kind_t kind, const unsigned char *data, unsigned int len,
+	    isc_boolean_t nocase)
+{
+	isc_uint64_t h;
+	unsigned char c;
+
+	h = 14695981039346656037ULL ^ (isc_uint64_t)kind;
+	while (len-- > 0) {
+		c = *data++;
+		if (nocase && c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+		h ^= c;
+		h *= 1099511628211ULL;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return (h);
+}
+
+static isc_uint64_t
+filter_hash_ip(filter_kind_t kind, const dns_rpz_cidr_key_t *ip,
+	       dns_rpz_prefix_t prefix)
+{
+	dns_rpz_cidr_word_t w[DNS_RPZ_CIDR_WORDS + 1];
+	int i, bits;
+
+	for (i = 0; i < DNS_RPZ_CIDR_WORDS; ++i) {
+		bits = prefix - i * DNS_RPZ_CIDR_WORD_BITS;
+		if (bits >= DNS_RPZ_CIDR_WORD_BITS)
+			w[i] = ip->w[i];
+		else if (bits <= 0)
+			w[i] = 0;
+		else
+			w[i] = ip->w[i] & DNS_RPZ_WORD_MASK(bits);
+	}
+	w[DNS_RPZ_CIDR_WORDS] = prefix;
+	return (filter_hash(kind, (const unsigned char *)w, sizeof(w),
+			    ISC_FALSE));
+}
+
+static void
+filter_set(dns_rpz_filter_t *filter, isc_uint64_t h) {
+	isc_uint32_t h1, h2, bit;
+	int i;
+
+	h1 = (isc_uint32_t)h;
+	h2 = (isc_uint32_t)(h >> 32) | 1;
+	for (i = 0; i < FILTER_HASHES; ++i) {
+		bit = (h1 + i * h2) & filter->mask;
+		filter->words[bit / 32] |= 1U << (bit % 32);
+	}
+	++filter->keys;
+}
+
+static isc_boolean_t
+filter_test(const dns_rpz_filter_t *filter, isc_uint64_t h) {
+	isc_uint32_t h1, h2, bit;
+	int i;
+
+	h1 = (isc_uint32_t)h;
+	h2 = (isc_uint32_t)(h >> 32) | 1;
+	for (i = 0; i < FILTER_HASHES; ++i) {
+		bit = (h1 + i * h2) & filter->mask;
+		if ((filter->words[bit / 32] & (1U << (bit % 32))) == 0)
+			return (ISC_FALSE);
+	}
+	return (ISC_TRUE);
+}
+
+static void
+filter_set_len(dns_rpz_filter_t *filter, filter_kind_t kind, unsigned int n) {
+	if (!FILTER_HAS_LEN(filter, kind, n)) {
+		filter->lens[kind][n / 32] |= 1U << (n % 32);
+		++filter->nlens[kind];
+	}
+}
+
+static isc_result_t
+filter_create(isc_mem_t *mctx, unsigned int keys, dns_rpz_filter_t **filterp) {
+	dns_rpz_filter_t *filter;
+	unsigned int capacity;
+	isc_uint32_t nbits;
+
+	REQUIRE(filterp != NULL && *filterp == NULL);
+
+	capacity = keys + keys / 2;
+	if (capacity < FILTER_MIN_KEYS)
+		capacity = FILTER_MIN_KEYS;
+	nbits = 1024;
+	while (nbits / FILTER_BITS_PER_KEY < capacity && nbits < (1U << 31))
+		nbits <<= 1;
+
+	filter = isc_mem_get(mctx, sizeof(*filter));
+	if (filter == NULL)
+		return (ISC_R_NOMEMORY);
+	memset(filter, 0, sizeof(*filter));
+	filter->words = isc_mem_get(mctx, nbits / 8);
+	if (filter->words == NULL) {
+		isc_mem_put(mctx, filter, sizeof(*filter));
+		return (ISC_R_NOMEMORY);
+	}
+	memset(filter->words, 0, nbits / 8);
+	filter->mask = nbits - 1;
+	filter->capacity = capacity;
+
+	*filterp = filter;
+	return (ISC_R_SUCCESS);
+}
+
+static void
+filter_destroy(isc_mem_t *mctx, dns_rpz_filter_t **filterp) {
+	dns_rpz_filter_t *filter = *filterp;
+
+	*filterp = NULL;
+	if (filter == NULL)
+		return;
+	isc_mem_put(mctx, filter->words, ((size_t)filter->mask + 1) / 8);
+	isc_mem_put(mctx, filter, sizeof(*filter));
+}
+
+/*
+ * A filter that has taken many more keys than it was sized for or that
+ * holds many deleted keys should be rebuilt.
+ */
+static isc_boolean_t
+filter_worn(const dns_rpz_filter_t *filter) {
+	if (filter == NULL)
+		return (ISC_TRUE);
+	return (ISC_TF(filter->keys > filter->capacity ||
+		       filter->stale > filter->keys / 4));
+}
+
+static void
+filter_add_name(dns_rpz_filter_t *filter, filter_kind_t kind,
+		dns_name_t *name)
+{
+	filter_set_len(filter, kind, dns_name_countlabels(name) - 1);
+	filter_set(filter, filter_hash(kind, name->ndata, name->length,
+				       ISC_TRUE));
+}
+
+static void
+filter_add_nm(dns_rpz_filter_t *filter, dns_name_t *trig_name,
+	      const dns_rpz_nm_data_t *data)
+{
+	if (filter == NULL)
+		return;
+	if (data->set.qname != 0)
+		filter_add_name(filter, FILTER_QNAME, trig_name);
+	if (data->wild.qname != 0)
+		filter_add_name(filter, FILTER_QNAME_WILD, trig_name);
+	if (data->set.ns != 0)
+		filter_add_name(filter, FILTER_NS, trig_name);
+	if (data->wild.ns != 0)
+		filter_add_name(filter, FILTER_NS_WILD, trig_name);
+}
+
+static void
+filter_add_ip(dns_rpz_filter_t *filter, filter_kind_t kind,
+	      const dns_rpz_cidr_key_t *ip, dns_rpz_prefix_t prefix)
+{
+	filter_set_len(filter, kind, prefix);
+	filter_set(filter, filter_hash_ip(kind, ip, prefix));
+}
+
+static void
+filter_add_cidr(dns_rpz_filter_t *filter, const dns_rpz_cidr_key_t *ip,
+		dns_rpz_prefix_t prefix, const dns_rpz_addr_zbits_t *set)
+{
+	if (filter == NULL)
+		return;
+	if (set->client_ip != 0)
+		filter_add_ip(filter, FILTER_CLIENT_IP, ip, prefix);
+	if (set->ip != 0)
+		filter_add_ip(filter, FILTER_IP, ip, prefix);
+	if (set->nsip != 0)
+		filter_add_ip(filter, FILTER_NSIP, ip, prefix);
+}
+
+/*
+ * Could a QNAME or NSDNAME trigger in the summary RBT match the name?
+ * The name matches triggers for itself and wildcard triggers
+ * for its ancestors.
+ */
+static isc_boolean_t
+filter_name(const dns_rpz_filter_t *filter, dns_rpz_type_t rpz_type,
+	    const dns_name_t *name)
+{
+	filter_kind_t kind, wild;
+	unsigned int labels, offset;
+
+	if (filter == NULL || !dns_name_isabsolute(name))
+		return (ISC_TRUE);
+
+	if (rpz_type == DNS_RPZ_TYPE_QNAME) {
+		kind = FILTER_QNAME;
+		wild = FILTER_QNAME_WILD;
+	} else {
+		kind = FILTER_NS;
+		wild = FILTER_NS_WILD;
+	}
+
+	labels = dns_name_countlabels(name);
+	if (FILTER_HAS_LEN(filter, kind, labels - 1) &&
+	    filter_test(filter, filter_hash(kind, name->ndata, name->length,
+					    ISC_TRUE)))
+		return (ISC_TRUE);
+
+	if (filter->nlens[wild] == 0)
+		return (ISC_FALSE);
+	offset = 0;
+	while (--labels > 0) {
+		offset += name->ndata[offset] + 1;
+		if (FILTER_HAS_LEN(filter, wild, labels - 1) &&
+		    filter_test(filter, filter_hash(wild, name->ndata + offset,
+						    name->length - offset,
+						    ISC_TRUE)))
+			return (ISC_TRUE);
+	}
+	return (ISC_FALSE);
+}
+
+/*
+ * Could an IP address trigger in the radix tree match the address?
+ */
+static isc_boolean_t
+filter_ip(const dns_rpz_filter_t *filter, dns_rpz_type_t rpz_type,
+	  const dns_rpz_cidr_key_t *ip)
+{
+	filter_kind_t kind;
+	isc_uint32_t w;
+	int i, n;
+
+	switch (rpz_type) {
+	case DNS_RPZ_TYPE_CLIENT_IP:
+		kind = FILTER_CLIENT_IP;
+		break;
+	case DNS_RPZ_TYPE_IP:
+		kind = FILTER_IP;
+		break;
+	case DNS_RPZ_TYPE_NSIP:
+		kind = FILTER_NSIP;
+		break;
+	default:
+		INSIST(0);
+		return (ISC_TRUE);
+	}
+
+	if (filter == NULL || filter->nlens[kind] > FILTER_MAX_LENS)
+		return (ISC_TRUE);
+
+	for (i = 0; i < FILTER_LEN_WORDS; ++i) {
+		w = filter->lens[kind][i];
+		for (n = 0; w != 0; ++n, w >>= 1) {
+			if ((w & 1) == 0)
+				continue;
+			if (filter_test(filter,
+					filter_hash_ip(kind, ip, i * 32 + n)))
+				return (ISC_TRUE);
+		}
+	}
+	return (ISC_FALSE);
+}
+
+/*
+ * Step through the radix tree in pre-order.
+ */
+static const dns_rpz_cidr_node_t *
+cidr_next(const dns_rpz_cidr_node_t *cnode) {
+	const dns_rpz_cidr_node_t *parent;
+
+	if (cnode->child[0] != NULL)
+		return (cnode->child[0]);
+	if (cnode->child[1] != NULL)
+		return (cnode->child[1]);
+	for (;;) {
+		parent = cnode->parent;
+		if (parent == NULL)
+			return (NULL);
+		if (parent->child[0] == cnode && parent->child[1] != NULL)
+			return (parent->child[1]);
+		cnode = parent;
+	}
+}
+
+/*
+ * Build a filter for the current contents of the summary databases.
+ * The caller must keep them from changing by holding rpzs->maint_lock.
+ */
+static isc_result_t
+filter_build(dns_rpz_zones_t *rpzs, dns_rpz_filter_t **filterp) {
+	dns_rpz_filter_t *filter = NULL;
+	const dns_rpz_cidr_node_t *cnode;
+	dns_rbtnodechain_t chain;
+	dns_rbtnode_t *nmnode;
+	dns_fixedname_t labelf, originf, namef;
+	dns_name_t *label, *origin, *name;
+	unsigned int keys;
+	isc_result_t result;
+
+	/*
+	 * Count the radix tree nodes, and assume one key for each.
+	 */
+	keys = dns_rbt_nodecount(rpzs->rbt);
+	for (cnode = rpzs->cidr; cnode != NULL; cnode = cidr_next(cnode))
+		++keys;
+
+	result = filter_create(rpzs->mctx, keys, &filter);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	for (cnode = rpzs->cidr; cnode != NULL; cnode = cidr_next(cnode))
+		filter_add_cidr(filter, &cnode->ip, cnode->prefix, &cnode->set);
+
+	dns_fixedname_init(&namef);
+	name = dns_fixedname_name(&namef);
+	dns_fixedname_init(&labelf);
+	label = dns_fixedname_name(&labelf);
+	dns_fixedname_init(&originf);
+	origin = dns_fixedname_name(&originf);
+	dns_rbtnodechain_init(&chain, NULL);
+	result = dns_rbtnodechain_first(&chain, rpzs->rbt, NULL, NULL);
+	while (result == DNS_R_NEWORIGIN || result == ISC_R_SUCCESS) {
+		result = dns_rbtnodechain_current(&chain, label, origin,
+						  &nmnode);
+		INSIST(result == ISC_R_SUCCESS);
+		if (nmnode->data != NULL) {
+			result = dns_name_concatenate(label, origin, name,
+						      NULL);
+			INSIST(result == ISC_R_SUCCESS);
+			filter_add_nm(filter, name, nmnode->data);
+		}
+		result = dns_rbtnodechain_next(&chain, NULL, NULL);
+	}
+	dns_rbtnodechain_invalidate(&chain);
+	if (result != ISC_R_NOMORE && result != ISC_R_NOTFOUND) {
+		filter_destroy(rpzs->mctx, &filter);
+		return (result);
+	}
+
+	*filterp = filter;
+	return (ISC_R_SUCCESS);
+}
+
+/*
+ * Replace the filter if it has become too full or has too many
+ * deleted keys.  rpzs->maint_lock must be held but not the search lock.
+ * The old filter remains good enough if a new one cannot be built.
+ */
+static void
+filter_refresh(dns_rpz_zones_t *rpzs, isc_boolean_t force) {
+	dns_rpz_filter_t *filter = NULL, *old;
+	isc_result_t result;
+
+	if (!force && !filter_worn(rpzs->filter))
+		return;
+
+	result = filter_build(rpzs, &filter);
+	if (result != ISC_R_SUCCESS) {
+		isc_log_write(dns_lctx, DNS_LOGCATEGORY_RPZ,
+			      DNS_LOGMODULE_RBTDB, DNS_RPZ_ERROR_LEVEL,
+			      "rpz filter rebuild failed: %s",
+			      isc_result_totext(result));
+		return;
+	}
+
+	RWLOCK(&rpzs->search_lock, isc_rwlocktype_write);
+	old = rpzs->filter;
+	rpzs->filter = filter;
+	filter = old;
+	RWUNLOCK(&rpzs->search_lock, isc_rwlocktype_write);
+
+	filter_destroy(rpzs->mctx, &filter);
+}
+
+/*
+ * The NS memo remembers delegations for which no name server name or
+ * address hit an NSDNAME or NSIP trigger, so that the NS rrset and the
+ * addresses of the name servers need not be checked again for each
+ * query.  Each entry records the policy zones that were checked, and is
+ * good only for the generation of the summary databases it was made
+ * with, no longer than the TTL of the NS rrset, and no longer than
+ * NSMEMO_MAX_TTL.  Colliding delegations replace each other.
+ */
+#define NSMEMO_SIZE		1024
+#define NSMEMO_LOCKS		16
+#define NSMEMO_MAX_TTL		300
+
+typedef struct nsmemo_entry {
+	dns_name_t		name;
+	unsigned int		trig_gen;
+	dns_rpz_zbits_t		nsdname;
+	dns_rpz_zbits_t		nsip;
+	isc_stdtime_t		expire;
+} nsmemo_entry_t;
+
+struct dns_rpz_nsmemo {
+	isc_mutex_t		locks[NSMEMO_LOCKS];
+	nsmemo_entry_t		entries[NSMEMO_SIZE];
+};
+
+static isc_result_t
+nsmemo_create(isc_mem_t *mctx, dns_rpz_nsmemo_t **memop) {
+	dns_rpz_nsmemo_t *memo;
+	isc_result_t result;
+	int i;
+
+	REQUIRE(memop != NULL && *memop == NULL);
+
+	memo = isc_mem_get(mctx, sizeof(*memo));
+	if (memo == NULL)
+		return (ISC_R_NOMEMORY);
+	result = isc_mutexblock_init(memo->locks, NSMEMO_LOCKS);
+	if (result != ISC_R_SUCCESS) {
+		isc_mem_put(mctx, memo, sizeof(*memo));
+		return (result);
+	}
+	for (i = 0; i < NSMEMO_SIZE; ++i) {
+		dns_name_init(&memo->entries[i].name, NULL);
+		memo->entries[i].expire = 0;
+	}
+
+	*memop = memo;
+	return (ISC_R_SUCCESS);
+}
+
+static void
+nsmemo_destroy(isc_mem_t *mctx, dns_rpz_nsmemo_t **memop) {
+	dns_rpz_nsmemo_t *memo = *memop;
+	int i;
+
+	*memop = NULL;
+	if (memo == NULL)
+		return;
+	for (i = 0; i < NSMEMO_SIZE; ++i) {
+		if (dns_name_dynamic(&memo->entries[i].name))
+			dns_name_free(&memo->entries[i].name, mctx);
+	}
+	RUNTIME_CHECK(isc_mutexblock_destroy(memo->locks, NSMEMO_LOCKS) ==
+		      ISC_R_SUCCESS);
+	isc_mem_put(mctx, memo, sizeof(*memo));
+}
+
+static unsigned int
+nsmemo_bucket(const dns_name_t *nsname) {
+	return ((unsigned int)(filter_hash(FILTER_NS, nsname->ndata,
+					   nsname->length, ISC_TRUE) %
+			       NSMEMO_SIZE));
+}
+
 static void
 adj_trigger_cnt(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num,
 		dns_rpz_type_t rpz_type,
@@ -600,12 +1098,15 @@ adj_trigger_cnt(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num,
 		INSIST(0);
 	}
 
+	rpzs->trig_gen++;
 	if (inc) {
 		if (++*cnt == 1U) {
 			*have |= DNS_RPZ_ZBIT(rpz_num);
 			fix_qname_skip_recurse(rpzs);
 		}
 	} else {
+		if (rpzs->filter != NULL)
+			rpzs->filter->stale++;
 		REQUIRE(*cnt != 0U);
 		if (--*cnt == 0U) {
 			*have &= ~DNS_RPZ_ZBIT(rpz_num);
@@ -1242,6 +1743,26 @@ search(dns_rpz_zones_t *rpzs,
 	}
 }
 
+/*
+ * Add an IP address key to the radix tree.
+ */
+static isc_result_t
+add_ip(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num, dns_rpz_type_t rpz_type,
+       const dns_rpz_cidr_key_t *tgt_ip, dns_rpz_prefix_t tgt_prefix,
+       const dns_rpz_addr_zbits_t *set)
+{
+	dns_rpz_cidr_node_t *found;
+	isc_result_t result;
+
+	result = search(rpzs, tgt_ip, tgt_prefix, set, ISC_TRUE, &found);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	adj_trigger_cnt(rpzs, rpz_num, rpz_type, tgt_ip, tgt_prefix, ISC_TRUE);
+	filter_add_cidr(rpzs->filter, tgt_ip, tgt_prefix, set);
+	return (ISC_R_SUCCESS);
+}
+
 /*
  * Add an IP address to the radix tree.
  */
@@ -1252,7 +1773,6 @@ add_cidr(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num,
 	dns_rpz_cidr_key_t tgt_ip;
 	dns_rpz_prefix_t tgt_prefix;
 	dns_rpz_addr_zbits_t set;
-	dns_rpz_cidr_node_t *found;
 	isc_result_t result;
 
 	result = name2ipkey(DNS_RPZ_ERROR_LEVEL, rpzs, rpz_num, rpz_type,
@@ -1263,7 +1783,7 @@ add_cidr(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num,
 	if (result != ISC_R_SUCCESS)
 		return (ISC_R_SUCCESS);
 
-	result = search(rpzs, &tgt_ip, tgt_prefix, &set, ISC_TRUE, &found);
+	result = add_ip(rpzs, rpz_num, rpz_type, &tgt_ip, tgt_prefix, &set);
 	if (result != ISC_R_SUCCESS) {
 		char namebuf[DNS_NAME_FORMATSIZE];
 
@@ -1282,10 +1802,7 @@ add_cidr(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num,
 			      DNS_LOGMODULE_RBTDB, DNS_RPZ_ERROR_LEVEL,
 			      "rpz add_cidr(%s) failed: %s",
 			      namebuf, isc_result_totext(result));
-		return (result);
 	}
-
-	adj_trigger_cnt(rpzs, rpz_num, rpz_type, &tgt_ip, tgt_prefix, ISC_TRUE);
 	return (result);
 }
 
@@ -1309,6 +1826,7 @@ add_nm(dns_rpz_zones_t *rpzs, dns_name_t *trig_name,
 				return (ISC_R_NOMEMORY);
 			*nm_data = *new_data;
 			nmnode->data = nm_data;
+			filter_add_nm(rpzs->filter, trig_name, new_data);
 			return (ISC_R_SUCCESS);
 		}
 		break;
@@ -1329,6 +1847,7 @@ add_nm(dns_rpz_zones_t *rpzs, dns_name_t *trig_name,
 	nm_data->set.ns |= new_data->set.ns;
 	nm_data->wild.qname |= new_data->wild.qname;
 	nm_data->wild.ns |= new_data->wild.ns;
+	filter_add_nm(rpzs->filter, trig_name, new_data);
 	return (ISC_R_SUCCESS);
 }
 
@@ -1410,19 +1929,33 @@ dns_rpz_new_zones(dns_rpz_zones_t **rpzsp, isc_mem_t *mctx) {
 	}
 
 	result = dns_rbt_create(mctx, rpz_node_deleter, mctx, &new->rbt);
-	if (result != ISC_R_SUCCESS) {
-		isc_refcount_decrement(&new->refs, NULL);
-		isc_refcount_destroy(&new->refs);
-		DESTROYLOCK(&new->maint_lock);
-		isc_rwlock_destroy(&new->search_lock);
-		isc_mem_put(mctx, new, sizeof(*new));
-		return (result);
-	}
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_refs;
+
+	result = filter_create(mctx, 0, &new->filter);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_rbt;
+
+	result = nsmemo_create(mctx, &new->nsmemo);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_filter;
 
 	isc_mem_attach(mctx, &new->mctx);
 
 	*rpzsp = new;
 	return (ISC_R_SUCCESS);
+
+ cleanup_filter:
+	filter_destroy(mctx, &new->filter);
+ cleanup_rbt:
+	dns_rbt_destroy(&new->rbt);
+ cleanup_refs:
+	isc_refcount_decrement(&new->refs, NULL);
+	isc_refcount_destroy(&new->refs);
+	DESTROYLOCK(&new->maint_lock);
+	isc_rwlock_destroy(&new->search_lock);
+	isc_mem_put(mctx, new, sizeof(*new));
+	return (result);
 }
 
 /*
@@ -1532,6 +2065,8 @@ dns_rpz_detach_rpzs(dns_rpz_zones_t **rpzsp) {
 
 		cidr_free(rpzs);
 		dns_rbt_destroy(&rpzs->rbt);
+		filter_destroy(rpzs->mctx, &rpzs->filter);
+		nsmemo_destroy(rpzs->mctx, &rpzs->nsmemo);
 		DESTROYLOCK(&rpzs->maint_lock);
 		isc_rwlock_destroy(&rpzs->search_lock);
 		isc_refcount_destroy(&rpzs->refs);
@@ -1562,11 +2097,10 @@ dns_rpz_beginload(dns_rpz_zones_t **load_rpzsp,
 	 * reloaded zone data.  To deal with that case:
 	 *    reload the new zone data into a new blank summary database
 	 *    if the reload fails, discard the new summary database
-	 *    if the new zone data is acceptable, copy the records for the
-	 *	other zones into the new summary CIDR and RBT databases
-	 *	and replace the old summary databases with the new, and
-	 *	correct the triggers and have values for the updated
-	 *	zone.
+	 *    if the new zone data is acceptable, apply the differences
+	 *	between the new and old summary data of the zone to the
+	 *	operational summary databases, and correct the triggers
+	 *	and have values for the updated zone.
 	 *
 	 * At the first attempt to load a zone, there is no summary data
 	 * for the zone and so no records that need to be deleted.
@@ -1600,6 +2134,11 @@ dns_rpz_beginload(dns_rpz_zones_t **load_rpzsp,
 		memset(&load_rpzs->triggers, 0, sizeof(load_rpzs->triggers));
 		load_rpzs->zones[rpz_num] = rpz;
 		isc_refcount_increment(&rpz->refs, NULL);
+		/*
+		 * The new summary databases are never searched.
+		 */
+		filter_destroy(load_rpzs->mctx, &load_rpzs->filter);
+		nsmemo_destroy(load_rpzs->mctx, &load_rpzs->nsmemo);
 	}
 
 	RWUNLOCK(&rpzs->search_lock, isc_rwlocktype_write);
@@ -1675,6 +2214,318 @@ fix_triggers(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num) {
 				       rpzs->total_triggers.client_ipv6));
 }
 
+/*
+ * Changes that dns_rpz_ready() makes to the view's summary databases
+ * are made with the search lock held for at most this many triggers
+ * at a time, so that reloading a large policy zone does not stall
+ * queries.
+ */
+#define READY_BATCH	1024
+
+/*
+ * A trigger that is no longer in a reloaded policy zone.
+ */
+typedef struct ready_del ready_del_t;
+struct ready_del {
+	dns_rpz_type_t		type;
+	dns_rpz_cidr_key_t	ip;
+	dns_rpz_prefix_t	prefix;
+	dns_name_t		name;
+	dns_rpz_nm_data_t	data;
+};
+
+static void
+del_ip(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num, dns_rpz_type_t rpz_type,
+       const dns_rpz_cidr_key_t *tgt_ip, dns_rpz_prefix_t tgt_prefix,
+       const dns_rpz_addr_zbits_t *del_set);
+static void
+del_nm(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num, dns_rpz_type_t rpz_type,
+       dns_name_t *trig_name, const dns_rpz_nm_data_t *tgt_data);
+
+static const dns_rpz_type_t ready_ip_types[] = {
+	DNS_RPZ_TYPE_CLIENT_IP, DNS_RPZ_TYPE_IP, DNS_RPZ_TYPE_NSIP
+};
+
+/*
+ * Take the search lock of the view's summary databases for one more
+ * change, giving queries a chance to run between batches.
+ * '*countp' is the number of changes made since the lock was taken,
+ * or 0 when it is not held.
+ */
+static void
+ready_lock(dns_rpz_zones_t *rpzs, unsigned int *countp) {
+	if (*countp == READY_BATCH) {
+		RWUNLOCK(&rpzs->search_lock, isc_rwlocktype_write);
+		*countp = 0;
+	}
+	if (*countp == 0)
+		RWLOCK(&rpzs->search_lock, isc_rwlocktype_write);
+	++*countp;
+}
+
+static void
+ready_unlock(dns_rpz_zones_t *rpzs, unsigned int *countp) {
+	if (*countp != 0) {
+		RWUNLOCK(&rpzs->search_lock, isc_rwlocktype_write);
+		*countp = 0;
+	}
+}
+
+/*
+ * Does a radix tree node have the bit in 'set'?
+ */
+static isc_boolean_t
+ready_has_ip(const dns_rpz_cidr_node_t *cnode, const dns_rpz_addr_zbits_t *set)
+{
+	return (ISC_TF((cnode->set.client_ip & set->client_ip) != 0 ||
+		       (cnode->set.ip & set->ip) != 0 ||
+		       (cnode->set.nsip & set->nsip) != 0));
+}
+
+/*
+ * Make the summary data for trigger number 'n' of the four name triggers
+ * (QNAME, wildcard QNAME, NSDNAME, wildcard NSDNAME) of a zone and say
+ * whether 'nm_data' has it.
+ */
+static isc_boolean_t
+ready_has_nm(const dns_rpz_nm_data_t *nm_data, dns_rpz_num_t rpz_num,
+	     unsigned int n, dns_rpz_type_t *typep, dns_rpz_nm_data_t *data)
+{
+	*typep = (n < 2) ? DNS_RPZ_TYPE_QNAME : DNS_RPZ_TYPE_NSDNAME;
+	memset(data, 0, sizeof(*data));
+	make_nm_set((n & 1) != 0 ? &data->wild : &data->set, rpz_num, *typep);
+	if (nm_data == NULL)
+		return (ISC_FALSE);
+	return (ISC_TF((nm_data->set.qname & data->set.qname) != 0 ||
+		       (nm_data->set.ns & data->set.ns) != 0 ||
+		       (nm_data->wild.qname & data->wild.qname) != 0 ||
+		       (nm_data->wild.ns & data->wild.ns) != 0));
+}
+
+/*
+ * Add the triggers of the reloaded zone to the view's summary databases.
+ * Triggers that the old version of the zone also had are left alone.
+ */
+static isc_result_t
+ready_add(dns_rpz_zones_t *rpzs, dns_rpz_zones_t *load_rpzs,
+	  dns_rpz_num_t rpz_num, unsigned int *countp)
+{
+	const dns_rpz_cidr_node_t *cnode;
+	dns_rpz_addr_zbits_t set;
+	dns_rbtnodechain_t chain;
+	dns_rbtnode_t *nmnode;
+	dns_rpz_nm_data_t data;
+	dns_rpz_type_t type;
+	dns_fixedname_t labelf, originf, namef;
+	dns_name_t *label, *origin, *name;
+	isc_result_t result;
+	unsigned int n;
+
+	for (cnode = load_rpzs->cidr;
+	     cnode != NULL;
+	     cnode = cidr_next(cnode))
+	{
+		for (n = 0; n < sizeof(ready_ip_types)/sizeof(ready_ip_types[0]);
+		     ++n)
+		{
+			type = ready_ip_types[n];
+			make_addr_set(&set, DNS_RPZ_ZBIT(rpz_num), type);
+			if (!ready_has_ip(cnode, &set))
+				continue;
+			ready_lock(rpzs, countp);
+			result = add_ip(rpzs, rpz_num, type,
+					&cnode->ip, cnode->prefix, &set);
+			if (result != ISC_R_SUCCESS && result != ISC_R_EXISTS)
+				return (result);
+		}
+	}
+
+	dns_fixedname_init(&namef);
+	name = dns_fixedname_name(&namef);
+	dns_fixedname_init(&labelf);
+	label = dns_fixedname_name(&labelf);
+	dns_fixedname_init(&originf);
+	origin = dns_fixedname_name(&originf);
+	dns_rbtnodechain_init(&chain, NULL);
+	result = dns_rbtnodechain_first(&chain, load_rpzs->rbt, NULL, NULL);
+	while (result == DNS_R_NEWORIGIN || result == ISC_R_SUCCESS) {
+		result = dns_rbtnodechain_current(&chain, label, origin,
+						  &nmnode);
+		INSIST(result == ISC_R_SUCCESS);
+		for (n = 0; n < 4 && nmnode->data != NULL; ++n) {
+			if (!ready_has_nm(nmnode->data, rpz_num, n,
+					  &type, &data))
+				continue;
+			result = dns_name_concatenate(label, origin, name, NULL);
+			INSIST(result == ISC_R_SUCCESS);
+			ready_lock(rpzs, countp);
+			result = add_nm(rpzs, name, &data);
+			if (result == ISC_R_SUCCESS)
+				adj_trigger_cnt(rpzs, rpz_num, type,
+						NULL, 0, ISC_TRUE);
+			else if (result != ISC_R_EXISTS)
+				goto cleanup;
+		}
+		result = dns_rbtnodechain_next(&chain, NULL, NULL);
+	}
+	if (result == ISC_R_NOMORE || result == ISC_R_NOTFOUND)
+		result = ISC_R_SUCCESS;
+
+ cleanup:
+	dns_rbtnodechain_invalidate(&chain);
+	return (result);
+}
+
+/*
+ * Remove the triggers of the old version of the zone that are not
+ * in the reloaded zone from the view's summary databases.
+ * This must follow ready_add(), so that the view's summary databases
+ * hold a superset of the triggers of the reloaded zone and the
+ * differences among the trigger counts say how many must be removed.
+ */
+static isc_result_t
+ready_del(dns_rpz_zones_t *rpzs, dns_rpz_zones_t *load_rpzs,
+	  dns_rpz_num_t rpz_num, unsigned int *countp)
+{
+	const dns_rpz_triggers_t *old, *new;
+	const dns_rpz_cidr_node_t *cnode;
+	dns_rpz_cidr_node_t *found;
+	dns_rpz_addr_zbits_t set;
+	dns_rbtnodechain_t chain;
+	dns_rbtnode_t *nmnode, *load_node;
+	dns_rpz_nm_data_t *load_data;
+	dns_fixedname_t labelf, originf, namef;
+	dns_name_t *label, *origin, *name;
+	ready_del_t *dels, *del;
+	size_t ndels, n, i;
+	isc_result_t result;
+
+	old = &rpzs->triggers[rpz_num];
+	new = &load_rpzs->triggers[rpz_num];
+	ndels = (old->client_ipv4 - new->client_ipv4) +
+		(old->client_ipv6 - new->client_ipv6) +
+		(old->qname - new->qname) +
+		(old->ipv4 - new->ipv4) +
+		(old->ipv6 - new->ipv6) +
+		(old->nsdname - new->nsdname) +
+		(old->nsipv4 - new->nsipv4) +
+		(old->nsipv6 - new->nsipv6);
+	if (ndels == 0)
+		return (ISC_R_SUCCESS);
+
+	dels = isc_mem_get(rpzs->mctx, ndels * sizeof(*dels));
+	if (dels == NULL)
+		return (ISC_R_NOMEMORY);
+	n = 0;
+
+	/*
+	 * Collect the stale triggers before removing any of them,
+	 * because removals change the trees.  Only our caller's
+	 * maint_lock changes the trees, so they are read here without
+	 * the search lock and queries run throughout the walk.
+	 */
+	ready_unlock(rpzs, countp);
+	for (cnode = rpzs->cidr;
+	     cnode != NULL && n < ndels;
+	     cnode = cidr_next(cnode))
+	{
+		for (i = 0;
+		     i < sizeof(ready_ip_types)/sizeof(ready_ip_types[0]) &&
+		     n < ndels;
+		     ++i)
+		{
+			make_addr_set(&set, DNS_RPZ_ZBIT(rpz_num),
+				      ready_ip_types[i]);
+			if (!ready_has_ip(cnode, &set))
+				continue;
+			result = search(load_rpzs, &cnode->ip, cnode->prefix,
+					&set, ISC_FALSE, &found);
+			if (result == ISC_R_SUCCESS)
+				continue;
+			del = &dels[n++];
+			del->type = ready_ip_types[i];
+			del->ip = cnode->ip;
+			del->prefix = cnode->prefix;
+			dns_name_init(&del->name, NULL);
+		}
+	}
+
+	dns_fixedname_init(&namef);
+	name = dns_fixedname_name(&namef);
+	dns_fixedname_init(&labelf);
+	label = dns_fixedname_name(&labelf);
+	dns_fixedname_init(&originf);
+	origin = dns_fixedname_name(&originf);
+	dns_rbtnodechain_init(&chain, NULL);
+	result = dns_rbtnodechain_first(&chain, rpzs->rbt, NULL, NULL);
+	while ((result == DNS_R_NEWORIGIN || result == ISC_R_SUCCESS) &&
+	       n < ndels)
+	{
+		result = dns_rbtnodechain_current(&chain, label, origin,
+						  &nmnode);
+		INSIST(result == ISC_R_SUCCESS);
+		if (nmnode->data != NULL) {
+			result = dns_name_concatenate(label, origin, name, NULL);
+			INSIST(result == ISC_R_SUCCESS);
+			load_node = NULL;
+			result = dns_rbt_findnode(load_rpzs->rbt, name, NULL,
+						  &load_node, NULL, 0,
+						  NULL, NULL);
+			load_data = NULL;
+			if (result == ISC_R_SUCCESS)
+				load_data = load_node->data;
+			for (i = 0; i < 4 && n < ndels; ++i) {
+				del = &dels[n];
+				if (!ready_has_nm(nmnode->data, rpz_num, i,
+						  &del->type, &del->data) ||
+				    ready_has_nm(load_data, rpz_num, i,
+						 &del->type, &del->data))
+					continue;
+				dns_name_init(&del->name, NULL);
+				result = dns_name_dup(name, rpzs->mctx,
+						      &del->name);
+				if (result != ISC_R_SUCCESS) {
+					dns_rbtnodechain_invalidate(&chain);
+					goto cleanup;
+				}
+				++n;
+			}
+		}
+		result = dns_rbtnodechain_next(&chain, NULL, NULL);
+	}
+	dns_rbtnodechain_invalidate(&chain);
+	if (result != ISC_R_SUCCESS && result != DNS_R_NEWORIGIN &&
+	    result != ISC_R_NOMORE && result != ISC_R_NOTFOUND)
+		goto cleanup;
+
+	for (i = 0; i < n; ++i) {
+		del = &dels[i];
+		ready_lock(rpzs, countp);
+		switch (del->type) {
+		case DNS_RPZ_TYPE_QNAME:
+		case DNS_RPZ_TYPE_NSDNAME:
+			del_nm(rpzs, rpz_num, del->type, &del->name,
+			       &del->data);
+			break;
+		default:
+			make_addr_set(&set, DNS_RPZ_ZBIT(rpz_num), del->type);
+			del_ip(rpzs, rpz_num, del->type,
+			       &del->ip, del->prefix, &set);
+			break;
+		}
+	}
+	result = ISC_R_SUCCESS;
+
+ cleanup:
+	for (i = 0; i < n; ++i) {
+		if (dels[i].type == DNS_RPZ_TYPE_QNAME ||
+		    dels[i].type == DNS_RPZ_TYPE_NSDNAME)
+			dns_name_free(&dels[i].name, rpzs->mctx);
+	}
+	isc_mem_put(rpzs->mctx, dels, ndels * sizeof(*dels));
+	return (result);
+}
+
 /*
  * Finish loading one zone. This function is called during a commit when
  * a RPZ zone loading is complete.  The RBTDB write tree lock must be
@@ -1691,29 +2542,22 @@ fix_triggers(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num) {
  * zone. Nothing else reads or writes *load_rpzsp. The view's common
  * rpzs is used during this time for queries.
  *
- * When zone loading is complete and we arrive here, the parts of the
- * summary databases (CIDR and nsdname+qname RBT trees) from the view's
- * common rpzs struct have to be merged into the summary databases of
- * *load_rpzsp, as the summary databases of the view's common rpzs
- * struct may have changed during the time the zone was being loaded.
- *
- * The function below carries out the merge. During the merge, it holds
- * the maint_lock of the view's common rpzs struct so that it is not
- * updated while the merging is taking place.
+ * When zone loading is complete and we arrive here, the differences
+ * between the summary data of the new version of the zone in
+ * *load_rpzsp and of the old version in the view's common rpzs struct
+ * are applied to the view's common summary databases.  New triggers
+ * are added first and then triggers that are no longer in the zone
+ * are removed, so that a trigger that is in both versions is never
+ * missing.  The summary data of the other policy zones is not touched.
  *
- * After the merging is carried out, *load_rpzsp contains the most
- * current state of the rpzs structure, i.e., the summary trees contain
- * data for the new zone that was just loaded, as well as all other
- * zones.
+ * The maint_lock of the view's common rpzs struct is held throughout
+ * so that nothing else changes the summary databases, while the
+ * search_lock is taken only for batches of READY_BATCH changes so that
+ * queries continue while a large zone is reloaded.  Walking the
+ * summary databases to find the triggers to remove is done without it.
  *
- * Pointers to the summary databases of *load_rpzsp (CIDR and
- * nsdname+qname RBT trees) are then swapped into the view's common rpz
- * struct, so that the query path can continue using it. During the
- * swap, the search_lock of the view's common rpz struct is acquired so
- * that queries are paused while this swap occurs.
- *
- * The trigger counts for the new zone are also copied into the view's
- * common rpz struct, and some other summary counts and masks are
+ * The trigger counts for the new zone are kept up to date by the
+ * changes, and finally some other summary counts and masks are
  * updated.
  */
 isc_result_t
@@ -1721,16 +2565,7 @@ dns_rpz_ready(dns_rpz_zones_t *rpzs,
 	      dns_rpz_zones_t **load_rpzsp, dns_rpz_num_t rpz_num)
 {
 	dns_rpz_zones_t *load_rpzs;
-	const dns_rpz_cidr_node_t *cnode, *next_cnode, *parent_cnode;
-	dns_rpz_cidr_node_t *found;
-	dns_rpz_zbits_t new_bit;
-	dns_rpz_addr_zbits_t new_ip;
-	dns_rbt_t *rbt;
-	dns_rbtnodechain_t chain;
-	dns_rbtnode_t *nmnode;
-	dns_rpz_nm_data_t *nm_data, new_data;
-	dns_fixedname_t labelf, originf, namef;
-	dns_name_t *label, *origin, *name;
+	unsigned int count;
 	isc_result_t result;
 
 	INSIST(rpzs != NULL);
@@ -1745,7 +2580,9 @@ dns_rpz_ready(dns_rpz_zones_t *rpzs,
 		 */
 		RWLOCK(&rpzs->search_lock, isc_rwlocktype_write);
 		fix_triggers(rpzs, rpz_num);
+		rpzs->trig_gen++;
 		RWUNLOCK(&rpzs->search_lock, isc_rwlocktype_write);
+		filter_refresh(rpzs, ISC_FALSE);
 		UNLOCK(&rpzs->maint_lock);
 		dns_rpz_detach_rpzs(load_rpzsp);
 		return (ISC_R_SUCCESS);
@@ -1754,121 +2591,27 @@ dns_rpz_ready(dns_rpz_zones_t *rpzs,
 	LOCK(&load_rpzs->maint_lock);
 	RWLOCK(&load_rpzs->search_lock, isc_rwlocktype_write);
 
-	/*
-	 * Unless there is only one policy zone, copy the other policy zones
-	 * from the old policy structure to the new summary databases.
-	 */
-	if (rpzs->p.num_zones > 1) {
-		new_bit = ~DNS_RPZ_ZBIT(rpz_num);
-
-		/*
-		 * Copy to the radix tree.
-		 */
-		for (cnode = rpzs->cidr; cnode != NULL; cnode = next_cnode) {
-			new_ip.ip = cnode->set.ip & new_bit;
-			new_ip.client_ip = cnode->set.client_ip & new_bit;
-			new_ip.nsip = cnode->set.nsip & new_bit;
-			if (new_ip.client_ip != 0 ||
-			    new_ip.ip != 0 ||
-			    new_ip.nsip != 0) {
-				result = search(load_rpzs,
-						&cnode->ip, cnode->prefix,
-						&new_ip, ISC_TRUE, &found);
-				if (result == ISC_R_NOMEMORY)
-					goto unlock_and_detach;
-				INSIST(result == ISC_R_SUCCESS);
-			}
-			/*
-			 * Do down and to the left as far as possible.
-			 */
-			next_cnode = cnode->child[0];
-			if (next_cnode != NULL)
-				continue;
-			/*
-			 * Go up until we find a branch to the right where
-			 * we previously took the branch to the left.
-			 */
-			for (;;) {
-				parent_cnode = cnode->parent;
-				if (parent_cnode == NULL)
-					break;
-				if (parent_cnode->child[0] == cnode) {
-					next_cnode = parent_cnode->child[1];
-					if (next_cnode != NULL)
-					    break;
-				}
-				cnode = parent_cnode;
-			}
-		}
-
-		/*
-		 * Copy to the summary RBT.
-		 */
-		dns_fixedname_init(&namef);
-		name = dns_fixedname_name(&namef);
-		dns_fixedname_init(&labelf);
-		label = dns_fixedname_name(&labelf);
-		dns_fixedname_init(&originf);
-		origin = dns_fixedname_name(&originf);
-		dns_rbtnodechain_init(&chain, NULL);
-		result = dns_rbtnodechain_first(&chain, rpzs->rbt, NULL, NULL);
-		while (result == DNS_R_NEWORIGIN || result == ISC_R_SUCCESS) {
-			result = dns_rbtnodechain_current(&chain, label, origin,
-							&nmnode);
-			INSIST(result == ISC_R_SUCCESS);
-			nm_data = nmnode->data;
-			if (nm_data != NULL) {
-				new_data.set.qname = (nm_data->set.qname &
-						      new_bit);
-				new_data.set.ns = nm_data->set.ns & new_bit;
-				new_data.wild.qname = (nm_data->wild.qname &
-						       new_bit);
-				new_data.wild.ns = nm_data->wild.ns & new_bit;
-				if (new_data.set.qname != 0 ||
-				    new_data.set.ns != 0 ||
-				    new_data.wild.qname != 0 ||
-				    new_data.wild.ns != 0) {
-					result = dns_name_concatenate(label,
-							origin, name, NULL);
-					INSIST(result == ISC_R_SUCCESS);
-					result = add_nm(load_rpzs, name,
-							&new_data);
-					if (result != ISC_R_SUCCESS)
-						goto unlock_and_detach;
-				}
-			}
-			result = dns_rbtnodechain_next(&chain, NULL, NULL);
-		}
-		if (result != ISC_R_NOMORE && result != ISC_R_NOTFOUND) {
-			isc_log_write(dns_lctx, DNS_LOGCATEGORY_RPZ,
-				      DNS_LOGMODULE_RBTDB, DNS_RPZ_ERROR_LEVEL,
-				      "dns_rpz_ready(): unexpected %s",
-				      isc_result_totext(result));
-			goto unlock_and_detach;
-		}
-	}
+	count = 0;
+	result = ready_add(rpzs, load_rpzs, rpz_num, &count);
+	if (result == ISC_R_SUCCESS)
+		result = ready_del(rpzs, load_rpzs, rpz_num, &count);
+	if (result != ISC_R_SUCCESS)
+		isc_log_write(dns_lctx, DNS_LOGCATEGORY_RPZ,
+			      DNS_LOGMODULE_RBTDB, DNS_RPZ_ERROR_LEVEL,
+			      "rpz dns_rpz_ready() failed: %s",
+			      isc_result_totext(result));
 
 	/*
-	 * Exchange the summary databases.
+	 * Fix the summary masks even after a failure, because the
+	 * trigger counts match whatever changes were made.
 	 */
-	RWLOCK(&rpzs->search_lock, isc_rwlocktype_write);
-
-	rpzs->triggers[rpz_num] = load_rpzs->triggers[rpz_num];
+	if (count == 0)
+		RWLOCK(&rpzs->search_lock, isc_rwlocktype_write);
 	fix_triggers(rpzs, rpz_num);
-
-	found = rpzs->cidr;
-	rpzs->cidr = load_rpzs->cidr;
-	load_rpzs->cidr = found;
-
-	rbt = rpzs->rbt;
-	rpzs->rbt = load_rpzs->rbt;
-	load_rpzs->rbt = rbt;
-
 	RWUNLOCK(&rpzs->search_lock, isc_rwlocktype_write);
 
-	result = ISC_R_SUCCESS;
+	filter_refresh(rpzs, ISC_FALSE);
 
- unlock_and_detach:
 	UNLOCK(&rpzs->maint_lock);
 	RWUNLOCK(&load_rpzs->search_lock, isc_rwlocktype_write);
 	UNLOCK(&load_rpzs->maint_lock);
@@ -1915,29 +2658,19 @@ dns_rpz_add(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num, dns_name_t *src_name)
 }
 
 /*
- * Remove an IP address from the radix tree.
+ * Remove an IP address key from the radix tree.
  */
 static void
-del_cidr(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num,
-	 dns_rpz_type_t rpz_type, dns_name_t *src_name)
+del_ip(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num, dns_rpz_type_t rpz_type,
+       const dns_rpz_cidr_key_t *tgt_ip, dns_rpz_prefix_t tgt_prefix,
+       const dns_rpz_addr_zbits_t *del_set)
 {
 	isc_result_t result;
-	dns_rpz_cidr_key_t tgt_ip;
-	dns_rpz_prefix_t tgt_prefix;
 	dns_rpz_addr_zbits_t tgt_set;
 	dns_rpz_cidr_node_t *tgt, *parent, *child;
 
-	/*
-	 * Do not worry about invalid rpz IP address names.  If we
-	 * are here, then something relevant was added and so was
-	 * valid.  Invalid names here are usually internal RBTDB nodes.
-	 */
-	result = name2ipkey(DNS_RPZ_DEBUG_QUIET, rpzs, rpz_num, rpz_type,
-			    src_name, &tgt_ip, &tgt_prefix, &tgt_set);
-	if (result != ISC_R_SUCCESS)
-		return;
-
-	result = search(rpzs, &tgt_ip, tgt_prefix, &tgt_set, ISC_FALSE, &tgt);
+	tgt_set = *del_set;
+	result = search(rpzs, tgt_ip, tgt_prefix, &tgt_set, ISC_FALSE, &tgt);
 	if (result != ISC_R_SUCCESS) {
 		INSIST(result == ISC_R_NOTFOUND ||
 		       result == DNS_R_PARTIALMATCH);
@@ -1962,7 +2695,7 @@ del_cidr(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num,
 	tgt->set.nsip &= ~tgt_set.nsip;
 	set_sum_pair(tgt);
 
-	adj_trigger_cnt(rpzs, rpz_num, rpz_type, &tgt_ip, tgt_prefix, ISC_FALSE);
+	adj_trigger_cnt(rpzs, rpz_num, rpz_type, tgt_ip, tgt_prefix, ISC_FALSE);
 
 	/*
 	 * We might need to delete 2 nodes.
@@ -2004,26 +2737,44 @@ del_cidr(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num,
 	} while (tgt != NULL);
 }
 
+/*
+ * Remove an IP address from the radix tree.
+ */
 static void
-del_name(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num,
+del_cidr(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num,
 	 dns_rpz_type_t rpz_type, dns_name_t *src_name)
 {
-	char namebuf[DNS_NAME_FORMATSIZE];
-	dns_fixedname_t trig_namef;
-	dns_name_t *trig_name;
-	dns_rbtnode_t *nmnode;
-	dns_rpz_nm_data_t *nm_data, del_data;
 	isc_result_t result;
+	dns_rpz_cidr_key_t tgt_ip;
+	dns_rpz_prefix_t tgt_prefix;
+	dns_rpz_addr_zbits_t tgt_set;
 
 	/*
-	 * We need a summary database of names even with 1 policy zone,
-	 * because wildcard triggers are handled differently.
+	 * Do not worry about invalid rpz IP address names.  If we
+	 * are here, then something relevant was added and so was
+	 * valid.  Invalid names here are usually internal RBTDB nodes.
 	 */
+	result = name2ipkey(DNS_RPZ_DEBUG_QUIET, rpzs, rpz_num, rpz_type,
+			    src_name, &tgt_ip, &tgt_prefix, &tgt_set);
+	if (result != ISC_R_SUCCESS)
+		return;
 
-	dns_fixedname_init(&trig_namef);
-	trig_name = dns_fixedname_name(&trig_namef);
-	name2data(rpzs, rpz_num, rpz_type, src_name, trig_name, &del_data);
+	del_ip(rpzs, rpz_num, rpz_type, &tgt_ip, tgt_prefix, &tgt_set);
+}
+
+/*
+ * Remove the bits in 'tgt_data' from a name in the summary database.
+ */
+static void
+del_nm(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num, dns_rpz_type_t rpz_type,
+       dns_name_t *trig_name, const dns_rpz_nm_data_t *tgt_data)
+{
+	char namebuf[DNS_NAME_FORMATSIZE];
+	dns_rbtnode_t *nmnode;
+	dns_rpz_nm_data_t *nm_data, del_data;
+	isc_result_t result;
 
+	del_data = *tgt_data;
 	nmnode = NULL;
 	result = dns_rbt_findnode(rpzs->rbt, trig_name, NULL, &nmnode, NULL, 0,
 				  NULL, NULL);
@@ -2037,7 +2788,7 @@ del_name(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num,
 		if (result == ISC_R_NOTFOUND ||
 		    result == DNS_R_PARTIALMATCH)
 			return;
-		dns_name_format(src_name, namebuf, sizeof(namebuf));
+		dns_name_format(trig_name, namebuf, sizeof(namebuf));
 		isc_log_write(dns_lctx, DNS_LOGCATEGORY_RPZ,
 			      DNS_LOGMODULE_RBTDB, DNS_RPZ_ERROR_LEVEL,
 			      "rpz del_name(%s) node search failed: %s",
@@ -2069,7 +2820,7 @@ del_name(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num,
 			/*
 			 * bin/tests/system/rpz/tests.sh looks for "rpz.*failed".
 			 */
-			dns_name_format(src_name, namebuf, sizeof(namebuf));
+			dns_name_format(trig_name, namebuf, sizeof(namebuf));
 			isc_log_write(dns_lctx, DNS_LOGCATEGORY_RPZ,
 				      DNS_LOGMODULE_RBTDB, DNS_RPZ_ERROR_LEVEL,
 				      "rpz del_name(%s) node delete failed: %s",
@@ -2080,6 +2831,26 @@ del_name(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num,
 	adj_trigger_cnt(rpzs, rpz_num, rpz_type, NULL, 0, ISC_FALSE);
 }
 
+static void
+del_name(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num,
+	 dns_rpz_type_t rpz_type, dns_name_t *src_name)
+{
+	dns_fixedname_t trig_namef;
+	dns_name_t *trig_name;
+	dns_rpz_nm_data_t del_data;
+
+	/*
+	 * We need a summary database of names even with 1 policy zone,
+	 * because wildcard triggers are handled differently.
+	 */
+
+	dns_fixedname_init(&trig_namef);
+	trig_name = dns_fixedname_name(&trig_namef);
+	name2data(rpzs, rpz_num, rpz_type, src_name, trig_name, &del_data);
+
+	del_nm(rpzs, rpz_num, rpz_type, trig_name, &del_data);
+}
+
 /*
  * Remove an IP address from the radix tree or a name from the summary database.
  */
@@ -2198,6 +2969,10 @@ dns_rpz_find_ip(dns_rpz_zones_t *rpzs, dns_rpz_type_t rpz_type,
 	make_addr_set(&tgt_set, zbits, rpz_type);
 
 	RWLOCK(&rpzs->search_lock, isc_rwlocktype_read);
+	if (!filter_ip(rpzs->filter, rpz_type, &tgt_ip)) {
+		RWUNLOCK(&rpzs->search_lock, isc_rwlocktype_read);
+		return (DNS_RPZ_INVALID_NUM);
+	}
 	result = search(rpzs, &tgt_ip, 128, &tgt_set, ISC_FALSE, &found);
 	if (result == ISC_R_NOTFOUND) {
 		/*
@@ -2262,6 +3037,11 @@ dns_rpz_find_name(dns_rpz_zones_t *rpzs, dns_rpz_type_t rpz_type,
 
 	RWLOCK(&rpzs->search_lock, isc_rwlocktype_read);
 
+	if (!filter_name(rpzs->filter, rpz_type, trig_name)) {
+		RWUNLOCK(&rpzs->search_lock, isc_rwlocktype_read);
+		return (0);
+	}
+
 	nmnode = NULL;
 	result = dns_rbt_findnode(rpzs->rbt, trig_name, NULL, &nmnode, NULL,
 				  DNS_RBTFIND_EMPTYDATA, NULL, NULL);
@@ -2308,6 +3088,73 @@ dns_rpz_find_name(dns_rpz_zones_t *rpzs, dns_rpz_type_t rpz_type,
 	return (zbits & found_zbits);
 }
 
+/*
+ * Has a check of the name servers of nsname against at least the
+ * nsdname_zbits and nsip_zbits policy zones recently missed?
+ */
+isc_boolean_t
+dns_rpz_nsmemo_find(dns_rpz_zones_t *rpzs, unsigned int trig_gen,
+		    dns_name_t *nsname, dns_rpz_zbits_t nsdname_zbits,
+		    dns_rpz_zbits_t nsip_zbits, isc_stdtime_t now)
+{
+	nsmemo_entry_t *entry;
+	unsigned int bucket;
+	isc_boolean_t found;
+
+	REQUIRE(rpzs != NULL && rpzs->nsmemo != NULL);
+
+	bucket = nsmemo_bucket(nsname);
+	entry = &rpzs->nsmemo->entries[bucket];
+	LOCK(&rpzs->nsmemo->locks[bucket % NSMEMO_LOCKS]);
+	found = ISC_TF(entry->expire > now &&
+		       entry->trig_gen == trig_gen &&
+		       (nsdname_zbits & ~entry->nsdname) == 0 &&
+		       (nsip_zbits & ~entry->nsip) == 0 &&
+		       dns_name_equal(&entry->name, nsname));
+	UNLOCK(&rpzs->nsmemo->locks[bucket % NSMEMO_LOCKS]);
+	return (found);
+}
+
+/*
+ * Remember that the name servers of nsname missed the nsdname_zbits
+ * and nsip_zbits policy zones.
+ */
+void
+dns_rpz_nsmemo_add(dns_rpz_zones_t *rpzs, unsigned int trig_gen,
+		   dns_name_t *nsname, dns_rpz_zbits_t nsdname_zbits,
+		   dns_rpz_zbits_t nsip_zbits, dns_ttl_t ttl, isc_stdtime_t now)
+{
+	nsmemo_entry_t *entry;
+	unsigned int bucket;
+
+	REQUIRE(rpzs != NULL && rpzs->nsmemo != NULL);
+
+	if (ttl > NSMEMO_MAX_TTL)
+		ttl = NSMEMO_MAX_TTL;
+	if (ttl == 0)
+		return;
+
+	bucket = nsmemo_bucket(nsname);
+	entry = &rpzs->nsmemo->entries[bucket];
+	LOCK(&rpzs->nsmemo->locks[bucket % NSMEMO_LOCKS]);
+	if (dns_name_dynamic(&entry->name) &&
+	    !dns_name_equal(&entry->name, nsname)) {
+		dns_name_free(&entry->name, rpzs->mctx);
+		dns_name_init(&entry->name, NULL);
+	}
+	if (!dns_name_dynamic(&entry->name) &&
+	    dns_name_dup(nsname, rpzs->mctx, &entry->name) != ISC_R_SUCCESS)
+	{
+		entry->expire = 0;
+	} else {
+		entry->trig_gen = trig_gen;
+		entry->nsdname = nsdname_zbits;
+		entry->nsip = nsip_zbits;
+		entry->expire = now + ttl;
+	}
+	UNLOCK(&rpzs->nsmemo->locks[bucket % NSMEMO_LOCKS]);
+}
+
 /*
  * Translate CNAME rdata to a QNAME response policy action.
  */
@@ -1298,7 +1298,10 @@ static dns_dbmethods_t sdb_methods = {
 	findnodeext,
 	findext,
 	NULL,			/* setcachestats */
-	NULL			/* hashsize */
+	NULL,			/* hashsize */
+	NULL,			/* setpopularity */
+	NULL,			/* setservestalettl */
+	NULL			/* setservestalesize */
 };
 
 static isc_result_t
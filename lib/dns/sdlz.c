@@ -1332,7 +1332,10 @@ static dns_dbmethods_t sdlzdb_methods = {
 	findnodeext,
 	findext,
 	NULL,			/* setcachestats */
-	NULL			/* hashsize */
+	NULL,			/* hashsize */
+	NULL,			/* setpopularity */
+	NULL,			/* setservestalettl */
+	NULL			/* setservestalesize */
 };
 
 /*
@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2015  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <isc/buffer.h>
+#include <isc/magic.h>
+#include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/mutexblock.h>
+#include <isc/refcount.h>
+#include <isc/serial.h>
+#include <isc/sha2.h>
+#include <isc/string.h>
+#include <isc/util.h>
+
+#include <dns/fixedname.h>
+#include <dns/name.h>
+#include <dns/rdata.h>
+#include <dns/rdataset.h>
+#include <dns/sigcache.h>
+
+#include <dst/dst.h>
+
+#define SIGCACHE_MAGIC			ISC_MAGIC('S', 'i', 'g', 'C')
+#define VALID_SIGCACHE(c)		ISC_MAGIC_VALID(c, SIGCACHE_MAGIC)
+
+/*%
+ * Slots are protected by a small block of locks; slot 'i' uses lock
+ * 'i % SIGCACHE_NLOCKS'.
+ */
+#define SIGCACHE_NLOCKS			16
+
+typedef struct sigentry {
+	unsigned char		digest[DNS_SIGCACHE_KEYLENGTH];
+	isc_stdtime_t		expire;
+	isc_boolean_t		used;
+} sigentry_t;
+
+struct dns_sigcache {
+	/* Unlocked. */
+	unsigned int		magic;
+	isc_mem_t		*mctx;
+	isc_refcount_t		references;
+	unsigned int		size;		/* power of 2 */
+	isc_mutex_t		locks[SIGCACHE_NLOCKS];
+
+	/* Locked by locks[]. */
+	sigentry_t		*entries;
+};
+
+isc_result_t
+dns_sigcache_create(isc_mem_t *mctx, unsigned int size,
+		    dns_sigcache_t **cachep)
+{
+	dns_sigcache_t *cache;
+	isc_result_t result;
+
+	REQUIRE(mctx != NULL);
+	REQUIRE(size > 0);
+	REQUIRE(cachep != NULL && *cachep == NULL);
+
+	cache = isc_mem_get(mctx, sizeof(*cache));
+	if (cache == NULL)
+		return (ISC_R_NOMEMORY);
+
+	cache->size = SIGCACHE_NLOCKS;
+	while (cache->size < size && cache->size < (1U << 24))
+		cache->size <<= 1;
+
+	cache->entries = isc_mem_get(mctx, cache->size * sizeof(sigentry_t));
+	if (cache->entries == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto cleanup_cache;
+	}
+	memset(cache->entries, 0, cache->size * sizeof(sigentry_t));
+
+	result = isc_mutexblock_init(cache->locks, SIGCACHE_NLOCKS);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_entries;
+
+	result = isc_refcount_init(&cache->references, 1);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_locks;
+
+	cache->mctx = NULL;
+	isc_mem_attach(mctx, &cache->mctx);
+	cache->magic = SIGCACHE_MAGIC;
+
+	*cachep = cache;
+	return (ISC_R_SUCCESS);
+
+ cleanup_locks:
+	DESTROYMUTEXBLOCK(cache->locks, SIGCACHE_NLOCKS);
+ cleanup_entries:
+	isc_mem_put(mctx, cache->entries, cache->size * sizeof(sigentry_t));
+ cleanup_cache:
+	isc_mem_put(mctx, cache, sizeof(*cache));
+	return (result);
+}
+
+void
+dns_sigcache_attach(dns_sigcache_t *source, dns_sigcache_t **targetp) {
+	REQUIRE(VALID_SIGCACHE(source));
+	REQUIRE(targetp != NULL && *targetp == NULL);
+
+	isc_refcount_increment(&source->references, NULL);
+	*targetp = source;
+}
+
+void
+dns_sigcache_detach(dns_sigcache_t **cachep) {
+	dns_sigcache_t *cache;
+	unsigned int refs;
+
+	REQUIRE(cachep != NULL);
+	cache = *cachep;
+	*cachep = NULL;
+	REQUIRE(VALID_SIGCACHE(cache));
+
+	isc_refcount_decrement(&cache->references, &refs);
+	if (refs > 0)
+		return;
+
+	cache->magic = 0;
+	isc_refcount_destroy(&cache->references);
+	DESTROYMUTEXBLOCK(cache->locks, SIGCACHE_NLOCKS);
+	isc_mem_put(cache->mctx, cache->entries,
+		    cache->size * sizeof(sigentry_t));
+	isc_mem_putanddetach(&cache->mctx, cache, sizeof(*cache));
+}
+
+static void
+hash_region(isc_sha256_t *ctx, const unsigned char *base,
+	    unsigned int length)
+{
+	unsigned char len[2];
+
+	len[0] = (length >> 8) & 0xff;
+	len[1] = length & 0xff;
+	isc_sha256_update(ctx, len, sizeof(len));
+	isc_sha256_update(ctx, base, length);
+}
+
+isc_result_t
+dns_sigcache_key(dns_name_t *name, dns_rdataset_t *rdataset, dst_key_t *key,
+		 dns_rdata_t *sigrdata, unsigned int maxbits,
+		 unsigned char digest[DNS_SIGCACHE_KEYLENGTH])
+{
+	unsigned char keydata[DST_KEY_MAXSIZE];
+	unsigned char misc[10];
+	dns_fixedname_t fixed;
+	dns_name_t *owner;
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	isc_buffer_t b;
+	isc_region_t r;
+	isc_sha256_t ctx;
+	isc_result_t result;
+
+	REQUIRE(dns_rdataset_isassociated(rdataset));
+	REQUIRE(key != NULL);
+	REQUIRE(sigrdata != NULL && sigrdata->type == dns_rdatatype_rrsig);
+
+	isc_buffer_init(&b, keydata, sizeof(keydata));
+	result = dst_key_todns(key, &b);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	dns_fixedname_init(&fixed);
+	owner = dns_fixedname_name(&fixed);
+	result = dns_name_downcase(name, owner, NULL);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	misc[0] = (rdataset->rdclass >> 8) & 0xff;
+	misc[1] = rdataset->rdclass & 0xff;
+	misc[2] = (rdataset->type >> 8) & 0xff;
+	misc[3] = rdataset->type & 0xff;
+	misc[4] = (rdataset->covers >> 8) & 0xff;
+	misc[5] = rdataset->covers & 0xff;
+	misc[6] = (maxbits >> 24) & 0xff;
+	misc[7] = (maxbits >> 16) & 0xff;
+	misc[8] = (maxbits >> 8) & 0xff;
+	misc[9] = maxbits & 0xff;
+
+	isc_sha256_init(&ctx);
+	isc_sha256_update(&ctx, misc, sizeof(misc));
+	dns_name_toregion(owner, &r);
+	hash_region(&ctx, r.base, r.length);
+	isc_buffer_usedregion(&b, &r);
+	hash_region(&ctx, r.base, r.length);
+	hash_region(&ctx, sigrdata->data, sigrdata->length);
+	for (result = dns_rdataset_first(rdataset);
+	     result == ISC_R_SUCCESS;
+	     result = dns_rdataset_next(rdataset))
+	{
+		dns_rdata_reset(&rdata);
+		dns_rdataset_current(rdataset, &rdata);
+		hash_region(&ctx, rdata.data, rdata.length);
+	}
+	isc_sha256_final(digest, &ctx);
+
+	if (result == ISC_R_NOMORE)
+		result = ISC_R_SUCCESS;
+	return (result);
+}
+
+static inline unsigned int
+slot_index(dns_sigcache_t *cache,
+	   const unsigned char digest[DNS_SIGCACHE_KEYLENGTH])
+{
+	isc_uint32_t h;
+
+	h = (digest[0] << 24) | (digest[1] << 16) | (digest[2] << 8) |
+	    digest[3];
+	return (h & (cache->size - 1));
+}
+
+isc_boolean_t
+dns_sigcache_lookup(dns_sigcache_t *cache,
+		    const unsigned char digest[DNS_SIGCACHE_KEYLENGTH],
+		    isc_stdtime_t now)
+{
+	sigentry_t *entry;
+	unsigned int i;
+	isc_boolean_t found = ISC_FALSE;
+
+	REQUIRE(VALID_SIGCACHE(cache));
+
+	i = slot_index(cache, digest);
+	entry = &cache->entries[i];
+
+	LOCK(&cache->locks[i % SIGCACHE_NLOCKS]);
+	if (entry->used &&
+	    memcmp(entry->digest, digest, DNS_SIGCACHE_KEYLENGTH) == 0)
+	{
+		if (isc_serial_le(now, entry->expire))
+			found = ISC_TRUE;
+		else
+			entry->used = ISC_FALSE;
+	}
+	UNLOCK(&cache->locks[i % SIGCACHE_NLOCKS]);
+
+	return (found);
+}
+
+void
+dns_sigcache_add(dns_sigcache_t *cache,
+		 const unsigned char digest[DNS_SIGCACHE_KEYLENGTH],
+		 isc_stdtime_t expire)
+{
+	sigentry_t *entry;
+	unsigned int i;
+
+	REQUIRE(VALID_SIGCACHE(cache));
+
+	i = slot_index(cache, digest);
+	entry = &cache->entries[i];
+
+	LOCK(&cache->locks[i % SIGCACHE_NLOCKS]);
+	memmove(entry->digest, digest, DNS_SIGCACHE_KEYLENGTH);
+	entry->expire = expire;
+	entry->used = ISC_TRUE;
+	UNLOCK(&cache->locks[i % SIGCACHE_NLOCKS]);
+}
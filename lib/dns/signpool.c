@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2015  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <isc/buffer.h>
+#include <isc/condition.h>
+#include <isc/magic.h>
+#include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/platform.h>
+#include <isc/refcount.h>
+#include <isc/thread.h>
+#include <isc/util.h>
+
+#include <dns/dnssec.h>
+#include <dns/signpool.h>
+
+#define SIGNPOOL_MAGIC			ISC_MAGIC('S', 'g', 'n', 'P')
+#define VALID_SIGNPOOL(p)		ISC_MAGIC_VALID(p, SIGNPOOL_MAGIC)
+
+typedef struct batch batch_t;
+
+struct batch {
+	dns_signjob_t		**jobs;
+	unsigned int		njobs;
+	unsigned int		next;		/* next job to hand out */
+	unsigned int		done;		/* jobs finished */
+	ISC_LINK(batch_t)	link;
+};
+
+struct dns_signpool {
+	/* Unlocked. */
+	unsigned int		magic;
+	isc_mem_t		*mctx;
+	isc_refcount_t		references;
+	unsigned int		nthreads;
+#ifdef ISC_PLATFORM_USETHREADS
+	isc_thread_t		*threads;
+	isc_mutex_t		lock;
+	isc_condition_t		work;		/* a batch was queued */
+	isc_condition_t		done;		/* a batch was finished */
+
+	/* Locked by lock. */
+	ISC_LIST(batch_t)	batches;	/* with jobs to hand out */
+	isc_boolean_t		exiting;
+#endif
+};
+
+static void
+run(dns_signpool_t *pool, dns_signjob_t *job) {
+	isc_buffer_t buffer;
+
+	isc_buffer_init(&buffer, job->data, sizeof(job->data));
+	dns_rdata_init(&job->rdata);
+	job->result = dns_dnssec_sign(dns_fixedname_name(&job->name),
+				      &job->rdataset, job->key,
+				      &job->inception, &job->expire,
+				      pool->mctx, &buffer, &job->rdata);
+}
+
+#ifdef ISC_PLATFORM_USETHREADS
+/*
+ * Hand out the next job of 'batch'.  Requires pool->lock.
+ */
+static dns_signjob_t *
+take(dns_signpool_t *pool, batch_t *batch) {
+	dns_signjob_t *job;
+
+	INSIST(batch->next < batch->njobs);
+	job = batch->jobs[batch->next++];
+	if (batch->next == batch->njobs)
+		ISC_LIST_UNLINK(pool->batches, batch, link);
+	return (job);
+}
+
+/*
+ * Record that a job of 'batch' is done.  Requires pool->lock.
+ */
+static void
+finish(dns_signpool_t *pool, batch_t *batch) {
+	if (++batch->done == batch->njobs)
+		BROADCAST(&pool->done);
+}
+
+static isc_threadresult_t
+#ifdef _WIN32
+WINAPI
+#endif
+worker(isc_threadarg_t arg) {
+	dns_signpool_t *pool = arg;
+	batch_t *batch;
+	dns_signjob_t *job;
+
+	LOCK(&pool->lock);
+	while (!pool->exiting) {
+		batch = ISC_LIST_HEAD(pool->batches);
+		if (batch == NULL) {
+			WAIT(&pool->work, &pool->lock);
+			continue;
+		}
+		job = take(pool, batch);
+		UNLOCK(&pool->lock);
+		run(pool, job);
+		LOCK(&pool->lock);
+		finish(pool, batch);
+	}
+	UNLOCK(&pool->lock);
+
+	return ((isc_threadresult_t)0);
+}
+
+/*
+ * Stop and join the pool's threads.
+ */
+static void
+stop(dns_signpool_t *pool) {
+	unsigned int i;
+
+	LOCK(&pool->lock);
+	pool->exiting = ISC_TRUE;
+	BROADCAST(&pool->work);
+	UNLOCK(&pool->lock);
+
+	for (i = 0; i < pool->nthreads; i++)
+		(void)isc_thread_join(pool->threads[i], NULL);
+	pool->nthreads = 0;
+}
+#endif /* ISC_PLATFORM_USETHREADS */
+
+isc_result_t
+dns_signpool_create(isc_mem_t *mctx, unsigned int nthreads,
+		    dns_signpool_t **poolp)
+{
+	dns_signpool_t *pool;
+	isc_result_t result;
+
+	REQUIRE(mctx != NULL);
+	REQUIRE(poolp != NULL && *poolp == NULL);
+
+	pool = isc_mem_get(mctx, sizeof(*pool));
+	if (pool == NULL)
+		return (ISC_R_NOMEMORY);
+	pool->mctx = NULL;
+	isc_mem_attach(mctx, &pool->mctx);
+	pool->nthreads = 0;
+
+	result = isc_refcount_init(&pool->references, 1);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_pool;
+
+#ifdef ISC_PLATFORM_USETHREADS
+	ISC_LIST_INIT(pool->batches);
+	pool->exiting = ISC_FALSE;
+	pool->threads = NULL;
+
+	result = isc_mutex_init(&pool->lock);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_refcount;
+	result = isc_condition_init(&pool->work);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_lock;
+	result = isc_condition_init(&pool->done);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_work;
+
+	if (nthreads > 0) {
+		pool->threads = isc_mem_get(mctx,
+					    nthreads * sizeof(isc_thread_t));
+		if (pool->threads == NULL) {
+			result = ISC_R_NOMEMORY;
+			goto cleanup_done;
+		}
+	}
+	while (pool->nthreads < nthreads) {
+		result = isc_thread_create(worker, pool,
+					   &pool->threads[pool->nthreads]);
+		if (result != ISC_R_SUCCESS)
+			goto cleanup_threads;
+		pool->nthreads++;
+	}
+#else
+	UNUSED(nthreads);
+#endif
+
+	pool->magic = SIGNPOOL_MAGIC;
+	*poolp = pool;
+	return (ISC_R_SUCCESS);
+
+#ifdef ISC_PLATFORM_USETHREADS
+ cleanup_threads:
+	stop(pool);
+	isc_mem_put(mctx, pool->threads, nthreads * sizeof(isc_thread_t));
+ cleanup_done:
+	(void)isc_condition_destroy(&pool->done);
+ cleanup_work:
+	(void)isc_condition_destroy(&pool->work);
+ cleanup_lock:
+	DESTROYLOCK(&pool->lock);
+ cleanup_refcount:
+	isc_refcount_destroy(&pool->references);
+#endif
+ cleanup_pool:
+	isc_mem_putanddetach(&pool->mctx, pool, sizeof(*pool));
+	return (result);
+}
+
+void
+dns_signpool_attach(dns_signpool_t *source, dns_signpool_t **targetp) {
+	REQUIRE(VALID_SIGNPOOL(source));
+	REQUIRE(targetp != NULL && *targetp == NULL);
+
+	isc_refcount_increment(&source->references, NULL);
+	*targetp = source;
+}
+
+void
+dns_signpool_detach(dns_signpool_t **poolp) {
+	dns_signpool_t *pool;
+	unsigned int refs;
+#ifdef ISC_PLATFORM_USETHREADS
+	unsigned int nthreads;
+#endif
+
+	REQUIRE(poolp != NULL);
+	pool = *poolp;
+	*poolp = NULL;
+	REQUIRE(VALID_SIGNPOOL(pool));
+
+	isc_refcount_decrement(&pool->references, &refs);
+	if (refs > 0)
+		return;
+
+	pool->magic = 0;
+#ifdef ISC_PLATFORM_USETHREADS
+	nthreads = pool->nthreads;
+	stop(pool);
+	INSIST(ISC_LIST_EMPTY(pool->batches));
+	if (pool->threads != NULL)
+		isc_mem_put(pool->mctx, pool->threads,
+			    nthreads * sizeof(isc_thread_t));
+	(void)isc_condition_destroy(&pool->done);
+	(void)isc_condition_destroy(&pool->work);
+	DESTROYLOCK(&pool->lock);
+#endif
+	isc_refcount_destroy(&pool->references);
+	isc_mem_putanddetach(&pool->mctx, pool, sizeof(*pool));
+}
+
+void
+dns_signpool_sign(dns_signpool_t *pool, dns_signjob_t **jobs,
+		  unsigned int njobs)
+{
+	unsigned int i;
+#ifdef ISC_PLATFORM_USETHREADS
+	batch_t batch;
+	dns_signjob_t *job;
+#endif
+
+	REQUIRE(VALID_SIGNPOOL(pool));
+	REQUIRE(jobs != NULL || njobs == 0);
+
+#ifdef ISC_PLATFORM_USETHREADS
+	if (pool->nthreads > 0 && njobs > 1) {
+		batch.jobs = jobs;
+		batch.njobs = njobs;
+		batch.next = 0;
+		batch.done = 0;
+		ISC_LINK_INIT(&batch, link);
+
+		/*
+		 * Queue the batch for the pool's threads, and work on it
+		 * ourselves until every job has been handed out.
+		 */
+		LOCK(&pool->lock);
+		ISC_LIST_APPEND(pool->batches, &batch, link);
+		BROADCAST(&pool->work);
+		while (batch.next < batch.njobs) {
+			job = take(pool, &batch);
+			UNLOCK(&pool->lock);
+			run(pool, job);
+			LOCK(&pool->lock);
+			finish(pool, &batch);
+		}
+		while (batch.done < batch.njobs)
+			WAIT(&pool->done, &pool->lock);
+		UNLOCK(&pool->lock);
+		return;
+	}
+#endif
+
+	for (i = 0; i < njobs; i++)
+		run(pool, jobs[i]);
+}
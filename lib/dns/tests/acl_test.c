@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) 2015  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <unistd.h>
+
+#include <isc/netaddr.h>
+#include <isc/random.h>
+#include <isc/string.h>
+
+#include <dns/acl.h>
+#include <dns/iptable.h>
+
+#include "dnstest.h"
+
+/*
+ * Helper functions
+ */
+
+static void
+addprefix(dns_acl_t *acl, const char *text, unsigned int bitlen,
+	  isc_boolean_t pos, isc_boolean_t ecs)
+{
+	isc_netaddr_t addr;
+	struct in_addr in4;
+	struct in6_addr in6;
+	isc_result_t result;
+
+	if (inet_pton(AF_INET6, text, &in6) == 1)
+		isc_netaddr_fromin6(&addr, &in6);
+	else {
+		ATF_REQUIRE(inet_pton(AF_INET, text, &in4) == 1);
+		isc_netaddr_fromin(&addr, &in4);
+	}
+	result = dns_iptable_addprefix2(acl->iptable, &addr, bitlen, pos, ecs);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+}
+
+/*
+ * Fill 'acl' with a mix of overlapping positive and negative prefixes,
+ * some of them client subnet prefixes.
+ */
+static void
+fillacl(dns_acl_t *acl) {
+	addprefix(acl, "10.53.0.1", 32, ISC_FALSE, ISC_FALSE);
+	addprefix(acl, "10.53.0.0", 24, ISC_TRUE, ISC_FALSE);
+	addprefix(acl, "10.0.0.0", 8, ISC_FALSE, ISC_FALSE);
+	addprefix(acl, "10.53.0.128", 25, ISC_FALSE, ISC_TRUE);
+	addprefix(acl, "192.168.0.0", 16, ISC_TRUE, ISC_TRUE);
+	addprefix(acl, "192.168.3.0", 24, ISC_TRUE, ISC_FALSE);
+	addprefix(acl, "fd92:7065:b8e:ffff::", 64, ISC_TRUE, ISC_FALSE);
+	addprefix(acl, "fd92:7065:b8e::", 48, ISC_FALSE, ISC_FALSE);
+	addprefix(acl, "fd92:7065:b8e:ff00::", 56, ISC_TRUE, ISC_TRUE);
+	addprefix(acl, "2001:db8::1", 128, ISC_TRUE, ISC_FALSE);
+}
+
+/*
+ * Append to 'acl' an element of type 'type', which refers to 'inner'
+ * if it is a nested ACL.
+ */
+static void
+addelement(dns_acl_t *acl, dns_aclelementtype_t type, dns_acl_t *inner,
+	   isc_boolean_t negative)
+{
+	dns_aclelement_t *e;
+
+	ATF_REQUIRE(acl->length < acl->alloc);
+	e = &acl->elements[acl->length];
+	memset(e, 0, sizeof(*e));
+	e->type = type;
+	e->negative = negative;
+	if (inner != NULL)
+		dns_acl_attach(inner, &e->nestedacl);
+	acl->node_count++;
+	e->node_num = acl->node_count;
+	acl->length++;
+}
+
+/*
+ * Return a random address near to the prefixes used by fillacl().
+ */
+static void
+randomaddr(isc_netaddr_t *addr) {
+	static const char *bases[] = {
+		"10.53.0.0", "10.0.0.0", "192.168.0.0", "192.168.3.0",
+		"fd92:7065:b8e::", "fd92:7065:b8e:ffff::", "2001:db8::"
+	};
+	struct in_addr in4;
+	struct in6_addr in6;
+	isc_uint32_t r;
+	const char *base;
+
+	isc_random_get(&r);
+	base = bases[r % (sizeof(bases) / sizeof(bases[0]))];
+	isc_random_get(&r);
+	if (inet_pton(AF_INET, base, &in4) == 1) {
+		unsigned char *p = (unsigned char *)&in4;
+		p[2] ^= (r >> 8) & 0x03;
+		p[3] = r & 0xff;
+		isc_netaddr_fromin(addr, &in4);
+	} else {
+		ATF_REQUIRE(inet_pton(AF_INET6, base, &in6) == 1);
+		in6.s6_addr[7] ^= (r >> 16) & 0x01;
+		in6.s6_addr[15] = r & 0x03;
+		isc_netaddr_fromin6(addr, &in6);
+	}
+}
+
+/*
+ * Individual unit tests
+ */
+
+ATF_TC(compiled);
+ATF_TC_HEAD(compiled, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "a compiled ACL matches like the radix tree");
+}
+ATF_TC_BODY(compiled, tc) {
+	isc_result_t result;
+	dns_acl_t *plain = NULL, *compiled = NULL;
+	isc_netaddr_t addr, ecs;
+	isc_uint8_t scope1, scope2;
+	isc_uint32_t r;
+	int match1, match2;
+	int i;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_acl_create(mctx, 0, &plain);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_acl_create(mctx, 0, &compiled);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	fillacl(plain);
+	fillacl(compiled);
+	result = dns_acl_compile(compiled);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < 5000; i++) {
+		randomaddr(&addr);
+		randomaddr(&ecs);
+		isc_random_get(&r);
+		r %= (ecs.family == AF_INET6) ? 129 : 33;
+
+		match1 = match2 = 0;
+		result = dns_acl_match(&addr, NULL, plain, NULL,
+				       &match1, NULL);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		result = dns_acl_match(&addr, NULL, compiled, NULL,
+				       &match2, NULL);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		ATF_CHECK_EQ(match1, match2);
+
+		scope1 = scope2 = 0xff;
+		result = dns_acl_match2(&addr, NULL, &ecs, r, &scope1,
+					plain, NULL, &match1, NULL);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		result = dns_acl_match2(&addr, NULL, &ecs, r, &scope2,
+					compiled, NULL, &match2, NULL);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		ATF_CHECK_EQ(match1, match2);
+		ATF_CHECK_EQ(scope1, scope2);
+	}
+
+	dns_acl_detach(&plain);
+	dns_acl_detach(&compiled);
+	dns_test_end();
+}
+
+ATF_TC(stale);
+ATF_TC_HEAD(stale, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "changes after compiling an ACL are not missed");
+}
+ATF_TC_BODY(stale, tc) {
+	isc_result_t result;
+	dns_acl_t *acl = NULL;
+	isc_netaddr_t addr;
+	struct in_addr in4;
+	int match;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_acl_create(mctx, 0, &acl);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	fillacl(acl);
+	result = dns_acl_compile(acl);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	ATF_REQUIRE(inet_pton(AF_INET, "172.16.1.1", &in4) == 1);
+	isc_netaddr_fromin(&addr, &in4);
+	result = dns_acl_match(&addr, NULL, acl, NULL, &match, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK_EQ(match, 0);
+
+	addprefix(acl, "172.16.0.0", 12, ISC_TRUE, ISC_FALSE);
+	result = dns_acl_match(&addr, NULL, acl, NULL, &match, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK(match > 0);
+
+	/* Compiling again picks up the change. */
+	result = dns_acl_compile(acl);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_acl_match(&addr, NULL, acl, NULL, &match, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK(match > 0);
+
+	dns_acl_detach(&acl);
+	dns_test_end();
+}
+
+ATF_TC(prefix);
+ATF_TC_HEAD(prefix, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "matching address prefixes against nested ACLs");
+}
+ATF_TC_BODY(prefix, tc) {
+	isc_result_t result;
+	dns_acl_t *acl = NULL, *inner = NULL;
+	isc_netaddr_t addr;
+	struct in_addr in4;
+	int match1, match2;
+	int i;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_acl_create(mctx, 0, &inner);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	addprefix(inner, "2001:db8::2", 127, ISC_TRUE, ISC_FALSE);
+	addprefix(inner, "10.0.0.0", 8, ISC_TRUE, ISC_FALSE);
+
+	result = dns_acl_create(mctx, 2, &acl);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	fillacl(acl);
+	addelement(acl, dns_aclelementtype_nestedacl, inner, ISC_FALSE);
+	addprefix(acl, "172.16.0.0", 12, ISC_TRUE, ISC_FALSE);
+	ATF_CHECK(dns_acl_isaddressonly(acl));
+
+	/* At full length, a prefix is an address. */
+	for (i = 0; i < 5000; i++) {
+		randomaddr(&addr);
+		result = dns_acl_match(&addr, NULL, acl, NULL, &match1, NULL);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		result = dns_acl_matchprefix(&addr,
+					     (addr.family == AF_INET6) ?
+					      128 : 32, acl, &match2);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		ATF_CHECK_EQ(match1, match2);
+	}
+
+	/* 10.53.0.0/24 itself is allowed; the rest of 10/8 is not. */
+	ATF_REQUIRE(inet_pton(AF_INET, "10.53.0.0", &in4) == 1);
+	isc_netaddr_fromin(&addr, &in4);
+	result = dns_acl_matchprefix(&addr, 24, acl, &match1);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK(match1 > 0);
+	result = dns_acl_matchprefix(&addr, 16, acl, &match1);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK(match1 < 0);
+
+	/* A prefix shorter than every prefix in the ACL matches nothing. */
+	ATF_REQUIRE(inet_pton(AF_INET, "172.16.0.0", &in4) == 1);
+	isc_netaddr_fromin(&addr, &in4);
+	result = dns_acl_matchprefix(&addr, 12, acl, &match1);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK(match1 > 0);
+	result = dns_acl_matchprefix(&addr, 8, acl, &match1);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK_EQ(match1, 0);
+
+	addelement(acl, dns_aclelementtype_localhost, NULL, ISC_FALSE);
+	ATF_CHECK(!dns_acl_isaddressonly(acl));
+
+	dns_acl_detach(&inner);
+	dns_acl_detach(&acl);
+	dns_test_end();
+}
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, compiled);
+	ATF_TP_ADD_TC(tp, stale);
+	ATF_TP_ADD_TC(tp, prefix);
+
+	return (atf_no_error());
+}
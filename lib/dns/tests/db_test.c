@@ -25,10 +25,17 @@
 #include <unistd.h>
 #include <stdlib.h>
 
+#include <isc/buffer.h>
+#include <isc/hash.h>
+#include <isc/stdtime.h>
+
 #include <dns/db.h>
 #include <dns/dbiterator.h>
+#include <dns/fixedname.h>
 #include <dns/name.h>
 #include <dns/journal.h>
+#include <dns/rdatalist.h>
+#include <dns/rdataset.h>
 
 #include "dnstest.h"
 
@@ -77,10 +84,239 @@ ATF_TC_BODY(getoriginnode, tc) {
 	isc_mem_detach(&mymctx);
 }
 
+ATF_TC(servestale);
+ATF_TC_HEAD(servestale, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "test finding expired cache data with "
+			  "DNS_DBFIND_STALEOK");
+}
+ATF_TC_BODY(servestale, tc) {
+	dns_db_t *db = NULL;
+	dns_dbnode_t *node = NULL;
+	isc_mem_t *mymctx = NULL;
+	dns_fixedname_t fixed, ffound;
+	dns_name_t *name, *found;
+	dns_rdatalist_t rdatalist;
+	dns_rdataset_t rdataset;
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	unsigned char addr[4] = { 10, 53, 0, 1 };
+	isc_buffer_t b;
+	isc_stdtime_t now;
+	isc_result_t result;
+
+	UNUSED(tc);
+
+	result = isc_mem_create(0, 0, &mymctx);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = isc_hash_create(mymctx, NULL, 256);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_db_create(mymctx, "rbt", dns_rootname, dns_dbtype_cache,
+			       dns_rdataclass_in, 0, NULL, &db);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_db_setservestalettl(db, 60);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	dns_fixedname_init(&fixed);
+	name = dns_fixedname_name(&fixed);
+	isc_buffer_constinit(&b, "www.example.", 12);
+	isc_buffer_add(&b, 12);
+	result = dns_name_fromtext(name, &b, dns_rootname, 0, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	dns_rdata_init(&rdata);
+	rdata.data = addr;
+	rdata.length = sizeof(addr);
+	rdata.rdclass = dns_rdataclass_in;
+	rdata.type = dns_rdatatype_a;
+	dns_rdatalist_init(&rdatalist);
+	rdatalist.rdclass = dns_rdataclass_in;
+	rdatalist.type = dns_rdatatype_a;
+	rdatalist.ttl = 10;
+	ISC_LIST_APPEND(rdatalist.rdata, &rdata, link);
+	dns_rdataset_init(&rdataset);
+	result = dns_rdatalist_tordataset(&rdatalist, &rdataset);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	isc_stdtime_get(&now);
+	result = dns_db_findnode(db, name, ISC_TRUE, &node);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_db_addrdataset(db, node, NULL, now, &rdataset, 0, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	dns_db_detachnode(db, &node);
+	dns_rdataset_disassociate(&rdataset);
+
+	dns_fixedname_init(&ffound);
+	found = dns_fixedname_name(&ffound);
+
+	/* Expired data is not returned unless asked for. */
+	result = dns_db_find(db, name, NULL, dns_rdatatype_a, 0, now + 30,
+			     NULL, found, &rdataset, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_NOTFOUND);
+
+	result = dns_db_find(db, name, NULL, dns_rdatatype_a,
+			     DNS_DBFIND_STALEOK, now + 30, NULL, found,
+			     &rdataset, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK((rdataset.attributes & DNS_RDATASETATTR_STALE) != 0);
+	ATF_CHECK_EQ(rdataset.ttl, 0);
+	dns_rdataset_disassociate(&rdataset);
+
+	/* Fresh data is not flagged as stale. */
+	result = dns_db_find(db, name, NULL, dns_rdatatype_a,
+			     DNS_DBFIND_STALEOK, now + 5, NULL, found,
+			     &rdataset, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK((rdataset.attributes & DNS_RDATASETATTR_STALE) == 0);
+	ATF_CHECK_EQ(rdataset.ttl, 5);
+	dns_rdataset_disassociate(&rdataset);
+
+	/* Nothing is served past the serve-stale window. */
+	result = dns_db_find(db, name, NULL, dns_rdatatype_a,
+			     DNS_DBFIND_STALEOK, now + 100, NULL, found,
+			     &rdataset, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_NOTFOUND);
+
+	dns_db_detach(&db);
+	isc_hash_destroy();
+	isc_mem_detach(&mymctx);
+}
+
+ATF_TC(servestalesize);
+ATF_TC_HEAD(servestalesize, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "test that dns_db_setservestalesize() limits "
+			  "the expired data kept in the cache");
+}
+ATF_TC_BODY(servestalesize, tc) {
+	dns_db_t *db = NULL;
+	dns_dbnode_t *node = NULL;
+	isc_mem_t *mymctx = NULL;
+	dns_fixedname_t fixed, ffound;
+	dns_name_t *name, *found;
+	dns_rdatalist_t rdatalist;
+	dns_rdataset_t rdataset;
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	unsigned char addr[16] = { 0x20, 0x01, 0x0d, 0xb8 };
+	isc_buffer_t b;
+	isc_stdtime_t now;
+	isc_result_t result;
+	size_t sizes[2] = { 1024 * 1024, 1 };
+	unsigned int i;
+
+	UNUSED(tc);
+
+	result = isc_mem_create(0, 0, &mymctx);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = isc_hash_create(mymctx, NULL, 256);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	dns_fixedname_init(&fixed);
+	name = dns_fixedname_name(&fixed);
+	isc_buffer_constinit(&b, "www.example.", 12);
+	isc_buffer_add(&b, 12);
+	result = dns_name_fromtext(name, &b, dns_rootname, 0, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	dns_fixedname_init(&ffound);
+	found = dns_fixedname_name(&ffound);
+
+	isc_stdtime_get(&now);
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		result = dns_db_create(mymctx, "rbt", dns_rootname,
+				       dns_dbtype_cache, dns_rdataclass_in,
+				       0, NULL, &db);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		result = dns_db_setservestalettl(db, 60);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		result = dns_db_setservestalesize(db, sizes[i]);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+		result = dns_db_findnode(db, name, ISC_TRUE, &node);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+		/*
+		 * Add an A rdataset which expires after 10 seconds, then
+		 * an AAAA rdataset to the same node 30 seconds later, so
+		 * that the A rdataset is moved to the stale data by then.
+		 */
+		dns_rdata_init(&rdata);
+		rdata.data = addr;
+		rdata.length = 4;
+		rdata.rdclass = dns_rdataclass_in;
+		rdata.type = dns_rdatatype_a;
+		dns_rdatalist_init(&rdatalist);
+		rdatalist.rdclass = dns_rdataclass_in;
+		rdatalist.type = dns_rdatatype_a;
+		rdatalist.ttl = 10;
+		ISC_LIST_APPEND(rdatalist.rdata, &rdata, link);
+		dns_rdataset_init(&rdataset);
+		result = dns_rdatalist_tordataset(&rdatalist, &rdataset);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		result = dns_db_addrdataset(db, node, NULL, now, &rdataset,
+					    0, NULL);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		dns_rdataset_disassociate(&rdataset);
+
+		dns_rdata_init(&rdata);
+		rdata.data = addr;
+		rdata.length = sizeof(addr);
+		rdata.rdclass = dns_rdataclass_in;
+		rdata.type = dns_rdatatype_aaaa;
+		dns_rdatalist_init(&rdatalist);
+		rdatalist.rdclass = dns_rdataclass_in;
+		rdatalist.type = dns_rdatatype_aaaa;
+		rdatalist.ttl = 300;
+		ISC_LIST_APPEND(rdatalist.rdata, &rdata, link);
+		dns_rdataset_init(&rdataset);
+		result = dns_rdatalist_tordataset(&rdatalist, &rdataset);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		result = dns_db_addrdataset(db, node, NULL, now + 30,
+					    &rdataset, 0, NULL);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		dns_rdataset_disassociate(&rdataset);
+
+		dns_db_detachnode(db, &node);
+
+		/*
+		 * The expired A rdataset is only kept while the stale
+		 * data fits within the limit.
+		 */
+		result = dns_db_find(db, name, NULL, dns_rdatatype_a,
+				     DNS_DBFIND_STALEOK, now + 30, NULL, found,
+				     &rdataset, NULL);
+		if (sizes[i] > 1) {
+			ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+			ATF_CHECK((rdataset.attributes &
+				   DNS_RDATASETATTR_STALE) != 0);
+			dns_rdataset_disassociate(&rdataset);
+		} else
+			ATF_REQUIRE_EQ(result, ISC_R_NOTFOUND);
+
+		/* Live data is never affected by the limit. */
+		result = dns_db_find(db, name, NULL, dns_rdatatype_aaaa,
+				     DNS_DBFIND_STALEOK, now + 30, NULL, found,
+				     &rdataset, NULL);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		ATF_CHECK((rdataset.attributes & DNS_RDATASETATTR_STALE) == 0);
+		dns_rdataset_disassociate(&rdataset);
+
+		dns_db_detach(&db);
+	}
+
+	isc_hash_destroy();
+	isc_mem_detach(&mymctx);
+}
+
 /*
  * Main
  */
 ATF_TP_ADD_TCS(tp) {
 	ATF_TP_ADD_TC(tp, getoriginnode);
+	ATF_TP_ADD_TC(tp, servestale);
+	ATF_TP_ADD_TC(tp, servestalesize);
 	return (atf_no_error());
 }
@@ -161,6 +161,51 @@ ATF_TC_BODY(diffx_remove, tc) {
 	dns_test_end();
 }
 
+ATF_TC(diffx_change);
+ATF_TC_HEAD(diffx_change, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "dns_db_diffx of zone with records changed in place");
+	atf_tc_set_md_var(tc, "X-old", "testdata/diff/zone1.data");
+	atf_tc_set_md_var(tc, "X-new", "testdata/diff/zone4.data");
+}
+ATF_TC_BODY(diffx_change, tc) {
+	dns_db_t *new = NULL, *old = NULL;
+	dns_difftuple_t *tuple;
+	isc_result_t result;
+	dns_diff_t diff;
+	int adds = 0, dels = 0;
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	test_create(tc, &old, &new);
+
+	dns_diff_init(mctx, &diff);
+
+	result = dns_db_diffx(&diff, new, NULL, old, NULL, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/*
+	 * The TTL change at the apex and the new address of "remove"
+	 * each delete the old RR and add the new one.
+	 */
+	for (tuple = ISC_LIST_HEAD(diff.tuples); tuple != NULL;
+	     tuple = ISC_LIST_NEXT(tuple, link)) {
+		ATF_REQUIRE_EQ(tuple->rdata.type, dns_rdatatype_a);
+		if (tuple->op == DNS_DIFFOP_ADD)
+			adds++;
+		else if (tuple->op == DNS_DIFFOP_DEL)
+			dels++;
+	}
+	ATF_REQUIRE_EQ(adds, 2);
+	ATF_REQUIRE_EQ(dels, 2);
+
+	dns_diff_clear(&diff);
+	dns_db_detach(&new);
+	dns_db_detach(&old);
+	dns_test_end();
+}
+
 /*
  * Main
  */
@@ -168,5 +213,6 @@ ATF_TP_ADD_TCS(tp) {
 	ATF_TP_ADD_TC(tp, diffx_same);
 	ATF_TP_ADD_TC(tp, diffx_add);
 	ATF_TP_ADD_TC(tp, diffx_remove);
+	ATF_TP_ADD_TC(tp, diffx_change);
 	return (atf_no_error());
 }
@@ -0,0 +1,378 @@
+/*
+ * Copyright (C) 2015  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <unistd.h>
+
+#include <isc/buffer.h>
+#include <isc/net.h>
+#include <isc/netaddr.h>
+#include <isc/string.h>
+
+#include <dns/db.h>
+#include <dns/ecscache.h>
+#include <dns/fixedname.h>
+#include <dns/name.h>
+#include <dns/rbt.h>
+#include <dns/rdata.h>
+#include <dns/rdatalist.h>
+#include <dns/rdataset.h>
+#include <dns/result.h>
+#include <dns/view.h>
+
+#include "dnstest.h"
+
+/*
+ * Helper functions
+ */
+
+static dns_rdatalist_t rdatalist;
+static dns_rdata_t rdata;
+static unsigned char adata[4];
+
+static void
+makename(const char *text, dns_fixedname_t *fixed) {
+	isc_buffer_t b;
+	isc_result_t result;
+
+	dns_fixedname_init(fixed);
+	isc_buffer_constinit(&b, text, strlen(text));
+	isc_buffer_add(&b, strlen(text));
+	result = dns_name_fromtext(dns_fixedname_name(fixed), &b,
+				   dns_rootname, 0, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+}
+
+static void
+makeaddr(const char *text, isc_netaddr_t *addr) {
+	struct in_addr in4;
+	struct in6_addr in6;
+
+	if (inet_pton(AF_INET, text, &in4) == 1)
+		isc_netaddr_fromin(addr, &in4);
+	else {
+		ATF_REQUIRE(inet_pton(AF_INET6, text, &in6) == 1);
+		isc_netaddr_fromin6(addr, &in6);
+	}
+}
+
+/*
+ * Make 'rdataset' an A rdataset holding the single address 'last'.
+ */
+static void
+makerdataset(unsigned char last, dns_trust_t trust, dns_rdataset_t *rdataset)
+{
+	isc_result_t result;
+
+	adata[0] = 192;
+	adata[1] = 0;
+	adata[2] = 2;
+	adata[3] = last;
+
+	dns_rdata_init(&rdata);
+	rdata.data = adata;
+	rdata.length = sizeof(adata);
+	rdata.rdclass = dns_rdataclass_in;
+	rdata.type = dns_rdatatype_a;
+
+	dns_rdatalist_init(&rdatalist);
+	rdatalist.rdclass = dns_rdataclass_in;
+	rdatalist.type = dns_rdatatype_a;
+	rdatalist.ttl = 300;
+	ISC_LIST_APPEND(rdatalist.rdata, &rdata, link);
+
+	dns_rdataset_init(rdataset);
+	result = dns_rdatalist_tordataset(&rdatalist, rdataset);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	rdataset->trust = trust;
+}
+
+/*
+ * Return the last octet of the address in the A rdataset 'rdataset'.
+ */
+static unsigned char
+lastoctet(dns_rdataset_t *rdataset) {
+	dns_rdata_t current = DNS_RDATA_INIT;
+
+	ATF_REQUIRE_EQ(dns_rdataset_first(rdataset), ISC_R_SUCCESS);
+	dns_rdataset_current(rdataset, &current);
+	ATF_REQUIRE_EQ(current.length, 4);
+	return (current.data[3]);
+}
+
+static void
+add(dns_ecscache_t *cache, dns_name_t *name, const char *addrtext,
+    unsigned int scope, unsigned char last, dns_trust_t trust,
+    isc_result_t expect)
+{
+	dns_rdataset_t rdataset;
+	isc_netaddr_t addr;
+	isc_result_t result;
+
+	makeaddr(addrtext, &addr);
+	makerdataset(last, trust, &rdataset);
+	result = dns_ecscache_add(cache, name, &rdataset, &addr, scope,
+				  1000, NULL);
+	ATF_CHECK_EQ(result, expect);
+	dns_rdataset_disassociate(&rdataset);
+}
+
+/*
+ * Look up 'name' for 'addrtext'/'sourcelen' at time 'now', and return
+ * the last octet of the answer, or 0 if there is none.
+ */
+static unsigned char
+lookup(dns_ecscache_t *cache, dns_name_t *name, const char *addrtext,
+       unsigned int sourcelen, isc_stdtime_t now, unsigned int options)
+{
+	dns_rdataset_t rdataset;
+	isc_netaddr_t addr;
+	isc_result_t result;
+	unsigned char last;
+
+	makeaddr(addrtext, &addr);
+	dns_rdataset_init(&rdataset);
+	result = dns_ecscache_lookup(cache, name, dns_rdatatype_a, &addr,
+				     sourcelen, now, options, &rdataset, NULL);
+	if (result == ISC_R_NOTFOUND)
+		return (0);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	last = lastoctet(&rdataset);
+	dns_rdataset_disassociate(&rdataset);
+	return (last);
+}
+
+/*
+ * Individual unit tests
+ */
+ATF_TC(scope);
+ATF_TC_HEAD(scope, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "lookups find the most specific covering scope");
+}
+ATF_TC_BODY(scope, tc) {
+	isc_result_t result;
+	dns_ecscache_t *cache = NULL;
+	dns_fixedname_t fname, fother;
+	dns_name_t *name, *other;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_ecscache_create(mctx, 0, &cache);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	makename("www.example", &fname);
+	name = dns_fixedname_name(&fname);
+	makename("ftp.example", &fother);
+	other = dns_fixedname_name(&fother);
+
+	add(cache, name, "10.1.2.3", 16, 1, dns_trust_answer, ISC_R_SUCCESS);
+	add(cache, name, "10.1.2.3", 24, 2, dns_trust_answer, ISC_R_SUCCESS);
+	add(cache, name, "2001:db8:1::1", 48, 3, dns_trust_answer,
+	    ISC_R_SUCCESS);
+
+	/* The /24 answer is preferred within its prefix. */
+	ATF_CHECK_EQ(lookup(cache, name, "10.1.2.99", 24, 1100, 0), 2);
+	ATF_CHECK_EQ(lookup(cache, name, "10.1.2.99", 32, 1100, 0), 2);
+	/* Elsewhere in the /16 only the /16 answer applies. */
+	ATF_CHECK_EQ(lookup(cache, name, "10.1.3.1", 24, 1100, 0), 1);
+	/* A short source prefix cannot use the /24 answer. */
+	ATF_CHECK_EQ(lookup(cache, name, "10.1.2.99", 20, 1100, 0), 1);
+	ATF_CHECK_EQ(lookup(cache, name, "10.1.2.99", 8, 1100, 0), 0);
+	/* Outside the prefixes, for other names and other families. */
+	ATF_CHECK_EQ(lookup(cache, name, "10.2.2.3", 24, 1100, 0), 0);
+	ATF_CHECK_EQ(lookup(cache, other, "10.1.2.3", 24, 1100, 0), 0);
+	ATF_CHECK_EQ(lookup(cache, name, "2001:db8:1:2::5", 56, 1100, 0), 3);
+	ATF_CHECK_EQ(lookup(cache, name, "2001:db8:2::1", 56, 1100, 0), 0);
+
+	/* Entries expire with their TTL. */
+	ATF_CHECK_EQ(lookup(cache, name, "10.1.2.99", 24, 1300, 0), 0);
+	ATF_CHECK(dns_ecscache_size(cache) > 0);
+
+	dns_ecscache_flush(cache);
+	ATF_CHECK_EQ(dns_ecscache_size(cache), 0);
+	ATF_CHECK_EQ(lookup(cache, name, "2001:db8:1:2::5", 56, 1100, 0), 0);
+
+	dns_ecscache_detach(&cache);
+	dns_test_end();
+}
+
+ATF_TC(trust);
+ATF_TC_HEAD(trust, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "pending data is hidden and better data is kept");
+}
+ATF_TC_BODY(trust, tc) {
+	isc_result_t result;
+	dns_ecscache_t *cache = NULL;
+	dns_fixedname_t fname;
+	dns_name_t *name;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_ecscache_create(mctx, 0, &cache);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	makename("www.example", &fname);
+	name = dns_fixedname_name(&fname);
+
+	add(cache, name, "10.1.2.3", 24, 1, dns_trust_pending_answer,
+	    ISC_R_SUCCESS);
+	ATF_CHECK_EQ(lookup(cache, name, "10.1.2.3", 24, 1100, 0), 0);
+	ATF_CHECK_EQ(lookup(cache, name, "10.1.2.3", 24, 1100,
+			    DNS_DBFIND_PENDINGOK), 1);
+
+	add(cache, name, "10.1.2.3", 24, 2, dns_trust_secure, ISC_R_SUCCESS);
+	ATF_CHECK_EQ(lookup(cache, name, "10.1.2.3", 24, 1100, 0), 2);
+
+	add(cache, name, "10.1.2.3", 24, 3, dns_trust_answer,
+	    DNS_R_UNCHANGED);
+	ATF_CHECK_EQ(lookup(cache, name, "10.1.2.3", 24, 1100, 0), 2);
+
+	dns_ecscache_detach(&cache);
+	dns_test_end();
+}
+
+ATF_TC(maxsize);
+ATF_TC_HEAD(maxsize, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "least recently used entries are discarded when "
+			  "the cache is full, but stay valid while bound");
+}
+ATF_TC_BODY(maxsize, tc) {
+	isc_result_t result;
+	dns_ecscache_t *cache = NULL;
+	dns_fixedname_t fname;
+	dns_name_t *name;
+	dns_rdataset_t rdataset, bound;
+	isc_netaddr_t addr;
+	unsigned int scope;
+	size_t one;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_ecscache_create(mctx, 0, &cache);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	makename("www.example", &fname);
+	name = dns_fixedname_name(&fname);
+
+	add(cache, name, "10.0.1.0", 24, 1, dns_trust_answer, ISC_R_SUCCESS);
+	one = dns_ecscache_size(cache);
+	add(cache, name, "10.0.2.0", 24, 2, dns_trust_answer, ISC_R_SUCCESS);
+	ATF_CHECK_EQ(dns_ecscache_size(cache), 2 * one);
+
+	/* Hold on to the first entry, then make room for one only. */
+	makeaddr("10.0.1.1", &addr);
+	dns_rdataset_init(&bound);
+	result = dns_ecscache_lookup(cache, name, dns_rdatatype_a, &addr,
+				     24, 1100, 0, &bound, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK(dns_ecscache_getscope(&bound, &scope));
+	ATF_CHECK_EQ(scope, 24);
+
+	dns_ecscache_setmaxsize(cache, one);
+	ATF_CHECK_EQ(dns_ecscache_size(cache), one);
+	ATF_CHECK_EQ(lookup(cache, name, "10.0.1.1", 24, 1100, 0), 1);
+	ATF_CHECK_EQ(lookup(cache, name, "10.0.2.1", 24, 1100, 0), 0);
+
+	add(cache, name, "10.0.3.0", 24, 3, dns_trust_answer, ISC_R_SUCCESS);
+	ATF_CHECK_EQ(dns_ecscache_size(cache), one);
+	ATF_CHECK_EQ(lookup(cache, name, "10.0.1.1", 24, 1100, 0), 0);
+	ATF_CHECK_EQ(lookup(cache, name, "10.0.3.1", 24, 1100, 0), 3);
+
+	/* The evicted entry is still usable through its binding. */
+	ATF_CHECK_EQ(lastoctet(&bound), 1);
+	dns_rdataset_disassociate(&bound);
+
+	/* Ordinary rdatasets have no scope. */
+	makerdataset(4, dns_trust_answer, &rdataset);
+	ATF_CHECK(!dns_ecscache_getscope(&rdataset, &scope));
+	dns_rdataset_disassociate(&rdataset);
+
+	dns_ecscache_detach(&cache);
+	dns_test_end();
+}
+
+/*
+ * Main
+ */
+ATF_TC(ecsname);
+ATF_TC_HEAD(ecsname, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "only names at or below an ecs-zones domain, and "
+			  "so only the servers of those domains, get the "
+			  "client subnet");
+}
+ATF_TC_BODY(ecsname, tc) {
+	isc_result_t result;
+	dns_view_t *view = NULL;
+	dns_fixedname_t fname;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_test_makeview("view", &view);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	makename("cdn.example", &fname);
+	ATF_CHECK(!dns_view_isecsname(view, dns_fixedname_name(&fname)));
+
+	result = dns_rbt_create(mctx, NULL, NULL, &view->ecszones);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_rbt_addname(view->ecszones, dns_fixedname_name(&fname),
+				 (void *)1);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/* The domain itself and names below it. */
+	ATF_CHECK(dns_view_isecsname(view, dns_fixedname_name(&fname)));
+	makename("www.cdn.example", &fname);
+	ATF_CHECK(dns_view_isecsname(view, dns_fixedname_name(&fname)));
+
+	/* Not the root, the TLD or other domains on the way there. */
+	ATF_CHECK(!dns_view_isecsname(view, dns_rootname));
+	makename("example", &fname);
+	ATF_CHECK(!dns_view_isecsname(view, dns_fixedname_name(&fname)));
+	makename("other.example", &fname);
+	ATF_CHECK(!dns_view_isecsname(view, dns_fixedname_name(&fname)));
+
+	dns_view_detach(&view);
+	dns_test_end();
+}
+
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, scope);
+	ATF_TP_ADD_TC(tp, trust);
+	ATF_TP_ADD_TC(tp, maxsize);
+	ATF_TP_ADD_TC(tp, ecsname);
+	return (atf_no_error());
+}
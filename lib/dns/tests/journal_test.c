@@ -0,0 +1,296 @@
+/*
+ * Copyright (C) 2015  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <isc/buffer.h>
+#include <isc/file.h>
+#include <isc/stdio.h>
+
+#include <dns/diff.h>
+#include <dns/fixedname.h>
+#include <dns/journal.h>
+#include <dns/name.h>
+#include <dns/rdata.h>
+#include <dns/soa.h>
+
+#include "dnstest.h"
+
+#define TESTJOURNAL	"testjournal.jnl"
+#define NTRANSACTIONS	300
+
+static dns_fixedname_t forigin;
+
+static void
+makeorigin(void) {
+	isc_buffer_t b;
+	isc_result_t result;
+
+	dns_fixedname_init(&forigin);
+	isc_buffer_constinit(&b, "example.", 8);
+	isc_buffer_add(&b, 8);
+	result = dns_name_fromtext(dns_fixedname_name(&forigin), &b,
+				   dns_rootname, 0, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+}
+
+static void
+addsoa(dns_diff_t *diff, dns_diffop_t op, isc_uint32_t serial,
+       unsigned char *buf)
+{
+	dns_name_t *origin = dns_fixedname_name(&forigin);
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	dns_difftuple_t *tuple = NULL;
+	isc_result_t result;
+
+	result = dns_soa_buildrdata(origin, origin, dns_rdataclass_in,
+				    serial, 3600, 600, 86400, 300,
+				    buf, &rdata);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_difftuple_create(mctx, op, origin, 300, &rdata, &tuple);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	dns_diff_append(diff, &tuple);
+}
+
+/*
+ * Append a transaction taking the zone from 'serial' - 1 to 'serial'
+ * to the open journal 'j'.
+ */
+static void
+append(dns_journal_t *j, isc_uint32_t serial) {
+	unsigned char buf0[DNS_SOA_BUFFERSIZE], buf1[DNS_SOA_BUFFERSIZE];
+	dns_diff_t diff;
+	isc_result_t result;
+
+	dns_diff_init(mctx, &diff);
+	addsoa(&diff, DNS_DIFFOP_DEL, serial - 1, buf0);
+	addsoa(&diff, DNS_DIFFOP_ADD, serial, buf1);
+	result = dns_journal_write_transaction(j, &diff);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	dns_diff_clear(&diff);
+}
+
+/*
+ * Append a transaction, opening and closing the journal around it
+ * as a zone does.
+ */
+static void
+write_transaction(isc_uint32_t serial) {
+	dns_journal_t *j = NULL;
+	isc_result_t result;
+
+	result = dns_journal_open(mctx, TESTJOURNAL, DNS_JOURNAL_CREATE, &j);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	append(j, serial);
+	dns_journal_destroy(&j);
+}
+
+/*
+ * Return the last serial in the journal as seen by a new reader.
+ */
+static isc_uint32_t
+last_serial(void) {
+	dns_journal_t *j = NULL;
+	isc_result_t result;
+	isc_uint32_t serial;
+
+	result = dns_journal_open(mctx, TESTJOURNAL, DNS_JOURNAL_READ, &j);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	serial = dns_journal_last_serial(j);
+	dns_journal_destroy(&j);
+	return (serial);
+}
+
+/*
+ * Read the index size from the journal file header.
+ */
+static isc_uint32_t
+index_size(void) {
+	unsigned char header[64];
+	FILE *fp = NULL;
+	isc_result_t result;
+
+	result = isc_stdio_open(TESTJOURNAL, "rb", &fp);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = isc_stdio_read(header, 1, sizeof(header), fp, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	(void)isc_stdio_close(fp);
+
+	return ((header[32] << 24) | (header[33] << 16) |
+		(header[34] << 8) | header[35]);
+}
+
+/*
+ * Check that the journal can bring the zone from 'serial' to
+ * NTRANSACTIONS, seeing the expected number of SOA records.
+ */
+static void
+check_from(isc_uint32_t serial) {
+	dns_journal_t *j = NULL;
+	isc_result_t result;
+	unsigned int n = 0;
+
+	result = dns_journal_open(mctx, TESTJOURNAL, DNS_JOURNAL_READ, &j);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_journal_iter_init(j, serial, NTRANSACTIONS);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	for (result = dns_journal_first_rr(j);
+	     result == ISC_R_SUCCESS;
+	     result = dns_journal_next_rr(j))
+		n++;
+	ATF_CHECK_EQ(result, ISC_R_NOMORE);
+	ATF_CHECK_EQ(n, 2 * (NTRANSACTIONS - serial));
+	dns_journal_destroy(&j);
+}
+
+/*
+ * Individual unit tests
+ */
+ATF_TC(growindex);
+ATF_TC_HEAD(growindex, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "the journal index grows to cover every transaction");
+}
+ATF_TC_BODY(growindex, tc) {
+	isc_result_t result;
+	isc_uint32_t serial;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	makeorigin();
+	(void)isc_file_remove(TESTJOURNAL);
+
+	for (serial = 1; serial <= NTRANSACTIONS; serial++)
+		write_transaction(serial);
+
+	ATF_CHECK(index_size() >= NTRANSACTIONS);
+
+	check_from(0);
+	check_from(1);
+	check_from(NTRANSACTIONS / 2);
+	check_from(NTRANSACTIONS - 1);
+	check_from(NTRANSACTIONS);
+
+	(void)isc_file_remove(TESTJOURNAL);
+	dns_test_end();
+}
+
+ATF_TC(compact);
+ATF_TC_HEAD(compact, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "compaction keeps the grown index and its entries");
+}
+ATF_TC_BODY(compact, tc) {
+	isc_result_t result;
+	isc_uint32_t serial, size;
+	dns_journal_t *j = NULL;
+	char filename[] = TESTJOURNAL;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	makeorigin();
+	(void)isc_file_remove(TESTJOURNAL);
+
+	for (serial = 1; serial <= NTRANSACTIONS; serial++)
+		write_transaction(serial);
+	size = index_size();
+
+	result = dns_journal_compact(mctx, filename,
+				     NTRANSACTIONS - 20, 1);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK_EQ(index_size(), size);
+
+	result = dns_journal_open(mctx, TESTJOURNAL, DNS_JOURNAL_READ, &j);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK(dns_journal_first_serial(j) >= NTRANSACTIONS / 2);
+	ATF_CHECK(dns_journal_first_serial(j) <= NTRANSACTIONS - 20);
+	ATF_CHECK_EQ(dns_journal_last_serial(j), NTRANSACTIONS);
+	dns_journal_destroy(&j);
+
+	check_from(NTRANSACTIONS - 20);
+	check_from(NTRANSACTIONS - 1);
+
+	(void)isc_file_remove(TESTJOURNAL);
+	dns_test_end();
+}
+
+ATF_TC(groupcommit);
+ATF_TC_HEAD(groupcommit, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "group commit defers the header until the sync");
+}
+ATF_TC_BODY(groupcommit, tc) {
+	isc_result_t result;
+	isc_uint32_t serial;
+	dns_journal_t *j = NULL;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	makeorigin();
+	(void)isc_file_remove(TESTJOURNAL);
+
+	for (serial = 1; serial <= 10; serial++)
+		write_transaction(serial);
+
+	result = dns_journal_open(mctx, TESTJOURNAL,
+				  DNS_JOURNAL_CREATE|DNS_JOURNAL_GROUPCOMMIT,
+				  &j);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	for (serial = 11; serial <= 20; serial++)
+		append(j, serial);
+	ATF_CHECK_EQ(dns_journal_last_serial(j), 20);
+	ATF_CHECK_EQ(last_serial(), 10);
+
+	result = dns_journal_sync(j);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK_EQ(last_serial(), 20);
+
+	/* Transactions left unsynced are written out on destroy. */
+	for (serial = 21; serial <= NTRANSACTIONS; serial++)
+		append(j, serial);
+	ATF_CHECK_EQ(last_serial(), 20);
+	dns_journal_destroy(&j);
+	ATF_CHECK_EQ(last_serial(), NTRANSACTIONS);
+
+	check_from(0);
+	check_from(NTRANSACTIONS / 2);
+
+	(void)isc_file_remove(TESTJOURNAL);
+	dns_test_end();
+}
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, growindex);
+	ATF_TP_ADD_TC(tp, compact);
+	ATF_TP_ADD_TC(tp, groupcommit);
+	return (atf_no_error());
+}
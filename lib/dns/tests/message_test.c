@@ -0,0 +1,527 @@
+/*
+ * Copyright (C) 2015  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <isc/buffer.h>
+#include <isc/string.h>
+
+#include <dns/compress.h>
+#include <dns/fixedname.h>
+#include <dns/message.h>
+#include <dns/name.h>
+#include <dns/rdata.h>
+#include <dns/rdatalist.h>
+#include <dns/rdataset.h>
+#include <dns/result.h>
+
+#include "dnstest.h"
+
+#define NRECORDS 100
+
+/*
+ * Helper functions
+ */
+
+static unsigned char addrs[NRECORDS][4];
+static unsigned char wire[65535];
+
+/*
+ * Render a response with 'count' A records, each with its own owner
+ * name, into 'target' using 'msg'.
+ */
+static void
+render(dns_message_t *msg, unsigned int count, isc_buffer_t *target) {
+	dns_compress_t cctx;
+	dns_fixedname_t fixed;
+	char text[32];
+	isc_buffer_t b;
+	isc_result_t result;
+	unsigned int i;
+
+	msg->id = 4711;
+	msg->flags = DNS_MESSAGEFLAG_QR | DNS_MESSAGEFLAG_AA;
+	msg->opcode = dns_opcode_query;
+	msg->rdclass = dns_rdataclass_in;
+
+	for (i = 0; i < count; i++) {
+		dns_name_t *name = NULL;
+		dns_rdata_t *rdata = NULL;
+		dns_rdatalist_t *rdatalist = NULL;
+		dns_rdataset_t *rdataset = NULL;
+
+		snprintf(text, sizeof(text), "host%u.example.", i);
+		dns_fixedname_init(&fixed);
+		isc_buffer_constinit(&b, text, strlen(text));
+		isc_buffer_add(&b, strlen(text));
+		result = dns_name_fromtext(dns_fixedname_name(&fixed), &b,
+					   dns_rootname, 0, NULL);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+		result = dns_message_gettempname(msg, &name);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		result = dns_name_dup(dns_fixedname_name(&fixed), mctx, name);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+		addrs[i][0] = 192;
+		addrs[i][1] = 0;
+		addrs[i][2] = 2;
+		addrs[i][3] = i;
+		result = dns_message_gettemprdata(msg, &rdata);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		rdata->data = addrs[i];
+		rdata->length = sizeof(addrs[i]);
+		rdata->rdclass = dns_rdataclass_in;
+		rdata->type = dns_rdatatype_a;
+
+		result = dns_message_gettemprdatalist(msg, &rdatalist);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		rdatalist->rdclass = dns_rdataclass_in;
+		rdatalist->type = dns_rdatatype_a;
+		rdatalist->ttl = 300;
+		ISC_LIST_APPEND(rdatalist->rdata, rdata, link);
+
+		result = dns_message_gettemprdataset(msg, &rdataset);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		result = dns_rdatalist_tordataset(rdatalist, rdataset);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+		ISC_LIST_APPEND(name->list, rdataset, link);
+		dns_message_addname(msg, name, DNS_SECTION_ANSWER);
+	}
+
+	result = dns_compress_init(&cctx, -1, mctx);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_message_renderbegin(msg, &cctx, target);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_message_rendersection(msg, DNS_SECTION_ANSWER, 0);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_message_renderend(msg);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	dns_compress_invalidate(&cctx);
+}
+
+/*
+ * Parse 'source' into 'msg' and check that it holds 'count' A records
+ * with the expected addresses.
+ */
+static void
+parse(dns_message_t *msg, isc_buffer_t *source, unsigned int count) {
+	dns_name_t *name;
+	dns_rdataset_t *rdataset;
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	isc_result_t result;
+	unsigned int i = 0;
+
+	isc_buffer_first(source);
+	result = dns_message_parse(msg, source, 0);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_REQUIRE_EQ(msg->counts[DNS_SECTION_ANSWER], count);
+
+	for (result = dns_message_firstname(msg, DNS_SECTION_ANSWER);
+	     result == ISC_R_SUCCESS;
+	     result = dns_message_nextname(msg, DNS_SECTION_ANSWER))
+	{
+		name = NULL;
+		dns_message_currentname(msg, DNS_SECTION_ANSWER, &name);
+		rdataset = ISC_LIST_HEAD(name->list);
+		ATF_REQUIRE(rdataset != NULL);
+		ATF_REQUIRE_EQ(dns_rdataset_first(rdataset), ISC_R_SUCCESS);
+		dns_rdataset_current(rdataset, &rdata);
+		ATF_CHECK_EQ(rdata.length, 4);
+		ATF_CHECK_EQ(rdata.data[3], i);
+		dns_rdata_reset(&rdata);
+		i++;
+	}
+	ATF_CHECK_EQ(i, count);
+}
+
+/*
+ * Add an A rrset of 'count' records owned by 'text' to the answer
+ * section of 'msg'.  The records keep the order they were added in.
+ */
+static void
+addrrset(dns_message_t *msg, const char *text, unsigned int count) {
+	dns_fixedname_t fixed;
+	dns_name_t *name = NULL;
+	dns_rdatalist_t *rdatalist = NULL;
+	dns_rdataset_t *rdataset = NULL;
+	isc_buffer_t b;
+	isc_result_t result;
+	unsigned int i;
+
+	dns_fixedname_init(&fixed);
+	isc_buffer_constinit(&b, text, strlen(text));
+	isc_buffer_add(&b, strlen(text));
+	result = dns_name_fromtext(dns_fixedname_name(&fixed), &b,
+				   dns_rootname, 0, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_message_gettempname(msg, &name);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_name_dup(dns_fixedname_name(&fixed), mctx, name);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_message_gettemprdatalist(msg, &rdatalist);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	rdatalist->rdclass = dns_rdataclass_in;
+	rdatalist->type = dns_rdatatype_a;
+	rdatalist->ttl = 300;
+
+	for (i = 0; i < count; i++) {
+		dns_rdata_t *rdata = NULL;
+
+		addrs[i][0] = 192;
+		addrs[i][1] = 0;
+		addrs[i][2] = 2;
+		addrs[i][3] = i;
+		result = dns_message_gettemprdata(msg, &rdata);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		rdata->data = addrs[i];
+		rdata->length = sizeof(addrs[i]);
+		rdata->rdclass = dns_rdataclass_in;
+		rdata->type = dns_rdatatype_a;
+		ISC_LIST_APPEND(rdatalist->rdata, rdata, link);
+	}
+
+	result = dns_message_gettemprdataset(msg, &rdataset);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_rdatalist_tordataset(rdatalist, rdataset);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	/*
+	 * Start the cyclic rotation at the first record.
+	 */
+	rdataset->count = 0;
+
+	ISC_LIST_APPEND(name->list, rdataset, link);
+	dns_message_addname(msg, name, DNS_SECTION_ANSWER);
+}
+
+/*
+ * Render the answer section of 'from' into 'msg' one record at a time
+ * with dns_message_renderrr(), stopping at the first record that does
+ * not fit.  Returns the number of records rendered.
+ */
+static unsigned int
+renderrrs(dns_message_t *from, dns_message_t *msg) {
+	dns_name_t *name;
+	dns_rdataset_t *rdataset;
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	isc_result_t result, tresult;
+	unsigned int count = 0, used;
+
+	for (result = dns_message_firstname(from, DNS_SECTION_ANSWER);
+	     result == ISC_R_SUCCESS;
+	     result = dns_message_nextname(from, DNS_SECTION_ANSWER))
+	{
+		name = NULL;
+		dns_message_currentname(from, DNS_SECTION_ANSWER, &name);
+		for (rdataset = ISC_LIST_HEAD(name->list);
+		     rdataset != NULL;
+		     rdataset = ISC_LIST_NEXT(rdataset, link))
+		{
+			for (tresult = dns_rdataset_first(rdataset);
+			     tresult == ISC_R_SUCCESS;
+			     tresult = dns_rdataset_next(rdataset))
+			{
+				dns_rdataset_current(rdataset, &rdata);
+				used = isc_buffer_usedlength(msg->buffer);
+				tresult = dns_message_renderrr(msg,
+						      DNS_SECTION_ANSWER,
+						      name, rdataset->ttl,
+						      &rdata);
+				dns_rdata_reset(&rdata);
+				if (tresult == ISC_R_NOSPACE) {
+					/*
+					 * Nothing of the record is left
+					 * behind.
+					 */
+					ATF_CHECK_EQ(isc_buffer_usedlength(
+							     msg->buffer),
+						     used);
+					return (count);
+				}
+				ATF_REQUIRE_EQ(tresult, ISC_R_SUCCESS);
+				count++;
+			}
+		}
+	}
+	return (count);
+}
+
+/*
+ * Individual unit tests
+ */
+
+ATF_TC(arenaparse);
+ATF_TC_HEAD(arenaparse, tc) {
+	atf_tc_set_md_var(tc, "descr", "parse messages into an arena and "
+				       "reuse it without further allocations");
+}
+ATF_TC_BODY(arenaparse, tc) {
+	dns_message_t *msg = NULL;
+	isc_buffer_t buffer;
+	isc_result_t result;
+	size_t inuse;
+	int i;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	isc_buffer_init(&buffer, wire, sizeof(wire));
+	result = dns_message_create(mctx, DNS_MESSAGE_INTENTRENDER, &msg);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	render(msg, NRECORDS, &buffer);
+	dns_message_destroy(&msg);
+
+	result = dns_message_create(mctx, DNS_MESSAGE_INTENTPARSE, &msg);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_message_usearena(msg, 0);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/*
+	 * The first parse overflows the initial arena; after the reset
+	 * it has grown to hold the whole message.
+	 */
+	parse(msg, &buffer, NRECORDS);
+	dns_message_reset(msg, DNS_MESSAGE_INTENTPARSE);
+
+	for (i = 0; i < 3; i++) {
+		inuse = isc_mem_inuse(mctx);
+		parse(msg, &buffer, NRECORDS);
+		ATF_CHECK_EQ(isc_mem_inuse(mctx), inuse);
+		dns_message_reset(msg, DNS_MESSAGE_INTENTPARSE);
+	}
+
+	dns_message_destroy(&msg);
+
+	dns_test_end();
+}
+
+ATF_TC(arenarender);
+ATF_TC_HEAD(arenarender, tc) {
+	atf_tc_set_md_var(tc, "descr", "render messages from an arena");
+}
+ATF_TC_BODY(arenarender, tc) {
+	dns_message_t *msg = NULL, *heapmsg = NULL;
+	unsigned char expect[sizeof(wire)];
+	isc_buffer_t buffer, ebuffer;
+	isc_result_t result;
+	int i;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	isc_buffer_init(&ebuffer, expect, sizeof(expect));
+	result = dns_message_create(mctx, DNS_MESSAGE_INTENTRENDER, &heapmsg);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	render(heapmsg, NRECORDS, &ebuffer);
+
+	result = dns_message_create(mctx, DNS_MESSAGE_INTENTRENDER, &msg);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_message_usearena(msg, 0);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < 3; i++) {
+		isc_buffer_init(&buffer, wire, sizeof(wire));
+		render(msg, NRECORDS, &buffer);
+		ATF_REQUIRE_EQ(isc_buffer_usedlength(&buffer),
+			       isc_buffer_usedlength(&ebuffer));
+		ATF_CHECK(memcmp(wire, expect,
+				 isc_buffer_usedlength(&buffer)) == 0);
+		dns_message_reset(msg, DNS_MESSAGE_INTENTRENDER);
+	}
+
+	/*
+	 * What was rendered from the arena parses back.
+	 */
+	dns_message_reset(heapmsg, DNS_MESSAGE_INTENTPARSE);
+	parse(heapmsg, &ebuffer, NRECORDS);
+
+	dns_message_destroy(&msg);
+	dns_message_destroy(&heapmsg);
+
+	dns_test_end();
+}
+
+ATF_TC(renderrr);
+ATF_TC_HEAD(renderrr, tc) {
+	atf_tc_set_md_var(tc, "descr", "dns_message_renderrr() renders the "
+				       "same wire format as "
+				       "dns_message_rendersection()");
+}
+ATF_TC_BODY(renderrr, tc) {
+	dns_message_t *msg = NULL, *rrmsg = NULL;
+	unsigned char expect[512];
+	dns_compress_t cctx, rrcctx;
+	isc_buffer_t buffer, ebuffer;
+	isc_result_t result;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_message_create(mctx, DNS_MESSAGE_INTENTRENDER, &msg);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	msg->id = 4711;
+	msg->flags = DNS_MESSAGEFLAG_QR | DNS_MESSAGEFLAG_AA;
+	msg->opcode = dns_opcode_query;
+	msg->rdclass = dns_rdataclass_in;
+	addrrset(msg, "www.example.", 4);
+	addrrset(msg, "mail.example.", 3);
+
+	isc_buffer_init(&ebuffer, expect, sizeof(expect));
+	result = dns_compress_init(&cctx, -1, mctx);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_message_renderbegin(msg, &cctx, &ebuffer);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_message_rendersection(msg, DNS_SECTION_ANSWER, 0);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_message_renderend(msg);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	dns_compress_invalidate(&cctx);
+
+	result = dns_message_create(mctx, DNS_MESSAGE_INTENTRENDER, &rrmsg);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	rrmsg->id = msg->id;
+	rrmsg->flags = msg->flags;
+	rrmsg->opcode = msg->opcode;
+	rrmsg->rdclass = msg->rdclass;
+
+	isc_buffer_init(&buffer, wire, sizeof(wire));
+	result = dns_compress_init(&rrcctx, -1, mctx);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_message_renderbegin(rrmsg, &rrcctx, &buffer);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK_EQ(renderrrs(msg, rrmsg), 7);
+	result = dns_message_renderend(rrmsg);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	dns_compress_invalidate(&rrcctx);
+
+	ATF_REQUIRE_EQ(isc_buffer_usedlength(&buffer),
+		       isc_buffer_usedlength(&ebuffer));
+	ATF_CHECK(memcmp(wire, expect, isc_buffer_usedlength(&buffer)) == 0);
+
+	dns_message_destroy(&rrmsg);
+	dns_message_destroy(&msg);
+
+	dns_test_end();
+}
+
+ATF_TC(renderrrpartial);
+ATF_TC_HEAD(renderrrpartial, tc) {
+	atf_tc_set_md_var(tc, "descr", "dns_message_renderrr() stops with "
+				       "ISC_R_NOSPACE where a partial "
+				       "dns_message_rendersection() does");
+}
+ATF_TC_BODY(renderrrpartial, tc) {
+	dns_message_t *msg = NULL, *rrmsg = NULL;
+	unsigned char expect[512];
+	dns_compress_t cctx, rrcctx;
+	isc_buffer_t buffer, ebuffer;
+	isc_result_t result;
+	/*
+	 * Room for the header, the first record with an uncompressed
+	 * owner (13 + 10 + 4 octets) and two more with a compressed one
+	 * (2 + 10 + 4 octets each), with a few octets to spare.
+	 */
+	unsigned int size = 12 + 27 + 2 * 16 + 8;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_message_create(mctx, DNS_MESSAGE_INTENTRENDER, &msg);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	msg->id = 4711;
+	msg->flags = DNS_MESSAGEFLAG_QR | DNS_MESSAGEFLAG_AA;
+	msg->opcode = dns_opcode_query;
+	msg->rdclass = dns_rdataclass_in;
+	addrrset(msg, "www.example.", 8);
+
+	isc_buffer_init(&ebuffer, expect, size);
+	result = dns_compress_init(&cctx, -1, mctx);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_message_renderbegin(msg, &cctx, &ebuffer);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_message_rendersection(msg, DNS_SECTION_ANSWER,
+					   DNS_MESSAGERENDER_PARTIAL);
+	ATF_REQUIRE_EQ(result, ISC_R_NOSPACE);
+	result = dns_message_renderend(msg);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	dns_compress_invalidate(&cctx);
+	ATF_REQUIRE_EQ(msg->counts[DNS_SECTION_ANSWER], 3);
+
+	result = dns_message_create(mctx, DNS_MESSAGE_INTENTRENDER, &rrmsg);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	rrmsg->id = msg->id;
+	rrmsg->opcode = msg->opcode;
+	rrmsg->rdclass = msg->rdclass;
+	rrmsg->flags = msg->flags;
+
+	isc_buffer_init(&buffer, wire, size);
+	result = dns_compress_init(&rrcctx, -1, mctx);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_message_renderbegin(rrmsg, &rrcctx, &buffer);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK_EQ(renderrrs(msg, rrmsg), 3);
+	result = dns_message_renderend(rrmsg);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	dns_compress_invalidate(&rrcctx);
+	ATF_CHECK_EQ(rrmsg->counts[DNS_SECTION_ANSWER], 3);
+
+	ATF_REQUIRE_EQ(isc_buffer_usedlength(&buffer),
+		       isc_buffer_usedlength(&ebuffer));
+	ATF_CHECK(memcmp(wire, expect, isc_buffer_usedlength(&buffer)) == 0);
+
+	/*
+	 * What was rendered parses back.
+	 */
+	dns_message_reset(rrmsg, DNS_MESSAGE_INTENTPARSE);
+	isc_buffer_first(&buffer);
+	result = dns_message_parse(rrmsg, &buffer, 0);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK_EQ(rrmsg->counts[DNS_SECTION_ANSWER], 3);
+
+	dns_message_destroy(&rrmsg);
+	dns_message_destroy(&msg);
+
+	dns_test_end();
+}
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, arenaparse);
+	ATF_TP_ADD_TC(tp, arenarender);
+	ATF_TP_ADD_TC(tp, renderrr);
+	ATF_TP_ADD_TC(tp, renderrrpartial);
+	return (atf_no_error());
+}
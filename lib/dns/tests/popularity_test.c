@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2015  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <isc/buffer.h>
+#include <isc/print.h>
+#include <isc/stdtime.h>
+
+#include <dns/db.h>
+#include <dns/fixedname.h>
+#include <dns/name.h>
+#include <dns/popularity.h>
+#include <dns/rdatalist.h>
+#include <dns/rdataset.h>
+
+#include "dnstest.h"
+
+static void
+makename(const char *text, dns_fixedname_t *fixed) {
+	isc_buffer_t b;
+	isc_result_t result;
+
+	dns_fixedname_init(fixed);
+	isc_buffer_constinit(&b, text, strlen(text));
+	isc_buffer_add(&b, strlen(text));
+	result = dns_name_fromtext(dns_fixedname_name(fixed), &b,
+				   dns_rootname, 0, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+}
+
+/*
+ * Individual unit tests
+ */
+ATF_TC(record);
+ATF_TC_HEAD(record, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "estimates never undercount and are case-insensitive");
+}
+ATF_TC_BODY(record, tc) {
+	isc_result_t result;
+	dns_popularity_t *pop = NULL;
+	dns_fixedname_t a, b, upper;
+	isc_uint32_t est;
+	int i;
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_popularity_create(mctx, 10, &pop);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	makename("www.example.com", &a);
+	makename("WWW.Example.COM", &upper);
+	makename("ftp.example.com", &b);
+
+	for (i = 0; i < 100; i++)
+		dns_popularity_record(pop, dns_fixedname_name(&a),
+				      dns_rdatatype_a);
+	for (i = 0; i < 10; i++)
+		dns_popularity_record(pop, dns_fixedname_name(&upper),
+				      dns_rdatatype_a);
+	dns_popularity_record(pop, dns_fixedname_name(&b), dns_rdatatype_a);
+
+	est = dns_popularity_estimate(pop, dns_fixedname_name(&a),
+				      dns_rdatatype_a);
+	ATF_REQUIRE(est >= 110);
+	est = dns_popularity_estimate(pop, dns_fixedname_name(&b),
+				      dns_rdatatype_a);
+	ATF_REQUIRE(est >= 1);
+
+	dns_popularity_decay(pop);
+	est = dns_popularity_estimate(pop, dns_fixedname_name(&a),
+				      dns_rdatatype_a);
+	ATF_REQUIRE(est >= 55);
+
+	dns_popularity_detach(&pop);
+	ATF_REQUIRE_EQ(pop, NULL);
+	dns_test_end();
+}
+
+ATF_TC(hotlist);
+ATF_TC_HEAD(hotlist, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "the hot list keeps the most popular tuples");
+}
+ATF_TC_BODY(hotlist, tc) {
+	isc_result_t result;
+	dns_popularity_t *pop = NULL;
+	dns_popentry_t entries[4];
+	dns_fixedname_t names[8];
+	char buf[64];
+	unsigned int n;
+	int i, j;
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_popularity_create(mctx, 4, &pop);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_REQUIRE_EQ(dns_popularity_hotsize(pop), 4);
+
+	/*
+	 * name<i> gets (i + 1) * 64 hits, so name4..name7 are the four
+	 * most popular, in reverse order.
+	 */
+	for (i = 0; i < 8; i++) {
+		snprintf(buf, sizeof(buf), "name%d.example", i);
+		makename(buf, &names[i]);
+		for (j = 0; j < (i + 1) * 64; j++)
+			dns_popularity_record(pop,
+					      dns_fixedname_name(&names[i]),
+					      dns_rdatatype_aaaa);
+	}
+
+	n = dns_popularity_gethot(pop, entries, 4);
+	ATF_REQUIRE_EQ(n, 4);
+	for (i = 0; i < 4; i++) {
+		ATF_CHECK(dns_name_equal(dns_fixedname_name(&entries[i].fname),
+				      dns_fixedname_name(&names[7 - i])));
+		ATF_CHECK_EQ(entries[i].type, dns_rdatatype_aaaa);
+		if (i > 0)
+			ATF_CHECK(entries[i - 1].count >= entries[i].count);
+	}
+
+	/*
+	 * Decaying enough times empties the hot list.
+	 */
+	for (i = 0; i < 32; i++)
+		dns_popularity_decay(pop);
+	n = dns_popularity_gethot(pop, entries, 4);
+	ATF_REQUIRE_EQ(n, 0);
+
+	dns_popularity_detach(&pop);
+	dns_test_end();
+}
+
+ATF_TC(cachefind);
+ATF_TC_HEAD(cachefind, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "cache lookups are counted unless "
+			  "DNS_DBFIND_NOPOPULARITY is set");
+}
+ATF_TC_BODY(cachefind, tc) {
+	isc_result_t result;
+	dns_popularity_t *pop = NULL;
+	dns_db_t *db = NULL;
+	dns_dbnode_t *node = NULL;
+	dns_fixedname_t fixed, ffound;
+	dns_name_t *name;
+	dns_rdatalist_t rdatalist;
+	dns_rdataset_t rdataset;
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	unsigned char addr[4] = { 10, 53, 0, 1 };
+	isc_stdtime_t now;
+	int i;
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_popularity_create(mctx, 4, &pop);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_db_create(mctx, "rbt", dns_rootname, dns_dbtype_cache,
+			       dns_rdataclass_in, 0, NULL, &db);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_db_setpopularity(db, pop);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	makename("www.example", &fixed);
+	name = dns_fixedname_name(&fixed);
+
+	rdata.data = addr;
+	rdata.length = sizeof(addr);
+	rdata.rdclass = dns_rdataclass_in;
+	rdata.type = dns_rdatatype_a;
+	dns_rdatalist_init(&rdatalist);
+	rdatalist.rdclass = dns_rdataclass_in;
+	rdatalist.type = dns_rdatatype_a;
+	rdatalist.ttl = 300;
+	ISC_LIST_APPEND(rdatalist.rdata, &rdata, link);
+	dns_rdataset_init(&rdataset);
+	result = dns_rdatalist_tordataset(&rdatalist, &rdataset);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	isc_stdtime_get(&now);
+	result = dns_db_findnode(db, name, ISC_TRUE, &node);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_db_addrdataset(db, node, NULL, now, &rdataset, 0, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	dns_db_detachnode(db, &node);
+	dns_rdataset_disassociate(&rdataset);
+
+	dns_fixedname_init(&ffound);
+	for (i = 0; i < 10; i++) {
+		result = dns_db_find(db, name, NULL, dns_rdatatype_a,
+				     DNS_DBFIND_NOPOPULARITY, now, NULL,
+				     dns_fixedname_name(&ffound), &rdataset,
+				     NULL);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		dns_rdataset_disassociate(&rdataset);
+	}
+	ATF_CHECK_EQ(dns_popularity_estimate(pop, name, dns_rdatatype_a), 0);
+
+	for (i = 0; i < 10; i++) {
+		result = dns_db_find(db, name, NULL, dns_rdatatype_a, 0, now,
+				     NULL, dns_fixedname_name(&ffound),
+				     &rdataset, NULL);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		dns_rdataset_disassociate(&rdataset);
+	}
+	ATF_CHECK(dns_popularity_estimate(pop, name, dns_rdatatype_a) >= 10);
+
+	dns_db_detach(&db);
+	dns_popularity_detach(&pop);
+	dns_test_end();
+}
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, record);
+	ATF_TP_ADD_TC(tp, hotlist);
+	ATF_TP_ADD_TC(tp, cachefind);
+	return (atf_no_error());
+}
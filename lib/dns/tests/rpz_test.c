@@ -0,0 +1,438 @@
+/*
+ * Copyright (C) 2015  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <isc/buffer.h>
+#include <isc/net.h>
+#include <isc/netaddr.h>
+#include <isc/print.h>
+#include <isc/string.h>
+
+#include <dns/fixedname.h>
+#include <dns/name.h>
+#include <dns/result.h>
+#include <dns/rpz.h>
+
+#include "dnstest.h"
+
+/*
+ * Helper functions
+ */
+
+#define ZBIT	DNS_RPZ_ZBIT(0)
+
+static void
+makename(const char *text, const dns_name_t *origin, dns_fixedname_t *fixed) {
+	isc_buffer_t b;
+	isc_result_t result;
+
+	dns_fixedname_init(fixed);
+	isc_buffer_constinit(&b, text, strlen(text));
+	isc_buffer_add(&b, strlen(text));
+	result = dns_name_fromtext(dns_fixedname_name(fixed), &b,
+				   origin, 0, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+}
+
+static void
+makeaddr(const char *text, isc_netaddr_t *addr) {
+	struct in_addr in4;
+	struct in6_addr in6;
+
+	if (inet_pton(AF_INET, text, &in4) == 1)
+		isc_netaddr_fromin(addr, &in4);
+	else {
+		ATF_REQUIRE(inet_pton(AF_INET6, text, &in6) == 1);
+		isc_netaddr_fromin6(addr, &in6);
+	}
+}
+
+static void
+setname(dns_name_t *name, const char *text, const dns_name_t *origin) {
+	isc_result_t result;
+
+	dns_name_init(name, NULL);
+	result = dns_name_fromstring2(name, text, origin, 0, mctx);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+}
+
+/*
+ * Make the summary databases for a single policy zone "rpz." the way
+ * named's configuration does.
+ */
+static dns_rpz_zones_t *
+makerpzs(void) {
+	dns_rpz_zones_t *rpzs = NULL;
+	dns_rpz_zone_t *rpz;
+	isc_result_t result;
+
+	result = dns_rpz_new_zones(&rpzs, mctx);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	rpz = isc_mem_get(mctx, sizeof(*rpz));
+	ATF_REQUIRE(rpz != NULL);
+	memset(rpz, 0, sizeof(*rpz));
+	result = isc_refcount_init(&rpz->refs, 1);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	setname(&rpz->origin, "rpz", dns_rootname);
+	setname(&rpz->client_ip, DNS_RPZ_CLIENT_IP_ZONE, &rpz->origin);
+	setname(&rpz->ip, DNS_RPZ_IP_ZONE, &rpz->origin);
+	setname(&rpz->nsdname, DNS_RPZ_NSDNAME_ZONE, &rpz->origin);
+	setname(&rpz->nsip, DNS_RPZ_NSIP_ZONE, &rpz->origin);
+	dns_name_init(&rpz->passthru, NULL);
+	dns_name_init(&rpz->drop, NULL);
+	dns_name_init(&rpz->tcp_only, NULL);
+	dns_name_init(&rpz->cname, NULL);
+	rpz->policy = DNS_RPZ_POLICY_GIVEN;
+	rpz->num = rpzs->p.num_zones++;
+	rpzs->zones[rpz->num] = rpz;
+
+	return (rpzs);
+}
+
+/*
+ * Add or delete the trigger with owner name 'text' in the policy zone.
+ */
+static void
+add(dns_rpz_zones_t *rpzs, const char *text) {
+	dns_fixedname_t fname;
+	isc_result_t result;
+
+	makename(text, &rpzs->zones[0]->origin, &fname);
+	result = dns_rpz_add(rpzs, 0, dns_fixedname_name(&fname));
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+}
+
+static void
+del(dns_rpz_zones_t *rpzs, const char *text) {
+	dns_fixedname_t fname;
+
+	makename(text, &rpzs->zones[0]->origin, &fname);
+	dns_rpz_delete(rpzs, 0, dns_fixedname_name(&fname));
+}
+
+static isc_boolean_t
+findname(dns_rpz_zones_t *rpzs, dns_rpz_type_t type, const char *text) {
+	dns_fixedname_t fname;
+
+	makename(text, dns_rootname, &fname);
+	return (ISC_TF(dns_rpz_find_name(rpzs, type, ZBIT,
+					 dns_fixedname_name(&fname)) == ZBIT));
+}
+
+/*
+ * Return the prefix length of the trigger that 'text' hits, or 0.
+ */
+static dns_rpz_prefix_t
+findip(dns_rpz_zones_t *rpzs, dns_rpz_type_t type, const char *text) {
+	dns_fixedname_t fname;
+	isc_netaddr_t addr;
+	dns_rpz_prefix_t prefix = 0;
+
+	makeaddr(text, &addr);
+	dns_fixedname_init(&fname);
+	if (dns_rpz_find_ip(rpzs, type, ZBIT, &addr,
+			    dns_fixedname_name(&fname), &prefix) != 0)
+		return (0);
+	return (prefix);
+}
+
+/*
+ * Individual unit tests
+ */
+
+ATF_TC(filtername);
+ATF_TC_HEAD(filtername, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "QNAME and NSDNAME triggers, exact and wildcard, "
+			  "are found through the filter and other names "
+			  "are not");
+}
+ATF_TC_BODY(filtername, tc) {
+	dns_rpz_zones_t *rpzs;
+	isc_result_t result;
+	char buf[64];
+	int i;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	rpzs = makerpzs();
+	add(rpzs, "bad.example");
+	add(rpzs, "*.wild.example");
+	add(rpzs, "ns.bad.net.rpz-nsdname");
+	add(rpzs, "*.wild.net.rpz-nsdname");
+
+	/* Exact QNAME triggers match only themselves, in any case. */
+	ATF_CHECK(findname(rpzs, DNS_RPZ_TYPE_QNAME, "bad.example."));
+	ATF_CHECK(findname(rpzs, DNS_RPZ_TYPE_QNAME, "BAD.Example."));
+	ATF_CHECK(!findname(rpzs, DNS_RPZ_TYPE_QNAME, "x.bad.example."));
+	ATF_CHECK(!findname(rpzs, DNS_RPZ_TYPE_QNAME, "good.example."));
+	ATF_CHECK(!findname(rpzs, DNS_RPZ_TYPE_QNAME, "example."));
+
+	/* Wildcard QNAME triggers match names below, not the apex. */
+	ATF_CHECK(findname(rpzs, DNS_RPZ_TYPE_QNAME, "a.wild.example."));
+	ATF_CHECK(findname(rpzs, DNS_RPZ_TYPE_QNAME, "a.b.c.wild.example."));
+	ATF_CHECK(findname(rpzs, DNS_RPZ_TYPE_QNAME, "A.Wild.Example."));
+	ATF_CHECK(!findname(rpzs, DNS_RPZ_TYPE_QNAME, "wild.example."));
+	ATF_CHECK(!findname(rpzs, DNS_RPZ_TYPE_QNAME, "a.tame.example."));
+
+	/* NSDNAME triggers are only found as NSDNAME triggers. */
+	ATF_CHECK(findname(rpzs, DNS_RPZ_TYPE_NSDNAME, "ns.bad.net."));
+	ATF_CHECK(!findname(rpzs, DNS_RPZ_TYPE_QNAME, "ns.bad.net."));
+	ATF_CHECK(!findname(rpzs, DNS_RPZ_TYPE_NSDNAME, "bad.example."));
+	ATF_CHECK(!findname(rpzs, DNS_RPZ_TYPE_NSDNAME, "ns2.bad.net."));
+	ATF_CHECK(findname(rpzs, DNS_RPZ_TYPE_NSDNAME, "ns1.wild.net."));
+	ATF_CHECK(findname(rpzs, DNS_RPZ_TYPE_NSDNAME, "a.ns1.wild.net."));
+	ATF_CHECK(!findname(rpzs, DNS_RPZ_TYPE_NSDNAME, "wild.net."));
+	ATF_CHECK(!findname(rpzs, DNS_RPZ_TYPE_QNAME, "ns1.wild.net."));
+
+	/*
+	 * Many more triggers than the filter was first sized for are
+	 * all still found.
+	 */
+	for (i = 0; i < 6000; i++) {
+		snprintf(buf, sizeof(buf), "n%d.many.example", i);
+		add(rpzs, buf);
+	}
+	for (i = 0; i < 6000; i++) {
+		snprintf(buf, sizeof(buf), "n%d.many.example.", i);
+		if (!findname(rpzs, DNS_RPZ_TYPE_QNAME, buf))
+			ATF_CHECK_MSG(ISC_FALSE, "%s not found", buf);
+	}
+	ATF_CHECK(findname(rpzs, DNS_RPZ_TYPE_QNAME, "bad.example."));
+	ATF_CHECK(!findname(rpzs, DNS_RPZ_TYPE_QNAME, "n6000.many.example."));
+
+	/* A deleted trigger is no longer found. */
+	del(rpzs, "bad.example");
+	ATF_CHECK(!findname(rpzs, DNS_RPZ_TYPE_QNAME, "bad.example."));
+	ATF_CHECK(findname(rpzs, DNS_RPZ_TYPE_QNAME, "a.wild.example."));
+
+	dns_rpz_detach_rpzs(&rpzs);
+	dns_test_end();
+}
+
+ATF_TC(filterip);
+ATF_TC_HEAD(filterip, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "IP triggers of several prefix lengths are found "
+			  "through the filter and other addresses are not");
+}
+ATF_TC_BODY(filterip, tc) {
+	dns_rpz_zones_t *rpzs;
+	isc_result_t result;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	rpzs = makerpzs();
+	add(rpzs, "32.1.2.0.192.rpz-ip");
+	add(rpzs, "24.0.100.51.198.rpz-ip");
+	add(rpzs, "16.0.0.16.172.rpz-ip");
+	add(rpzs, "8.0.0.0.10.rpz-ip");
+	add(rpzs, "64.zz.1.db8.2001.rpz-ip");
+	add(rpzs, "128.1.zz.db8.2001.rpz-ip");
+	add(rpzs, "32.1.2.0.192.rpz-client-ip");
+	add(rpzs, "32.53.2.0.192.rpz-nsip");
+
+	/* IPv4 keys are IPv4-mapped IPv6 keys, so 96 longer. */
+	ATF_CHECK_EQ(findip(rpzs, DNS_RPZ_TYPE_IP, "192.0.2.1"), 96 + 32);
+	ATF_CHECK_EQ(findip(rpzs, DNS_RPZ_TYPE_IP, "192.0.2.2"), 0);
+	ATF_CHECK_EQ(findip(rpzs, DNS_RPZ_TYPE_IP, "198.51.100.77"), 96 + 24);
+	ATF_CHECK_EQ(findip(rpzs, DNS_RPZ_TYPE_IP, "198.51.101.77"), 0);
+	ATF_CHECK_EQ(findip(rpzs, DNS_RPZ_TYPE_IP, "172.16.200.1"), 96 + 16);
+	ATF_CHECK_EQ(findip(rpzs, DNS_RPZ_TYPE_IP, "172.17.0.1"), 0);
+	ATF_CHECK_EQ(findip(rpzs, DNS_RPZ_TYPE_IP, "10.9.8.7"), 96 + 8);
+	ATF_CHECK_EQ(findip(rpzs, DNS_RPZ_TYPE_IP, "11.0.0.1"), 0);
+	ATF_CHECK_EQ(findip(rpzs, DNS_RPZ_TYPE_IP, "2001:db8:1::5"), 64);
+	ATF_CHECK_EQ(findip(rpzs, DNS_RPZ_TYPE_IP, "2001:db8:2::5"), 0);
+	ATF_CHECK_EQ(findip(rpzs, DNS_RPZ_TYPE_IP, "2001:db8::1"), 128);
+	ATF_CHECK_EQ(findip(rpzs, DNS_RPZ_TYPE_IP, "2001:db8::2"), 0);
+
+	/* Each kind of IP trigger is only found as that kind. */
+	ATF_CHECK_EQ(findip(rpzs, DNS_RPZ_TYPE_CLIENT_IP, "192.0.2.1"),
+		     96 + 32);
+	ATF_CHECK_EQ(findip(rpzs, DNS_RPZ_TYPE_CLIENT_IP, "10.9.8.7"), 0);
+	ATF_CHECK_EQ(findip(rpzs, DNS_RPZ_TYPE_NSIP, "192.0.2.53"), 96 + 32);
+	ATF_CHECK_EQ(findip(rpzs, DNS_RPZ_TYPE_NSIP, "192.0.2.1"), 0);
+	ATF_CHECK_EQ(findip(rpzs, DNS_RPZ_TYPE_IP, "192.0.2.53"), 0);
+
+	/* A deleted trigger leaves the shorter ones that cover it. */
+	add(rpzs, "32.1.1.1.10.rpz-ip");
+	ATF_CHECK_EQ(findip(rpzs, DNS_RPZ_TYPE_IP, "10.1.1.1"), 96 + 32);
+	del(rpzs, "32.1.1.1.10.rpz-ip");
+	ATF_CHECK_EQ(findip(rpzs, DNS_RPZ_TYPE_IP, "10.1.1.1"), 96 + 8);
+
+	dns_rpz_detach_rpzs(&rpzs);
+	dns_test_end();
+}
+
+ATF_TC(filterrebuild);
+ATF_TC_HEAD(filterrebuild, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "the filter rebuilt after a reload deletes "
+			  "triggers finds the remaining and new triggers");
+}
+ATF_TC_BODY(filterrebuild, tc) {
+	dns_rpz_zones_t *rpzs, *load_rpzs = NULL;
+	dns_rpz_filter_t *filter;
+	isc_result_t result;
+	char buf[64];
+	int i;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	rpzs = makerpzs();
+
+	/* The first load goes straight into the view's databases. */
+	result = dns_rpz_beginload(&load_rpzs, rpzs, 0);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_REQUIRE_EQ(load_rpzs, rpzs);
+	for (i = 0; i < 100; i++) {
+		snprintf(buf, sizeof(buf), "n%d.example", i);
+		add(load_rpzs, buf);
+	}
+	add(load_rpzs, "*.wild.example");
+	add(load_rpzs, "24.0.100.51.198.rpz-ip");
+	add(load_rpzs, "32.1.2.0.192.rpz-ip");
+	result = dns_rpz_ready(rpzs, &load_rpzs, 0);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	filter = rpzs->filter;
+
+	/*
+	 * Reload without most of the names and one of the addresses,
+	 * and with a new name, so that the filter is rebuilt.
+	 */
+	result = dns_rpz_beginload(&load_rpzs, rpzs, 0);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_REQUIRE(load_rpzs != rpzs);
+	for (i = 0; i < 10; i++) {
+		snprintf(buf, sizeof(buf), "n%d.example", i);
+		add(load_rpzs, buf);
+	}
+	add(load_rpzs, "new.example");
+	add(load_rpzs, "*.wild.example");
+	add(load_rpzs, "24.0.100.51.198.rpz-ip");
+	result = dns_rpz_ready(rpzs, &load_rpzs, 0);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK(rpzs->filter != filter);
+	ATF_CHECK_EQ(rpzs->triggers[0].qname, 12);
+	ATF_CHECK_EQ(rpzs->triggers[0].ipv4, 1);
+
+	for (i = 0; i < 100; i++) {
+		snprintf(buf, sizeof(buf), "n%d.example.", i);
+		if (findname(rpzs, DNS_RPZ_TYPE_QNAME, buf) != (i < 10))
+			ATF_CHECK_MSG(ISC_FALSE, "%s %sfound", buf,
+				      i < 10 ? "not " : "");
+	}
+	ATF_CHECK(findname(rpzs, DNS_RPZ_TYPE_QNAME, "new.example."));
+	ATF_CHECK(findname(rpzs, DNS_RPZ_TYPE_QNAME, "a.wild.example."));
+	ATF_CHECK_EQ(findip(rpzs, DNS_RPZ_TYPE_IP, "198.51.100.77"), 96 + 24);
+	ATF_CHECK_EQ(findip(rpzs, DNS_RPZ_TYPE_IP, "192.0.2.1"), 0);
+
+	dns_rpz_detach_rpzs(&rpzs);
+	dns_test_end();
+}
+
+ATF_TC(nsmemo);
+ATF_TC_HEAD(nsmemo, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "the NS memo forgets delegations when the summary "
+			  "databases change, when more policy zones are "
+			  "checked, and when the TTL runs out");
+}
+ATF_TC_BODY(nsmemo, tc) {
+	dns_rpz_zones_t *rpzs;
+	dns_fixedname_t fname, fother;
+	dns_name_t *nsname, *other;
+	dns_rpz_zbits_t both;
+	unsigned int gen;
+	isc_stdtime_t now = 100000;
+	isc_result_t result;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	rpzs = makerpzs();
+	makename("example.net", dns_rootname, &fname);
+	nsname = dns_fixedname_name(&fname);
+	makename("example.org", dns_rootname, &fother);
+	other = dns_fixedname_name(&fother);
+	both = DNS_RPZ_ZBIT(0) | DNS_RPZ_ZBIT(1);
+
+	gen = rpzs->trig_gen;
+	ATF_CHECK(!dns_rpz_nsmemo_find(rpzs, gen, nsname, ZBIT, ZBIT, now));
+	dns_rpz_nsmemo_add(rpzs, gen, nsname, ZBIT, ZBIT, 60, now);
+	ATF_CHECK(dns_rpz_nsmemo_find(rpzs, gen, nsname, ZBIT, ZBIT, now));
+	ATF_CHECK(dns_rpz_nsmemo_find(rpzs, gen, nsname, 0, ZBIT, now));
+	ATF_CHECK(!dns_rpz_nsmemo_find(rpzs, gen, other, ZBIT, ZBIT, now));
+
+	/* More policy zones than were checked. */
+	ATF_CHECK(!dns_rpz_nsmemo_find(rpzs, gen, nsname, both, ZBIT, now));
+	ATF_CHECK(!dns_rpz_nsmemo_find(rpzs, gen, nsname, ZBIT, both, now));
+
+	/* The TTL, capped at 5 minutes. */
+	ATF_CHECK(dns_rpz_nsmemo_find(rpzs, gen, nsname, ZBIT, ZBIT,
+				      now + 59));
+	ATF_CHECK(!dns_rpz_nsmemo_find(rpzs, gen, nsname, ZBIT, ZBIT,
+				       now + 60));
+	dns_rpz_nsmemo_add(rpzs, gen, nsname, ZBIT, ZBIT, 86400, now);
+	ATF_CHECK(!dns_rpz_nsmemo_find(rpzs, gen, nsname, ZBIT, ZBIT,
+				       now + 300));
+
+	/* Any change to the summary databases. */
+	add(rpzs, "ns.example.net.rpz-nsdname");
+	ATF_CHECK(rpzs->trig_gen != gen);
+	ATF_CHECK(!dns_rpz_nsmemo_find(rpzs, rpzs->trig_gen, nsname,
+				       ZBIT, ZBIT, now));
+	gen = rpzs->trig_gen;
+	dns_rpz_nsmemo_add(rpzs, gen, nsname, ZBIT, ZBIT, 60, now);
+	ATF_CHECK(dns_rpz_nsmemo_find(rpzs, gen, nsname, ZBIT, ZBIT, now));
+	del(rpzs, "ns.example.net.rpz-nsdname");
+	ATF_CHECK(!dns_rpz_nsmemo_find(rpzs, rpzs->trig_gen, nsname,
+				       ZBIT, ZBIT, now));
+
+	dns_rpz_detach_rpzs(&rpzs);
+	dns_test_end();
+}
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, filtername);
+	ATF_TP_ADD_TC(tp, filterip);
+	ATF_TP_ADD_TC(tp, filterrebuild);
+	ATF_TP_ADD_TC(tp, nsmemo);
+	return (atf_no_error());
+}
@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2015  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <unistd.h>
+
+#include <isc/buffer.h>
+#include <isc/string.h>
+
+#include <dns/fixedname.h>
+#include <dns/keyvalues.h>
+#include <dns/name.h>
+#include <dns/rdata.h>
+#include <dns/rdatalist.h>
+#include <dns/rdataset.h>
+#include <dns/sigcache.h>
+
+#include <dst/dst.h>
+
+#include "dnstest.h"
+
+static void
+makename(const char *text, dns_fixedname_t *fixed) {
+	isc_buffer_t b;
+	isc_result_t result;
+
+	dns_fixedname_init(fixed);
+	isc_buffer_constinit(&b, text, strlen(text));
+	isc_buffer_add(&b, strlen(text));
+	result = dns_name_fromtext(dns_fixedname_name(fixed), &b,
+				   dns_rootname, 0, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+}
+
+static void
+makedigest(unsigned char *digest, unsigned char fill) {
+	memset(digest, fill, DNS_SIGCACHE_KEYLENGTH);
+}
+
+/*
+ * Individual unit tests
+ */
+ATF_TC(lookup);
+ATF_TC_HEAD(lookup, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "remembered verifications are found until they expire");
+}
+ATF_TC_BODY(lookup, tc) {
+	isc_result_t result;
+	dns_sigcache_t *cache = NULL;
+	unsigned char d1[DNS_SIGCACHE_KEYLENGTH];
+	unsigned char d2[DNS_SIGCACHE_KEYLENGTH];
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_sigcache_create(mctx, 64, &cache);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	makedigest(d1, 0x11);
+	makedigest(d2, 0x22);
+
+	ATF_CHECK(!dns_sigcache_lookup(cache, d1, 1000));
+
+	dns_sigcache_add(cache, d1, 2000);
+	ATF_CHECK(dns_sigcache_lookup(cache, d1, 1000));
+	ATF_CHECK(dns_sigcache_lookup(cache, d1, 2000));
+	ATF_CHECK(!dns_sigcache_lookup(cache, d2, 1000));
+
+	/*
+	 * Once the signature has expired the entry is gone for good.
+	 */
+	ATF_CHECK(!dns_sigcache_lookup(cache, d1, 2001));
+	ATF_CHECK(!dns_sigcache_lookup(cache, d1, 1000));
+
+	/*
+	 * A digest landing in the same slot replaces the old entry.
+	 */
+	dns_sigcache_add(cache, d1, 2000);
+	d2[0] = d1[0]; d2[1] = d1[1]; d2[2] = d1[2]; d2[3] = d1[3];
+	dns_sigcache_add(cache, d2, 2000);
+	ATF_CHECK(dns_sigcache_lookup(cache, d2, 1000));
+	ATF_CHECK(!dns_sigcache_lookup(cache, d1, 1000));
+
+	dns_sigcache_detach(&cache);
+	dns_test_end();
+}
+
+ATF_TC(key);
+ATF_TC_HEAD(key, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "memo keys depend on every input of the verification");
+}
+ATF_TC_BODY(key, tc) {
+	isc_result_t result;
+	dns_fixedname_t fname, fupper, fother;
+	dst_key_t *key = NULL, *key2 = NULL;
+	dns_rdatalist_t rdatalist;
+	dns_rdataset_t rdataset;
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	dns_rdata_t sig = DNS_RDATA_INIT;
+	unsigned char a[4] = { 10, 53, 0, 1 };
+	unsigned char sigdata[32];
+	unsigned char base[DNS_SIGCACHE_KEYLENGTH];
+	unsigned char digest[DNS_SIGCACHE_KEYLENGTH];
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	makename("www.example", &fname);
+	makename("WWW.Example", &fupper);
+	makename("ftp.example", &fother);
+
+	result = dst_key_generate(dns_fixedname_name(&fname),
+				  DST_ALG_HMACSHA256, 256, 0, 0,
+				  DNS_KEYPROTO_DNSSEC, dns_rdataclass_in,
+				  mctx, &key);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dst_key_generate(dns_fixedname_name(&fname),
+				  DST_ALG_HMACSHA256, 256, 0, 0,
+				  DNS_KEYPROTO_DNSSEC, dns_rdataclass_in,
+				  mctx, &key2);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	dns_rdata_init(&rdata);
+	rdata.data = a;
+	rdata.length = sizeof(a);
+	rdata.rdclass = dns_rdataclass_in;
+	rdata.type = dns_rdatatype_a;
+
+	dns_rdatalist_init(&rdatalist);
+	rdatalist.rdclass = dns_rdataclass_in;
+	rdatalist.type = dns_rdatatype_a;
+	rdatalist.ttl = 300;
+	ISC_LIST_APPEND(rdatalist.rdata, &rdata, link);
+
+	dns_rdataset_init(&rdataset);
+	result = dns_rdatalist_tordataset(&rdatalist, &rdataset);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	memset(sigdata, 0x5a, sizeof(sigdata));
+	sig.data = sigdata;
+	sig.length = sizeof(sigdata);
+	sig.rdclass = dns_rdataclass_in;
+	sig.type = dns_rdatatype_rrsig;
+
+	result = dns_sigcache_key(dns_fixedname_name(&fname), &rdataset,
+				  key, &sig, 0, base);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/* Same inputs, same key; owner name case does not matter. */
+	result = dns_sigcache_key(dns_fixedname_name(&fupper), &rdataset,
+				  key, &sig, 0, digest);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK(memcmp(base, digest, sizeof(base)) == 0);
+
+	/* Different owner. */
+	result = dns_sigcache_key(dns_fixedname_name(&fother), &rdataset,
+				  key, &sig, 0, digest);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK(memcmp(base, digest, sizeof(base)) != 0);
+
+	/* Different key. */
+	result = dns_sigcache_key(dns_fixedname_name(&fname), &rdataset,
+				  key2, &sig, 0, digest);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK(memcmp(base, digest, sizeof(base)) != 0);
+
+	/* Different maxbits. */
+	result = dns_sigcache_key(dns_fixedname_name(&fname), &rdataset,
+				  key, &sig, 1024, digest);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK(memcmp(base, digest, sizeof(base)) != 0);
+
+	/* Different signature. */
+	sigdata[sizeof(sigdata) - 1] ^= 1;
+	result = dns_sigcache_key(dns_fixedname_name(&fname), &rdataset,
+				  key, &sig, 0, digest);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK(memcmp(base, digest, sizeof(base)) != 0);
+	sigdata[sizeof(sigdata) - 1] ^= 1;
+
+	/* Different rdata. */
+	a[3] = 2;
+	result = dns_sigcache_key(dns_fixedname_name(&fname), &rdataset,
+				  key, &sig, 0, digest);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK(memcmp(base, digest, sizeof(base)) != 0);
+
+	dns_rdataset_disassociate(&rdataset);
+	dst_key_free(&key);
+	dst_key_free(&key2);
+	dns_test_end();
+}
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, lookup);
+	ATF_TP_ADD_TC(tp, key);
+	return (atf_no_error());
+}
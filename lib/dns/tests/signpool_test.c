@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2015  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <isc/buffer.h>
+#include <isc/print.h>
+#include <isc/string.h>
+
+#include <dns/dnssec.h>
+#include <dns/fixedname.h>
+#include <dns/keyvalues.h>
+#include <dns/name.h>
+#include <dns/rdata.h>
+#include <dns/rdatalist.h>
+#include <dns/rdataset.h>
+#include <dns/signpool.h>
+
+#include <dst/dst.h>
+
+#include "dnstest.h"
+
+#define NJOBS 64
+
+/*
+ * Helper functions
+ */
+
+static dns_signjob_t jobstore[NJOBS];
+static dns_signjob_t *jobs[NJOBS];
+static dns_rdatalist_t rdatalists[NJOBS];
+static dns_rdata_t rdatas[NJOBS];
+static unsigned char addrs[NJOBS][4];
+
+static void
+makename(const char *text, dns_fixedname_t *fixed) {
+	isc_buffer_t b;
+	isc_result_t result;
+
+	dns_fixedname_init(fixed);
+	isc_buffer_constinit(&b, text, strlen(text));
+	isc_buffer_add(&b, strlen(text));
+	result = dns_name_fromtext(dns_fixedname_name(fixed), &b,
+				   dns_rootname, 0, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+}
+
+/*
+ * Set up NJOBS jobs, each signing a single A record at its own name
+ * with 'key'.  Job 'bad' gets an inception time after its expiry, so
+ * it must fail.
+ */
+static void
+makejobs(dst_key_t *key, unsigned int bad) {
+	char text[32];
+	unsigned int i;
+	isc_result_t result;
+
+	for (i = 0; i < NJOBS; i++) {
+		dns_signjob_t *job = &jobstore[i];
+
+		snprintf(text, sizeof(text), "host%u.example", i);
+		makename(text, &job->name);
+
+		addrs[i][0] = 10;
+		addrs[i][1] = 53;
+		addrs[i][2] = i >> 8;
+		addrs[i][3] = i & 0xff;
+		dns_rdata_init(&rdatas[i]);
+		rdatas[i].data = addrs[i];
+		rdatas[i].length = sizeof(addrs[i]);
+		rdatas[i].rdclass = dns_rdataclass_in;
+		rdatas[i].type = dns_rdatatype_a;
+
+		dns_rdatalist_init(&rdatalists[i]);
+		rdatalists[i].rdclass = dns_rdataclass_in;
+		rdatalists[i].type = dns_rdatatype_a;
+		rdatalists[i].ttl = 300;
+		ISC_LIST_APPEND(rdatalists[i].rdata, &rdatas[i], link);
+
+		dns_rdataset_init(&job->rdataset);
+		result = dns_rdatalist_tordataset(&rdatalists[i],
+						  &job->rdataset);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+		job->key = key;
+		job->inception = 1000;
+		job->expire = (i == bad) ? 1000 : 2000;
+		job->result = ISC_R_UNEXPECTED;
+		jobs[i] = job;
+	}
+}
+
+static void
+freejobs(void) {
+	unsigned int i;
+
+	for (i = 0; i < NJOBS; i++)
+		dns_rdataset_disassociate(&jobstore[i].rdataset);
+}
+
+/*
+ * Sign a batch through a pool with 'nthreads' threads and check every
+ * job against signing its rrset directly.  HMAC signatures are
+ * deterministic, so a result handed back to the wrong job shows up as
+ * a mismatch.
+ */
+static void
+signbatch(unsigned int nthreads) {
+	isc_result_t result;
+	dns_signpool_t *pool = NULL;
+	dns_fixedname_t fname;
+	dst_key_t *key = NULL;
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	unsigned char data[1024];
+	isc_buffer_t buffer;
+	unsigned int i, bad = NJOBS / 3;
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	makename("example", &fname);
+	result = dst_key_generate(dns_fixedname_name(&fname),
+				  DST_ALG_HMACSHA256, 256, 0,
+				  DNS_KEYOWNER_ZONE, DNS_KEYPROTO_DNSSEC,
+				  dns_rdataclass_in, mctx, &key);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_signpool_create(mctx, nthreads, &pool);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	makejobs(key, bad);
+	dns_signpool_sign(pool, jobs, NJOBS);
+
+	for (i = 0; i < NJOBS; i++) {
+		dns_signjob_t *job = jobs[i];
+
+		ATF_REQUIRE_EQ(job, &jobstore[i]);
+		if (i == bad) {
+			ATF_CHECK_EQ(job->result, DNS_R_INVALIDTIME);
+			continue;
+		}
+		ATF_REQUIRE_EQ(job->result, ISC_R_SUCCESS);
+		ATF_CHECK_EQ(job->rdata.type, dns_rdatatype_rrsig);
+
+		isc_buffer_init(&buffer, data, sizeof(data));
+		dns_rdata_reset(&rdata);
+		result = dns_dnssec_sign(dns_fixedname_name(&job->name),
+					 &job->rdataset, key,
+					 &job->inception, &job->expire,
+					 mctx, &buffer, &rdata);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		ATF_CHECK_EQ(dns_rdata_compare(&job->rdata, &rdata), 0);
+	}
+
+	freejobs();
+
+	/*
+	 * The pool can be reused for another batch.
+	 */
+	makejobs(key, NJOBS);
+	dns_signpool_sign(pool, jobs, NJOBS);
+	for (i = 0; i < NJOBS; i++)
+		ATF_CHECK_EQ(jobs[i]->result, ISC_R_SUCCESS);
+	freejobs();
+
+	dns_signpool_detach(&pool);
+	ATF_REQUIRE_EQ(pool, NULL);
+	dst_key_free(&key);
+	dns_test_end();
+}
+
+/*
+ * Individual unit tests
+ */
+ATF_TC(sign);
+ATF_TC_HEAD(sign, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "every job in a batch is signed by the pool threads "
+			  "and gets its own result");
+}
+ATF_TC_BODY(sign, tc) {
+	UNUSED(tc);
+
+	signbatch(4);
+}
+
+ATF_TC(nothreads);
+ATF_TC_HEAD(nothreads, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "a pool without threads signs the batch in the "
+			  "caller");
+}
+ATF_TC_BODY(nothreads, tc) {
+	UNUSED(tc);
+
+	signbatch(0);
+}
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, sign);
+	ATF_TP_ADD_TC(tp, nothreads);
+	return (atf_no_error());
+}
@@ -50,6 +50,7 @@
 #include <dns/rdatastruct.h>
 #include <dns/rdatatype.h>
 #include <dns/result.h>
+#include <dns/signpool.h>
 #include <dns/soa.h>
 #include <dns/ssu.h>
 #include <dns/tsig.h>
@@ -1066,15 +1067,130 @@ find_zone_keys(dns_zone_t *zone, dns_db_t *db, dns_dbversion_t *ver,
 	return (result);
 }
 
+/*%
+ * Signatures waiting to be computed by a signing pool.  Once they are,
+ * sign_pending() adds them to the database in the order they were
+ * queued.  Only the RRSIG changes for RRsets that are not themselves
+ * changed until then are queued.
+ */
+typedef struct sigqueue {
+	isc_mem_t		*mctx;
+	dns_signpool_t		*pool;
+	dns_signjob_t		**jobs;
+	unsigned int		njobs;
+	unsigned int		size;
+} sigqueue_t;
+
+/*%
+ * Sign the queued RRsets once this many signatures are waiting.
+ */
+#define SIGQUEUE_MAX	256
+
+static void
+sigqueue_clear(sigqueue_t *queue) {
+	dns_signjob_t *job;
+
+	while (queue->njobs > 0) {
+		job = queue->jobs[--queue->njobs];
+		dns_rdataset_disassociate(&job->rdataset);
+		isc_mem_put(queue->mctx, job, sizeof(*job));
+	}
+}
+
+static void
+sigqueue_free(sigqueue_t *queue) {
+	sigqueue_clear(queue);
+	if (queue->jobs != NULL) {
+		isc_mem_put(queue->mctx, queue->jobs,
+			    queue->size * sizeof(*queue->jobs));
+		queue->jobs = NULL;
+		queue->size = 0;
+	}
+	if (queue->pool != NULL)
+		dns_signpool_detach(&queue->pool);
+}
+
+static isc_result_t
+sigqueue_add(sigqueue_t *queue, dns_name_t *name, dns_rdataset_t *rdataset,
+	     dst_key_t *key, isc_stdtime_t inception, isc_stdtime_t expire)
+{
+	dns_signjob_t *job, **jobs;
+	unsigned int size;
+
+	if (queue->njobs == queue->size) {
+		size = (queue->size == 0) ? 16 : queue->size * 2;
+		jobs = isc_mem_get(queue->mctx, size * sizeof(*jobs));
+		if (jobs == NULL)
+			return (ISC_R_NOMEMORY);
+		if (queue->jobs != NULL) {
+			memmove(jobs, queue->jobs,
+				queue->njobs * sizeof(*jobs));
+			isc_mem_put(queue->mctx, queue->jobs,
+				    queue->size * sizeof(*jobs));
+		}
+		queue->jobs = jobs;
+		queue->size = size;
+	}
+
+	job = isc_mem_get(queue->mctx, sizeof(*job));
+	if (job == NULL)
+		return (ISC_R_NOMEMORY);
+	dns_fixedname_init(&job->name);
+	dns_name_copy(name, dns_fixedname_name(&job->name), NULL);
+	dns_rdataset_init(&job->rdataset);
+	dns_rdataset_clone(rdataset, &job->rdataset);
+	job->key = key;
+	job->inception = inception;
+	job->expire = expire;
+	job->result = ISC_R_UNEXPECTED;
+	queue->jobs[queue->njobs++] = job;
+
+	return (ISC_R_SUCCESS);
+}
+
+/*%
+ * Compute the queued signatures in parallel and add them to the
+ * database, recording the changes in "diff".
+ */
+static isc_result_t
+sign_pending(dns_db_t *db, dns_dbversion_t *ver, sigqueue_t *queue,
+	     dns_diff_t *diff)
+{
+	isc_result_t result = ISC_R_SUCCESS;
+	dns_signjob_t *job;
+	unsigned int i;
+
+	if (queue->njobs == 0)
+		return (ISC_R_SUCCESS);
+
+	dns_signpool_sign(queue->pool, queue->jobs, queue->njobs);
+
+	for (i = 0; i < queue->njobs; i++) {
+		job = queue->jobs[i];
+		CHECK(job->result);
+		/* XXX inefficient - will cause dataset merging */
+		CHECK(update_one_rr(db, ver, diff, DNS_DIFFOP_ADDRESIGN,
+				    dns_fixedname_name(&job->name),
+				    job->rdataset.ttl, &job->rdata));
+	}
+
+ failure:
+	sigqueue_clear(queue);
+	return (result);
+}
+
 /*%
  * Add RRSIG records for an RRset, recording the change in "diff".
+ * If "queue" has a signing pool, the signatures are queued there
+ * instead of being computed here.
  */
 static isc_result_t
 add_sigs(dns_update_log_t *log, dns_zone_t *zone, dns_db_t *db,
 	 dns_dbversion_t *ver, dns_name_t *name, dns_rdatatype_t type,
 	 dns_diff_t *diff, dst_key_t **keys, unsigned int nkeys,
 	 isc_stdtime_t inception, isc_stdtime_t expire,
-	 isc_boolean_t check_ksk, isc_boolean_t keyset_kskonly)
+	 isc_boolean_t check_ksk, isc_boolean_t keyset_kskonly,
+	 sigqueue_t *queue)
 {
 	isc_result_t result;
 	dns_dbnode_t *node = NULL;
@@ -1153,6 +1269,13 @@ add_sigs(dns_update_log_t *log, dns_zone_t *zone, dns_db_t *db,
 		} else if (REVOKE(keys[i]) && type != dns_rdatatype_dnskey)
 			continue;
 
+		if (queue != NULL && queue->pool != NULL) {
+			CHECK(sigqueue_add(queue, name, &rdataset, keys[i],
+					   inception, expire));
+			added_sig = ISC_TRUE;
+			continue;
+		}
+
 		/* Calculate the signature, creating a RRSIG RDATA. */
 		CHECK(dns_dnssec_sign(name, &rdataset, keys[i],
 				      &inception, &expire,
@@ -1171,7 +1294,8 @@ add_sigs(dns_update_log_t *log, dns_zone_t *zone, dns_db_t *db,
 			   "found no active private keys, "
 			   "unable to generate any signatures");
 		result = ISC_R_NOTFOUND;
-	}
+	} else if (queue != NULL && queue->njobs >= SIGQUEUE_MAX)
+		result = sign_pending(db, ver, queue, diff);
 
  failure:
 	if (dns_rdataset_isassociated(&rdataset))
@@ -1312,7 +1436,7 @@ add_exposed_sigs(dns_update_log_t *log, dns_zone_t *zone, dns_db_t *db,
 			continue;;
 		result = add_sigs(log, zone, db, ver, name, type, diff,
 				  keys, nkeys, inception, expire,
-				  check_ksk, keyset_kskonly);
+				  check_ksk, keyset_kskonly, NULL);
 		if (result != ISC_R_SUCCESS)
 			goto cleanup_iterator;
 		(*sigs)++;
@@ -1362,6 +1486,7 @@ struct dns_update_state {
 	isc_stdtime_t inception, expire;
 	dns_ttl_t nsecttl;
 	isc_boolean_t check_ksk, keyset_kskonly;
+	sigqueue_t sigqueue;
 	enum { sign_updates, remove_orphaned, build_chain, process_nsec,
 	       sign_nsec, update_nsec3, process_nsec3, sign_nsec3 } state;
 };
@@ -1405,6 +1530,12 @@ dns_update_signaturesinc(dns_update_log_t *log, dns_zone_t *zone, dns_db_t *db,
 		dns_diff_init(diff->mctx, &state->nsec_mindiff);
 		dns_diff_init(diff->mctx, &state->work);
 		state->nkeys = 0;
+		state->sigqueue.mctx = diff->mctx;
+		state->sigqueue.pool = NULL;
+		state->sigqueue.jobs = NULL;
+		state->sigqueue.njobs = 0;
+		state->sigqueue.size = 0;
+		dns_zone_getsignpool(zone, &state->sigqueue.pool);
 
 		result = find_zone_keys(zone, db, newver, diff->mctx,
 					DNS_MAXZONEKEYS, state->zone_keys,
@@ -1522,7 +1653,8 @@ dns_update_signaturesinc(dns_update_log_t *log, dns_zone_t *zone, dns_db_t *db,
 						       state->inception,
 						       state->expire,
 						       state->check_ksk,
-						       state->keyset_kskonly));
+						       state->keyset_kskonly,
+						       &state->sigqueue));
 					sigs++;
 				}
 			skip:
@@ -1538,9 +1670,15 @@ dns_update_signaturesinc(dns_update_log_t *log, dns_zone_t *zone, dns_db_t *db,
 					t = next;
 				}
 			}
-			if (state != &mystate && sigs > maxsigs)
+			if (state != &mystate && sigs > maxsigs) {
+				CHECK(sign_pending(db, newver,
+						   &state->sigqueue,
+						   &state->sig_diff));
 				return (DNS_R_CONTINUE);
+			}
 		}
+		CHECK(sign_pending(db, newver, &state->sigqueue,
+				   &state->sig_diff));
 		ISC_LIST_APPENDLIST(diff->tuples, state->work.tuples, link);
 
 		update_log(log, zone, ISC_LOG_DEBUG(3),
@@ -1801,16 +1939,23 @@ dns_update_signaturesinc(dns_update_log_t *log, dns_zone_t *zone, dns_db_t *db,
 					       state->zone_keys, state->nkeys,
 					       state->inception, state->expire,
 					       state->check_ksk,
-					       state->keyset_kskonly));
+					       state->keyset_kskonly,
+					       &state->sigqueue));
 				sigs++;
 			} else {
 				INSIST(0);
 			}
 			ISC_LIST_UNLINK(state->nsec_mindiff.tuples, t, link);
 			ISC_LIST_APPEND(state->work.tuples, t, link);
-			if (state != &mystate && sigs > maxsigs)
+			if (state != &mystate && sigs > maxsigs) {
+				CHECK(sign_pending(db, newver,
+						   &state->sigqueue,
+						   &state->sig_diff));
 				return (DNS_R_CONTINUE);
+			}
 		}
+		CHECK(sign_pending(db, newver, &state->sigqueue,
+				   &state->sig_diff));
 		ISC_LIST_APPENDLIST(state->nsec_mindiff.tuples,
 				    state->work.tuples, link);
 		/*FALLTHROUGH*/
@@ -1974,16 +2119,23 @@ dns_update_signaturesinc(dns_update_log_t *log, dns_zone_t *zone, dns_db_t *db,
 					       state->zone_keys,
 					       state->nkeys, state->inception,
 					       state->expire, state->check_ksk,
-					       state->keyset_kskonly));
+					       state->keyset_kskonly,
+					       &state->sigqueue));
 				sigs++;
 			} else {
 				INSIST(0);
 			}
 			ISC_LIST_UNLINK(state->nsec_mindiff.tuples, t, link);
 			ISC_LIST_APPEND(state->work.tuples, t, link);
-			if (state != &mystate && sigs > maxsigs)
+			if (state != &mystate && sigs > maxsigs) {
+				CHECK(sign_pending(db, newver,
+						   &state->sigqueue,
+						   &state->sig_diff));
 				return (DNS_R_CONTINUE);
+			}
 		}
+		CHECK(sign_pending(db, newver, &state->sigqueue,
+				   &state->sig_diff));
 		ISC_LIST_APPENDLIST(state->nsec_mindiff.tuples,
 				    state->work.tuples, link);
 
@@ -2014,6 +2166,7 @@ dns_update_signaturesinc(dns_update_log_t *log, dns_zone_t *zone, dns_db_t *db,
 	dns_diff_clear(&state->affected);
 	dns_diff_clear(&state->diffnames);
 	dns_diff_clear(&state->work);
+	sigqueue_free(&state->sigqueue);
 
 	for (i = 0; i < state->nkeys; i++)
 		dst_key_free(&state->zone_keys[i]);
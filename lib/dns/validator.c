@@ -20,9 +20,11 @@
 #include <isc/base32.h>
 #include <isc/mem.h>
 #include <isc/print.h>
+#include <isc/serial.h>
 #include <isc/sha2.h>
 #include <isc/string.h>
 #include <isc/task.h>
+#include <isc/taskpool.h>
 #include <isc/util.h>
 
 #include <dns/db.h>
@@ -41,6 +43,7 @@
 #include <dns/rdatatype.h>
 #include <dns/resolver.h>
 #include <dns/result.h>
+#include <dns/sigcache.h>
 #include <dns/validator.h>
 #include <dns/view.h>
 
@@ -81,6 +84,9 @@
  * startfinddlvsep: starts the DLV record lookup.
  * dlv_validator_start: resets state and restarts the lookup using the
  *	DLV RRset found by startfinddlvsep.
+ * verify_action: runs a signature verification on behalf of validate
+ *	on one of the view's verification tasks.
+ * verifydone: resumes validate once that verification has completed.
  */
 
 #define VALIDATOR_MAGIC			ISC_MAGIC('V', 'a', 'l', '?')
@@ -92,6 +98,8 @@
 						 * have attempted a verify. */
 #define VALATTR_INSECURITY		0x0010	/*%< Attempting proveunsecure. */
 #define VALATTR_DLVTRIED		0x0020	/*%< Looked for a DLV record. */
+#define VALATTR_VERIFYING		0x0040	/*%< Waiting for an offloaded
+						 * verification. */
 
 /*!
  * NSEC proofs to be looked for.
@@ -124,11 +132,29 @@
 #define FOUNDCLOSEST(val) ((val->attributes & VALATTR_FOUNDCLOSEST) != 0)
 #define FOUNDOPTOUT(val) ((val->attributes & VALATTR_FOUNDOPTOUT) != 0)
 
+#define VERIFYING(v)		(((v)->attributes & VALATTR_VERIFYING) != 0)
 #define SHUTDOWN(v)		(((v)->attributes & VALATTR_SHUTDOWN) != 0)
 #define CANCELED(v)		(((v)->attributes & VALATTR_CANCELED) != 0)
 
 #define NEGATIVE(r)	(((r)->attributes & DNS_RDATASETATTR_NEGATIVE) != 0)
 
+/*%
+ * A signature verification handed off to one of the view's
+ * verification tasks.  The same event carries the result back.
+ */
+typedef struct verifyevent {
+	ISC_EVENT_COMMON(struct verifyevent);
+	dns_validator_t *	validator;
+	dst_key_t *		key;
+	dns_rdata_t		rdata;
+	dns_fixedname_t		wild;
+	isc_boolean_t		ignore;
+	isc_boolean_t		memo;
+	unsigned char		digest[DNS_SIGCACHE_KEYLENGTH];
+	isc_stdtime_t		expire;
+	isc_result_t		result;
+} verifyevent_t;
+
 static void
 destroy(dns_validator_t *val);
 
@@ -226,7 +252,7 @@ exit_check(dns_validator_t *val) {
 
 	INSIST(val->event == NULL);
 
-	if (val->fetch != NULL || val->subvalidator != NULL)
+	if (val->fetch != NULL || val->subvalidator != NULL || VERIFYING(val))
 		return (ISC_FALSE);
 
 	return (ISC_TRUE);
@@ -1492,37 +1518,218 @@ isselfsigned(dns_validator_t *val) {
 	return (answer);
 }
 
+/*%
+ * Run the public key operation for verify(), retrying with the
+ * validity period ignored if dnssec-accept-expired is set.
+ *
+ * This may run on one of the view's verification tasks while the
+ * validator is waiting, so only 'val->event' and 'val->view' may be
+ * used.
+ */
+static isc_result_t
+verify_rdataset(dns_validator_t *val, dst_key_t *key, dns_rdata_t *rdata,
+		dns_name_t *wild, isc_boolean_t *ignorep)
+{
+	isc_result_t result;
+	isc_boolean_t ignore = ISC_FALSE;
+
+ again:
+	result = dns_dnssec_verify3(val->event->name, val->event->rdataset,
+				    key, ignore, val->view->maxbits,
+				    val->view->mctx, rdata, wild);
+	if ((result == DNS_R_SIGEXPIRED || result == DNS_R_SIGFUTURE) &&
+	    val->view->acceptexpired && !ignore)
+	{
+		ignore = ISC_TRUE;
+		goto again;
+	}
+	*ignorep = ignore;
+	return (result);
+}
+
+/*%
+ * Callback when an offloaded verification has completed.
+ *
+ * Resumes validate(), which picks up the result in verify().
+ */
+static void
+verifydone(isc_task_t *task, isc_event_t *event) {
+	dns_validator_t *val;
+	isc_boolean_t want_destroy;
+	isc_result_t result;
+
+	UNUSED(task);
+	INSIST(event->ev_type == DNS_EVENT_VALIDATORVERIFY);
+
+	val = ((verifyevent_t *)event)->validator;
+
+	INSIST(val->event != NULL);
+
+	validator_log(val, ISC_LOG_DEBUG(3), "in verifydone");
+	LOCK(&val->lock);
+	INSIST(VERIFYING(val) && val->verifyevent == NULL);
+	val->attributes &= ~VALATTR_VERIFYING;
+	if (CANCELED(val)) {
+		isc_event_free(&event);
+		validator_done(val, ISC_R_CANCELED);
+	} else {
+		val->verifyevent = event;
+		result = validate(val, ISC_TRUE);
+		if (val->verifyevent != NULL)
+			isc_event_free(&val->verifyevent);
+		if (result != DNS_R_WAIT)
+			validator_done(val, result);
+	}
+	want_destroy = exit_check(val);
+	UNLOCK(&val->lock);
+	if (want_destroy)
+		destroy(val);
+}
+
+/*%
+ * Verify a signature on one of the view's verification tasks and
+ * post the result back to the validator's task.
+ */
+static void
+verify_action(isc_task_t *task, isc_event_t *event) {
+	verifyevent_t *vevent;
+	dns_validator_t *val;
+
+	UNUSED(task);
+	INSIST(event->ev_type == DNS_EVENT_VALIDATORVERIFY);
+
+	vevent = (verifyevent_t *)event;
+	val = vevent->validator;
+
+	vevent->result = verify_rdataset(val, vevent->key, &vevent->rdata,
+					 dns_fixedname_name(&vevent->wild),
+					 &vevent->ignore);
+
+	event->ev_sender = val;
+	event->ev_action = verifydone;
+	isc_task_send(val->task, &event);
+}
+
 /*%
  * Attempt to verify the rdataset using the given key and rdata (RRSIG).
  * The signature was good and from a wildcard record and the QNAME does
  * not match the wildcard we need to look for a NOQNAME proof.
  *
+ * If 'offload' is true and the view has verification tasks, the public
+ * key operation is handed to one of them and DNS_R_WAIT is returned;
+ * verifydone() then resumes validate(), which calls us again with the
+ * same arguments to collect the result.
+ *
  * Returns:
  * \li	ISC_R_SUCCESS if the verification succeeds.
+ * \li	DNS_R_WAIT if the verification has been offloaded.
  * \li	Others if the verification fails.
  */
 static isc_result_t
 verify(dns_validator_t *val, dst_key_t *key, dns_rdata_t *rdata,
-       isc_uint16_t keyid)
+       isc_uint16_t keyid, isc_boolean_t offload)
 {
 	isc_result_t result;
 	dns_fixedname_t fixed;
 	isc_boolean_t ignore = ISC_FALSE;
+	isc_boolean_t memo = ISC_FALSE;
 	dns_name_t *wild;
+	dns_rdata_rrsig_t sig;
+	unsigned char digest[DNS_SIGCACHE_KEYLENGTH];
+	isc_stdtime_t now, expire = 0;
+	verifyevent_t *vevent;
+	isc_task_t *vtask = NULL;
 
 	val->attributes |= VALATTR_TRIEDVERIFY;
 	dns_fixedname_init(&fixed);
 	wild = dns_fixedname_name(&fixed);
- again:
-	result = dns_dnssec_verify3(val->event->name, val->event->rdataset,
-				    key, ignore, val->view->maxbits,
-				    val->view->mctx, rdata, wild);
-	if ((result == DNS_R_SIGEXPIRED || result == DNS_R_SIGFUTURE) &&
-	    val->view->acceptexpired)
-	{
-		ignore = ISC_TRUE;
-		goto again;
+
+	/*
+	 * Collect the result of an offloaded verification.
+	 */
+	if (val->verifyevent != NULL) {
+		vevent = (verifyevent_t *)val->verifyevent;
+		val->verifyevent = NULL;
+		INSIST(vevent->key == key);
+		result = vevent->result;
+		ignore = vevent->ignore;
+		memo = vevent->memo;
+		if (memo) {
+			memmove(digest, vevent->digest, sizeof(digest));
+			expire = vevent->expire;
+		}
+		if (result == DNS_R_FROMWILDCARD)
+			dns_name_copy(dns_fixedname_name(&vevent->wild),
+				      wild, NULL);
+		isc_event_free((isc_event_t **)&vevent);
+		goto done;
+	}
+
+	/*
+	 * If this exact verification has succeeded before and the
+	 * signature is still within its validity period, don't repeat
+	 * the public key operation.
+	 */
+	if (val->view->sigcache != NULL) {
+		result = dns_rdata_tostruct(rdata, &sig, NULL);
+		RUNTIME_CHECK(result == ISC_R_SUCCESS);
+		isc_stdtime_get(&now);
+		if (!isc_serial_lt((isc_uint32_t)now, sig.timesigned) &&
+		    !isc_serial_lt(sig.timeexpire, (isc_uint32_t)now) &&
+		    dns_sigcache_key(val->event->name, val->event->rdataset,
+				     key, rdata, val->view->maxbits,
+				     digest) == ISC_R_SUCCESS)
+		{
+			if (dns_sigcache_lookup(val->view->sigcache,
+						digest, now))
+			{
+				validator_log(val, ISC_LOG_DEBUG(3),
+					      "verify rdataset (keyid=%u): "
+					      "success (cached)", keyid);
+				return (ISC_R_SUCCESS);
+			}
+			memo = ISC_TRUE;
+			expire = sig.timeexpire;
+		}
+	}
+
+	/*
+	 * Hand the public key operation to one of the view's verification
+	 * tasks so that a burst of validations doesn't hold up everything
+	 * else queued on our task.  If that isn't possible, verify inline.
+	 */
+	if (offload && val->view->verifytasks != NULL) {
+		vevent = (verifyevent_t *)
+			isc_event_allocate(val->view->mctx, val,
+					   DNS_EVENT_VALIDATORVERIFY,
+					   verify_action, NULL,
+					   sizeof(verifyevent_t));
+		if (vevent != NULL) {
+			vevent->validator = val;
+			vevent->key = key;
+			dns_rdata_init(&vevent->rdata);
+			dns_rdata_clone(rdata, &vevent->rdata);
+			dns_fixedname_init(&vevent->wild);
+			vevent->ignore = ISC_FALSE;
+			vevent->memo = memo;
+			if (memo)
+				memmove(vevent->digest, digest,
+					sizeof(digest));
+			vevent->expire = expire;
+			vevent->result = ISC_R_UNEXPECTED;
+			isc_taskpool_gettask(val->view->verifytasks, &vtask);
+			val->attributes |= VALATTR_VERIFYING;
+			isc_task_sendanddetach(&vtask,
+					       (isc_event_t **)&vevent);
+			return (DNS_R_WAIT);
+		}
 	}
+
+	result = verify_rdataset(val, key, rdata, wild, &ignore);
+
+ done:
+	if (memo && !ignore && result == ISC_R_SUCCESS)
+		dns_sigcache_add(val->view->sigcache, digest, expire);
 	if (ignore && (result == ISC_R_SUCCESS || result == DNS_R_FROMWILDCARD))
 		validator_log(val, ISC_LOG_INFO,
 			      "accepted expired %sRRSIG (keyid=%u)",
@@ -1633,7 +1840,9 @@ validate(dns_validator_t *val, isc_boolean_t resume) {
 
 		do {
 			vresult = verify(val, val->key, &rdata,
-					val->siginfo->keyid);
+					val->siginfo->keyid, ISC_TRUE);
+			if (vresult == DNS_R_WAIT)
+				return (DNS_R_WAIT);
 			if (vresult == ISC_R_SUCCESS)
 				break;
 			if (val->keynode != NULL) {
@@ -1747,7 +1956,7 @@ checkkey(dns_validator_t *val, dns_rdata_t *keyrdata, isc_uint16_t keyid,
 				 */
 				continue;
 		}
-		result = verify(val, dstkey, &rdata, sig.keyid);
+		result = verify(val, dstkey, &rdata, sig.keyid, ISC_FALSE);
 		if (result == ISC_R_SUCCESS)
 			break;
 	}
@@ -2024,7 +2233,7 @@ validatezonekey(dns_validator_t *val) {
 					break;
 				}
 				result = verify(val, dstkey, &sigrdata,
-						sig.keyid);
+						sig.keyid, ISC_FALSE);
 				if (result == ISC_R_SUCCESS) {
 					dns_keytable_detachkeynode(
 								val->keytable,
@@ -3770,6 +3979,7 @@ dns_validator_create(dns_view_t *view, dns_name_t *name, dns_rdatatype_t type,
 	val->fetch = NULL;
 	val->subvalidator = NULL;
 	val->parent = NULL;
+	val->verifyevent = NULL;
 
 	val->keytable = NULL;
 	result = dns_view_getsecroots(val->view, &val->keytable);
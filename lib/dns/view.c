@@ -27,6 +27,7 @@
 #include <isc/stats.h>
 #include <isc/string.h>		/* Required for HP/UX (and others?) */
 #include <isc/task.h>
+#include <isc/taskpool.h>
 #include <isc/util.h>
 
 #include <dns/acache.h>
@@ -39,6 +40,7 @@
 #include <dns/dlz.h>
 #include <dns/dns64.h>
 #include <dns/dnssec.h>
+#include <dns/ecscache.h>
 #include <dns/events.h>
 #include <dns/forward.h>
 #include <dns/keytable.h>
@@ -55,6 +57,7 @@
 #include <dns/resolver.h>
 #include <dns/result.h>
 #include <dns/rpz.h>
+#include <dns/sigcache.h>
 #include <dns/stats.h>
 #include <dns/time.h>
 #include <dns/tsig.h>
@@ -216,6 +219,8 @@ dns_view_create(isc_mem_t *mctx, dns_rdataclass_t rdclass,
 	view->nta_recheck = 0;
 	view->prefetch_eligible = 0;
 	view->prefetch_trigger = 0;
+	view->maxstalettl = 0;
+	view->staleanswerttl = 1;
 	view->dstport = 53;
 	view->preferred_glue = 0;
 	view->flush = ISC_FALSE;
@@ -223,6 +228,10 @@ dns_view_create(isc_mem_t *mctx, dns_rdataclass_t rdclass,
 	view->maxudp = 0;
 	view->nocookieudp = 0;
 	view->maxbits = 0;
+	view->sigcache = NULL;
+	view->ecscache = NULL;
+	view->ecszones = NULL;
+	view->verifytasks = NULL;
 	view->v4_aaaa = dns_aaaa_ok;
 	view->v6_aaaa = dns_aaaa_ok;
 	view->aaaa_acl = NULL;
@@ -372,6 +381,14 @@ destroy(dns_view_t *view) {
 		dns_acache_detach(&view->acache);
 	}
 	dns_rrl_view_destroy(view);
+	if (view->sigcache != NULL)
+		dns_sigcache_detach(&view->sigcache);
+	if (view->ecscache != NULL)
+		dns_ecscache_detach(&view->ecscache);
+	if (view->ecszones != NULL)
+		dns_rbt_destroy(&view->ecszones);
+	if (view->verifytasks != NULL)
+		isc_taskpool_destroy(&view->verifytasks);
 	if (view->rpzs != NULL)
 		dns_rpz_detach_rpzs(&view->rpzs);
 	for (dlzdb = ISC_LIST_HEAD(view->dlz_searched);
@@ -800,6 +817,19 @@ dns_view_createresolver(dns_view_t *view,
 	return (ISC_R_SUCCESS);
 }
 
+isc_result_t
+dns_view_createverifytasks(dns_view_t *view, isc_taskmgr_t *taskmgr,
+			   unsigned int ntasks)
+{
+	REQUIRE(DNS_VIEW_VALID(view));
+	REQUIRE(!view->frozen);
+	REQUIRE(view->verifytasks == NULL);
+	REQUIRE(ntasks > 0);
+
+	return (isc_taskpool_create(taskmgr, view->mctx, ntasks, 0,
+				    &view->verifytasks));
+}
+
 void
 dns_view_setcache(dns_view_t *view, dns_cache_t *cache) {
 	dns_view_setcache2(view, cache, ISC_FALSE);
@@ -1604,6 +1634,8 @@ dns_view_flushcache2(dns_view_t *view, isc_boolean_t fixuponly) {
 		dns_resolver_flushbadcache(view->resolver, NULL);
 	if (view->failcache != NULL)
 		dns_badcache_flush(view->failcache);
+	if (view->ecscache != NULL && !fixuponly)
+		dns_ecscache_flush(view->ecscache);
 
 	dns_adb_flush(view->adb);
 	return (ISC_R_SUCCESS);
@@ -1636,6 +1668,8 @@ dns_view_flushnode(dns_view_t *view, dns_name_t *name, isc_boolean_t tree) {
 			dns_badcache_flushname(view->failcache, name);
 	}
 
+	if (view->ecscache != NULL)
+		dns_ecscache_flushnode(view->ecscache, name, tree);
 	if (view->cache != NULL)
 		result = dns_cache_flushnode(view->cache, name, tree);
 
@@ -2209,3 +2243,18 @@ dns_view_loadnta(dns_view_t *view) {
 
 	return (result);
 }
+
+isc_boolean_t
+dns_view_isecsname(dns_view_t *view, dns_name_t *name) {
+	isc_result_t result;
+	void *data = NULL;
+
+	REQUIRE(DNS_VIEW_VALID(view));
+
+	if (view->ecszones == NULL)
+		return (ISC_FALSE);
+
+	result = dns_rbt_findname(view->ecszones, name, 0, NULL, &data);
+	return (ISC_TF(result == ISC_R_SUCCESS ||
+		       result == DNS_R_PARTIALMATCH));
+}
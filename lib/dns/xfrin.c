@@ -21,9 +21,13 @@
 
 #include <config.h>
 
+#include <isc/magic.h>
 #include <isc/mem.h>
+#include <isc/mutex.h>
 #include <isc/print.h>
 #include <isc/random.h>
+#include <isc/refcount.h>
+#include <isc/stdtime.h>
 #include <isc/string.h>		/* Required for HP/UX (and others?) */
 #include <isc/task.h>
 #include <isc/timer.h>
@@ -128,6 +132,10 @@ struct dns_xfrin_ctx {
 	isc_sockaddr_t		sourceaddr;
 	isc_socket_t 		*socket;
 
+	dns_xfrinpool_t		*pool;		/*%< Connection cache */
+	isc_boolean_t		reuse;		/*%< May use a cached one */
+	isc_boolean_t		pooled;		/*%< Untried cached one */
+
 	/*% Buffer for IXFR/AXFR request message */
 	isc_buffer_t 		qbuffer;
 	unsigned char 		qbuffer_data[512];
@@ -177,6 +185,48 @@ struct dns_xfrin_ctx {
 #define XFRIN_MAGIC		  ISC_MAGIC('X', 'f', 'r', 'I')
 #define VALID_XFRIN(x)		  ISC_MAGIC_VALID(x, XFRIN_MAGIC)
 
+/*%
+ * An idle connection to a master.
+ */
+typedef struct xfrinconn xfrinconn_t;
+
+struct xfrinconn {
+	isc_socket_t		*socket;
+	isc_sockaddr_t		masteraddr;
+	isc_sockaddr_t		sourceaddr;
+	isc_dscp_t		dscp;
+	isc_stdtime_t		idle;		/*%< When it became idle */
+	ISC_LINK(xfrinconn_t)	link;
+};
+
+/*%
+ * Cache of idle connections.
+ */
+struct dns_xfrinpool {
+	/* Unlocked. */
+	unsigned int		magic;
+	isc_mem_t		*mctx;
+	isc_refcount_t		references;
+	isc_mutex_t		lock;
+
+	/* Locked by lock. */
+	ISC_LIST(xfrinconn_t)	conns;		/*%< Most recently used first */
+	unsigned int		nconns;
+	isc_boolean_t		exiting;
+};
+
+#define XFRINPOOL_MAGIC		  ISC_MAGIC('X', 'f', 'r', 'P')
+#define VALID_XFRINPOOL(x)	  ISC_MAGIC_VALID(x, XFRINPOOL_MAGIC)
+
+/*%
+ * At most XFRINPOOL_MAX connections are cached, each for at most
+ * XFRINPOOL_IDLE seconds, which is well within the time a master
+ * running named waits for the next request before closing the
+ * connection.
+ */
+#define XFRINPOOL_MAX		64
+#define XFRINPOOL_IDLE		10
+
 /**************************************************************************/
 /*
  * Forward declarations.
@@ -226,6 +276,12 @@ static void xfrin_recv_done(isc_task_t *task, isc_event_t *event);
 static void xfrin_timeout(isc_task_t *task, isc_event_t *event);
 
 static void maybe_free(dns_xfrin_ctx_t *xfr);
+static void xfrin_reset(dns_xfrin_ctx_t *xfr);
+
+static isc_socket_t *
+pool_take(dns_xfrinpool_t *pool, isc_sockaddr_t *masteraddr,
+	  isc_sockaddr_t *sourceaddr, isc_dscp_t dscp);
+static void pool_give(dns_xfrinpool_t *pool, dns_xfrin_ctx_t *xfr);
 
 static void
 xfrin_fail(dns_xfrin_ctx_t *xfr, isc_result_t result, const char *msg);
@@ -670,7 +726,11 @@ dns_xfrin_create3(dns_zone_t *zone, dns_rdatatype_t xfrtype,
 			   dns_zone_getclass(zone), xfrtype, masteraddr,
 			   sourceaddr, dscp, tsigkey, &xfr));
 
-	CHECK(xfrin_start(xfr));
+	result = xfrin_start(xfr);
+	if (result != ISC_R_SUCCESS) {
+		xfrin_fail(xfr, result, "failed setting up socket");
+		goto failure;
+	}
 
 	xfr->done = done;
 	if (xfr->done != NULL)
@@ -728,8 +788,6 @@ static void
 xfrin_reset(dns_xfrin_ctx_t *xfr) {
 	REQUIRE(VALID_XFRIN(xfr));
 
-	xfrin_log(xfr, ISC_LOG_INFO, "resetting");
-
 	xfrin_cancelio(xfr);
 
 	if (xfr->socket != NULL)
@@ -831,6 +889,10 @@ xfrin_create(isc_mem_t *mctx,
 
 	/* sockaddr */
 	xfr->socket = NULL;
+	xfr->pool = NULL;
+	dns_zone_getxfrinpool(zone, &xfr->pool);
+	xfr->reuse = ISC_TRUE;
+	xfr->pooled = ISC_FALSE;
 	/* qbuffer */
 	/* qbuffer_data */
 	/* tcpmsg */
@@ -903,6 +965,8 @@ xfrin_create(isc_mem_t *mctx,
 		dns_tsigkey_detach(&xfr->tsigkey);
 	if (xfr->db != NULL)
 		dns_db_detach(&xfr->db);
+	if (xfr->pool != NULL)
+		dns_xfrinpool_detach(&xfr->pool);
 	isc_task_detach(&xfr->task);
 	dns_zone_idetach(&xfr->zone);
 	isc_mem_putanddetach(&xfr->mctx, xfr, sizeof(*xfr));
@@ -913,6 +977,21 @@ xfrin_create(isc_mem_t *mctx,
 static isc_result_t
 xfrin_start(dns_xfrin_ctx_t *xfr) {
 	isc_result_t result;
+
+	if (xfr->pool != NULL && xfr->reuse) {
+		xfr->socket = pool_take(xfr->pool, &xfr->masteraddr,
+					&xfr->sourceaddr, xfr->dscp);
+		if (xfr->socket != NULL) {
+			xfr->pooled = ISC_TRUE;
+			xfrin_log(xfr, ISC_LOG_INFO,
+				  "reusing connection to master");
+			dns_tcpmsg_init(xfr->mctx, xfr->socket, &xfr->tcpmsg);
+			xfr->tcpmsg_valid = ISC_TRUE;
+			CHECK(xfrin_send_request(xfr));
+			return (ISC_R_SUCCESS);
+		}
+	}
+
 	CHECK(isc_socket_create(xfr->socketmgr,
 				isc_sockaddr_pf(&xfr->sourceaddr),
 				isc_sockettype_tcp,
@@ -928,7 +1007,6 @@ xfrin_start(dns_xfrin_ctx_t *xfr) {
 	xfr->connects++;
 	return (ISC_R_SUCCESS);
  failure:
-	xfrin_fail(xfr, result, "failed setting up socket");
 	return (result);
 }
 
@@ -1165,6 +1243,29 @@ xfrin_send_request(dns_xfrin_ctx_t *xfr) {
 	return (result);
 }
 
+/*
+ * A cached connection failed before any response was received on it;
+ * most likely the master closed it while it was idle.  Send the
+ * request again over a new connection.
+ */
+static isc_boolean_t
+xfrin_retry(dns_xfrin_ctx_t *xfr, isc_result_t result) {
+	if (!xfr->pooled || xfr->shuttingdown)
+		return (ISC_FALSE);
+
+	xfrin_log(xfr, ISC_LOG_DEBUG(3),
+		  "cached connection failed: %s",
+		  isc_result_totext(result));
+	xfrin_log(xfr, ISC_LOG_DEBUG(3), "resetting");
+	xfrin_reset(xfr);
+	xfr->reuse = ISC_FALSE;
+	xfr->pooled = ISC_FALSE;
+	result = xfrin_start(xfr);
+	if (result != ISC_R_SUCCESS)
+		xfrin_fail(xfr, result, "retrying transfer");
+	return (ISC_TRUE);
+}
+
 static void
 xfrin_send_done(isc_task_t *task, isc_event_t *event) {
 	isc_socketevent_t *sev = (isc_socketevent_t *) event;
@@ -1179,6 +1280,10 @@ xfrin_send_done(isc_task_t *task, isc_event_t *event) {
 
 	xfr->sends--;
 	xfrin_log(xfr, ISC_LOG_DEBUG(3), "sent request data");
+	if (sev->result != ISC_R_SUCCESS && xfrin_retry(xfr, sev->result)) {
+		isc_event_free(&event);
+		return;
+	}
 	CHECK(sev->result);
 
 	CHECK(dns_tcpmsg_readmessage(&xfr->tcpmsg, xfr->task,
@@ -1214,7 +1319,11 @@ xfrin_recv_done(isc_task_t *task, isc_event_t *ev) {
 		return;
 	}
 
+	if (tcpmsg->result != ISC_R_SUCCESS &&
+	    xfrin_retry(xfr, tcpmsg->result))
+		return;
 	CHECK(tcpmsg->result);
+	xfr->pooled = ISC_FALSE;
 
 	xfrin_log(xfr, ISC_LOG_DEBUG(7), "received %u bytes",
 		  tcpmsg->buffer.used);
@@ -1258,10 +1367,13 @@ xfrin_recv_done(isc_task_t *task, isc_event_t *ev) {
 		       isc_result_totext(result));
  try_axfr:
 		dns_message_destroy(&msg);
+		xfrin_log(xfr, ISC_LOG_INFO, "resetting");
 		xfrin_reset(xfr);
 		xfr->reqtype = dns_rdatatype_soa;
 		xfr->state = XFRST_SOAQUERY;
-		(void)xfrin_start(xfr);
+		result = xfrin_start(xfr);
+		if (result != ISC_R_SUCCESS)
+			xfrin_fail(xfr, result, "failed setting up socket");
 		return;
 	}
 
@@ -1381,6 +1493,16 @@ xfrin_recv_done(isc_task_t *task, isc_event_t *ev) {
 		if (xfr->ixfr.journal != NULL)
 			dns_journal_destroy(&xfr->ixfr.journal);
 
+		/*
+		 * The response is complete, so the connection can carry
+		 * another transfer.
+		 */
+		if (xfr->pool != NULL) {
+			dns_tcpmsg_invalidate(&xfr->tcpmsg);
+			xfr->tcpmsg_valid = ISC_FALSE;
+			pool_give(xfr->pool, xfr);
+		}
+
 		/*
 		 * Inform the caller we succeeded.
 		 */
@@ -1509,9 +1631,186 @@ maybe_free(dns_xfrin_ctx_t *xfr) {
 	if (xfr->zone != NULL)
 		dns_zone_idetach(&xfr->zone);
 
+	if (xfr->pool != NULL)
+		dns_xfrinpool_detach(&xfr->pool);
+
 	isc_mem_putanddetach(&xfr->mctx, xfr, sizeof(*xfr));
 }
 
+/**************************************************************************/
+/*
+ * Connection cache.
+ */
+
+isc_result_t
+dns_xfrinpool_create(isc_mem_t *mctx, dns_xfrinpool_t **poolp) {
+	dns_xfrinpool_t *pool;
+	isc_result_t result;
+
+	REQUIRE(mctx != NULL);
+	REQUIRE(poolp != NULL && *poolp == NULL);
+
+	pool = isc_mem_get(mctx, sizeof(*pool));
+	if (pool == NULL)
+		return (ISC_R_NOMEMORY);
+
+	result = isc_mutex_init(&pool->lock);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_pool;
+	result = isc_refcount_init(&pool->references, 1);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_lock;
+
+	ISC_LIST_INIT(pool->conns);
+	pool->nconns = 0;
+	pool->exiting = ISC_FALSE;
+	pool->mctx = NULL;
+	isc_mem_attach(mctx, &pool->mctx);
+	pool->magic = XFRINPOOL_MAGIC;
+
+	*poolp = pool;
+	return (ISC_R_SUCCESS);
+
+ cleanup_lock:
+	DESTROYLOCK(&pool->lock);
+ cleanup_pool:
+	isc_mem_put(mctx, pool, sizeof(*pool));
+	return (result);
+}
+
+void
+dns_xfrinpool_attach(dns_xfrinpool_t *source, dns_xfrinpool_t **targetp) {
+	REQUIRE(VALID_XFRINPOOL(source));
+	REQUIRE(targetp != NULL && *targetp == NULL);
+
+	isc_refcount_increment(&source->references, NULL);
+	*targetp = source;
+}
+
+/*
+ * Close 'conn' and remove it from the cache.  Requires pool->lock.
+ */
+static void
+conn_free(dns_xfrinpool_t *pool, xfrinconn_t *conn) {
+	ISC_LIST_UNLINK(pool->conns, conn, link);
+	pool->nconns--;
+	isc_socket_detach(&conn->socket);
+	isc_mem_put(pool->mctx, conn, sizeof(*conn));
+}
+
+/*
+ * Close the connections that have been idle for too long.  Requires
+ * pool->lock.
+ */
+static void
+pool_expire(dns_xfrinpool_t *pool, isc_stdtime_t now) {
+	xfrinconn_t *conn;
+
+	while ((conn = ISC_LIST_TAIL(pool->conns)) != NULL &&
+	       conn->idle + XFRINPOOL_IDLE <= now)
+		conn_free(pool, conn);
+}
+
+void
+dns_xfrinpool_shutdown(dns_xfrinpool_t *pool) {
+	REQUIRE(VALID_XFRINPOOL(pool));
+
+	LOCK(&pool->lock);
+	pool->exiting = ISC_TRUE;
+	while (!ISC_LIST_EMPTY(pool->conns))
+		conn_free(pool, ISC_LIST_HEAD(pool->conns));
+	UNLOCK(&pool->lock);
+}
+
+void
+dns_xfrinpool_detach(dns_xfrinpool_t **poolp) {
+	dns_xfrinpool_t *pool;
+	unsigned int refs;
+
+	REQUIRE(poolp != NULL);
+	pool = *poolp;
+	*poolp = NULL;
+	REQUIRE(VALID_XFRINPOOL(pool));
+
+	isc_refcount_decrement(&pool->references, &refs);
+	if (refs > 0)
+		return;
+
+	dns_xfrinpool_shutdown(pool);
+	INSIST(pool->nconns == 0);
+	pool->magic = 0;
+	isc_refcount_destroy(&pool->references);
+	DESTROYLOCK(&pool->lock);
+	isc_mem_putanddetach(&pool->mctx, pool, sizeof(*pool));
+}
+
+/*
+ * Take a cached connection to 'masteraddr' from 'sourceaddr' out of
+ * the cache, if there is one.
+ */
+static isc_socket_t *
+pool_take(dns_xfrinpool_t *pool, isc_sockaddr_t *masteraddr,
+	  isc_sockaddr_t *sourceaddr, isc_dscp_t dscp)
+{
+	xfrinconn_t *conn;
+	isc_socket_t *sock = NULL;
+	isc_stdtime_t now;
+
+	isc_stdtime_get(&now);
+
+	LOCK(&pool->lock);
+	pool_expire(pool, now);
+	for (conn = ISC_LIST_HEAD(pool->conns);
+	     conn != NULL;
+	     conn = ISC_LIST_NEXT(conn, link))
+	{
+		if (conn->dscp == dscp &&
+		    isc_sockaddr_equal(&conn->masteraddr, masteraddr) &&
+		    isc_sockaddr_equal(&conn->sourceaddr, sourceaddr))
+		{
+			isc_socket_attach(conn->socket, &sock);
+			conn_free(pool, conn);
+			break;
+		}
+	}
+	UNLOCK(&pool->lock);
+
+	return (sock);
+}
+
+/*
+ * Move the connection of the finished transfer 'xfr' into the cache.
+ */
+static void
+pool_give(dns_xfrinpool_t *pool, dns_xfrin_ctx_t *xfr) {
+	xfrinconn_t *conn;
+	isc_stdtime_t now;
+
+	conn = isc_mem_get(pool->mctx, sizeof(*conn));
+	if (conn == NULL) {
+		isc_socket_detach(&xfr->socket);
+		return;
+	}
+	conn->socket = xfr->socket;
+	xfr->socket = NULL;
+	conn->masteraddr = xfr->masteraddr;
+	conn->sourceaddr = xfr->sourceaddr;
+	conn->dscp = xfr->dscp;
+	isc_stdtime_get(&now);
+	conn->idle = now;
+	ISC_LINK_INIT(conn, link);
+
+	LOCK(&pool->lock);
+	pool_expire(pool, now);
+	if (pool->nconns == XFRINPOOL_MAX)
+		conn_free(pool, ISC_LIST_TAIL(pool->conns));
+	ISC_LIST_PREPEND(pool->conns, conn, link);
+	pool->nconns++;
+	if (pool->exiting)
+		conn_free(pool, conn);
+	UNLOCK(&pool->lock);
+}
+
 /*
  * Log incoming zone transfer messages in a format like
  * transfer of <zone> from <address>: <message>
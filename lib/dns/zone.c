@@ -74,6 +74,7 @@
 #include <dns/resolver.h>
 #include <dns/result.h>
 #include <dns/rriterator.h>
+#include <dns/signpool.h>
 #include <dns/soa.h>
 #include <dns/ssu.h>
 #include <dns/stats.h>
@@ -149,6 +150,7 @@ typedef struct dns_signing dns_signing_t;
 typedef ISC_LIST(dns_signing_t) dns_signinglist_t;
 typedef struct dns_nsec3chain dns_nsec3chain_t;
 typedef ISC_LIST(dns_nsec3chain_t) dns_nsec3chainlist_t;
+typedef struct journalwaiter journalwaiter_t;
 typedef struct dns_keyfetch dns_keyfetch_t;
 typedef struct dns_asyncload dns_asyncload_t;
 typedef struct dns_include dns_include_t;
@@ -422,6 +424,23 @@ struct dns_zone {
 	dns_zone_t		*rss_raw;
 	isc_event_t		*rss_event;
 	dns_update_state_t      *rss_state;
+
+	/*
+	 * Group commit of journal transactions, see
+	 * dns_zone_journalwrite().  Only used from the zone's task.
+	 */
+	dns_journal_t		*jnl_pending;
+	ISC_LIST(journalwaiter_t) jnl_waiters;
+};
+
+/*%
+ * An event to be sent once the pending journal transactions
+ * have been committed to stable storage.
+ */
+struct journalwaiter {
+	isc_task_t		*task;
+	isc_event_t		*event;
+	ISC_LINK(journalwaiter_t) link;
 };
 
 typedef struct {
@@ -515,6 +534,21 @@ struct dns_unreachable {
 	isc_uint32_t	count;
 };
 
+/*%
+ * Zones waiting to send an SOA query to the same master.  Each slot
+ * granted by the refresh rate limiter releases a burst of up to
+ * 'serialqueryburst' of them.
+ */
+typedef struct dns_refreshq dns_refreshq_t;
+
+struct dns_refreshq {
+	dns_zonemgr_t *		zmgr;
+	isc_sockaddr_t		master;
+	ISC_LIST(isc_event_t)	events;		/* soa_query() events */
+	isc_boolean_t		queued;		/* waiting for a slot */
+	ISC_LINK(dns_refreshq_t) link;
+};
+
 struct dns_zonemgr {
 	unsigned int		magic;
 	isc_mem_t *		mctx;
@@ -526,6 +560,8 @@ struct dns_zonemgr {
 	isc_taskpool_t *	loadtasks;
 	isc_task_t *		task;
 	isc_pool_t *		mctxpool;
+	dns_signpool_t *	signpool;
+	dns_xfrinpool_t *	xfrinpool;
 	isc_ratelimiter_t *	notifyrl;
 	isc_ratelimiter_t *	refreshrl;
 	isc_ratelimiter_t *	startupnotifyrl;
@@ -533,6 +569,7 @@ struct dns_zonemgr {
 	isc_rwlock_t		rwlock;
 	isc_mutex_t		iolock;
 	isc_rwlock_t		urlock;
+	isc_mutex_t		refreshlock;
 
 	/* Locked by rwlock. */
 	dns_zonelist_t		zones;
@@ -546,6 +583,7 @@ struct dns_zonemgr {
 	unsigned int		startupnotifyrate;
 	unsigned int		serialqueryrate;
 	unsigned int		startupserialqueryrate;
+	unsigned int		serialqueryburst;
 
 	/* Locked by iolock */
 	isc_uint32_t		iolimit;
@@ -556,6 +594,9 @@ struct dns_zonemgr {
 	/* Locked by urlock. */
 	/* LRU cache */
 	struct dns_unreachable	unreachable[UNREACH_CHACHE_SIZE];
+
+	/* Locked by refreshlock. */
+	ISC_LIST(dns_refreshq_t) refreshqs;
 };
 
 /*%
@@ -768,6 +809,9 @@ static void dns_zonemgr_dbdestroyed(isc_task_t *task, isc_event_t *event);
 static void refresh_callback(isc_task_t *, isc_event_t *);
 static void stub_callback(isc_task_t *, isc_event_t *);
 static void queue_soa_query(dns_zone_t *zone);
+static isc_result_t refreshq_enqueue(dns_zonemgr_t *zmgr,
+				     isc_sockaddr_t *master,
+				     isc_event_t **eventp);
 static void soa_query(isc_task_t *, isc_event_t *);
 static void ns_query(dns_zone_t *zone, dns_rdataset_t *soardataset,
 		     dns_stub_t *stub);
@@ -1050,6 +1094,8 @@ dns_zone_create(dns_zone_t **zonep, isc_mem_t *mctx) {
 	zone->rss_oldver = NULL;
 	zone->rss_event = NULL;
 	zone->rss_state = NULL;
+	zone->jnl_pending = NULL;
+	ISC_LIST_INIT(zone->jnl_waiters);
 	zone->updatemethod = dns_updatemethod_increment;
 
 	zone->magic = ZONE_MAGIC;
@@ -1106,6 +1152,8 @@ zone_free(dns_zone_t *zone) {
 	INSIST(zone->readio == NULL);
 	INSIST(zone->statelist == NULL);
 	INSIST(zone->writeio == NULL);
+	INSIST(zone->jnl_pending == NULL);
+	INSIST(ISC_LIST_EMPTY(zone->jnl_waiters));
 
 	if (zone->task != NULL)
 		isc_task_detach(&zone->task);
@@ -3866,6 +3914,203 @@ update_soa_serial(dns_db_t *db, dns_dbversion_t *ver, dns_diff_t *diff,
 	return (result);
 }
 
+static void
+zone_journaldump(isc_task_t *task, isc_event_t *event) {
+	const char me[] = "zone_journaldump";
+	dns_zone_t *zone = event->ev_arg;
+
+	UNUSED(task);
+
+	INSIST(DNS_ZONE_VALID(zone));
+
+	ENTER;
+
+	LOCK_ZONE(zone);
+	zone_needdump(zone, 0);
+	UNLOCK_ZONE(zone);
+
+	isc_event_free(&event);
+	dns_zone_detach(&zone);
+}
+
+/*
+ * The transactions of a group commit could not be committed to
+ * stable storage, but they are already live in the zone database.
+ * The journal no longer matches the zone, so remove it, which
+ * makes IXFR fall back to AXFR, and dump the zone as soon as
+ * possible so that the master file holds the committed data.
+ * The zone may or may not be locked by the caller, so the dump
+ * is requested from the zone's task, holding an external
+ * reference which can be taken without the zone lock.
+ */
+static void
+zone_journalfailed(dns_zone_t *zone, isc_result_t result) {
+	isc_result_t tresult;
+	isc_event_t *e;
+	dns_zone_t *dummy = NULL;
+
+	dns_zone_log(zone, ISC_LOG_ERROR,
+		     "journal sync failed: %s: removing journal '%s' "
+		     "and dumping zone", dns_result_totext(result),
+		     zone->journal);
+
+	tresult = isc_file_remove(zone->journal);
+	if (tresult != ISC_R_SUCCESS && tresult != ISC_R_FILENOTFOUND)
+		dns_zone_log(zone, ISC_LOG_ERROR,
+			     "unable to remove journal '%s': %s",
+			     zone->journal, isc_result_totext(tresult));
+
+	e = isc_event_allocate(zone->mctx, zone, DNS_EVENT_ZONEJOURNALDUMP,
+			       zone_journaldump, zone, sizeof(isc_event_t));
+	if (e == NULL) {
+		dns_zone_log(zone, ISC_LOG_ERROR,
+			     "unable to schedule zone dump: %s",
+			     isc_result_totext(ISC_R_NOMEMORY));
+		return;
+	}
+	dns_zone_attach(zone, &dummy);
+	isc_task_send(zone->task, &e);
+}
+
+/*
+ * Commit any transactions written by dns_zone_journalwrite() to
+ * stable storage, close the journal and send the events waiting
+ * for them.  This must be done before the journal file is written
+ * by any other means.
+ *
+ * The waiting updates have already been committed to the zone
+ * database, so a failure here does not change their result; it
+ * is handled by zone_journalfailed() instead.
+ */
+static isc_result_t
+zone_journalsync(dns_zone_t *zone) {
+	isc_result_t result = ISC_R_SUCCESS;
+	journalwaiter_t *waiter;
+
+	if (zone->jnl_pending != NULL) {
+		result = dns_journal_sync(zone->jnl_pending);
+		dns_journal_destroy(&zone->jnl_pending);
+		if (result != ISC_R_SUCCESS)
+			zone_journalfailed(zone, result);
+	}
+
+	while ((waiter = ISC_LIST_HEAD(zone->jnl_waiters)) != NULL) {
+		ISC_LIST_UNLINK(zone->jnl_waiters, waiter, link);
+		isc_task_sendanddetach(&waiter->task, &waiter->event);
+		isc_mem_put(zone->mctx, waiter, sizeof(*waiter));
+	}
+
+	return (result);
+}
+
+static void
+zone_journalflush(isc_task_t *task, isc_event_t *event) {
+	const char me[] = "zone_journalflush";
+	dns_zone_t *zone = event->ev_arg;
+
+	UNUSED(task);
+
+	INSIST(DNS_ZONE_VALID(zone));
+
+	ENTER;
+
+	(void)zone_journalsync(zone);
+
+	isc_event_free(&event);
+	dns_zone_idetach(&zone);
+}
+
+isc_result_t
+dns_zone_journalwrite(dns_zone_t *zone, dns_diff_t *diff) {
+	const char me[] = "dns_zone_journalwrite";
+	const char *journalfile;
+	isc_result_t result;
+	isc_event_t *e;
+	dns_zone_t *dummy = NULL;
+	isc_boolean_t queued = ISC_TRUE;
+	unsigned int mode = DNS_JOURNAL_CREATE|DNS_JOURNAL_GROUPCOMMIT;
+
+	REQUIRE(DNS_ZONE_VALID(zone));
+
+	ENTER;
+
+	journalfile = dns_zone_getjournal(zone);
+	if (journalfile == NULL)
+		return (ISC_R_SUCCESS);
+
+	if (zone->jnl_pending == NULL) {
+		result = dns_journal_open(zone->mctx, journalfile, mode,
+					  &zone->jnl_pending);
+		if (result != ISC_R_SUCCESS)
+			return (result);
+
+		/*
+		 * Commit the journal once the events already queued for
+		 * the zone's task have been processed, so that updates
+		 * which arrive while a sync is in progress share the
+		 * next one.
+		 */
+		e = isc_event_allocate(zone->mctx, zone,
+				       DNS_EVENT_ZONEJOURNALSYNC,
+				       zone_journalflush, zone,
+				       sizeof(isc_event_t));
+		if (e != NULL) {
+			LOCK_ZONE(zone);
+			zone_iattach(zone, &dummy);
+			UNLOCK_ZONE(zone);
+			isc_task_send(zone->task, &e);
+		} else
+			queued = ISC_FALSE;
+	}
+
+	result = dns_journal_write_transaction(zone->jnl_pending, diff);
+	if (result != ISC_R_SUCCESS) {
+		dns_zone_log(zone, ISC_LOG_ERROR,
+			     "dns_journal_write_transaction -> %s",
+			     dns_result_totext(result));
+		(void)zone_journalsync(zone);
+		return (result);
+	}
+
+	/*
+	 * Without a flush event, commit now.  So too for the raw zone
+	 * of an inline-signing pair, as the secure zone reads this
+	 * journal from its own task.
+	 */
+	if (!queued || inline_raw(zone))
+		result = zone_journalsync(zone);
+	return (result);
+}
+
+void
+dns_zone_journalwait(dns_zone_t *zone, isc_task_t *task,
+		     isc_event_t **eventp)
+{
+	journalwaiter_t *waiter;
+
+	REQUIRE(DNS_ZONE_VALID(zone));
+	REQUIRE(eventp != NULL && *eventp != NULL);
+
+	if (zone->jnl_pending == NULL) {
+		isc_task_send(task, eventp);
+		return;
+	}
+
+	waiter = isc_mem_get(zone->mctx, sizeof(*waiter));
+	if (waiter == NULL) {
+		(void)zone_journalsync(zone);
+		isc_task_send(task, eventp);
+		return;
+	}
+
+	waiter->task = NULL;
+	isc_task_attach(task, &waiter->task);
+	waiter->event = *eventp;
+	*eventp = NULL;
+	ISC_LINK_INIT(waiter, link);
+	ISC_LIST_APPEND(zone->jnl_waiters, waiter, link);
+}
+
 /*
  * Write all transactions in 'diff' to the zone journal file.
  */
@@ -3880,6 +4125,7 @@ zone_journal(dns_zone_t *zone, dns_diff_t *diff, isc_uint32_t *sourceserial,
 	unsigned int mode = DNS_JOURNAL_CREATE|DNS_JOURNAL_WRITE;
 
 	ENTER;
+	(void)zone_journalsync(zone);
 	journalfile = dns_zone_getjournal(zone);
 	if (journalfile != NULL) {
 		result = dns_journal_open(zone->mctx, journalfile, mode,
@@ -9808,6 +10054,7 @@ dump_done(void *arg, isc_result_t result) {
 		 * zone->xfr safely.
 		 */
 		if (tresult == ISC_R_SUCCESS && zone->xfr == NULL) {
+			(void)zone_journalsync(zone);
 			tresult = dns_journal_compact(zone->mctx,
 						      zone->journal,
 						      serial,
@@ -10603,6 +10850,13 @@ zone_notify(dns_zone_t *zone, isc_time_t *now) {
 	    zone->type != dns_zone_master)
 		return;
 
+	/*
+	 * The new serial may still be in a journal transaction waiting
+	 * for group commit; commit it first, so that a slave's IXFR in
+	 * response to this notify finds it.
+	 */
+	(void)zone_journalsync(zone);
+
 	origin = &zone->origin;
 
 	/*
@@ -11642,8 +11896,9 @@ queue_soa_query(dns_zone_t *zone) {
 	zone_iattach(zone, &dummy);
 
 	e->ev_arg = zone;
-	e->ev_sender = NULL;
-	result = isc_ratelimiter_enqueue(zone->zmgr->refreshrl, zone->task, &e);
+	e->ev_sender = zone->task;
+	result = refreshq_enqueue(zone->zmgr, &zone->masters[zone->curmaster],
+				  &e);
 	if (result != ISC_R_SUCCESS) {
 		zone_idetach(&dummy);
 		isc_event_free(&e);
@@ -13671,6 +13926,7 @@ receive_secure_serial(isc_task_t *task, isc_event_t *event) {
 				       zone->rss_raw->journal,
 				       DNS_JOURNAL_WRITE, &rjournal));
 
+		(void)zone_journalsync(zone);
 		result = dns_journal_open(zone->mctx, zone->journal,
 					  DNS_JOURNAL_READ, &sjournal);
 		if (result != ISC_R_SUCCESS && result != ISC_R_NOTFOUND)
@@ -14415,6 +14671,7 @@ zone_replacedb(dns_zone_t *zone, dns_db_t *db, isc_boolean_t dump) {
 			goto fail;
 		}
 
+		(void)zone_journalsync(zone);
 		result = dns_db_diff(zone->mctx, db, ver, zone->db, NULL,
 				     zone->journal);
 		if (result != ISC_R_SUCCESS)
@@ -14757,6 +15014,7 @@ zone_xfrdone(dns_zone_t *zone, isc_result_t result) {
 	 * Handle any deferred journal compaction.
 	 */
 	if (DNS_ZONE_FLAG(zone, DNS_ZONEFLG_NEEDCOMPACT)) {
+		(void)zone_journalsync(zone);
 		result = dns_journal_compact(zone->mctx, zone->journal,
 					     zone->compact_serial,
 					     zone->journalsize);
@@ -15423,6 +15681,8 @@ dns_zonemgr_create(isc_mem_t *mctx, isc_taskmgr_t *taskmgr,
 	zmgr->zonetasks = NULL;
 	zmgr->loadtasks = NULL;
 	zmgr->mctxpool = NULL;
+	zmgr->signpool = NULL;
+	zmgr->xfrinpool = NULL;
 	zmgr->task = NULL;
 	zmgr->notifyrl = NULL;
 	zmgr->refreshrl = NULL;
@@ -15431,6 +15691,7 @@ dns_zonemgr_create(isc_mem_t *mctx, isc_taskmgr_t *taskmgr,
 	ISC_LIST_INIT(zmgr->zones);
 	ISC_LIST_INIT(zmgr->waiting_for_xfrin);
 	ISC_LIST_INIT(zmgr->xfrin_in_progress);
+	ISC_LIST_INIT(zmgr->refreshqs);
 	memset(zmgr->unreachable, 0, sizeof(zmgr->unreachable));
 	result = isc_rwlock_init(&zmgr->rwlock, 0, 0);
 	if (result != ISC_R_SUCCESS)
@@ -15475,6 +15736,7 @@ dns_zonemgr_create(isc_mem_t *mctx, isc_taskmgr_t *taskmgr,
 	setrl(zmgr->startupnotifyrl, &zmgr->startupnotifyrate, 20);
 	setrl(zmgr->refreshrl, &zmgr->serialqueryrate, 20);
 	setrl(zmgr->startuprefreshrl, &zmgr->startupserialqueryrate, 20);
+	zmgr->serialqueryburst = 1;
 
 	zmgr->iolimit = 1;
 	zmgr->ioactive = 0;
@@ -15485,15 +15747,23 @@ dns_zonemgr_create(isc_mem_t *mctx, isc_taskmgr_t *taskmgr,
 	if (result != ISC_R_SUCCESS)
 		goto free_startuprefreshrl;
 
+	result = isc_mutex_init(&zmgr->refreshlock);
+	if (result != ISC_R_SUCCESS)
+		goto free_iolock;
+
+	result = dns_xfrinpool_create(mctx, &zmgr->xfrinpool);
+	if (result != ISC_R_SUCCESS)
+		goto free_refreshlock;
+
 	zmgr->magic = ZONEMGR_MAGIC;
 
 	*zmgrp = zmgr;
 	return (ISC_R_SUCCESS);
 
-#if 0
+ free_refreshlock:
+	DESTROYLOCK(&zmgr->refreshlock);
  free_iolock:
 	DESTROYLOCK(&zmgr->iolock);
-#endif
  free_startuprefreshrl:
 	isc_ratelimiter_detach(&zmgr->startuprefreshrl);
  free_startupnotifyrl:
@@ -15704,6 +15974,8 @@ dns_zonemgr_shutdown(dns_zonemgr_t *zmgr) {
 	isc_ratelimiter_shutdown(zmgr->startupnotifyrl);
 	isc_ratelimiter_shutdown(zmgr->startuprefreshrl);
 
+	dns_xfrinpool_shutdown(zmgr->xfrinpool);
+
 	if (zmgr->task != NULL)
 		isc_task_destroy(&zmgr->task);
 	if (zmgr->zonetasks != NULL)
@@ -15831,11 +16103,16 @@ zonemgr_free(dns_zonemgr_t *zmgr) {
 
 	zmgr->magic = 0;
 
+	INSIST(ISC_LIST_EMPTY(zmgr->refreshqs));
+	DESTROYLOCK(&zmgr->refreshlock);
 	DESTROYLOCK(&zmgr->iolock);
 	isc_ratelimiter_detach(&zmgr->notifyrl);
 	isc_ratelimiter_detach(&zmgr->refreshrl);
 	isc_ratelimiter_detach(&zmgr->startupnotifyrl);
 	isc_ratelimiter_detach(&zmgr->startuprefreshrl);
+	if (zmgr->signpool != NULL)
+		dns_signpool_detach(&zmgr->signpool);
+	dns_xfrinpool_detach(&zmgr->xfrinpool);
 
 	isc_rwlock_destroy(&zmgr->urlock);
 	isc_rwlock_destroy(&zmgr->rwlock);
@@ -16257,6 +16534,14 @@ dns_zonemgr_setserialqueryrate(dns_zonemgr_t *zmgr, unsigned int value) {
 	setrl(zmgr->startuprefreshrl, &zmgr->startupserialqueryrate, value);
 }
 
+void
+dns_zonemgr_setserialqueryburst(dns_zonemgr_t *zmgr, unsigned int value) {
+
+	REQUIRE(DNS_ZONEMGR_VALID(zmgr));
+
+	zmgr->serialqueryburst = (value == 0) ? 1 : value;
+}
+
 unsigned int
 dns_zonemgr_getnotifyrate(dns_zonemgr_t *zmgr) {
 	REQUIRE(DNS_ZONEMGR_VALID(zmgr));
@@ -16278,6 +16563,166 @@ dns_zonemgr_getserialqueryrate(dns_zonemgr_t *zmgr) {
 	return (zmgr->serialqueryrate);
 }
 
+unsigned int
+dns_zonemgr_getserialqueryburst(dns_zonemgr_t *zmgr) {
+	REQUIRE(DNS_ZONEMGR_VALID(zmgr));
+
+	return (zmgr->serialqueryburst);
+}
+
+static void refreshq_release(isc_task_t *task, isc_event_t *event);
+
+/*
+ * Ask the refresh rate limiter for a slot for 'q'.  Requires
+ * zmgr->refreshlock.
+ */
+static isc_result_t
+refreshq_schedule(dns_refreshq_t *q) {
+	dns_zonemgr_t *zmgr = q->zmgr;
+	isc_event_t *e;
+	isc_result_t result;
+
+	INSIST(!q->queued);
+
+	e = isc_event_allocate(zmgr->mctx, NULL, DNS_EVENT_ZONE,
+			       refreshq_release, q, sizeof(isc_event_t));
+	if (e == NULL)
+		return (ISC_R_NOMEMORY);
+	result = isc_ratelimiter_enqueue(zmgr->refreshrl, zmgr->task, &e);
+	if (result != ISC_R_SUCCESS) {
+		isc_event_free(&e);
+		return (result);
+	}
+	q->queued = ISC_TRUE;
+	return (ISC_R_SUCCESS);
+}
+
+/*
+ * Queue the soa_query() event '*eventp', to be sent to the task in its
+ * ev_sender field, behind the other zones waiting to query 'master'.
+ */
+static isc_result_t
+refreshq_enqueue(dns_zonemgr_t *zmgr, isc_sockaddr_t *master,
+		 isc_event_t **eventp)
+{
+	dns_refreshq_t *q;
+	isc_result_t result = ISC_R_SUCCESS;
+
+	LOCK(&zmgr->refreshlock);
+	for (q = ISC_LIST_HEAD(zmgr->refreshqs);
+	     q != NULL;
+	     q = ISC_LIST_NEXT(q, link))
+		if (isc_sockaddr_equal(&q->master, master))
+			break;
+
+	if (q == NULL) {
+		q = isc_mem_get(zmgr->mctx, sizeof(*q));
+		if (q == NULL) {
+			result = ISC_R_NOMEMORY;
+			goto unlock;
+		}
+		q->zmgr = zmgr;
+		q->master = *master;
+		ISC_LIST_INIT(q->events);
+		q->queued = ISC_FALSE;
+		ISC_LINK_INIT(q, link);
+		result = refreshq_schedule(q);
+		if (result != ISC_R_SUCCESS) {
+			isc_mem_put(zmgr->mctx, q, sizeof(*q));
+			goto unlock;
+		}
+		ISC_LIST_APPEND(zmgr->refreshqs, q, link);
+	}
+
+	ISC_LIST_APPEND(q->events, *eventp, ev_link);
+	*eventp = NULL;
+
+ unlock:
+	UNLOCK(&zmgr->refreshlock);
+	return (result);
+}
+
+/*
+ * A refresh slot has been granted to the zones waiting to query a
+ * master: let the next burst of them send their queries.
+ */
+static void
+refreshq_release(isc_task_t *task, isc_event_t *event) {
+	dns_refreshq_t *q = event->ev_arg;
+	dns_zonemgr_t *zmgr = q->zmgr;
+	isc_boolean_t canceled;
+	unsigned int n;
+	isc_event_t *e;
+	isc_task_t *etask;
+
+	UNUSED(task);
+
+	canceled = ISC_TF((event->ev_attributes &
+			   ISC_EVENTATTR_CANCELED) != 0);
+	isc_event_free(&event);
+
+	LOCK(&zmgr->refreshlock);
+	q->queued = ISC_FALSE;
+	for (n = 0;
+	     (e = ISC_LIST_HEAD(q->events)) != NULL &&
+	     (canceled || n < zmgr->serialqueryburst);
+	     n++)
+	{
+		ISC_LIST_UNLINK(q->events, e, ev_link);
+		if (canceled)
+			e->ev_attributes |= ISC_EVENTATTR_CANCELED;
+		etask = e->ev_sender;
+		isc_task_send(etask, &e);
+	}
+
+	if (!ISC_LIST_EMPTY(q->events) &&
+	    refreshq_schedule(q) != ISC_R_SUCCESS)
+	{
+		while ((e = ISC_LIST_HEAD(q->events)) != NULL) {
+			ISC_LIST_UNLINK(q->events, e, ev_link);
+			e->ev_attributes |= ISC_EVENTATTR_CANCELED;
+			etask = e->ev_sender;
+			isc_task_send(etask, &e);
+		}
+	}
+
+	if (ISC_LIST_EMPTY(q->events)) {
+		ISC_LIST_UNLINK(zmgr->refreshqs, q, link);
+		isc_mem_put(zmgr->mctx, q, sizeof(*q));
+	}
+	UNLOCK(&zmgr->refreshlock);
+}
+
+void
+dns_zonemgr_setsignpool(dns_zonemgr_t *zmgr, dns_signpool_t *pool) {
+	REQUIRE(DNS_ZONEMGR_VALID(zmgr));
+	REQUIRE(zmgr->signpool == NULL);
+
+	dns_signpool_attach(pool, &zmgr->signpool);
+}
+
+void
+dns_zone_getsignpool(dns_zone_t *zone, dns_signpool_t **poolp) {
+	REQUIRE(DNS_ZONE_VALID(zone));
+	REQUIRE(poolp != NULL && *poolp == NULL);
+
+	LOCK_ZONE(zone);
+	if (zone->zmgr != NULL && zone->zmgr->signpool != NULL)
+		dns_signpool_attach(zone->zmgr->signpool, poolp);
+	UNLOCK_ZONE(zone);
+}
+
+void
+dns_zone_getxfrinpool(dns_zone_t *zone, dns_xfrinpool_t **poolp) {
+	REQUIRE(DNS_ZONE_VALID(zone));
+	REQUIRE(poolp != NULL && *poolp == NULL);
+
+	LOCK_ZONE(zone);
+	if (zone->zmgr != NULL)
+		dns_xfrinpool_attach(zone->zmgr->xfrinpool, poolp);
+	UNLOCK_ZONE(zone);
+}
+
 isc_boolean_t
 dns_zonemgr_unreachable(dns_zonemgr_t *zmgr, isc_sockaddr_t *remote,
 			isc_sockaddr_t *local, isc_time_t *now)
@@ -506,6 +506,13 @@ isc_mem_references(isc_mem_t *ctx);
  * Return the current reference count.
  */
 
+isc_uint64_t
+isc_mem_mallocs(isc_mem_t *ctx);
+/*%<
+ * Return the number of times 'ctx' has obtained memory from the
+ * underlying allocator, as opposed to its own free lists.
+ */
+
 void
 isc_mem_setname(isc_mem_t *ctx, const char *name, void *tag);
 /*%<
@@ -144,6 +144,7 @@ struct isc__mem {
 	size_t			total;
 	size_t			inuse;
 	size_t			maxinuse;
+	isc_uint64_t		mallocs;	/*%< memalloc() calls */
 	size_t			hi_water;
 	size_t			lo_water;
 	isc_boolean_t		hi_called;
@@ -541,6 +542,7 @@ more_basic_blocks(isc__mem_t *ctx) {
 			ctx->memalloc_failures++;
 			return (ISC_FALSE);
 		}
+		ctx->mallocs++;
 		if (ctx->basic_table_size != 0) {
 			memmove(table, ctx->basic_table,
 				ctx->basic_table_size *
@@ -556,6 +558,7 @@ more_basic_blocks(isc__mem_t *ctx) {
 		ctx->memalloc_failures++;
 		return (ISC_FALSE);
 	}
+	ctx->mallocs++;
 	ctx->total += increment;
 	ctx->basic_table[ctx->basic_table_count] = new;
 	ctx->basic_table_count++;
@@ -663,6 +666,7 @@ mem_getunlocked(isc__mem_t *ctx, size_t size) {
 			ctx->memalloc_failures++;
 			goto done;
 		}
+		ctx->mallocs++;
 		ctx->total += size;
 		ctx->inuse += size;
 		ctx->stats[ctx->max_size].gets++;
@@ -821,6 +825,7 @@ mem_put(isc__mem_t *ctx, void *mem, size_t size) {
  */
 static inline void
 mem_getstats(isc__mem_t *ctx, size_t size) {
+	ctx->mallocs++;
 	ctx->total += size;
 	ctx->inuse += size;
 
@@ -932,6 +937,7 @@ isc_mem_createx2(size_t init_max_size, size_t target_size,
 	ctx->total = 0;
 	ctx->inuse = 0;
 	ctx->maxinuse = 0;
+	ctx->mallocs = 0;
 	ctx->hi_water = 0;
 	ctx->lo_water = 0;
 	ctx->hi_called = ISC_FALSE;
@@ -2323,6 +2329,20 @@ isc_mem_checkdestroyed(FILE *file) {
 	UNLOCK(&contextslock);
 }
 
+isc_uint64_t
+isc_mem_mallocs(isc_mem_t *ctx0) {
+	isc__mem_t *ctx = (isc__mem_t *)ctx0;
+	isc_uint64_t mallocs;
+
+	REQUIRE(VALID_CONTEXT(ctx));
+
+	MCTXLOCK(ctx, &ctx->lock);
+	mallocs = ctx->mallocs;
+	MCTXUNLOCK(ctx, &ctx->lock);
+
+	return (mallocs);
+}
+
 unsigned int
 isc_mem_references(isc_mem_t *ctx0) {
 	isc__mem_t *ctx = (isc__mem_t *)ctx0;
@@ -2341,6 +2361,7 @@ isc_mem_references(isc_mem_t *ctx0) {
 typedef struct summarystat {
 	isc_uint64_t	total;
 	isc_uint64_t	inuse;
+	isc_uint64_t	mallocs;
 	isc_uint64_t	blocksize;
 	isc_uint64_t	contextsize;
 } summarystat_t;
@@ -2405,6 +2426,13 @@ xml_renderctx(isc__mem_t *ctx, summarystat_t *summary,
 					    (isc_uint64_t)ctx->maxinuse));
 	TRY0(xmlTextWriterEndElement(writer)); /* maxinuse */
 
+	summary->mallocs += ctx->mallocs;
+	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "mallocs"));
+	TRY0(xmlTextWriterWriteFormatString(writer,
+					    "%" ISC_PRINT_QUADFORMAT "u",
+					    ctx->mallocs));
+	TRY0(xmlTextWriterEndElement(writer)); /* mallocs */
+
 	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "blocksize"));
 	if ((ctx->flags & ISC_MEMFLAG_INTERNAL) != 0) {
 		summary->blocksize += ctx->basic_table_count *
@@ -2486,6 +2514,12 @@ isc_mem_renderxml(xmlTextWriterPtr writer) {
 					    summary.inuse));
 	TRY0(xmlTextWriterEndElement(writer)); /* InUse */
 
+	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "Mallocs"));
+	TRY0(xmlTextWriterWriteFormatString(writer,
+					    "%" ISC_PRINT_QUADFORMAT "u",
+					    summary.mallocs));
+	TRY0(xmlTextWriterEndElement(writer)); /* Mallocs */
+
 	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "BlockSize"));
 	TRY0(xmlTextWriterWriteFormatString(writer,
 					    "%" ISC_PRINT_QUADFORMAT "u",
@@ -2537,6 +2571,7 @@ json_renderctx(isc__mem_t *ctx, summarystat_t *summary, json_object *array) {
 		ctx->basic_table_count * sizeof(char *);
 	summary->total += ctx->total;
 	summary->inuse += ctx->inuse;
+	summary->mallocs += ctx->mallocs;
 	if ((ctx->flags & ISC_MEMFLAG_INTERNAL) != 0)
 		summary->blocksize += ctx->basic_table_count *
 			NUM_BASIC_BLOCKS * ctx->mem_target;
@@ -2578,6 +2613,10 @@ json_renderctx(isc__mem_t *ctx, summarystat_t *summary, json_object *array) {
 	CHECKMEM(obj);
 	json_object_object_add(ctxobj, "maxinuse", obj);
 
+	obj = json_object_new_int64(ctx->mallocs);
+	CHECKMEM(obj);
+	json_object_object_add(ctxobj, "mallocs", obj);
+
 	if ((ctx->flags & ISC_MEMFLAG_INTERNAL) != 0) {
 		isc_uint64_t blocksize;
 		blocksize = ctx->basic_table_count * NUM_BASIC_BLOCKS *
@@ -2647,6 +2686,10 @@ isc_mem_renderjson(json_object *memobj) {
 	CHECKMEM(obj);
 	json_object_object_add(memobj, "InUse", obj);
 
+	obj = json_object_new_int64(summary.mallocs);
+	CHECKMEM(obj);
+	json_object_object_add(memobj, "Mallocs", obj);
+
 	obj = json_object_new_int64(summary.blocksize);
 	CHECKMEM(obj);
 	json_object_object_add(memobj, "BlockSize", obj);
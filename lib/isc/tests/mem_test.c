@@ -149,12 +149,65 @@ ATF_TC_BODY(isc_mem_inuse, tc) {
 	isc_test_end();
 }
 
+ATF_TC(isc_mem_mallocs);
+ATF_TC_HEAD(isc_mem_mallocs, tc) {
+	atf_tc_set_md_var(tc, "descr", "test counting of heap allocations");
+}
+
+ATF_TC_BODY(isc_mem_mallocs, tc) {
+	isc_result_t result;
+	isc_mem_t *mctx2 = NULL;
+	isc_mempool_t *mp = NULL;
+	isc_uint64_t before, after;
+	void *ptr;
+
+	result = isc_test_begin(NULL, ISC_TRUE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = isc_mem_createx2(0, 0, default_memalloc, default_memfree,
+				  NULL, &mctx2, ISC_MEMFLAG_INTERNAL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/* Small blocks are reused from the free lists. */
+	ptr = isc_mem_get(mctx2, 100);
+	isc_mem_put(mctx2, ptr, 100);
+	before = isc_mem_mallocs(mctx2);
+	ptr = isc_mem_get(mctx2, 100);
+	isc_mem_put(mctx2, ptr, 100);
+	after = isc_mem_mallocs(mctx2);
+	ATF_CHECK_EQ(after, before);
+
+	/* Large blocks always come from the allocator... */
+	ptr = isc_mem_get(mctx2, 100000);
+	isc_mem_put(mctx2, ptr, 100000);
+	after = isc_mem_mallocs(mctx2);
+	ATF_CHECK_EQ(after, before + 1);
+
+	/* ...unless a pool keeps them. */
+	result = isc_mempool_create(mctx2, 100000, &mp);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	isc_mempool_setfillcount(mp, 1);
+	ptr = isc_mempool_get(mp);
+	isc_mempool_put(mp, ptr);
+	before = isc_mem_mallocs(mctx2);
+	ptr = isc_mempool_get(mp);
+	isc_mempool_put(mp, ptr);
+	after = isc_mem_mallocs(mctx2);
+	ATF_CHECK_EQ(after, before);
+
+	isc_mempool_destroy(&mp);
+	isc_mem_destroy(&mctx2);
+
+	isc_test_end();
+}
+
 /*
  * Main
  */
 ATF_TP_ADD_TCS(tp) {
 	ATF_TP_ADD_TC(tp, isc_mem_total);
 	ATF_TP_ADD_TC(tp, isc_mem_inuse);
+	ATF_TP_ADD_TC(tp, isc_mem_mallocs);
 
 	return (atf_no_error());
 }
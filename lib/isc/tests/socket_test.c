@@ -314,6 +314,92 @@ ATF_TC_BODY(udp_dup, tc) {
 	isc_test_end();
 }
 
+/* Test several UDP recvs waiting on one socket */
+ATF_TC(udp_recvmany);
+ATF_TC_HEAD(udp_recvmany, tc) {
+	atf_tc_set_md_var(tc, "descr", "UDP recv with several waiting");
+}
+ATF_TC_BODY(udp_recvmany, tc) {
+	isc_result_t result;
+	isc_sockaddr_t addr1, addr2;
+	struct in_addr in;
+	isc_socket_t *s1 = NULL, *s2 = NULL;
+	isc_task_t *task = NULL;
+	char sendbuf[20][16], recvbuf[20][BUFSIZ];
+	completion_t sends[20], recvs[20];
+	isc_region_t r;
+	int i, n;
+
+	UNUSED(tc);
+
+	result = isc_test_begin(NULL, ISC_TRUE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	in.s_addr = inet_addr("127.0.0.1");
+	isc_sockaddr_fromin(&addr1, &in, 5444);
+	isc_sockaddr_fromin(&addr2, &in, 5445);
+
+	result = isc_socket_create(socketmgr, PF_INET, isc_sockettype_udp, &s1);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = isc_socket_bind(s1, &addr1, ISC_SOCKET_REUSEADDRESS);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = isc_socket_create(socketmgr, PF_INET, isc_sockettype_udp, &s2);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = isc_socket_bind(s2, &addr2, ISC_SOCKET_REUSEADDRESS);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = isc_task_create(taskmgr, 0, &task);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/*
+	 * Queue more recvs than are filled by one system call before
+	 * anything is sent, so that they are satisfied together.
+	 */
+	for (i = 0; i < 20; i++) {
+		r.base = (void *) recvbuf[i];
+		r.length = BUFSIZ;
+		completion_init(&recvs[i]);
+		result = isc_socket_recv(s2, &r, 1, task, event_done,
+					 &recvs[i]);
+		ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	}
+
+	for (i = 0; i < 20; i++) {
+		snprintf(sendbuf[i], sizeof(sendbuf[i]), "Hello %d", i);
+		r.base = (void *) sendbuf[i];
+		r.length = strlen(sendbuf[i]) + 1;
+
+		completion_init(&sends[i]);
+		result = isc_socket_sendto(s1, &r, task, event_done,
+					   &sends[i], &addr2, NULL);
+		ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	}
+	for (i = 0; i < 20; i++) {
+		waitfor(&sends[i]);
+		ATF_CHECK(sends[i].done);
+		ATF_CHECK_EQ(sends[i].result, ISC_R_SUCCESS);
+	}
+
+	/*
+	 * Datagrams are received in order.
+	 */
+	for (i = 0; i < 20; i++) {
+		waitfor(&recvs[i]);
+		ATF_CHECK(recvs[i].done);
+		ATF_CHECK_EQ(recvs[i].result, ISC_R_SUCCESS);
+		ATF_CHECK_EQ(sscanf(recvbuf[i], "Hello %d", &n), 1);
+		ATF_CHECK_EQ(n, i);
+	}
+
+	isc_task_detach(&task);
+
+	isc_socket_detach(&s1);
+	isc_socket_detach(&s2);
+
+	isc_test_end();
+}
+
 /* Test TCP sendto/recv (IPv4) */
 ATF_TC(udp_dscp_v4);
 ATF_TC_HEAD(udp_dscp_v4, tc) {
@@ -761,6 +847,7 @@ ATF_TC_BODY(net_probedscp, tc) {
 ATF_TP_ADD_TCS(tp) {
 	ATF_TP_ADD_TC(tp, udp_sendto);
 	ATF_TP_ADD_TC(tp, udp_dup);
+	ATF_TP_ADD_TC(tp, udp_recvmany);
 	ATF_TP_ADD_TC(tp, tcp_dscp_v4);
 	ATF_TP_ADD_TC(tp, tcp_dscp_v6);
 	ATF_TP_ADD_TC(tp, udp_dscp_v4);
@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2015  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS.  IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <isc/mutex.h>
+#include <isc/task.h>
+#include <isc/time.h>
+#include <isc/timer.h>
+#include <isc/util.h>
+
+#include "isctest.h"
+
+/*
+ * Helper functions
+ */
+
+#define MAXEVENTS	10
+
+static isc_mutex_t lock;
+static int nevents;
+static int order[MAXEVENTS];
+static isc_eventtype_t types[MAXEVENTS];
+static isc_time_t dues[MAXEVENTS];
+
+static void
+record(isc_task_t *task, isc_event_t *event) {
+	isc_timerevent_t *tev = (isc_timerevent_t *)event;
+
+	UNUSED(task);
+
+	LOCK(&lock);
+	if (nevents < MAXEVENTS) {
+		order[nevents] = *(int *)event->ev_arg;
+		types[nevents] = event->ev_type;
+		dues[nevents] = tev->due;
+		nevents++;
+	}
+	UNLOCK(&lock);
+	isc_event_free(&event);
+}
+
+static void
+setup(void) {
+	isc_result_t result;
+
+	nevents = 0;
+	result = isc_mutex_init(&lock);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = isc_test_begin(NULL, ISC_TRUE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+}
+
+static void
+teardown(void) {
+	isc_test_end();
+	DESTROYLOCK(&lock);
+}
+
+/*
+ * Wait up to 'seconds' for 'count' events.
+ */
+static int
+waitfor(int count, int seconds) {
+	int i, n = 0;
+
+	for (i = 0; i < seconds * 100; i++) {
+		LOCK(&lock);
+		n = nevents;
+		UNLOCK(&lock);
+		if (n >= count)
+			break;
+		isc_test_nap(10000);
+	}
+	return (n);
+}
+
+/*
+ * Individual unit tests
+ */
+
+ATF_TC(ticker);
+ATF_TC_HEAD(ticker, tc) {
+	atf_tc_set_md_var(tc, "descr", "a ticker fires repeatedly");
+}
+ATF_TC_BODY(ticker, tc) {
+	isc_result_t result;
+	isc_task_t *task = NULL;
+	isc_timer_t *timer = NULL;
+	isc_interval_t interval;
+	int id = 0, i;
+
+	UNUSED(tc);
+
+	setup();
+
+	result = isc_task_create(taskmgr, 0, &task);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	isc_interval_set(&interval, 0, 50000000);
+	result = isc_timer_create(timermgr, isc_timertype_ticker, NULL,
+				  &interval, task, record, &id, &timer);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	ATF_REQUIRE(waitfor(4, 10) >= 4);
+	isc_timer_detach(&timer);
+
+	LOCK(&lock);
+	for (i = 0; i < 4; i++) {
+		ATF_CHECK_EQ(types[i], ISC_TIMEREVENT_TICK);
+		if (i > 0)
+			ATF_CHECK(isc_time_compare(&dues[i - 1],
+						   &dues[i]) < 0);
+	}
+	UNLOCK(&lock);
+
+	isc_task_detach(&task);
+	teardown();
+}
+
+ATF_TC(order);
+ATF_TC_HEAD(order, tc) {
+	atf_tc_set_md_var(tc, "descr", "once timers fire in due order, "
+			  "including one on a higher wheel level");
+}
+ATF_TC_BODY(order, tc) {
+	isc_result_t result;
+	isc_task_t *task = NULL;
+	isc_timer_t *timers[4] = { NULL, NULL, NULL, NULL };
+	isc_interval_t interval;
+	isc_time_t expires;
+	/* Milliseconds from now; 1300 is beyond the first wheel level. */
+	static int when[4] = { 1300, 100, 300, 200 };
+	static int ids[4] = { 0, 1, 2, 3 };
+	int i;
+
+	UNUSED(tc);
+
+	setup();
+
+	result = isc_task_create(taskmgr, 0, &task);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < 4; i++) {
+		isc_interval_set(&interval, when[i] / 1000,
+				 (when[i] % 1000) * 1000000);
+		result = isc_time_nowplusinterval(&expires, &interval);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		result = isc_timer_create(timermgr, isc_timertype_once,
+					  &expires, NULL, task, record,
+					  &ids[i], &timers[i]);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	}
+
+	ATF_REQUIRE_EQ(waitfor(4, 10), 4);
+
+	LOCK(&lock);
+	ATF_CHECK_EQ(order[0], 1);
+	ATF_CHECK_EQ(order[1], 3);
+	ATF_CHECK_EQ(order[2], 2);
+	ATF_CHECK_EQ(order[3], 0);
+	for (i = 0; i < 4; i++)
+		ATF_CHECK_EQ(types[i], ISC_TIMEREVENT_LIFE);
+	UNLOCK(&lock);
+
+	for (i = 0; i < 4; i++)
+		isc_timer_detach(&timers[i]);
+	isc_task_detach(&task);
+	teardown();
+}
+
+ATF_TC(reset);
+ATF_TC_HEAD(reset, tc) {
+	atf_tc_set_md_var(tc, "descr", "rescheduled and stopped timers");
+}
+ATF_TC_BODY(reset, tc) {
+	isc_result_t result;
+	isc_task_t *task = NULL;
+	isc_timer_t *stopped = NULL, *moved = NULL;
+	isc_interval_t interval;
+	static int ids[2] = { 0, 1 };
+
+	UNUSED(tc);
+
+	setup();
+
+	result = isc_task_create(taskmgr, 0, &task);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	isc_interval_set(&interval, 0, 100000000);
+	result = isc_timer_create(timermgr, isc_timertype_once, NULL,
+				  &interval, task, record, &ids[0], &stopped);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	isc_interval_set(&interval, 5, 0);
+	result = isc_timer_create(timermgr, isc_timertype_once, NULL,
+				  &interval, task, record, &ids[1], &moved);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/* Stop the first timer and bring the second one forward. */
+	result = isc_timer_reset(stopped, isc_timertype_inactive, NULL, NULL,
+				 ISC_TRUE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	isc_interval_set(&interval, 0, 200000000);
+	result = isc_timer_reset(moved, isc_timertype_once, NULL, &interval,
+				 ISC_TRUE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	ATF_REQUIRE_EQ(waitfor(1, 2), 1);
+	isc_test_nap(300000);
+
+	LOCK(&lock);
+	ATF_CHECK_EQ(nevents, 1);
+	ATF_CHECK_EQ(order[0], 1);
+	ATF_CHECK_EQ(types[0], ISC_TIMEREVENT_IDLE);
+	UNLOCK(&lock);
+
+	isc_timer_detach(&stopped);
+	isc_timer_detach(&moved);
+	isc_task_detach(&task);
+	teardown();
+}
+
+ATF_TC(boundary);
+ATF_TC_HEAD(boundary, tc) {
+	atf_tc_set_md_var(tc, "descr", "a timer due exactly on a wheel "
+			  "level boundary fires on that tick");
+}
+ATF_TC_BODY(boundary, tc) {
+	isc_result_t result;
+	isc_task_t *task = NULL;
+	isc_timer_t *early = NULL, *late = NULL;
+	isc_time_t now, expires;
+	isc_uint64_t tick;
+	static int ids[2] = { 0, 1 };
+
+	UNUSED(tc);
+
+	setup();
+
+	result = isc_task_create(taskmgr, 0, &task);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/*
+	 * Find a first-level boundary (a multiple of 256 ms) at least
+	 * 100 ms away, so both timers start out on a higher level.
+	 */
+	result = isc_time_now(&now);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	tick = (isc_uint64_t)isc_time_seconds(&now) * 1000 +
+		isc_time_nanoseconds(&now) / 1000000;
+	tick = ((tick + 100) | 255) + 1;
+
+	/*
+	 * Create the timer due one tick after the boundary first.  If
+	 * the one due on the boundary were cascaded a tick late, both
+	 * would share a slot and fire in creation order.
+	 */
+	isc_time_set(&expires, (unsigned int)((tick + 1) / 1000),
+		     (unsigned int)((tick + 1) % 1000) * 1000000);
+	result = isc_timer_create(timermgr, isc_timertype_once, &expires,
+				  NULL, task, record, &ids[1], &late);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	isc_time_set(&expires, (unsigned int)(tick / 1000),
+		     (unsigned int)(tick % 1000) * 1000000);
+	result = isc_timer_create(timermgr, isc_timertype_once, &expires,
+				  NULL, task, record, &ids[0], &early);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	ATF_REQUIRE_EQ(waitfor(2, 10), 2);
+
+	LOCK(&lock);
+	ATF_CHECK_EQ(order[0], 0);
+	ATF_CHECK_EQ(order[1], 1);
+	ATF_CHECK(isc_time_compare(&dues[0], &expires) == 0);
+	UNLOCK(&lock);
+
+	isc_timer_detach(&early);
+	isc_timer_detach(&late);
+	isc_task_detach(&task);
+	teardown();
+}
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, ticker);
+	ATF_TP_ADD_TC(tp, order);
+	ATF_TP_ADD_TC(tp, reset);
+	ATF_TP_ADD_TC(tp, boundary);
+
+	return (atf_no_error());
+}
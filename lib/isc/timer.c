@@ -23,7 +23,6 @@
 
 #include <isc/app.h>
 #include <isc/condition.h>
-#include <isc/heap.h>
 #include <isc/log.h>
 #include <isc/magic.h>
 #include <isc/mem.h>
@@ -74,6 +73,21 @@
 
 typedef struct isc__timer isc__timer_t;
 typedef struct isc__timermgr isc__timermgr_t;
+typedef LIST(isc__timer_t) timerlist_t;
+
+/*%
+ * Scheduled timers live on a hierarchical timing wheel with a
+ * resolution of one millisecond.  Level 'n' has WHEEL_SIZE slots of
+ * WHEEL_SIZE^n ticks each, and holds the timers that are due within
+ * the current level 'n + 1' slot; whatever is further away than the
+ * top level can reach waits on the overflow list.  When the wheel
+ * turns into a new slot of a higher level, the timers in that slot are
+ * redistributed to the levels below.
+ */
+#define WHEEL_BITS			8
+#define WHEEL_SIZE			(1 << WHEEL_BITS)
+#define WHEEL_MASK			(WHEEL_SIZE - 1)
+#define WHEEL_LEVELS			4
 
 struct isc__timer {
 	/*! Not locked. */
@@ -90,8 +104,11 @@ struct isc__timer {
 	isc_task_t *			task;
 	isc_taskaction_t		action;
 	void *				arg;
-	unsigned int			index;
 	isc_time_t			due;
+	isc_uint64_t			tick;
+	unsigned int			level;
+	timerlist_t *			bucket;
+	LINK(isc__timer_t)		wlink;
 	LINK(isc__timer_t)		link;
 };
 
@@ -115,7 +132,10 @@ struct isc__timermgr {
 #ifdef USE_SHARED_MANAGER
 	unsigned int			refs;
 #endif /* USE_SHARED_MANAGER */
-	isc_heap_t *			heap;
+	isc_uint64_t			curtick;
+	timerlist_t			wheel[WHEEL_LEVELS][WHEEL_SIZE];
+	unsigned int			nwheel[WHEEL_LEVELS];
+	timerlist_t			overflow;
 };
 
 /*%
@@ -183,12 +203,224 @@ static struct isc__timermgrmethods {
 static isc__timermgr_t *timermgr = NULL;
 #endif /* USE_SHARED_MANAGER */
 
+/*
+ * Timing wheel.  All of these require the manager lock.
+ */
+
+static inline isc_uint64_t
+time_to_tick(const isc_time_t *t, isc_boolean_t roundup) {
+	isc_uint64_t tick;
+	unsigned int ns = isc_time_nanoseconds(t);
+
+	tick = (isc_uint64_t)isc_time_seconds(t) * 1000 + ns / 1000000;
+	if (roundup && ns % 1000000 != 0)
+		tick++;
+	return (tick);
+}
+
+static inline void
+tick_to_time(isc_uint64_t tick, isc_time_t *t) {
+	isc_time_set(t, (unsigned int)(tick / 1000),
+		     (unsigned int)(tick % 1000) * 1000000);
+}
+
+/*%
+ * The first tick of the level 'level' slot after the current one.
+ */
+static inline isc_uint64_t
+next_boundary(isc__timermgr_t *manager, unsigned int level) {
+	isc_uint64_t span = ((isc_uint64_t)1) << (WHEEL_BITS * level);
+
+	return ((manager->curtick | (span - 1)) + 1);
+}
+
+/*%
+ * Put 'timer' on the wheel.  A timer that is already due fires on the
+ * next tick, except that when 'cascading' a timer due on the tick the
+ * wheel has just turned to goes into that tick's slot, which the
+ * caller collects straight after the cascade.
+ */
+static void
+wheel_insert(isc__timermgr_t *manager, isc__timer_t *timer,
+	     isc_boolean_t cascading)
+{
+	isc_uint64_t tick = timer->tick;
+	unsigned int level, shift;
+	timerlist_t *bucket;
+
+	INSIST(timer->bucket == NULL);
+
+	if (tick < manager->curtick ||
+	    (tick == manager->curtick && !cascading))
+		tick = manager->curtick + 1;
+
+	for (level = 0; level < WHEEL_LEVELS; level++) {
+		shift = WHEEL_BITS * (level + 1);
+		if ((tick >> shift) == (manager->curtick >> shift))
+			break;
+	}
+	if (level < WHEEL_LEVELS) {
+		shift = WHEEL_BITS * level;
+		bucket = &manager->wheel[level][(tick >> shift) & WHEEL_MASK];
+		manager->nwheel[level]++;
+	} else
+		bucket = &manager->overflow;
+
+	APPEND(*bucket, timer, wlink);
+	timer->level = level;
+	timer->bucket = bucket;
+}
+
+static void
+wheel_remove(isc__timermgr_t *manager, isc__timer_t *timer) {
+	INSIST(timer->bucket != NULL);
+
+	UNLINK(*timer->bucket, timer, wlink);
+	if (timer->level < WHEEL_LEVELS) {
+		INSIST(manager->nwheel[timer->level] > 0);
+		manager->nwheel[timer->level]--;
+	}
+	timer->bucket = NULL;
+}
+
+/*%
+ * Move every timer in 'bucket' onto 'list'.
+ */
+static void
+wheel_take(isc__timermgr_t *manager, timerlist_t *bucket, timerlist_t *list) {
+	isc__timer_t *timer;
+
+	while ((timer = HEAD(*bucket)) != NULL) {
+		wheel_remove(manager, timer);
+		APPEND(*list, timer, wlink);
+	}
+}
+
+static void
+wheel_reinsert(isc__timermgr_t *manager, timerlist_t *list,
+	       isc_boolean_t cascading)
+{
+	isc__timer_t *timer;
+
+	while ((timer = HEAD(*list)) != NULL) {
+		UNLINK(*list, timer, wlink);
+		wheel_insert(manager, timer, cascading);
+	}
+}
+
+/*%
+ * The wheel has just turned to 'curtick': redistribute the higher
+ * level slots that start here.
+ */
+static void
+wheel_cascade(isc__timermgr_t *manager) {
+	timerlist_t list;
+	unsigned int level, shift;
+	isc_uint64_t span;
+
+	INIT_LIST(list);
+	for (level = WHEEL_LEVELS; level > 0; level--) {
+		shift = WHEEL_BITS * level;
+		span = ((isc_uint64_t)1) << shift;
+		if ((manager->curtick & (span - 1)) != 0)
+			continue;
+		if (level == WHEEL_LEVELS)
+			wheel_take(manager, &manager->overflow, &list);
+		else
+			wheel_take(manager,
+				   &manager->wheel[level][(manager->curtick >>
+							   shift) & WHEEL_MASK],
+				   &list);
+		wheel_reinsert(manager, &list, ISC_TRUE);
+	}
+}
+
+/*%
+ * Turn the wheel to 'nowtick', moving every timer that becomes due on
+ * the way onto 'expired'.  Stretches in which the lower levels are empty
+ * are skipped in one step.
+ */
+static void
+wheel_advance(isc__timermgr_t *manager, isc_uint64_t nowtick,
+	      timerlist_t *expired)
+{
+	timerlist_t list;
+	unsigned int level;
+	isc_uint64_t next;
+
+	if (nowtick < manager->curtick) {
+		/*
+		 * The clock has gone backwards; rebuild the wheel from
+		 * the new time so nothing waits for the lost interval.
+		 */
+		INIT_LIST(list);
+		for (level = 0; level < WHEEL_LEVELS; level++) {
+			unsigned int i;
+			for (i = 0; i < WHEEL_SIZE; i++)
+				wheel_take(manager, &manager->wheel[level][i],
+					   &list);
+		}
+		wheel_take(manager, &manager->overflow, &list);
+		manager->curtick = nowtick;
+		wheel_reinsert(manager, &list, ISC_FALSE);
+		return;
+	}
+
+	while (manager->curtick < nowtick) {
+		for (level = 0; level < WHEEL_LEVELS; level++)
+			if (manager->nwheel[level] > 0)
+				break;
+		if (level == WHEEL_LEVELS && EMPTY(manager->overflow)) {
+			manager->curtick = nowtick;
+			break;
+		}
+		next = next_boundary(manager, level);
+		if (next > nowtick) {
+			manager->curtick = nowtick;
+			break;
+		}
+		manager->curtick = next;
+		wheel_cascade(manager);
+		wheel_take(manager,
+			   &manager->wheel[0][manager->curtick & WHEEL_MASK],
+			   expired);
+	}
+}
+
+/*%
+ * Set '*due' to when the wheel next needs to turn.  The result may be
+ * earlier than the first timer's due time, when that timer is still
+ * on a higher level and has to be cascaded first.
+ */
+static void
+wheel_nextdue(isc__timermgr_t *manager, isc_time_t *due) {
+	unsigned int level;
+	isc_uint64_t tick;
+
+	INSIST(manager->nscheduled > 0);
+
+	if (manager->nwheel[0] > 0) {
+		for (tick = manager->curtick + 1; ; tick++) {
+			INSIST((tick & ~(isc_uint64_t)WHEEL_MASK) ==
+			       (manager->curtick & ~(isc_uint64_t)WHEEL_MASK));
+			if (!EMPTY(manager->wheel[0][tick & WHEEL_MASK]))
+				break;
+		}
+	} else {
+		for (level = 1; level < WHEEL_LEVELS; level++)
+			if (manager->nwheel[level] > 0)
+				break;
+		tick = next_boundary(manager, level);
+	}
+	tick_to_time(tick, due);
+}
+
 static inline isc_result_t
 schedule(isc__timer_t *timer, isc_time_t *now, isc_boolean_t signal_ok) {
 	isc_result_t result;
 	isc__timermgr_t *manager;
-	isc_time_t due;
-	int cmp;
+	isc_time_t due, when;
+	isc_boolean_t wasidle;
 #ifdef USE_TIMER_THREAD
 	isc_boolean_t timedwait;
 #endif
@@ -239,41 +471,24 @@ schedule(isc__timer_t *timer, isc_time_t *now, isc_boolean_t signal_ok) {
 	 * Schedule the timer.
 	 */
 
-	if (timer->index > 0) {
-		/*
-		 * Already scheduled.
-		 */
-		cmp = isc_time_compare(&due, &timer->due);
-		timer->due = due;
-		switch (cmp) {
-		case -1:
-			isc_heap_increased(manager->heap, timer->index);
-			break;
-		case 1:
-			isc_heap_decreased(manager->heap, timer->index);
-			break;
-		case 0:
-			/* Nothing to do. */
-			break;
-		}
-	} else {
-		timer->due = due;
-		result = isc_heap_insert(manager->heap, timer);
-		if (result != ISC_R_SUCCESS) {
-			INSIST(result == ISC_R_NOMEMORY);
-			return (ISC_R_NOMEMORY);
-		}
+	wasidle = ISC_TF(manager->nscheduled == 0);
+	if (timer->bucket != NULL)
+		wheel_remove(manager, timer);
+	else
 		manager->nscheduled++;
-	}
+	timer->due = due;
+	timer->tick = time_to_tick(&due, ISC_TRUE);
+	wheel_insert(manager, timer, ISC_FALSE);
+	tick_to_time(timer->tick, &when);
 
 	XTRACETIMER(isc_msgcat_get(isc_msgcat, ISC_MSGSET_TIMER,
 				   ISC_MSG_SCHEDULE, "schedule"), timer, due);
 
 	/*
-	 * If this timer is at the head of the queue, we need to ensure
-	 * that we won't miss it if it has a more recent due time than
-	 * the current "next" timer.  We do this either by waking up the
-	 * run thread, or explicitly setting the value in the manager.
+	 * If this timer is due before the manager next looks at the
+	 * wheel, we need to ensure that we won't miss it.  We do this
+	 * either by waking up the run thread, or explicitly setting the
+	 * value in the manager.
 	 */
 #ifdef USE_TIMER_THREAD
 
@@ -302,16 +517,16 @@ schedule(isc__timer_t *timer, isc_time_t *now, isc_boolean_t signal_ok) {
 		}
 	}
 
-	if (timer->index == 1 && signal_ok) {
+	if (signal_ok &&
+	    (wasidle || isc_time_compare(&when, &manager->due) < 0)) {
 		XTRACE(isc_msgcat_get(isc_msgcat, ISC_MSGSET_TIMER,
 				      ISC_MSG_SIGNALSCHED,
 				      "signal (schedule)"));
 		SIGNAL(&manager->wakeup);
 	}
 #else /* USE_TIMER_THREAD */
-	if (timer->index == 1 &&
-	    isc_time_compare(&timer->due, &manager->due) < 0)
-		manager->due = timer->due;
+	if (wasidle || isc_time_compare(&when, &manager->due) < 0)
+		manager->due = when;
 #endif /* USE_TIMER_THREAD */
 
 	return (ISC_R_SUCCESS);
@@ -319,33 +534,20 @@ schedule(isc__timer_t *timer, isc_time_t *now, isc_boolean_t signal_ok) {
 
 static inline void
 deschedule(isc__timer_t *timer) {
-#ifdef USE_TIMER_THREAD
-	isc_boolean_t need_wakeup = ISC_FALSE;
-#endif
 	isc__timermgr_t *manager;
 
 	/*
 	 * The caller must ensure locking.
+	 *
+	 * There is no need to wake the manager: at worst it will find
+	 * nothing to do when it next turns the wheel.
 	 */
 
 	manager = timer->manager;
-	if (timer->index > 0) {
-#ifdef USE_TIMER_THREAD
-		if (timer->index == 1)
-			need_wakeup = ISC_TRUE;
-#endif
-		isc_heap_delete(manager->heap, timer->index);
-		timer->index = 0;
+	if (timer->bucket != NULL) {
+		wheel_remove(manager, timer);
 		INSIST(manager->nscheduled > 0);
 		manager->nscheduled--;
-#ifdef USE_TIMER_THREAD
-		if (need_wakeup) {
-			XTRACE(isc_msgcat_get(isc_msgcat, ISC_MSGSET_TIMER,
-					      ISC_MSG_SIGNALDESCHED,
-					      "signal (deschedule)"));
-			SIGNAL(&manager->wakeup);
-		}
-#endif /* USE_TIMER_THREAD */
 	}
 }
 
@@ -456,7 +658,8 @@ isc__timer_create(isc_timermgr_t *manager0, isc_timertype_t type,
 	 * keep track of whether arg started as a true const.
 	 */
 	DE_CONST(arg, timer->arg);
-	timer->index = 0;
+	timer->bucket = NULL;
+	ISC_LINK_INIT(timer, wlink);
 	result = isc_mutex_init(&timer->lock);
 	if (result != ISC_R_SUCCESS) {
 		isc_task_detach(&timer->task);
@@ -665,121 +868,127 @@ isc__timer_detach(isc_timer_t **timerp) {
 
 static void
 dispatch(isc__timermgr_t *manager, isc_time_t *now) {
-	isc_boolean_t done = ISC_FALSE, post_event, need_schedule;
+	isc_boolean_t post_event, need_schedule;
 	isc_timerevent_t *event;
 	isc_eventtype_t type = 0;
 	isc__timer_t *timer;
 	isc_result_t result;
 	isc_boolean_t idle;
+	timerlist_t expired;
 
 	/*!
 	 * The caller must be holding the manager lock.
 	 */
 
-	while (manager->nscheduled > 0 && !done) {
-		timer = isc_heap_element(manager->heap, 1);
-		INSIST(timer != NULL && timer->type != isc_timertype_inactive);
-		if (isc_time_compare(now, &timer->due) >= 0) {
-			if (timer->type == isc_timertype_ticker) {
-				type = ISC_TIMEREVENT_TICK;
-				post_event = ISC_TRUE;
-				need_schedule = ISC_TRUE;
-			} else if (timer->type == isc_timertype_limited) {
-				int cmp;
-				cmp = isc_time_compare(now, &timer->expires);
-				if (cmp >= 0) {
-					type = ISC_TIMEREVENT_LIFE;
-					post_event = ISC_TRUE;
-					need_schedule = ISC_FALSE;
-				} else {
-					type = ISC_TIMEREVENT_TICK;
-					post_event = ISC_TRUE;
-					need_schedule = ISC_TRUE;
-				}
-			} else if (!isc_time_isepoch(&timer->expires) &&
-				   isc_time_compare(now,
-						    &timer->expires) >= 0) {
+	/*
+	 * Collect everything that is due and then deal with it as one
+	 * batch; timers rescheduled below go back on the wheel after
+	 * 'now', so they cannot fire twice.
+	 */
+	INIT_LIST(expired);
+	wheel_advance(manager, time_to_tick(now, ISC_FALSE), &expired);
+
+	while ((timer = HEAD(expired)) != NULL) {
+		UNLINK(expired, timer, wlink);
+		INSIST(manager->nscheduled > 0);
+		manager->nscheduled--;
+		INSIST(timer->type != isc_timertype_inactive);
+
+		if (timer->type == isc_timertype_ticker) {
+			type = ISC_TIMEREVENT_TICK;
+			post_event = ISC_TRUE;
+			need_schedule = ISC_TRUE;
+		} else if (timer->type == isc_timertype_limited) {
+			int cmp;
+			cmp = isc_time_compare(now, &timer->expires);
+			if (cmp >= 0) {
 				type = ISC_TIMEREVENT_LIFE;
 				post_event = ISC_TRUE;
 				need_schedule = ISC_FALSE;
 			} else {
-				idle = ISC_FALSE;
-
-				LOCK(&timer->lock);
-				if (!isc_time_isepoch(&timer->idle) &&
-				    isc_time_compare(now,
-						     &timer->idle) >= 0) {
-					idle = ISC_TRUE;
-				}
-				UNLOCK(&timer->lock);
-				if (idle) {
-					type = ISC_TIMEREVENT_IDLE;
-					post_event = ISC_TRUE;
-					need_schedule = ISC_FALSE;
-				} else {
-					/*
-					 * Idle timer has been touched;
-					 * reschedule.
-					 */
-					XTRACEID(isc_msgcat_get(isc_msgcat,
-								ISC_MSGSET_TIMER,
-								ISC_MSG_IDLERESCHED,
-								"idle reschedule"),
-						 timer);
-					post_event = ISC_FALSE;
-					need_schedule = ISC_TRUE;
-				}
+				type = ISC_TIMEREVENT_TICK;
+				post_event = ISC_TRUE;
+				need_schedule = ISC_TRUE;
 			}
+		} else if (!isc_time_isepoch(&timer->expires) &&
+			   isc_time_compare(now,
+					    &timer->expires) >= 0) {
+			type = ISC_TIMEREVENT_LIFE;
+			post_event = ISC_TRUE;
+			need_schedule = ISC_FALSE;
+		} else {
+			idle = ISC_FALSE;
 
-			if (post_event) {
-				XTRACEID(isc_msgcat_get(isc_msgcat,
-							ISC_MSGSET_TIMER,
-							ISC_MSG_POSTING,
-							"posting"), timer);
+			LOCK(&timer->lock);
+			if (!isc_time_isepoch(&timer->idle) &&
+			    isc_time_compare(now,
+					     &timer->idle) >= 0) {
+				idle = ISC_TRUE;
+			}
+			UNLOCK(&timer->lock);
+			if (idle) {
+				type = ISC_TIMEREVENT_IDLE;
+				post_event = ISC_TRUE;
+				need_schedule = ISC_FALSE;
+			} else {
 				/*
-				 * XXX We could preallocate this event.
+				 * Idle timer has been touched;
+				 * reschedule.
 				 */
-				event = (isc_timerevent_t *)isc_event_allocate(manager->mctx,
-							   timer,
-							   type,
-							   timer->action,
-							   timer->arg,
-							   sizeof(*event));
-
-				if (event != NULL) {
-					event->due = timer->due;
-					isc_task_send(timer->task,
-						      ISC_EVENT_PTR(&event));
-				} else
-					UNEXPECTED_ERROR(__FILE__, __LINE__, "%s",
-						 isc_msgcat_get(isc_msgcat,
-							 ISC_MSGSET_TIMER,
-							 ISC_MSG_EVENTNOTALLOC,
-							 "couldn't "
-							 "allocate event"));
+				XTRACEID(isc_msgcat_get(isc_msgcat,
+							ISC_MSGSET_TIMER,
+							ISC_MSG_IDLERESCHED,
+							"idle reschedule"),
+					 timer);
+				post_event = ISC_FALSE;
+				need_schedule = ISC_TRUE;
 			}
+		}
 
-			timer->index = 0;
-			isc_heap_delete(manager->heap, 1);
-			manager->nscheduled--;
+		if (post_event) {
+			XTRACEID(isc_msgcat_get(isc_msgcat,
+						ISC_MSGSET_TIMER,
+						ISC_MSG_POSTING,
+						"posting"), timer);
+			/*
+			 * XXX We could preallocate this event.
+			 */
+			event = (isc_timerevent_t *)isc_event_allocate(manager->mctx,
+						   timer,
+						   type,
+						   timer->action,
+						   timer->arg,
+						   sizeof(*event));
+
+			if (event != NULL) {
+				event->due = timer->due;
+				isc_task_send(timer->task,
+					      ISC_EVENT_PTR(&event));
+			} else
+				UNEXPECTED_ERROR(__FILE__, __LINE__, "%s",
+					 isc_msgcat_get(isc_msgcat,
+						 ISC_MSGSET_TIMER,
+						 ISC_MSG_EVENTNOTALLOC,
+						 "couldn't "
+						 "allocate event"));
+		}
 
-			if (need_schedule) {
-				result = schedule(timer, now, ISC_FALSE);
-				if (result != ISC_R_SUCCESS)
-					UNEXPECTED_ERROR(__FILE__, __LINE__,
-							 "%s: %u",
-						isc_msgcat_get(isc_msgcat,
-							ISC_MSGSET_TIMER,
-							ISC_MSG_SCHEDFAIL,
-							"couldn't schedule "
-							"timer"),
-							 result);
-			}
-		} else {
-			manager->due = timer->due;
-			done = ISC_TRUE;
+		if (need_schedule) {
+			result = schedule(timer, now, ISC_FALSE);
+			if (result != ISC_R_SUCCESS)
+				UNEXPECTED_ERROR(__FILE__, __LINE__,
+						 "%s: %u",
+					isc_msgcat_get(isc_msgcat,
+						ISC_MSGSET_TIMER,
+						ISC_MSG_SCHEDFAIL,
+						"couldn't schedule "
+						"timer"),
+						 result);
 		}
 	}
+
+	if (manager->nscheduled > 0)
+		wheel_nextdue(manager, &manager->due);
 }
 
 #ifdef USE_TIMER_THREAD
@@ -829,34 +1038,12 @@ run(void *uap) {
 }
 #endif /* USE_TIMER_THREAD */
 
-static isc_boolean_t
-sooner(void *v1, void *v2) {
-	isc__timer_t *t1, *t2;
-
-	t1 = v1;
-	t2 = v2;
-	REQUIRE(VALID_TIMER(t1));
-	REQUIRE(VALID_TIMER(t2));
-
-	if (isc_time_compare(&t1->due, &t2->due) < 0)
-		return (ISC_TRUE);
-	return (ISC_FALSE);
-}
-
-static void
-set_index(void *what, unsigned int index) {
-	isc__timer_t *timer;
-
-	timer = what;
-	REQUIRE(VALID_TIMER(timer));
-
-	timer->index = index;
-}
-
 isc_result_t
 isc__timermgr_create(isc_mem_t *mctx, isc_timermgr_t **managerp) {
 	isc__timermgr_t *manager;
 	isc_result_t result;
+	isc_time_t now;
+	unsigned int i, j;
 
 	/*
 	 * Create a timer manager.
@@ -884,16 +1071,16 @@ isc__timermgr_create(isc_mem_t *mctx, isc_timermgr_t **managerp) {
 	INIT_LIST(manager->timers);
 	manager->nscheduled = 0;
 	isc_time_settoepoch(&manager->due);
-	manager->heap = NULL;
-	result = isc_heap_create(mctx, sooner, set_index, 0, &manager->heap);
-	if (result != ISC_R_SUCCESS) {
-		INSIST(result == ISC_R_NOMEMORY);
-		isc_mem_put(mctx, manager, sizeof(*manager));
-		return (ISC_R_NOMEMORY);
+	TIME_NOW(&now);
+	manager->curtick = time_to_tick(&now, ISC_FALSE);
+	for (i = 0; i < WHEEL_LEVELS; i++) {
+		for (j = 0; j < WHEEL_SIZE; j++)
+			INIT_LIST(manager->wheel[i][j]);
+		manager->nwheel[i] = 0;
 	}
+	INIT_LIST(manager->overflow);
 	result = isc_mutex_init(&manager->lock);
 	if (result != ISC_R_SUCCESS) {
-		isc_heap_destroy(&manager->heap);
 		isc_mem_put(mctx, manager, sizeof(*manager));
 		return (result);
 	}
@@ -902,7 +1089,6 @@ isc__timermgr_create(isc_mem_t *mctx, isc_timermgr_t **managerp) {
 	if (isc_condition_init(&manager->wakeup) != ISC_R_SUCCESS) {
 		isc_mem_detach(&manager->mctx);
 		DESTROYLOCK(&manager->lock);
-		isc_heap_destroy(&manager->heap);
 		isc_mem_put(mctx, manager, sizeof(*manager));
 		UNEXPECTED_ERROR(__FILE__, __LINE__,
 				 "isc_condition_init() %s",
@@ -915,7 +1101,6 @@ isc__timermgr_create(isc_mem_t *mctx, isc_timermgr_t **managerp) {
 		isc_mem_detach(&manager->mctx);
 		(void)isc_condition_destroy(&manager->wakeup);
 		DESTROYLOCK(&manager->lock);
-		isc_heap_destroy(&manager->heap);
 		isc_mem_put(mctx, manager, sizeof(*manager));
 		UNEXPECTED_ERROR(__FILE__, __LINE__,
 				 "isc_thread_create() %s",
@@ -1005,7 +1190,6 @@ isc__timermgr_destroy(isc_timermgr_t **managerp) {
 	(void)isc_condition_destroy(&manager->wakeup);
 #endif /* USE_TIMER_THREAD */
 	DESTROYLOCK(&manager->lock);
-	isc_heap_destroy(&manager->heap);
 	manager->common.impmagic = 0;
 	manager->common.magic = 0;
 	mctx = manager->mctx;
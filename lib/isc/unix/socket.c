@@ -323,6 +323,22 @@ typedef isc_event_t intev_t;
  */
 #define NRETRIES 10
 
+/*%
+ * Linux can fill several pending UDP receive requests with a single
+ * recvmmsg() call.  RECVMMSG_BATCH is the largest number of requests
+ * filled by one call, and RECVMMSG_CMSGSPACE is the control message
+ * space available to each of them.
+ */
+#if defined(__linux__) && defined(_GNU_SOURCE) && defined(MSG_WAITFORONE)
+#define USE_RECVMMSG	1
+#ifdef TUNE_LARGE
+#define RECVMMSG_BATCH		64
+#else
+#define RECVMMSG_BATCH		16
+#endif /* TUNE_LARGE */
+#define RECVMMSG_CMSGSPACE	256
+#endif
+
 typedef struct isc__socket isc__socket_t;
 typedef struct isc__socketmgr isc__socketmgr_t;
 
@@ -417,6 +433,9 @@ struct isc__socketmgr {
 	int			fd_bufsize;
 #endif	/* USE_SELECT */
 	unsigned int		maxsocks;
+#ifdef USE_RECVMMSG
+	isc_boolean_t		norecvmmsg;
+#endif
 #ifdef ISC_PLATFORM_USETHREADS
 	int			pipe_fds[2];
 #endif
@@ -1829,42 +1848,24 @@ dump_msg(struct msghdr *msg) {
 #define DOIO_HARD		2	/* i/o error, event sent */
 #define DOIO_EOF		3	/* EOF, no event sent */
 
+/*
+ * Turn a failed recvmsg() or recvmmsg() into DOIO_SOFT or DOIO_HARD.
+ */
 static int
-doio_recv(isc__socket_t *sock, isc_socketevent_t *dev) {
-	int cc;
-	struct iovec iov[MAXSCATTERGATHER_RECV];
-	size_t read_count;
-	size_t actual_count;
-	struct msghdr msghdr;
-	isc_buffer_t *buffer;
-	int recv_errno;
+doio_recv_error(isc__socket_t *sock, isc_socketevent_t *dev, int recv_errno) {
 	char strbuf[ISC_STRERRORSIZE];
 
-	build_msghdr_recv(sock, dev, &msghdr, iov, &read_count);
-
-#if defined(ISC_SOCKET_DEBUG)
-	dump_msg(&msghdr);
-#endif
-
-	cc = recvmsg(sock->fd, &msghdr, 0);
-	recv_errno = errno;
-
-#if defined(ISC_SOCKET_DEBUG)
-	dump_msg(&msghdr);
-#endif
-
-	if (cc < 0) {
-		if (SOFT_ERROR(recv_errno))
-			return (DOIO_SOFT);
+	if (SOFT_ERROR(recv_errno))
+		return (DOIO_SOFT);
 
-		if (isc_log_wouldlog(isc_lctx, IOEVENT_LEVEL)) {
-			isc__strerror(recv_errno, strbuf, sizeof(strbuf));
-			socket_log(sock, NULL, IOEVENT,
-				   isc_msgcat, ISC_MSGSET_SOCKET,
-				   ISC_MSG_DOIORECV,
-				  "doio_recv: recvmsg(%d) %d bytes, err %d/%s",
-				   sock->fd, cc, recv_errno, strbuf);
-		}
+	if (isc_log_wouldlog(isc_lctx, IOEVENT_LEVEL)) {
+		isc__strerror(recv_errno, strbuf, sizeof(strbuf));
+		socket_log(sock, NULL, IOEVENT,
+			   isc_msgcat, ISC_MSGSET_SOCKET,
+			   ISC_MSG_DOIORECV,
+			  "doio_recv: recvmsg(%d) err %d/%s",
+			   sock->fd, recv_errno, strbuf);
+	}
 
 #define SOFT_OR_HARD(_system, _isc) \
 	if (recv_errno == _system) { \
@@ -1884,34 +1885,44 @@ doio_recv(isc__socket_t *sock, isc_socketevent_t *dev) {
 		return (DOIO_HARD); \
 	}
 
-		SOFT_OR_HARD(ECONNREFUSED, ISC_R_CONNREFUSED);
-		SOFT_OR_HARD(ENETUNREACH, ISC_R_NETUNREACH);
-		SOFT_OR_HARD(EHOSTUNREACH, ISC_R_HOSTUNREACH);
-		SOFT_OR_HARD(EHOSTDOWN, ISC_R_HOSTDOWN);
-		/* HPUX 11.11 can return EADDRNOTAVAIL. */
-		SOFT_OR_HARD(EADDRNOTAVAIL, ISC_R_ADDRNOTAVAIL);
-		ALWAYS_HARD(ENOBUFS, ISC_R_NORESOURCES);
-		/* Should never get this one but it was seen. */
+	SOFT_OR_HARD(ECONNREFUSED, ISC_R_CONNREFUSED);
+	SOFT_OR_HARD(ENETUNREACH, ISC_R_NETUNREACH);
+	SOFT_OR_HARD(EHOSTUNREACH, ISC_R_HOSTUNREACH);
+	SOFT_OR_HARD(EHOSTDOWN, ISC_R_HOSTDOWN);
+	/* HPUX 11.11 can return EADDRNOTAVAIL. */
+	SOFT_OR_HARD(EADDRNOTAVAIL, ISC_R_ADDRNOTAVAIL);
+	ALWAYS_HARD(ENOBUFS, ISC_R_NORESOURCES);
+	/* Should never get this one but it was seen. */
 #ifdef ENOPROTOOPT
-		SOFT_OR_HARD(ENOPROTOOPT, ISC_R_HOSTUNREACH);
+	SOFT_OR_HARD(ENOPROTOOPT, ISC_R_HOSTUNREACH);
 #endif
-		/*
-		 * HPUX returns EPROTO and EINVAL on receiving some ICMP/ICMPv6
-		 * errors.
-		 */
+	/*
+	 * HPUX returns EPROTO and EINVAL on receiving some ICMP/ICMPv6
+	 * errors.
+	 */
 #ifdef EPROTO
-		SOFT_OR_HARD(EPROTO, ISC_R_HOSTUNREACH);
+	SOFT_OR_HARD(EPROTO, ISC_R_HOSTUNREACH);
 #endif
-		SOFT_OR_HARD(EINVAL, ISC_R_HOSTUNREACH);
+	SOFT_OR_HARD(EINVAL, ISC_R_HOSTUNREACH);
 
 #undef SOFT_OR_HARD
 #undef ALWAYS_HARD
 
-		dev->result = isc__errno2result(recv_errno);
-		inc_stats(sock->manager->stats,
-			  sock->statsindex[STATID_RECVFAIL]);
-		return (DOIO_HARD);
-	}
+	dev->result = isc__errno2result(recv_errno);
+	inc_stats(sock->manager->stats,
+		  sock->statsindex[STATID_RECVFAIL]);
+	return (DOIO_HARD);
+}
+
+/*
+ * Finish a receive request after 'cc' bytes were read into it.
+ */
+static int
+doio_recv_done(isc__socket_t *sock, isc_socketevent_t *dev,
+	       struct msghdr *msghdr, int cc, size_t read_count)
+{
+	size_t actual_count;
+	isc_buffer_t *buffer;
 
 	/*
 	 * On TCP and UNIX sockets, zero length reads indicate EOF,
@@ -1933,7 +1944,7 @@ doio_recv(isc__socket_t *sock, isc_socketevent_t *dev) {
 	}
 
 	if (sock->type == isc_sockettype_udp) {
-		dev->address.length = msghdr.msg_namelen;
+		dev->address.length = msghdr->msg_namelen;
 		if (isc_sockaddr_getport(&dev->address) == 0) {
 			if (isc_log_wouldlog(isc_lctx, IOEVENT_LEVEL)) {
 				socket_log(sock, &dev->address, IOEVENT,
@@ -1971,7 +1982,7 @@ doio_recv(isc__socket_t *sock, isc_socketevent_t *dev) {
 	 * If there are control messages attached, run through them and pull
 	 * out the interesting bits.
 	 */
-	process_cmsg(sock, &msghdr, dev);
+	process_cmsg(sock, msghdr, dev);
 
 	/*
 	 * update the buffers (if any) and the i/o count
@@ -2011,6 +2022,107 @@ doio_recv(isc__socket_t *sock, isc_socketevent_t *dev) {
 	return (DOIO_SUCCESS);
 }
 
+static int
+doio_recv(isc__socket_t *sock, isc_socketevent_t *dev) {
+	int cc;
+	struct iovec iov[MAXSCATTERGATHER_RECV];
+	size_t read_count;
+	struct msghdr msghdr;
+	int recv_errno;
+
+	build_msghdr_recv(sock, dev, &msghdr, iov, &read_count);
+
+#if defined(ISC_SOCKET_DEBUG)
+	dump_msg(&msghdr);
+#endif
+
+	cc = recvmsg(sock->fd, &msghdr, 0);
+	recv_errno = errno;
+
+#if defined(ISC_SOCKET_DEBUG)
+	dump_msg(&msghdr);
+#endif
+
+	if (cc < 0)
+		return (doio_recv_error(sock, dev, recv_errno));
+	return (doio_recv_done(sock, dev, &msghdr, cc, read_count));
+}
+
+#ifdef USE_RECVMMSG
+/*
+ * Fill as many as RECVMMSG_BATCH of the pending receive requests of a
+ * UDP socket with one recvmmsg() call, and post the completed requests.
+ *
+ * Returns:
+ *	DOIO_SUCCESS	More datagrams may be waiting.
+ *
+ *	DOIO_SOFT	The socket has been drained or a soft error
+ *			was encountered.
+ */
+static int
+doio_recvmmsg(isc__socket_t *sock) {
+	isc_socketevent_t *devs[RECVMMSG_BATCH];
+	struct mmsghdr msgs[RECVMMSG_BATCH];
+	struct iovec iov[RECVMMSG_BATCH][MAXSCATTERGATHER_RECV];
+	size_t read_count[RECVMMSG_BATCH];
+#if defined(USE_CMSG)
+	union {
+		struct cmsghdr hdr;
+		char buf[RECVMMSG_CMSGSPACE];
+	} cmsgbuf[RECVMMSG_BATCH];
+#endif
+	isc_socketevent_t *dev;
+	int cc, i, n, recv_errno;
+
+	n = 0;
+	for (dev = ISC_LIST_HEAD(sock->recv_list);
+	     dev != NULL && n < RECVMMSG_BATCH;
+	     dev = ISC_LIST_NEXT(dev, ev_link))
+	{
+		devs[n] = dev;
+		build_msghdr_recv(sock, dev, &msgs[n].msg_hdr, iov[n],
+				  &read_count[n]);
+#if defined(USE_CMSG)
+		/*
+		 * Each datagram needs its own control messages.
+		 */
+		if (msgs[n].msg_hdr.msg_control != NULL)
+			msgs[n].msg_hdr.msg_control = cmsgbuf[n].buf;
+#endif
+		msgs[n].msg_len = 0;
+		n++;
+	}
+
+	cc = recvmmsg(sock->fd, msgs, n, 0, NULL);
+	recv_errno = errno;
+
+	if (cc < 0) {
+		if (recv_errno == ENOSYS) {
+			/*
+			 * Use recvmsg() from now on.
+			 */
+			sock->manager->norecvmmsg = ISC_TRUE;
+			return (DOIO_SUCCESS);
+		}
+		dev = devs[0];
+		if (doio_recv_error(sock, dev, recv_errno) == DOIO_SOFT)
+			return (DOIO_SOFT);
+		send_recvdone_event(sock, &dev);
+		return (DOIO_SUCCESS);
+	}
+
+	for (i = 0; i < cc; i++) {
+		dev = devs[i];
+		if (doio_recv_done(sock, dev, &msgs[i].msg_hdr,
+				   (int)msgs[i].msg_len,
+				   read_count[i]) != DOIO_SOFT)
+			send_recvdone_event(sock, &dev);
+	}
+
+	return (cc < n ? DOIO_SOFT : DOIO_SUCCESS);
+}
+#endif /* USE_RECVMMSG */
+
 /*
  * Returns:
  *	DOIO_SUCCESS	The operation succeeded.  dev->result contains
@@ -3739,6 +3851,21 @@ internal_recv(isc_task_t *me, isc_event_t *ev) {
 	 */
 	dev = ISC_LIST_HEAD(sock->recv_list);
 	while (dev != NULL) {
+#ifdef USE_RECVMMSG
+		/*
+		 * Fill several requests at once if there are several.
+		 */
+		if (sock->type == isc_sockettype_udp &&
+		    ISC_LIST_NEXT(dev, ev_link) != NULL &&
+		    sock->recvcmsgbuflen <= RECVMMSG_CMSGSPACE &&
+		    !sock->manager->norecvmmsg)
+		{
+			if (doio_recvmmsg(sock) == DOIO_SOFT)
+				goto poke;
+			dev = ISC_LIST_HEAD(sock->recv_list);
+			continue;
+		}
+#endif
 		switch (doio_recv(sock, dev)) {
 		case DOIO_SOFT:
 			goto poke;
@@ -4601,6 +4728,9 @@ isc__socketmgr_create2(isc_mem_t *mctx, isc_socketmgr_t **managerp,
 	manager->maxsocks = maxsocks;
 	manager->reserved = 0;
 	manager->maxudp = 0;
+#ifdef USE_RECVMMSG
+	manager->norecvmmsg = ISC_FALSE;
+#endif
 	manager->fds = isc_mem_get(mctx,
 				   manager->maxsocks * sizeof(isc__socket_t *));
 	if (manager->fds == NULL) {
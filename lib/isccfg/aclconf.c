@@ -618,6 +618,7 @@ cfg_acl_fromconfig2(const cfg_obj_t *caml, const cfg_obj_t *cctx,
 	const cfg_listelt_t *elt;
 	dns_iptable_t *iptab;
 	int new_nest_level = 0;
+	isc_boolean_t absorbed = ISC_FALSE;
 
 	if (nest_level != 0)
 		new_nest_level = nest_level - 1;
@@ -634,6 +635,7 @@ cfg_acl_fromconfig2(const cfg_obj_t *caml, const cfg_obj_t *cctx,
 		 */
 		dns_acl_attach(*target, &dacl);
 		dns_acl_detach(target);
+		absorbed = ISC_TRUE;
 	} else {
 		/*
 		 * Need to allocate a new ACL structure.  Count the items
@@ -870,6 +872,16 @@ nested_acl:
 		INSIST(dacl->length <= dacl->alloc);
 	}
 
+	/*
+	 * Compile the finished ACL for matching; a parent that absorbs
+	 * this one will be compiled when it is finished.
+	 */
+	if (!absorbed) {
+		result = dns_acl_compile(dacl);
+		if (result != ISC_R_SUCCESS)
+			goto cleanup;
+	}
+
 	dns_acl_attach(dacl, target);
 	result = ISC_R_SUCCESS;
 